@@ -45,12 +45,9 @@ int main(int argc, char **argv)
     if (rank == 0) {
         strmap_setf(map, "val=%s", "hello world");
     }
-    lwgrp_allgather_strmap(map, comm.node);
-    int64_t rank_node = lwgrp_rank(comm.node);
-    if (rank_node == 0) {
-        lwgrp_allgather_strmap(map, comm.leaders);
-    }
-    lwgrp_allgather_strmap(map, comm.node);
+    lwgrp_hier* hier = lwgrp_hier_create(comm.world, NULL);
+    lwgrp_hier_allgather_strmap(map, hier);
+    lwgrp_hier_free(&hier);
     if (rank == size-1) {
         const char* data = strmap_get(map, "val");
         printf("received: %s\n", data);
@@ -76,14 +76,33 @@ void comm_create(int rank, int size, spawn_net_endpoint* ep, lwgrp_comm* comm)
     /* get name of our endpoint */
     const char* ep_name = spawn_net_name(ep);
 
-    /* exchange endpoint address on ring */
-    int ring_rank, ring_size;
-    char val[128], left[128], right[128];
-    snprintf(val, sizeof(val), "%s", ep_name);
-    ring(rank, size, val, &ring_rank, &ring_size, left, right, 128);
-
-    /* create global comm, using left and right endpoints */
-    comm->world = lwgrp_create(ring_size, ring_rank, ep_name, left, right, ep);
+    const char* boot = getenv("SPAWN_BOOT_ROOT");
+    if (boot != NULL) {
+        /* launcher runs a boot service, get ring from it instead of PMI */
+        int64_t ring_size;
+        char* left;
+        char* right;
+        if (spawn_boot_ring(boot, rank, ep, &ring_size, &left, &right, NULL) != 0) {
+            /* other procs wait on us in the tree, so we can't go on */
+            SPAWN_ERR("Failed to get ring from boot service at %s", boot);
+            exit(1);
+        }
+
+        /* create global comm, using left and right endpoints */
+        comm->world = lwgrp_create(ring_size, rank, ep_name, left, right, ep);
+
+        spawn_free(&left);
+        spawn_free(&right);
+    } else {
+        /* exchange endpoint address on ring */
+        int ring_rank, ring_size;
+        char val[128], left[128], right[128];
+        snprintf(val, sizeof(val), "%s", ep_name);
+        ring(rank, size, val, &ring_rank, &ring_size, left, right, 128);
+
+        /* create global comm, using left and right endpoints */
+        comm->world = lwgrp_create(ring_size, ring_rank, ep_name, left, right, ep);
+    }
 
     /* get comm of procs on same node */
     char hostname[128];
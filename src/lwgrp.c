@@ -12,18 +12,229 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
 
 #include <sys/types.h>
 #include <unistd.h>
 
 #include "lwgrp.h"
+#include "lwgrp_shm.h"
+#include "lwgrp_tune.h"
+#include "lwgrp_xchg.h"
 #include "spawn_internal.h"
 
-/* waits for channel in specified round to connect */
+/* number of groups and of channels they hold not yet freed */
+static uint64_t lwgrp_live_groups   = 0;
+static uint64_t lwgrp_live_channels = 0;
+
+/* prepare exchange with partners dist hops away on the left and right
+ * in the given round, xs[0] is the left partner and xs[1] the right */
+static void lwgrp_xchg_pair(lwgrp_xchg* xs, const lwgrp* group, int round, int64_t dist)
+{
+  int64_t rank  = group->rank;
+  int64_t ranks = group->size;
+  lwgrp_xchg_init(&xs[0], (rank - dist >= 0)    ? group->list_left[round]  : NULL);
+  lwgrp_xchg_init(&xs[1], (rank + dist < ranks) ? group->list_right[round] : NULL);
+}
+
+/* Scan engine: executes an inclusive scan in one or both directions
+ * along the chain with recursive doubling.  In the round with
+ * distance 2^d, each proc sends its left-to-right value to its right
+ * partner and its right-to-left value to its left partner, then
+ * combines what it receives into its own values.  The combine
+ * function is called as fn(inout, in, arg), where in comes before
+ * inout in the direction of the scan, so the engine supports
+ * associative operations that are not commutative, like segmented
+ * scans.  Either ltr or rtl may be NULL to scan in one direction. */
+typedef void (*lwgrp_scan_fn)(void* inout, const void* in, void* arg);
+
+static int lwgrp_scan_rounds(
+  void* ltr,
+  void* rtl,
+  size_t size,
+  lwgrp_scan_fn fn,
+  void* arg,
+  const lwgrp* group)
+{
+  int64_t rank  = group->rank;
+  int64_t ranks = group->size;
+
+  void* ltr_recv = SPAWN_MALLOC(size);
+  void* rtl_recv = SPAWN_MALLOC(size);
+
+  int round = 0;
+  int64_t dist = 1;
+  while (dist < ranks) {
+    /* exchange values with left and right partners */
+    lwgrp_xchg xs[2];
+    lwgrp_xchg_pair(xs, group, round, dist);
+    if (rtl != NULL) {
+      lwgrp_xchg_send(&xs[0], rtl, size);
+      lwgrp_xchg_recv(&xs[1], rtl_recv, size);
+    }
+    if (ltr != NULL) {
+      lwgrp_xchg_recv(&xs[0], ltr_recv, size);
+      lwgrp_xchg_send(&xs[1], ltr, size);
+    }
+    lwgrp_exchange(xs, 2);
+
+    /* combine values from procs that come before us in each direction */
+    if (ltr != NULL && rank - dist >= 0) {
+      (*fn)(ltr, ltr_recv, arg);
+    }
+    if (rtl != NULL && rank + dist < ranks) {
+      (*fn)(rtl, rtl_recv, arg);
+    }
+
+    dist <<= 1;
+    round++;
+  }
+
+  spawn_free(&rtl_recv);
+  spawn_free(&ltr_recv);
+
+  return LWGRP_SUCCESS;
+}
+
+/* returns size in bytes of one element of given type */
+static size_t lwgrp_type_size(lwgrp_type type)
+{
+  switch (type) {
+  case LWGRP_TYPE_UINT64:
+    return sizeof(uint64_t);
+  case LWGRP_TYPE_INT64:
+    return sizeof(int64_t);
+  case LWGRP_TYPE_DOUBLE:
+    return sizeof(double);
+  }
+  return 0;
+}
+
+/* applies op to each element, setting inout[i] = in[i] op inout[i] */
+#define LWGRP_OP_LOOP(T, inout, in, count, op) do { \
+  T* a = (T*) (inout);                              \
+  const T* b = (const T*) (in);                     \
+  uint64_t i;                                       \
+  for (i = 0; i < (count); i++) {                   \
+    if ((op) == LWGRP_OP_SUM) {                     \
+      a[i] = b[i] + a[i];                           \
+    } else if ((op) == LWGRP_OP_MIN) {              \
+      if (b[i] < a[i]) {                            \
+        a[i] = b[i];                                \
+      }                                             \
+    } else if ((op) == LWGRP_OP_MAX) {              \
+      if (b[i] > a[i]) {                            \
+        a[i] = b[i];                                \
+      }                                             \
+    }                                               \
+  }                                                 \
+} while (0)
+
+static void lwgrp_op_apply(void* inout, const void* in, uint64_t count, lwgrp_type type, lwgrp_op op)
+{
+  switch (type) {
+  case LWGRP_TYPE_UINT64:
+    LWGRP_OP_LOOP(uint64_t, inout, in, count, op);
+    break;
+  case LWGRP_TYPE_INT64:
+    LWGRP_OP_LOOP(int64_t, inout, in, count, op);
+    break;
+  case LWGRP_TYPE_DOUBLE:
+    LWGRP_OP_LOOP(double, inout, in, count, op);
+    break;
+  }
+}
+
+/* fills buf with the identity element of op */
+static void lwgrp_op_identity(void* buf, uint64_t count, lwgrp_type type, lwgrp_op op)
+{
+  uint64_t i;
+  for (i = 0; i < count; i++) {
+    if (type == LWGRP_TYPE_UINT64) {
+      uint64_t* ptr = (uint64_t*) buf;
+      ptr[i] = (op == LWGRP_OP_MIN) ? UINT64_MAX : 0;
+    } else if (type == LWGRP_TYPE_INT64) {
+      int64_t* ptr = (int64_t*) buf;
+      ptr[i] = (op == LWGRP_OP_MIN) ? INT64_MAX :
+               (op == LWGRP_OP_MAX) ? INT64_MIN : 0;
+    } else if (type == LWGRP_TYPE_DOUBLE) {
+      double* ptr = (double*) buf;
+      ptr[i] = (op == LWGRP_OP_MIN) ? HUGE_VAL :
+               (op == LWGRP_OP_MAX) ? -HUGE_VAL : 0.0;
+    }
+  }
+}
+
+/* describes the elements and operation of a typed scan */
+typedef struct lwgrp_scan_args_t {
+  uint64_t count;   /* number of elements */
+  lwgrp_type type;  /* type of each element */
+  lwgrp_op op;      /* operation to apply */
+  size_t bytes;     /* size of count elements in bytes */
+} lwgrp_scan_args;
+
+/* values are count elements */
+static void lwgrp_scan_fn_op(void* inout, const void* in, void* arg)
+{
+  lwgrp_scan_args* args = (lwgrp_scan_args*) arg;
+  lwgrp_op_apply(inout, in, args->count, args->type, args->op);
+}
+
+/* values are an exclusive result followed by an inclusive result,
+ * the exclusive result of inout extends with the inclusive result
+ * of in, since in covers procs just before those of inout */
+static void lwgrp_scan_fn_exscan(void* inout, const void* in, void* arg)
+{
+  lwgrp_scan_args* args = (lwgrp_scan_args*) arg;
+  char* a = (char*) inout;
+  const char* b = (const char*) in;
+  lwgrp_op_apply(a, b + args->bytes, args->count, args->type, args->op);
+  lwgrp_op_apply(a + args->bytes, b + args->bytes, args->count, args->type, args->op);
+}
+
+/* values are a uint64_t flag followed by count elements, a set flag
+ * marks the start of a segment, so we stop accumulating values from
+ * procs before us once our flag is set */
+static void lwgrp_scan_fn_segmented(void* inout, const void* in, void* arg)
+{
+  lwgrp_scan_args* args = (lwgrp_scan_args*) arg;
+  uint64_t* a_flag = (uint64_t*) inout;
+  const uint64_t* b_flag = (const uint64_t*) in;
+  if (! *a_flag) {
+    *a_flag = *b_flag;
+    lwgrp_op_apply(a_flag + 1, b_flag + 1, args->count, args->type, args->op);
+  }
+}
+
+/* connections are identified by an id, ids less than list_size
+ * refer to entries in list_left and list_right, and larger ids
+ * refer to entries in radix_left and radix_right */
+
+/* returns pointer to slot for left channel with given id */
+static spawn_net_channel** lwgrp_left_slot(lwgrp* group, int id)
+{
+  if (id < group->list_size) {
+    return &group->list_left[id];
+  }
+  return &group->radix_left[id - group->list_size];
+}
+
+/* returns pointer to slot for right channel with given id */
+static spawn_net_channel** lwgrp_right_slot(lwgrp* group, int id)
+{
+  if (id < group->list_size) {
+    return &group->list_right[id];
+  }
+  return &group->radix_right[id - group->list_size];
+}
+
+/* waits for channel with specified id to connect */
 static int lwgrp_accept_left(lwgrp* group, int target_round)
 {
   /* return immediately if we already accepted this connection */
-  if (group->list_left[target_round] != SPAWN_NET_CHANNEL_NULL) {
+  if (*lwgrp_left_slot(group, target_round) != SPAWN_NET_CHANNEL_NULL) {
     return LWGRP_SUCCESS;
   }
 
@@ -38,7 +249,10 @@ static int lwgrp_accept_left(lwgrp* group, int target_round)
       spawn_net_read(ch, &round, sizeof(int));
 
       /* save the channel in our list */
-      group->list_left[round] = ch;
+      *lwgrp_left_slot(group, round) = ch;
+      if (ch != SPAWN_NET_CHANNEL_NULL) {
+        __atomic_fetch_add(&lwgrp_live_channels, 1, __ATOMIC_RELAXED);
+      }
   }
 
   return LWGRP_SUCCESS;
@@ -53,14 +267,17 @@ static int lwgrp_connect_right(lwgrp* group, int round, const char* name)
   spawn_net_write(ch, &round, sizeof(int));
 
   /* record the channel */
-  group->list_right[round] = ch;
+  *lwgrp_right_slot(group, round) = ch;
+  if (ch != SPAWN_NET_CHANNEL_NULL) {
+    __atomic_fetch_add(&lwgrp_live_channels, 1, __ATOMIC_RELAXED);
+  }
 
   return LWGRP_SUCCESS;
 }
 
 /* given a group, build a list of neighbors that are 2^d away on
  * our left and right sides */
-static int lwgrp_connect_blocking(lwgrp* group)
+static int lwgrp_connect(lwgrp* group)
 {
   /* get our rank and size of the group */
   int64_t rank  = group->rank;
@@ -72,13 +289,8 @@ static int lwgrp_connect_blocking(lwgrp* group)
   int round = 0;
   int64_t dist = 1;
   while (dist < ranks) {
-    /* define temps to hold next left/right addresses */
-    char* next_right = NULL;
-    char* next_left  = NULL;
-
     /* compute our relative rank for this round */
     int64_t relrank  = (rank >> round);
-
     if (relrank & 0x1) {
         /* we're an odd rank in this round */
 
@@ -91,28 +303,6 @@ static int lwgrp_connect_blocking(lwgrp* group)
         if (rank + dist < ranks) {
           lwgrp_connect_right(group, round, right);
         }
-
-        /* exchange data with left rank */
-        if (rank - dist >= 0) {
-          spawn_net_channel* ch = group->list_left[round];
-
-          /* receive next left address from left */
-          next_left = spawn_net_read_str(ch);
-
-          /* send next right address to left */
-          spawn_net_write_str(ch, right);
-        }
-
-        /* exchange data with right rank */
-        if (rank + dist < ranks) {
-          spawn_net_channel* ch = group->list_right[round];
-
-          /* send next left address to right */
-          spawn_net_write_str(ch, left);
-
-          /* receive next right address from right */
-          next_right = spawn_net_read_str(ch);
-        }
     } else {
         /* we're an even rank in this round */
 
@@ -125,28 +315,32 @@ static int lwgrp_connect_blocking(lwgrp* group)
         if (rank - dist >= 0) {
           lwgrp_accept_left(group, round);
         }
+    }
 
-        /* exchange data with right rank */
-        if (rank + dist < ranks) {
-          spawn_net_channel* ch = group->list_right[round];
-
-          /* send next left address to right */
-          spawn_net_write_str(ch, left);
-
-          /* receive next right address from right */
-          next_right = spawn_net_read_str(ch);
-        }
+    /* send next right address to left */
+    if (rank - dist >= 0) {
+        spawn_net_channel* ch = group->list_left[round];
+        spawn_net_write_str(ch, right);
+    }
 
-        /* exchange data with left rank */
-        if (rank - dist >= 0) {
-          spawn_net_channel* ch = group->list_left[round];
+    /* send next left address to right */
+    if (rank + dist < ranks) {
+        spawn_net_channel* ch = group->list_right[round];
+        spawn_net_write_str(ch, left);
+    }
 
-          /* receive next left address from left */
-          next_left = spawn_net_read_str(ch);
+    /* receive next left address from left */
+    char* next_left = NULL;
+    if (rank - dist >= 0) {
+        spawn_net_channel* ch = group->list_left[round];
+        next_left = spawn_net_read_str(ch);
+    }
 
-          /* send next right address to left */
-          spawn_net_write_str(ch, right);
-        }
+    /* receive next right address from right */
+    char* next_right = NULL;
+    if (rank + dist < ranks) {
+        spawn_net_channel* ch = group->list_right[round];
+        next_right = spawn_net_read_str(ch);
     }
 
     spawn_free(&left);
@@ -165,87 +359,131 @@ static int lwgrp_connect_blocking(lwgrp* group)
   return LWGRP_SUCCESS;
 }
 
-/* given a group, build a list of neighbors that are 2^d away on
- * our left and right sides */
-static int lwgrp_connect(lwgrp* group)
+/* returns 1 if dist is a power of two and sets bit to its log */
+static int lwgrp_pow2(int64_t dist, int* bit)
+{
+  if (dist <= 0 || (dist & (dist - 1)) != 0) {
+    return 0;
+  }
+  int b = 0;
+  while ((((int64_t) 1) << b) < dist) {
+    b++;
+  }
+  *bit = b;
+  return 1;
+}
+
+/* returns newly allocated copy of address of process dist hops to
+ * our right, or NULL if there is none, shifts addresses left over
+ * the 2^d channels, one hop for each bit set in dist */
+static char* lwgrp_name_right(lwgrp* group, int64_t dist)
 {
-  /* get our rank and size of the group */
   int64_t rank  = group->rank;
   int64_t ranks = group->size;
 
-  /* build list of left and right ranks in our group */
-  char* left  = SPAWN_STRDUP(group->left);
-  char* right = SPAWN_STRDUP(group->right);
+  char* name = SPAWN_STRDUP(group->name);
   int round = 0;
-  int64_t dist = 1;
-  while (dist < ranks) {
-    /* compute our relative rank for this round */
-    int64_t relrank  = (rank >> round);
-    if (relrank & 0x1) {
-        /* we're an odd rank in this round */
+  int64_t hop = 1;
+  while (hop <= dist && hop < ranks) {
+    if (dist & hop) {
+      /* send current address to left */
+      if (rank - hop >= 0) {
+        spawn_net_channel* ch = group->list_left[round];
+        spawn_net_write_str(ch, name);
+      }
 
-        /* first, even ranks connect to right */
+      /* receive next address from right */
+      char* next = NULL;
+      if (rank + hop < ranks) {
+        spawn_net_channel* ch = group->list_right[round];
+        next = spawn_net_read_str(ch);
+      }
+
+      spawn_free(&name);
+      name = next;
+    }
+
+    hop <<= 1;
+    round++;
+  }
+
+  /* if dist is beyond the end of the group, there is no such process */
+  if (rank + dist >= ranks) {
+    spawn_free(&name);
+  }
+
+  return name;
+}
+
+/* given a group with connections to procs 2^d hops away, add
+ * connections to procs j*radix^r hops away for j in [1,radix-1],
+ * we reuse the 2^d channels for distances that are powers of two */
+static int lwgrp_connect_radix(lwgrp* group)
+{
+  /* get our rank and size of the group */
+  int64_t rank  = group->rank;
+  int64_t ranks = group->size;
+  int64_t radix = group->radix;
+
+  int64_t round = 0;
+  int64_t base = 1;
+  while (base < ranks) {
+    int64_t j;
+    for (j = 1; j < radix; j++) {
+      /* compute distance and index of this partner */
+      int64_t dist = j * base;
+      if (dist >= ranks) {
+        break;
+      }
+      int64_t index = round * (radix - 1) + (j - 1);
+
+      /* reuse 2^d channels */
+      int bit;
+      if (lwgrp_pow2(dist, &bit)) {
+        group->radix_left[index]  = group->list_left[bit];
+        group->radix_right[index] = group->list_right[bit];
+        continue;
+      }
+
+      /* get address of proc we connect to on our right,
+       * all procs must participate in this shift */
+      char* right = lwgrp_name_right(group, dist);
+
+      /* connection id for this partner */
+      int id = (int) (group->list_size + index);
+
+      /* procs are linked in chains whose members are dist hops
+       * apart, alternate connects and accepts along each chain */
+      int64_t relrank = rank / dist;
+      if (relrank & 0x1) {
+        /* we're odd in this chain, first even ranks connect right */
         if (rank - dist >= 0) {
-          lwgrp_accept_left(group, round);
+          lwgrp_accept_left(group, id);
         }
 
         /* then, odd ranks connect to the right */
         if (rank + dist < ranks) {
-          lwgrp_connect_right(group, round, right);
+          lwgrp_connect_right(group, id, right);
         }
-    } else {
-        /* we're an even rank in this round */
-
-        /* first, even ranks connect to the right */
+      } else {
+        /* we're even in this chain, first even ranks connect right */
         if (rank + dist < ranks) {
-          lwgrp_connect_right(group, round, right);
+          lwgrp_connect_right(group, id, right);
         }
 
         /* then, odd ranks connect to the right */
         if (rank - dist >= 0) {
-          lwgrp_accept_left(group, round);
+          lwgrp_accept_left(group, id);
         }
-    }
-
-    /* send next right address to left */
-    if (rank - dist >= 0) {
-        spawn_net_channel* ch = group->list_left[round];
-        spawn_net_write_str(ch, right);
-    }
-
-    /* send next left address to right */
-    if (rank + dist < ranks) {
-        spawn_net_channel* ch = group->list_right[round];
-        spawn_net_write_str(ch, left);
-    }
-
-    /* receive next left address from left */
-    char* next_left = NULL;
-    if (rank - dist >= 0) {
-        spawn_net_channel* ch = group->list_left[round];
-        next_left = spawn_net_read_str(ch);
-    }
+      }
 
-    /* receive next right address from right */
-    char* next_right = NULL;
-    if (rank + dist < ranks) {
-        spawn_net_channel* ch = group->list_right[round];
-        next_right = spawn_net_read_str(ch);
+      spawn_free(&right);
     }
 
-    spawn_free(&left);
-    spawn_free(&right);
-    left  = next_left;
-    right = next_right;
-
-    /* update our current left and right ranks to the next set */
-    dist <<= 1;
+    base *= radix;
     round++;
   }
 
-  spawn_free(&left);
-  spawn_free(&right);
-
   return LWGRP_SUCCESS;
 }
 
@@ -257,7 +495,25 @@ lwgrp* lwgrp_create(
   const char* right,
   spawn_net_endpoint* ep)
 {
+  return lwgrp_create_radix(ranks, rank, name, left, right, ep, 2);
+}
+
+static lwgrp* lwgrp_create_radix_untraced(
+  int64_t ranks,
+  int64_t rank,
+  const char* name,
+  const char* left,
+  const char* right,
+  spawn_net_endpoint* ep,
+  int64_t radix)
+{
+  /* a radix less than 2 makes no sense */
+  if (radix < 2) {
+    radix = 2;
+  }
+
   lwgrp* group = (lwgrp*) SPAWN_MALLOC(sizeof(lwgrp));
+  __atomic_fetch_add(&lwgrp_live_groups, 1, __ATOMIC_RELAXED);
 
   /* copy input values from caller */
   group->size  = ranks;
@@ -266,6 +522,7 @@ lwgrp* lwgrp_create(
   group->left  = SPAWN_STRDUP(left);
   group->right = SPAWN_STRDUP(right);
   group->ep    = ep;
+  group->shm   = NULL;
 
   /* initialize the fields to 0 and NULL */
   group->list_size  = 0;
@@ -306,12 +563,107 @@ lwgrp* lwgrp_create(
   group->list_left  = list_left;
   group->list_right = list_right;
 
+  /* compute ceiling(log_radix(ranks)) to determine the number
+   * of rounds in radix collectives */
+  int64_t radix_rounds = 0;
+  count = 1;
+  while (count < ranks) {
+    radix_rounds++;
+    count *= radix;
+  }
+
+  /* allocate lists of radix-1 partners on each side per round,
+   * with one extra entry so lists are never empty */
+  int64_t radix_size = radix_rounds * (radix - 1) + 1;
+  size_t radix_bytes = radix_size * sizeof(spawn_net_channel*);
+  group->radix        = radix;
+  group->radix_rounds = radix_rounds;
+  group->radix_left   = (spawn_net_channel**) SPAWN_MALLOC(radix_bytes);
+  group->radix_right  = (spawn_net_channel**) SPAWN_MALLOC(radix_bytes);
+  for (i = 0; i < radix_size; i++) {
+    group->radix_left[i]  = SPAWN_NET_CHANNEL_NULL;
+    group->radix_right[i] = SPAWN_NET_CHANNEL_NULL;
+  }
+
   /* create connections */
   lwgrp_connect(group);
+  lwgrp_connect_radix(group);
 
   return group;
 }
 
+lwgrp* lwgrp_create_radix(
+  int64_t ranks,
+  int64_t rank,
+  const char* name,
+  const char* left,
+  const char* right,
+  spawn_net_endpoint* ep,
+  int64_t radix)
+{
+  SPAWN_TRACE_BEGIN("lwgrp_create_radix", ranks);
+  lwgrp* newgroup = lwgrp_create_radix_untraced(ranks, rank, name, left, right, ep, radix);
+  SPAWN_TRACE_END("lwgrp_create_radix", ranks);
+  return newgroup;
+}
+
+lwgrp* lwgrp_merge(
+  const lwgrp* group,
+  spawn_net_channel* bridge,
+  int high)
+{
+  int64_t rank  = group->rank;
+  int64_t ranks = group->size;
+
+  /* the bridge joins the last proc of the low group to the first
+   * proc of the high group, those two procs trade the size and
+   * radix of their groups and their own addresses */
+  int64_t root = high ? 0 : ranks - 1;
+  int64_t info[2];
+  char* peer = NULL;
+  if (rank == root) {
+    int64_t mine[2];
+    mine[0] = ranks;
+    mine[1] = group->radix;
+    spawn_net_write(bridge, mine, sizeof(mine));
+    spawn_net_write_str(bridge, group->name);
+    spawn_net_read(bridge, info, sizeof(info));
+    peer = spawn_net_read_str(bridge);
+  }
+
+  /* tell the rest of our group about the other group */
+  lwgrp_bcast(info, sizeof(info), root, group);
+  int64_t other_ranks = info[0];
+  int64_t radix = group->radix;
+  if (info[1] > radix) {
+    radix = info[1];
+  }
+
+  /* low procs keep their ranks, high procs follow them */
+  int64_t new_rank  = high ? other_ranks + rank : rank;
+  int64_t new_ranks = ranks + other_ranks;
+
+  /* the procs at the junction link the two chains */
+  const char* left  = group->left;
+  const char* right = group->right;
+  if (peer != NULL) {
+    if (high) {
+      left = peer;
+    } else {
+      right = peer;
+    }
+  }
+
+  /* connect the 2^d and radix partners along the joined chain */
+  lwgrp* merged = lwgrp_create_radix(
+    new_ranks, new_rank, group->name, left, right, group->ep, radix
+  );
+
+  spawn_free(&peer);
+
+  return merged;
+}
+
 int lwgrp_free(lwgrp** pgroup)
 {
   /* nothing to do if caller passed in NULL address */
@@ -324,15 +676,45 @@ int lwgrp_free(lwgrp** pgroup)
 
   /* free up resources in group */
   if (group != NULL) {
+    /* unmap shared memory segment */
+    lwgrp_shm_detach(group);
+
+    /* disconnect radix channels, skipping those that
+     * refer to channels in our 2^d lists */
+    int64_t round, j;
+    int64_t base = 1;
+    for (round = 0; round < group->radix_rounds; round++) {
+      for (j = 1; j < group->radix; j++) {
+        int bit;
+        int64_t index = round * (group->radix - 1) + (j - 1);
+        if (lwgrp_pow2(j * base, &bit)) {
+          continue;
+        }
+        if (group->radix_left[index] != SPAWN_NET_CHANNEL_NULL) {
+          spawn_net_disconnect(&group->radix_left[index]);
+          __atomic_fetch_sub(&lwgrp_live_channels, 1, __ATOMIC_RELAXED);
+        }
+        if (group->radix_right[index] != SPAWN_NET_CHANNEL_NULL) {
+          spawn_net_disconnect(&group->radix_right[index]);
+          __atomic_fetch_sub(&lwgrp_live_channels, 1, __ATOMIC_RELAXED);
+        }
+      }
+      base *= group->radix;
+    }
+    spawn_free(&group->radix_right);
+    spawn_free(&group->radix_left);
+
     /* disconnect all channels */
     int64_t i;
     for (i = 0; i < group->list_size; i++) {
       if (group->list_left[i] != SPAWN_NET_CHANNEL_NULL) {
         spawn_net_disconnect(&group->list_left[i]);
+        __atomic_fetch_sub(&lwgrp_live_channels, 1, __ATOMIC_RELAXED);
       }
 
       if (group->list_right[i] != SPAWN_NET_CHANNEL_NULL) {
         spawn_net_disconnect(&group->list_right[i]);
+        __atomic_fetch_sub(&lwgrp_live_channels, 1, __ATOMIC_RELAXED);
       }
     }
 
@@ -344,6 +726,8 @@ int lwgrp_free(lwgrp** pgroup)
     spawn_free(&group->right);
     spawn_free(&group->left);
     spawn_free(&group->name);
+
+    __atomic_fetch_sub(&lwgrp_live_groups, 1, __ATOMIC_RELAXED);
   }
 
   /* free the group */
@@ -370,17 +754,91 @@ int64_t lwgrp_rank(const lwgrp* group)
   return rank;
 }
 
-/* TODO: need to unpack these values to convert them to right format */
+/* add counters of channel into stats */
+static void lwgrp_stats_add(spawn_net_stats* stats, const spawn_net_channel* ch)
+{
+  if (ch != SPAWN_NET_CHANNEL_NULL) {
+    spawn_net_stats ch_stats;
+    spawn_net_channel_stats(ch, &ch_stats);
+    spawn_net_stats_add(stats, &ch_stats);
+  }
+}
 
-/* compares first int,
- *   - used to compare color values after sorting
- *   - used to sort data back to its originating rank */
-static int cmp_int(const void* a_void, const void* b_void, size_t offset)
+int lwgrp_stats(const lwgrp* group, spawn_net_stats* stats)
 {
-  /* get pointers to the integer array, offset is dummy in this case */
-  const int64_t* a = (const int64_t*) a_void;
-  const int64_t* b = (const int64_t*) b_void;
-  if (a[0] != b[0]) {
+  memset(stats, 0, sizeof(spawn_net_stats));
+
+  /* channels in our 2^d lists */
+  int64_t i;
+  for (i = 0; i < group->list_size; i++) {
+    lwgrp_stats_add(stats, group->list_left[i]);
+    lwgrp_stats_add(stats, group->list_right[i]);
+  }
+
+  /* radix channels, skipping those that refer to channels
+   * in our 2^d lists */
+  int64_t round, j;
+  int64_t base = 1;
+  for (round = 0; round < group->radix_rounds; round++) {
+    for (j = 1; j < group->radix; j++) {
+      int bit;
+      int64_t index = round * (group->radix - 1) + (j - 1);
+      if (lwgrp_pow2(j * base, &bit)) {
+        continue;
+      }
+      lwgrp_stats_add(stats, group->radix_left[index]);
+      lwgrp_stats_add(stats, group->radix_right[index]);
+    }
+    base *= group->radix;
+  }
+
+  return LWGRP_SUCCESS;
+}
+
+int lwgrp_allreduce_stats(spawn_net_stats* stats, const lwgrp* group)
+{
+  /* every field is a uint64_t */
+  uint64_t count = sizeof(spawn_net_stats) / sizeof(uint64_t);
+  return lwgrp_allreduce_uint64_sum((uint64_t*) stats, count, group);
+}
+
+int lwgrp_stats_dump(const char* path, spawn_stats_format format, int64_t root, const lwgrp* group)
+{
+  /* each proc counts itself, so the sum is the number of procs */
+  strmap* map = spawn_stats_collect();
+  strmap_set(map, "spawn_procs", "g 1");
+
+  lwgrp_reduce_strmap(map, spawn_stats_combine, root, group);
+
+  int rc = LWGRP_SUCCESS;
+  if (group->rank == root) {
+    if (spawn_stats_write(path, map, format) != SPAWN_SUCCESS) {
+      rc = LWGRP_FAILURE;
+    }
+  }
+
+  strmap_delete(&map);
+  return rc;
+}
+
+int lwgrp_counts(uint64_t* groups, uint64_t* channels)
+{
+  *groups   = __atomic_load_n(&lwgrp_live_groups, __ATOMIC_RELAXED);
+  *channels = __atomic_load_n(&lwgrp_live_channels, __ATOMIC_RELAXED);
+  return LWGRP_SUCCESS;
+}
+
+/* TODO: need to unpack these values to convert them to right format */
+
+/* compares first int,
+ *   - used to compare color values after sorting
+ *   - used to sort data back to its originating rank */
+static int cmp_int(const void* a_void, const void* b_void, size_t offset)
+{
+  /* get pointers to the integer array, offset is dummy in this case */
+  const int64_t* a = (const int64_t*) a_void;
+  const int64_t* b = (const int64_t*) b_void;
+  if (a[0] != b[0]) {
     if (a[0] > b[0]) {
       return 1;
     }
@@ -477,90 +935,36 @@ static int cmp_str_int(const void* a, const void* b, size_t offset)
   return 0;
 }
 
-static int lwgrp_sort_bitonic_merge_blocking(
-  void* value,
-  void* scratch,
-  size_t size,
-  size_t offset,
-  int (*compare)(const void*, const void*, size_t),
-  int64_t start,
-  int64_t num,
-  int direction,
-  const lwgrp* group)
+/* compares a (string,color,rank) tuple, first by string, then by
+ * color and rank, which are offset bytes from start of buffer
+ *   - used to sort (string,color,rank) tuples */
+static int cmp_str_int_int(const void* a, const void* b, size_t offset)
 {
-  if (num > 1) {
-    /* get our rank within the group */
-    int64_t rank = group->rank;
-
-    /* determine largest power of two that is smaller than num */
-    int64_t count = 1;
-    int64_t index = 0;
-    while (count < num) {
-      count <<= 1;
-      index++;
-    }
-    count >>= 1;
-    index--;
-
-    /* divide range into two chunks, execute bitonic half-clean step,
-     * then recursively merge each half */
-    if (rank < start + count) {
-      /* we are in the lower half, find a partner in the upper half */
-      int64_t dst_rank = rank + count;
-      if (dst_rank < start + num) {
-        /* exchange data with our partner rank */
-        spawn_net_channel* partner = group->list_right[index];
-        spawn_net_read(partner, scratch, size);
-        spawn_net_write(partner, value, size);
-
-        /* select the appropriate value,
-         * depedning on the sort direction */
-        int cmp = (*compare)(scratch, value, offset);
-        if ((direction && cmp < 0) || (!direction && cmp > 0)) {
-          /* we keep the value if
-           *   direction is ascending and new value is smaller,
-           *   direction is descending and new value is greater */
-          memcpy(value, scratch, size);
-        }
-      }
-
-      /* recursively merge our half */
-      lwgrp_sort_bitonic_merge_blocking(
-        value, scratch, size, offset, compare,
-        start, count, direction,
-        group
-      );
-    } else {
-      /* we are in the upper half, find a partner in the lower half */
-      int64_t dst_rank = rank - count;
-      if (dst_rank >= start) {
-        /* exchange data with our partner rank */
-        spawn_net_channel* partner = group->list_left[index];
-        spawn_net_write(partner, value, size);
-        spawn_net_read(partner, scratch, size);
+  /* compare string and color values first */
+  int rc = cmp_str_int(a, b, offset);
+  if (rc != 0) {
+    return rc;
+  }
 
-        /* select the appropriate value,
-         * depedning on the sort direction */
-        int cmp = (*compare)(scratch, value, offset);
-        if ((direction && cmp > 0) || (!direction && cmp < 0)) {
-          /* we keep the value if
-           *   direction is ascending and new value is bigger,
-           *   direction is descending and new value is smaller */
-          memcpy(value, scratch, size);
-        }
-      }
+  /* then compare ranks, stored just after the color */
+  return cmp_str_int(a, b, offset + sizeof(int64_t));
+}
 
-      /* recursively merge our half */
-      int64_t new_start = start + count;
-      int64_t new_num   = num - count;
-      lwgrp_sort_bitonic_merge_blocking(
-        value, scratch, size, offset, compare,
-        new_start, new_num, direction,
-        group
-      );
-    }
-  }
+/* compares a (string,color) tuple, where offset is the position of
+ * the rank, which directly follows the color
+ *   - used to compare (string,color) values after sorting */
+static int cmp_str_color(const void* a, const void* b, size_t offset)
+{
+  return cmp_str_int(a, b, offset - sizeof(int64_t));
+}
 
+/* treats all items as equal
+ *   - used to keep all sorted items in a single group */
+static int cmp_none(const void* a, const void* b, size_t offset)
+{
+  (void) a;
+  (void) b;
+  (void) offset;
   return 0;
 }
 
@@ -596,9 +1000,11 @@ static int lwgrp_sort_bitonic_merge(
       int64_t dst_rank = rank + count;
       if (dst_rank < start + num) {
         /* exchange data with our partner rank */
-        spawn_net_channel* partner = group->list_right[index];
-        spawn_net_write(partner, value, size);
-        spawn_net_read(partner, scratch, size);
+        lwgrp_xchg x;
+        lwgrp_xchg_init(&x, group->list_right[index]);
+        lwgrp_xchg_send(&x, value, size);
+        lwgrp_xchg_recv(&x, scratch, size);
+        lwgrp_exchange(&x, 1);
 
         /* select the appropriate value,
          * depedning on the sort direction */
@@ -622,9 +1028,11 @@ static int lwgrp_sort_bitonic_merge(
       int64_t dst_rank = rank - count;
       if (dst_rank >= start) {
         /* exchange data with our partner rank */
-        spawn_net_channel* partner = group->list_left[index];
-        spawn_net_write(partner, value, size);
-        spawn_net_read(partner, scratch, size);
+        lwgrp_xchg x;
+        lwgrp_xchg_init(&x, group->list_left[index]);
+        lwgrp_xchg_send(&x, value, size);
+        lwgrp_xchg_recv(&x, scratch, size);
+        lwgrp_exchange(&x, 1);
 
         /* select the appropriate value,
          * depedning on the sort direction */
@@ -740,6 +1148,23 @@ enum chain_fields {
   CHAIN_COUNT = 4, /* number of new groups */
 };
 
+/* combines scan values from a proc before us in the scan direction */
+static void lwgrp_split_scan_fn(void* inout, const void* in, void* arg)
+{
+  (void) arg;
+  int64_t* ints = (int64_t*) inout;
+  const int64_t* recv_ints = (const int64_t*) in;
+
+  /* count the number of groups before us */
+  ints[SCAN_COLOR] += recv_ints[SCAN_COLOR];
+
+  /* continue accumulating the count if our flag has not already been set */
+  if (ints[SCAN_FLAG] != 1) {
+    ints[SCAN_FLAG]   = recv_ints[SCAN_FLAG];
+    ints[SCAN_COUNT] += recv_ints[SCAN_COUNT];
+  }
+}
+
 /* assumes that color/key/rank tuples have been globally sorted
  * across ranks of in chain, computes corresponding group
  * information for val and passes that back to originating rank:
@@ -749,7 +1174,7 @@ enum chain_fields {
  *   2) executes left-to-right and right-to-left (double) inclusive
  *      segmented scan to compute number of ranks to left and right
  *      sides of host value */
-static lwgrp* lwgrp_split_sorted_blocking(
+static lwgrp* lwgrp_split_sorted(
   const void* value,
   size_t size,
   size_t offset,
@@ -781,35 +1206,8 @@ static lwgrp* lwgrp_split_sorted_blocking(
    * boundaries of group */
   int64_t rank  = group->rank;
   int64_t ranks = group->size;
-  if (rank & 0x1) {
-    /* odd ranks recv from left first, then send to right */
-    if (rank > 0) {
-      /* recv from left, then send to left */
-      spawn_net_channel* left = group->list_left[0];
-      spawn_net_read(left, left_buf, size);
-      spawn_net_write(left, value, size);
-    }
-    if (rank < ranks - 1) {
-      /* send to right, then recv from right */
-      spawn_net_channel* right = group->list_right[0];
-      spawn_net_write(right, value, size);
-      spawn_net_read(right, right_buf, size);
-    }
-  } else {
-    /* even ranks send right first, then recv from left */
-    if (rank < ranks - 1) {
-      /* send to right, then recv from right */
-      spawn_net_channel* right = group->list_right[0];
-      spawn_net_write(right, value, size);
-      spawn_net_read(right, right_buf, size);
-    }
-    if (rank > 0) {
-      /* recv from left, then send to left */
-      spawn_net_channel* left = group->list_left[0];
-      spawn_net_read(left, left_buf, size);
-      spawn_net_write(left, value, size);
-    }
-  }
+
+  lwgrp_shift(value, left_buf, right_buf, size, group);
 
   /* if we have a left neighbor, and if its color value matches ours,
    * then our element is part of its group, otherwise we are the first
@@ -824,7 +1222,7 @@ static lwgrp* lwgrp_split_sorted_blocking(
     }
 
     /* check whether we're first in a new group */
-    int left_cmp = (*compare)(left_buf, value, 0);
+    int left_cmp = (*compare)(left_buf, value, offset);
     if (left_cmp == 0) {
       first_in_group = 0;
     }
@@ -843,7 +1241,7 @@ static lwgrp* lwgrp_split_sorted_blocking(
     }
 
     /* check whether we're last in our group */
-    int right_cmp = (*compare)(right_buf, value, 0);
+    int right_cmp = (*compare)(right_buf, value, offset);
     if (right_cmp == 0) {
       last_in_group = 0;
     }
@@ -859,8 +1257,6 @@ static lwgrp* lwgrp_split_sorted_blocking(
   size_t scan_size = 3 * sizeof(int64_t);
   int64_t send_left_ints[3]  = {0,0,1};
   int64_t send_right_ints[3] = {0,0,1};
-  int64_t recv_left_ints[3]  = {0,0,0};
-  int64_t recv_right_ints[3] = {0,0,0};
   if (first_in_group) {
     send_right_ints[SCAN_COLOR] = 1;
     send_right_ints[SCAN_FLAG] = 1;
@@ -872,70 +1268,10 @@ static lwgrp* lwgrp_split_sorted_blocking(
 
   /* execute inclusive scan in both directions to count number of
    * ranks in our group to our left and right sides */
-  int64_t dist  = 1;
-  int64_t index = 0;
-  while (dist < ranks) {
-    /* compute our relative rank for this round */
-    int64_t relrank  = (rank >> index);
-
-    /* send and receive data with left partner */
-    if (relrank & 0x1) {
-      /* odd ranks recv from left first, then send to right */
-      if (rank - dist >= 0) {
-        spawn_net_channel* partner = group->list_left[index];
-        spawn_net_read(partner, recv_left_ints, scan_size);
-        spawn_net_write(partner, send_left_ints, scan_size);
-      }
-      if (rank + dist < ranks) {
-        spawn_net_channel* partner = group->list_right[index];
-        spawn_net_write(partner, send_right_ints, scan_size);
-        spawn_net_read(partner, recv_right_ints, scan_size);
-      }
-    } else {
-      /* even ranks send right first, then recv from left */
-      if (rank + dist < ranks) {
-        spawn_net_channel* partner = group->list_right[index];
-        spawn_net_write(partner, send_right_ints, scan_size);
-        spawn_net_read(partner, recv_right_ints, scan_size);
-      }
-      if (rank - dist >= 0) {
-        spawn_net_channel* partner = group->list_left[index];
-        spawn_net_read(partner, recv_left_ints, scan_size);
-        spawn_net_write(partner, send_left_ints, scan_size);
-      }
-    }
-
-    /* TODO: unpack */
-    /* reduce data from left partner */
-    if (rank - dist >= 0) {
-      /* count the number of groups to our left */
-      send_right_ints[SCAN_COLOR] += recv_left_ints[SCAN_COLOR];
-
-      /* continue accumulating the count in our right-going data
-       * if our flag has not already been set */
-      if (send_right_ints[SCAN_FLAG] != 1) {
-        send_right_ints[SCAN_FLAG]   = recv_left_ints[SCAN_FLAG];
-        send_right_ints[SCAN_COUNT] += recv_left_ints[SCAN_COUNT];
-      }
-    }
-
-    /* reduce data from right partner */
-    if (rank + dist < ranks) {
-      /* count the number of groups to our right */
-      send_left_ints[SCAN_COLOR] += recv_right_ints[SCAN_COLOR];
-
-      /* continue accumulating the count in our left-going data
-       * if our flag has not already been set */
-      if (send_left_ints[SCAN_FLAG] != 1) {
-        send_left_ints[SCAN_FLAG]   = recv_right_ints[SCAN_FLAG];
-        send_left_ints[SCAN_COUNT] += recv_right_ints[SCAN_COUNT];
-      }
-    }
-
-    /* prepare for the next round */
-    dist <<= 1;
-    index++;
-  }
+  lwgrp_scan_rounds(
+    send_right_ints, send_left_ints, scan_size,
+    lwgrp_split_scan_fn, NULL, group
+  );
 
   /* Now we can set our rank and the number of ranks in our group.
    * At this point, our right-going count is the number of ranks to our
@@ -967,8 +1303,8 @@ static lwgrp* lwgrp_split_sorted_blocking(
   if (newrank < newranks - 1) {
     newright = (char*)result_buf + 5 * sizeof(int64_t) + payload_size;
   }
-  lwgrp* newgroup = lwgrp_create(
-    newranks, newrank, group->name, newleft, newright, group->ep
+  lwgrp* newgroup = lwgrp_create_radix(
+    newranks, newrank, group->name, newleft, newright, group->ep, group->radix
   );
 
   /* free buffer */
@@ -977,219 +1313,60 @@ static lwgrp* lwgrp_split_sorted_blocking(
   return newgroup;
 }
 
-static lwgrp* lwgrp_split_sorted(
-  const void* value,
-  size_t size,
-  size_t offset,
-  int (*compare)(const void*, const void*, size_t),
-  const lwgrp* group)
+static lwgrp* lwgrp_split_untraced(
+  const lwgrp* comm,
+  int64_t color,
+  int64_t key)
 {
-  /* we will fill in 7 values (src, rank, size, groupid, groups, left, right)
-   * representing the chain data structure for the the globally
-   * ordered color/key/rank tuple that we hold, which we'll later
-   * send back to the rank that contributed our item */
-  size_t payload_offset = offset + sizeof(int64_t);
-  size_t payload_size = size - payload_offset;
-  size_t result_buf_size = 5 * sizeof(int64_t) + 2 * payload_size;
-  void* result_buf = SPAWN_MALLOC(result_buf_size);
-  int64_t* send_ints = (int64_t*) result_buf;
+  /* TODO: for small groups, fastest to do an allgather and
+   * local sort */
 
-  /* TODO: unpack */
-  /* record address of process that contributed this item */
-  int64_t* orig_ptr = (int64_t*)((char*)value + offset);
-  send_ints[CHAIN_SRC] = *orig_ptr;
+  /* TODO: allreduce to determine whether keys are already ordered and
+   * to compute min and max color values, if already ordered, reduce
+   * problem to bin split using min/max colors to set number of bins */
 
-  /* allocate a scratch buffer to receive value from left neighbor */
-  void* left_buf = SPAWN_MALLOC(size);
+  /* TODO: prepare input data (need allreduce on ep lengths),
+   * convert color/key to 64-bit values */
 
-  /* allocate a scratch buffer to receive value from right neighbor */
-  void* right_buf = SPAWN_MALLOC(size);
+  /* determine maximum length of endpoint names */
+  uint64_t length = (uint64_t) (strlen(comm->name) + 1);
+  lwgrp_allreduce_uint64_max(&length, 1, comm);
+  size_t max_name = length;
 
-  /* exchange data with left and right neighbors to find
-   * boundaries of group */
-  int64_t rank  = group->rank;
-  int64_t ranks = group->size;
+  /* allocate memory to hold item for sorting (color,key,rank) tuple
+   * and prepare input -- O(1) local */
+  size_t buf_size = 3 * sizeof(int64_t) + max_name;
+  char* buf = SPAWN_MALLOC(buf_size);
 
-  /* send data left */
-  if (rank > 0) {
-    spawn_net_channel* left = group->list_left[0];
-    spawn_net_write(left, value, size);
-  }
+  /* TODO: we should pack these to be network order */
 
-  /* send data right */
-  if (rank < ranks - 1) {
-    spawn_net_channel* right = group->list_right[0];
-    spawn_net_write(right, value, size);
-  }
+  /* copy in our color, key, and rank tuple */
+  int64_t* ptr = (int64_t*) buf;
+  ptr[0] = color;
+  ptr[1] = key;
+  ptr[2] = comm->rank;
 
-  /* read data from left */
-  if (rank > 0) {
-    spawn_net_channel* left = group->list_left[0];
-    spawn_net_read(left, left_buf, size);
-  }
+  /* copy in endpoint name */
+  char* ptr_ep = buf + 3 * sizeof(int64_t);
+  strcpy(ptr_ep, comm->name);
 
-  /* recv data from right */
-  if (rank < ranks - 1) {
-    spawn_net_channel* right = group->list_right[0];
-    spawn_net_read(right, right_buf, size);
-  }
+  /* sort our values using bitonic sort algorithm -- 
+   * O(log^2 N) communication */
+  lwgrp_sort_bitonic(
+    buf, buf_size, 0, cmp_three_ints, comm
+  );
 
-  /* if we have a left neighbor, and if its color value matches ours,
-   * then our element is part of its group, otherwise we are the first
-   * rank of a new group */
-  int first_in_group = 1;
-  if (rank > 0) {
-    /* copy endpoint name from neighbor */
-    if (payload_size > 0) {
-      char* payload = ((char*)left_buf + payload_offset);
-      char* bufptr = ((char*)result_buf + 5 * sizeof(int64_t));
-      memcpy(bufptr, payload, payload_size);
-    }
+  /* now split our sorted values by comparing our value with our
+   * left and right neighbors to determine group boundaries --
+   * O(log N) communication, need offset to skip color and key
+   * and point to rank (of type int64_t) followed by endpoint name */
+  size_t offset = 2 * sizeof(int64_t);
+  lwgrp* newgroup = lwgrp_split_sorted(
+    buf, buf_size, offset, cmp_int, comm
+  );
 
-    /* check whether we're first in a new group */
-    int left_cmp = (*compare)(left_buf, value, 0);
-    if (left_cmp == 0) {
-      first_in_group = 0;
-    }
-  }
-
-  /* if we have a right neighbor, and if its color value matches ours,
-   * then our element is part of its group, otherwise we are the last
-   * rank of our group */
-  int last_in_group = 1;
-  if (rank < ranks - 1) {
-    /* copy endpoint name from neighbor */
-    if (payload_size > 0) {
-      char* payload = ((char*)right_buf + payload_offset);
-      char* bufptr = ((char*)result_buf + 5 * sizeof(int64_t) + payload_size);
-      memcpy(bufptr, payload, payload_size);
-    }
-
-    /* check whether we're last in our group */
-    int right_cmp = (*compare)(right_buf, value, 0);
-    if (right_cmp == 0) {
-      last_in_group = 0;
-    }
-  }
-
-  /* free temporary buffers */
-  spawn_free(&left_buf);
-  spawn_free(&right_buf);
-
-  /* TODO: pack */
-  /* prepare buffers for our scan operations:
-   * group count, flag, rank count, next proc */
-  size_t scan_size = 3 * sizeof(int64_t);
-  int64_t send_left_ints[3]  = {0,0,1};
-  int64_t send_right_ints[3] = {0,0,1};
-  int64_t recv_left_ints[3]  = {0,0,0};
-  int64_t recv_right_ints[3] = {0,0,0};
-  if (first_in_group) {
-    send_right_ints[SCAN_COLOR] = 1;
-    send_right_ints[SCAN_FLAG] = 1;
-  }
-  if (last_in_group) {
-    send_left_ints[SCAN_COLOR] = 1;
-    send_left_ints[SCAN_FLAG] = 1;
-  }
-
-  /* execute inclusive scan in both directions to count number of
-   * ranks in our group to our left and right sides */
-  int64_t dist  = 1;
-  int64_t index = 0;
-  while (dist < ranks) {
-    /* send data left */
-    if (rank - dist >= 0) {
-      spawn_net_channel* partner = group->list_left[index];
-      spawn_net_write(partner, send_left_ints, scan_size);
-    }
-
-    /* send data right */
-    if (rank + dist < ranks) {
-      spawn_net_channel* partner = group->list_right[index];
-      spawn_net_write(partner, send_right_ints, scan_size);
-    }
-
-    /* recv data from left */
-    if (rank - dist >= 0) {
-      spawn_net_channel* partner = group->list_left[index];
-      spawn_net_read(partner, recv_left_ints, scan_size);
-    }
-
-    /* recv data from right */
-    if (rank + dist < ranks) {
-      spawn_net_channel* partner = group->list_right[index];
-      spawn_net_read(partner, recv_right_ints, scan_size);
-    }
-
-    /* TODO: unpack */
-    /* reduce data from left partner */
-    if (rank - dist >= 0) {
-      /* count the number of groups to our left */
-      send_right_ints[SCAN_COLOR] += recv_left_ints[SCAN_COLOR];
-
-      /* continue accumulating the count in our right-going data
-       * if our flag has not already been set */
-      if (send_right_ints[SCAN_FLAG] != 1) {
-        send_right_ints[SCAN_FLAG]   = recv_left_ints[SCAN_FLAG];
-        send_right_ints[SCAN_COUNT] += recv_left_ints[SCAN_COUNT];
-      }
-    }
-
-    /* reduce data from right partner */
-    if (rank + dist < ranks) {
-      /* count the number of groups to our right */
-      send_left_ints[SCAN_COLOR] += recv_right_ints[SCAN_COLOR];
-
-      /* continue accumulating the count in our left-going data
-       * if our flag has not already been set */
-      if (send_left_ints[SCAN_FLAG] != 1) {
-        send_left_ints[SCAN_FLAG]   = recv_right_ints[SCAN_FLAG];
-        send_left_ints[SCAN_COUNT] += recv_right_ints[SCAN_COUNT];
-      }
-    }
-
-    /* prepare for the next round */
-    dist <<= 1;
-    index++;
-  }
-
-  /* Now we can set our rank and the number of ranks in our group.
-   * At this point, our right-going count is the number of ranks to our
-   * left including ourself, and the left-going count is the number of
-   * ranks to our right including ourself.
-   * Our rank is the number of ranks to our left (right-going count
-   * minus 1), and the group size is the sum of right-going and
-   * left-going counts minus 1 so we don't double counts ourself. */
-  send_ints[CHAIN_RANK] = send_right_ints[SCAN_COUNT] - 1;
-  send_ints[CHAIN_SIZE] = send_right_ints[SCAN_COUNT] + 
-                          send_left_ints[SCAN_COUNT] - 1;
-  send_ints[CHAIN_ID]    = send_right_ints[SCAN_COLOR] - 1;
-  send_ints[CHAIN_COUNT] = send_right_ints[SCAN_COLOR] +
-                           send_left_ints[SCAN_COLOR] - 1;
-
-  /* sort item back to its originating rank */
-  lwgrp_sort_bitonic(
-    result_buf, result_buf_size, 0, cmp_int, group
-  );
-
-  /* build new group */
-  int64_t newrank  = send_ints[CHAIN_RANK];
-  int64_t newranks = send_ints[CHAIN_SIZE];
-  char* newleft    = NULL;
-  char* newright   = NULL;
-  if (newrank > 0) {
-    newleft = (char*)result_buf + 5 * sizeof(int64_t);
-  }
-  if (newrank < newranks - 1) {
-    newright = (char*)result_buf + 5 * sizeof(int64_t) + payload_size;
-  }
-  lwgrp* newgroup = lwgrp_create(
-    newranks, newrank, group->name, newleft, newright, group->ep
-  );
-
-  /* free buffer */
-  spawn_free(&result_buf);
+  /* free memory allocated for buffer */
+  spawn_free(&buf);
 
   return newgroup;
 }
@@ -1199,51 +1376,62 @@ lwgrp* lwgrp_split(
   int64_t color,
   int64_t key)
 {
-  /* TODO: for small groups, fastest to do an allgather and
-   * local sort */
-
-  /* TODO: allreduce to determine whether keys are already ordered and
-   * to compute min and max color values, if already ordered, reduce
-   * problem to bin split using min/max colors to set number of bins */
+  SPAWN_TRACE_BEGIN("lwgrp_split", comm->size);
+  lwgrp* newgroup = lwgrp_split_untraced(comm, color, key);
+  SPAWN_TRACE_END("lwgrp_split", comm->size);
+  return newgroup;
+}
 
-  /* TODO: prepare input data (need allreduce on ep lengths),
-   * convert color/key to 64-bit values */
+/* sorts procs by (string,rank) and then splits the sorted items
+ * into groups of items that cmp_split reports as equal */
+static lwgrp* lwgrp_sort_str(
+  const lwgrp* comm,
+  const char* str,
+  int (*cmp_split)(const void*, const void*, size_t))
+{
+  /* get max length of string and endpoint names */
+  uint64_t lengths[2];
+  lengths[0] = (uint64_t) (strlen(str) + 1);
+  lengths[1] = (uint64_t) (strlen(comm->name) + 1);
+  lwgrp_allreduce_uint64_max(lengths, 2, comm);
+  uint64_t max_len  = lengths[0];
+  uint64_t max_name = lengths[1];
 
-  /* determine maximum length of endpoint names */
-  uint64_t length = (uint64_t) (strlen(comm->name) + 1);
-  lwgrp_allreduce_uint64_max(&length, 1, comm);
-  size_t max_name = length;
+  /* allocate space to hold a copy of the string,
+   * our rank, and our endpoint name */
+  size_t buf_size = max_len + sizeof(int64_t) + max_name;
+  void* buf = SPAWN_MALLOC(buf_size);
 
-  /* allocate memory to hold item for sorting (color,key,rank) tuple
-   * and prepare input -- O(1) local */
-  size_t buf_size = 3 * sizeof(int64_t) + max_name;
-  char* buf = SPAWN_MALLOC(buf_size);
+  /* Prepare buffer, copy in string and then rank after max_len characters.
+   * This rank serves two purposes. First by sorting on string and then rank,
+   * it ensures that every item is unique since the ranks are distinct.
+   * Second, it is used as a return address to send the result back. */
 
-  /* TODO: we should pack these to be network order */
+  /* copy string provided by caller */
+  char* ptr = (char*) buf;
+  strcpy(ptr, str);
+  ptr += max_len;
 
-  /* copy in our color, key, and rank tuple */
-  int64_t* ptr = (int64_t*) buf;
-  ptr[0] = color;
-  ptr[1] = key;
-  ptr[2] = comm->rank;
+  /* copy our rank in the current group */
+  int64_t* ptr_int64 = (int64_t*) ptr;
+  *ptr_int64 = comm->rank;
+  ptr += sizeof(int64_t);
 
   /* copy in endpoint name */
-  char* ptr_ep = buf + 3 * sizeof(int64_t);
-  strcpy(ptr_ep, comm->name);
+  strcpy(ptr, comm->name);
+  ptr += max_name;
 
   /* sort our values using bitonic sort algorithm -- 
    * O(log^2 N) communication */
   lwgrp_sort_bitonic(
-    buf, buf_size, 0, cmp_three_ints, comm
+    buf, buf_size, max_len, cmp_str_int, comm
   );
 
   /* now split our sorted values by comparing our value with our
    * left and right neighbors to determine group boundaries --
-   * O(log N) communication, need offset to skip color and key
-   * and point to rank (of type int64_t) followed by endpoint name */
-  size_t offset = 2 * sizeof(int64_t);
+   * O(log N) communication */
   lwgrp* newgroup = lwgrp_split_sorted(
-    buf, buf_size, offset, cmp_int, comm
+    buf, buf_size, max_len, cmp_split, comm
   );
 
   /* free memory allocated for buffer */
@@ -1285,6 +1473,16 @@ lwgrp* lwgrp_split_str(const lwgrp* comm, const char* str)
     /* TODO: error */
   }
 
+  return lwgrp_sort_str(comm, str, cmp_str);
+}
+
+int lwgrp_split_str_multi(
+  const lwgrp* comm,
+  const char* str,
+  int64_t color,
+  lwgrp** outer,
+  lwgrp** inner)
+{
   /* get max length of string and endpoint names */
   uint64_t lengths[2];
   lengths[0] = (uint64_t) (strlen(str) + 1);
@@ -1294,97 +1492,58 @@ lwgrp* lwgrp_split_str(const lwgrp* comm, const char* str)
   uint64_t max_name = lengths[1];
 
   /* allocate space to hold a copy of the string,
-   * our rank, and our endpoint name */
-  size_t buf_size = max_len + sizeof(int64_t) + max_name;
-  void* buf = SPAWN_MALLOC(buf_size);
-
-  /* Prepare buffer, copy in string and then rank after max_len characters.
-   * This rank serves two purposes. First by sorting on string and then rank,
-   * it ensures that every item is unique since the ranks are distinct.
-   * Second, it is used as a return address to send the result back. */
+   * our color, our rank, and our endpoint name */
+  size_t buf_size = max_len + 2 * sizeof(int64_t) + max_name;
+  char* buf = SPAWN_MALLOC(buf_size);
+  memset(buf, 0, buf_size);
 
-  /* copy string provided by caller */
-  char* ptr = (char*) buf;
+  /* copy in string, color, rank, and endpoint name */
+  char* ptr = buf;
   strcpy(ptr, str);
   ptr += max_len;
 
-  /* copy our rank in the current group */
   int64_t* ptr_int64 = (int64_t*) ptr;
-  *ptr_int64 = comm->rank;
-  ptr += sizeof(int64_t);
+  ptr_int64[0] = color;
+  ptr_int64[1] = comm->rank;
+  ptr += 2 * sizeof(int64_t);
 
-  /* copy in endpoint name */
   strcpy(ptr, comm->name);
-  ptr += max_name;
 
-  /* sort our values using bitonic sort algorithm -- 
-   * O(log^2 N) communication */
+  /* sort once by (string,color,rank) -- O(log^2 N) communication */
   lwgrp_sort_bitonic(
-    buf, buf_size, max_len, cmp_str_int, comm
+    buf, buf_size, max_len, cmp_str_int_int, comm
   );
 
-  /* now split our sorted values by comparing our value with our
-   * left and right neighbors to determine group boundaries --
-   * O(log N) communication */
-  lwgrp* newgroup = lwgrp_split_sorted(
-    buf, buf_size, max_len, cmp_str, comm
-  );
+  /* both levels are contiguous in the sorted order, so we split
+   * the same sorted items twice, with the rank just after the color */
+  size_t offset = max_len + sizeof(int64_t);
+  *outer = lwgrp_split_sorted(buf, buf_size, offset, cmp_str, comm);
+  *inner = lwgrp_split_sorted(buf, buf_size, offset, cmp_str_color, comm);
 
-  /* free memory allocated for buffer */
   spawn_free(&buf);
 
-  return newgroup;
+  return LWGRP_SUCCESS;
 }
 
-int lwgrp_shift_blocking(
-  const void* buf,
-  void* left,
-  void* right,
-  size_t buf_size,
-  const lwgrp* group)
+lwgrp* lwgrp_reorder(const lwgrp* group, const char* locality)
 {
-  int64_t rank  = group->rank;
-  int64_t ranks = group->size;
-
-  if (rank & 0x1) {
-    /* we're an odd rank */
-
-    /* exchange data with left partner */
-    /* recv then send */
-    if (rank - 1 >= 0) {
-      spawn_net_channel* ch = group->list_left[0];
-      spawn_net_read(ch, left, buf_size);
-      spawn_net_write(ch, buf, buf_size);
-    }
-
-    /* exchange data with right partner */
-    /* send then recv */
-    if (rank + 1 < ranks) {
-      spawn_net_channel* ch = group->list_right[0];
-      spawn_net_write(ch, buf, buf_size);
-      spawn_net_read(ch, right, buf_size);
-    }
-  } else {
-    /* we're an even rank */
-
-    /* exchange data with right partner */
-    /* send then recv */
-    if (rank + 1 < ranks) {
-      spawn_net_channel* ch = group->list_right[0];
-      spawn_net_write(ch, buf, buf_size);
-      spawn_net_read(ch, right, buf_size);
-    }
-
-    /* exchange data with left partner */
-    /* recv then send */
-    if (rank - 1 >= 0) {
-      spawn_net_channel* ch = group->list_left[0];
-      spawn_net_read(ch, left, buf_size);
-      spawn_net_write(ch, buf, buf_size);
-    }
+  /* use our hostname if caller did not give a locality key */
+  char hostname[HOST_NAME_MAX + 1];
+  if (locality == NULL) {
+    if (gethostname(hostname, sizeof(hostname)) < 0) {
+      SPAWN_ERR("Failed gethostname()");
+      return NULL;
+    }
+    hostname[HOST_NAME_MAX] = '\0';
+    locality = hostname;
   }
 
-  return LWGRP_SUCCESS;
+  /* Order procs by locality key and then by rank, keeping all
+   * procs in one group.  Procs with the same key are then
+   * contiguous, so the low rounds, whose partners are close in
+   * rank, stay within a node, and keys like "rack/switch/host"
+   * also keep the middle rounds within a rack. */
+  return lwgrp_sort_str(group, locality, cmp_none);
 }
 
 int lwgrp_shift(
@@ -1394,274 +1553,330 @@ int lwgrp_shift(
   size_t buf_size,
   const lwgrp* group)
 {
-  int64_t rank  = group->rank;
-  int64_t ranks = group->size;
+  lwgrp_xchg xs[2];
+  lwgrp_xchg_pair(xs, group, 0, 1);
 
-  /* send data left */
-  if (rank > 0) {
-    spawn_net_channel* ch = group->list_left[0];
-    spawn_net_write(ch, buf, buf_size);
-  }
+  /* send our data to both sides, and receive data from both sides */
+  lwgrp_xchg_send(&xs[0], buf, buf_size);
+  lwgrp_xchg_recv(&xs[0], left, buf_size);
+  lwgrp_xchg_send(&xs[1], buf, buf_size);
+  lwgrp_xchg_recv(&xs[1], right, buf_size);
 
-  /* send data right */
-  if (rank < ranks - 1) {
-    spawn_net_channel* ch = group->list_right[0];
-    spawn_net_write(ch, buf, buf_size);
-  }
+  return lwgrp_exchange(xs, 2);
+}
 
-  /* recv data from left */
-  if (rank > 0) {
-    spawn_net_channel* ch = group->list_left[0];
-    spawn_net_read(ch, left, buf_size);
-  }
+/* In radix collectives, each proc exchanges data with the procs
+ * j*radix^r hops away on each side for j in [1,radix-1] in round r.
+ * After round r, a proc has data from all procs within radix^(r+1)-1
+ * hops on each side, so the collective completes in log_radix(N)
+ * rounds. */
 
-  /* recv data from right */
-  if (rank < ranks - 1) {
-    spawn_net_channel* ch = group->list_right[0];
-    spawn_net_read(ch, right, buf_size);
-  }
+/* returns channel to partner j*radix^round hops to the left */
+static spawn_net_channel* lwgrp_radix_left(const lwgrp* group, int64_t round, int64_t j)
+{
+  return group->radix_left[round * (group->radix - 1) + (j - 1)];
+}
 
-  return LWGRP_SUCCESS;
+/* returns channel to partner j*radix^round hops to the right */
+static spawn_net_channel* lwgrp_radix_right(const lwgrp* group, int64_t round, int64_t j)
+{
+  return group->radix_right[round * (group->radix - 1) + (j - 1)];
 }
 
-int lwgrp_barrier_blocking(const lwgrp* group)
+static int lwgrp_barrier_radix(const lwgrp* group)
 {
   int64_t rank  = group->rank;
   int64_t ranks = group->size;
+  int64_t radix = group->radix;
 
   char c = 'A';
   void* buf = (void*) &c;
   size_t buf_size = 1;
 
-  int round = 0;
-  int64_t dist = 1;
-  while (dist < ranks) {
-    /* compute our relative rank for this round */
-    int64_t relrank  = (rank >> round);
-
-    if (relrank & 0x1) {
-      /* we're odd in this round */
-
-      /* exchange data with left partner */
+  int64_t j;
+  int64_t round = 0;
+  int64_t base = 1;
+  while (base < ranks) {
+    /* send message to each partner */
+    for (j = 1; j < radix && j * base < ranks; j++) {
+      int64_t dist = j * base;
       if (rank - dist >= 0) {
-        /* recv then send */
-        spawn_net_channel* ch = group->list_left[round];
-        spawn_net_read(ch, buf, buf_size);
-        spawn_net_write(ch, buf, buf_size);
-      }
-
-      /* exchange data with right partner */
-      if (rank + dist < ranks) {
-        /* send then recv */
-        spawn_net_channel* ch = group->list_right[round];
-        spawn_net_write(ch, buf, buf_size);
-        spawn_net_read(ch, buf, buf_size);
+        spawn_net_write(lwgrp_radix_left(group, round, j), buf, buf_size);
       }
-    } else {
-      /* we're even in this round */
-
-      /* exchange data with right partner */
       if (rank + dist < ranks) {
-        /* send then recv */
-        spawn_net_channel* ch = group->list_right[round];
-        spawn_net_write(ch, buf, buf_size);
-        spawn_net_read(ch, buf, buf_size);
+        spawn_net_write(lwgrp_radix_right(group, round, j), buf, buf_size);
       }
+    }
 
-      /* exchange data with left partner */
+    /* recv message from each partner */
+    for (j = 1; j < radix && j * base < ranks; j++) {
+      int64_t dist = j * base;
       if (rank - dist >= 0) {
-        /* recv then send */
-        spawn_net_channel* ch = group->list_left[round];
-        spawn_net_read(ch, buf, buf_size);
-        spawn_net_write(ch, buf, buf_size);
+        spawn_net_read(lwgrp_radix_left(group, round, j), buf, buf_size);
+      }
+      if (rank + dist < ranks) {
+        spawn_net_read(lwgrp_radix_right(group, round, j), buf, buf_size);
       }
     }
 
-    dist <<= 1;
+    base *= radix;
     round++;
   }
 
   return LWGRP_SUCCESS;
 }
 
-int lwgrp_barrier(const lwgrp* group)
+/* prepare exchange with all partners in the given round, partner j
+ * on the left is at xs[2*(j-1)] and on the right at xs[2*(j-1)+1] */
+static void lwgrp_xchg_radix(lwgrp_xchg* xs, const lwgrp* group, int64_t round, int64_t base)
 {
   int64_t rank  = group->rank;
   int64_t ranks = group->size;
 
-  char c = 'A';
-  void* buf = (void*) &c;
-  size_t buf_size = 1;
-
-  int round = 0;
-  int64_t dist = 1;
-  while (dist < ranks) {
-    /* send message left */
-    if (rank - dist >= 0) {
-      spawn_net_channel* ch = group->list_left[round];
-      spawn_net_write(ch, buf, buf_size);
+  int64_t j;
+  for (j = 1; j < group->radix; j++) {
+    int64_t dist = j * base;
+    lwgrp_xchg* left  = &xs[2 * (j - 1)];
+    lwgrp_xchg* right = &xs[2 * (j - 1) + 1];
+    lwgrp_xchg_init(left,  NULL);
+    lwgrp_xchg_init(right, NULL);
+    if (dist < ranks && rank - dist >= 0) {
+      lwgrp_xchg_init(left, lwgrp_radix_left(group, round, j));
     }
-
-    /* send message right */
-    if (rank + dist < ranks) {
-      spawn_net_channel* ch = group->list_right[round];
-      spawn_net_write(ch, buf, buf_size);
+    if (dist < ranks && rank + dist < ranks) {
+      lwgrp_xchg_init(right, lwgrp_radix_right(group, round, j));
     }
-
-    /* recv message from left */
-    if (rank - dist >= 0) {
-      spawn_net_channel* ch = group->list_left[round];
-      spawn_net_read(ch, buf, buf_size);
-    }
-
-    /* recv message from right */
-    if (rank + dist < ranks) {
-      spawn_net_channel* ch = group->list_right[round];
-      spawn_net_read(ch, buf, buf_size);
-    }
-
-    dist <<= 1;
-    round++;
   }
-
-  return LWGRP_SUCCESS;
 }
 
-int lwgrp_allreduce_uint64_sum_blocking(uint64_t* buf, uint64_t count, const lwgrp* group)
+/* computes left-to-right and right-to-left inclusive sums,
+ * in round r, each proc holds the sum of the radix^r procs ending
+ * with itself on each side, so summing values from the procs
+ * j*radix^r hops away for j in [0,radix-1] covers radix^(r+1) procs
+ * without overlap */
+static int lwgrp_double_scan_uint64_sum_radix(const uint64_t* buf, uint64_t* ltr, uint64_t* rtl, uint64_t count, const lwgrp* group)
 {
-  size_t buf_size = count * sizeof(uint64_t);
-  uint64_t* left_buf  = SPAWN_MALLOC(buf_size);
-  uint64_t* right_buf = SPAWN_MALLOC(buf_size);
+  int64_t ranks = group->size;
+  int64_t radix = group->radix;
+  int nxs = (int) (2 * (radix - 1));
 
-  int rc = lwgrp_double_scan_uint64_sum_blocking(buf, left_buf, right_buf, count, group);
+  size_t buf_size = count * sizeof(uint64_t);
+  uint64_t* left_send  = SPAWN_MALLOC(buf_size);
+  uint64_t* right_send = SPAWN_MALLOC(buf_size);
+  uint64_t* recv = SPAWN_MALLOC(buf_size * nxs);
+  lwgrp_xchg* xs = (lwgrp_xchg*) SPAWN_MALLOC(nxs * sizeof(lwgrp_xchg));
 
-  /* set output buffer to be sum of left and right values,
-   * minus our input buffer to avoid double counting */
-  int i;
+  /* initialize outgoing buffers */
+  uint64_t i;
   for (i = 0; i < count; i++) {
-    buf[i] = left_buf[i] + right_buf[i] - buf[i];
+      left_send[i]  = buf[i];
+      right_send[i] = buf[i];
   }
 
-  spawn_free(&right_buf);
-  spawn_free(&left_buf);
-
-  return rc;
-}
-
-int lwgrp_allreduce_uint64_sum(uint64_t* buf, uint64_t count, const lwgrp* group)
-{
-  size_t buf_size = count * sizeof(uint64_t);
-  uint64_t* left_buf  = SPAWN_MALLOC(buf_size);
-  uint64_t* right_buf = SPAWN_MALLOC(buf_size);
+  int k;
+  int64_t round = 0;
+  int64_t base = 1;
+  while (base < ranks) {
+    /* send partial sums to each partner and recv theirs */
+    lwgrp_xchg_radix(xs, group, round, base);
+    for (k = 0; k < nxs; k++) {
+      uint64_t* send = (k & 1) ? right_send : left_send;
+      lwgrp_xchg_send(&xs[k], send, buf_size);
+      lwgrp_xchg_recv(&xs[k], recv + k * count, buf_size);
+    }
+    lwgrp_exchange(xs, nxs);
+
+    /* add values from left partners into our left-to-right sum
+     * and values from right partners into our right-to-left sum */
+    for (k = 0; k < nxs; k++) {
+      if (xs[k].ch == NULL) {
+        continue;
+      }
+      uint64_t* sum = (k & 1) ? left_send : right_send;
+      uint64_t* ptr = recv + k * count;
+      for (i = 0; i < count; i++) {
+        sum[i] += ptr[i];
+      }
+    }
 
-  int rc = lwgrp_double_scan_uint64_sum(buf, left_buf, right_buf, count, group);
+    base *= radix;
+    round++;
+  }
 
-  /* set output buffer to be sum of left and right values,
-   * minus our input buffer to avoid double counting */
-  int i;
   for (i = 0; i < count; i++) {
-    buf[i] = left_buf[i] + right_buf[i] - buf[i];
+    ltr[i] = right_send[i];
+    rtl[i] = left_send[i];
   }
 
-  spawn_free(&right_buf);
-  spawn_free(&left_buf);
+  spawn_free(&xs);
+  spawn_free(&recv);
+  spawn_free(&right_send);
+  spawn_free(&left_send);
 
-  return rc;
+  return LWGRP_SUCCESS;
 }
 
-int lwgrp_allreduce_uint64_max_blocking(uint64_t* buf, uint64_t count, const lwgrp* group)
+static int lwgrp_allreduce_uint64_max_radix(uint64_t* buf, uint64_t count, const lwgrp* group)
 {
-  int64_t rank  = group->rank;
   int64_t ranks = group->size;
+  int64_t radix = group->radix;
+  int nxs = (int) (2 * (radix - 1));
 
   size_t buf_size = count * sizeof(uint64_t);
-  uint64_t* left_buf  = SPAWN_MALLOC(buf_size);
-  uint64_t* right_buf = SPAWN_MALLOC(buf_size);
+  uint64_t* recv = SPAWN_MALLOC(buf_size * nxs);
+  lwgrp_xchg* xs = (lwgrp_xchg*) SPAWN_MALLOC(nxs * sizeof(lwgrp_xchg));
+
+  uint64_t i;
+  int k;
+  int64_t round = 0;
+  int64_t base = 1;
+  while (base < ranks) {
+    /* send our current values to each partner and recv theirs */
+    lwgrp_xchg_radix(xs, group, round, base);
+    for (k = 0; k < nxs; k++) {
+      lwgrp_xchg_send(&xs[k], buf, buf_size);
+      lwgrp_xchg_recv(&xs[k], recv + k * count, buf_size);
+    }
+    lwgrp_exchange(xs, nxs);
+
+    /* merge received values with our current values */
+    for (k = 0; k < nxs; k++) {
+      if (xs[k].ch == NULL) {
+        continue;
+      }
+      uint64_t* ptr = recv + k * count;
+      for (i = 0; i < count; i++) {
+        if (ptr[i] > buf[i]) {
+          buf[i] = ptr[i];
+        }
+      }
+    }
 
-  int i;
-  int round = 0;
-  int64_t dist = 1;
-  while (dist < ranks) {
-    /* compute our relative rank for this round */
-    int64_t relrank  = (rank >> round);
+    base *= radix;
+    round++;
+  }
 
-    if (relrank & 0x1) {
-      /* we're odd in this round */
+  spawn_free(&xs);
+  spawn_free(&recv);
 
-      /* exchange data with left partner */
-      if (rank - dist >= 0) {
-        /* recv then send */
-        spawn_net_channel* ch = group->list_left[round];
-        spawn_net_read(ch, left_buf, buf_size);
-        spawn_net_write(ch, buf, buf_size);
-      }
+  return LWGRP_SUCCESS;
+}
 
-      /* exchange data with right partner */
-      if (rank + dist < ranks) {
-        /* send then recv */
-        spawn_net_channel* ch = group->list_right[round];
-        spawn_net_write(ch, buf, buf_size);
-        spawn_net_read(ch, right_buf, buf_size);
-      }
-    } else {
-      /* we're even in this round */
+static int lwgrp_allgather_strmap_radix(strmap* map, const lwgrp* group)
+{
+  int64_t ranks = group->size;
+  int64_t radix = group->radix;
+  int nxs = (int) (2 * (radix - 1));
 
-      /* exchange data with right partner */
-      if (rank + dist < ranks) {
-        /* send then recv */
-        spawn_net_channel* ch = group->list_right[round];
-        spawn_net_write(ch, buf, buf_size);
-        spawn_net_read(ch, right_buf, buf_size);
-      }
+  lwgrp_xchg* xs = (lwgrp_xchg*) SPAWN_MALLOC(nxs * sizeof(lwgrp_xchg));
 
-      /* exchange data with left partner */
-      if (rank - dist >= 0) {
-        /* recv then send */
-        spawn_net_channel* ch = group->list_left[round];
-        spawn_net_read(ch, left_buf, buf_size);
-        spawn_net_write(ch, buf, buf_size);
-      }
+  int k;
+  int64_t round = 0;
+  int64_t base = 1;
+  while (base < ranks) {
+    /* pack our current map */
+    size_t pack_size = strmap_pack_size(map);
+    void* pack_buf = SPAWN_MALLOC(pack_size);
+    strmap_pack(pack_buf, map);
+
+    /* send map to each partner and recv theirs */
+    lwgrp_xchg_radix(xs, group, round, base);
+    for (k = 0; k < nxs; k++) {
+      lwgrp_xchg_send(&xs[k], pack_buf, pack_size);
+      lwgrp_xchg_recv(&xs[k], NULL, 0);
     }
+    lwgrp_exchange(xs, nxs);
 
     /* merge received maps with our current map */
-    if (rank - dist >= 0) {
-      for (i = 0; i < count; i++) {
-        if (left_buf[i] > buf[i]) {
-          buf[i] = left_buf[i];
-        }
-      }
-    }
-    if (rank + dist < ranks) {
-      for (i = 0; i < count; i++) {
-        if (right_buf[i] > buf[i]) {
-          buf[i] = right_buf[i];
-        }
+    for (k = 0; k < nxs; k++) {
+      if (xs[k].recv != NULL) {
+        strmap_unpack(xs[k].recv, map);
+        spawn_free(&xs[k].recv);
       }
     }
+    spawn_free(&pack_buf);
 
-    dist <<= 1;
+    base *= radix;
     round++;
   }
 
-  spawn_free(&right_buf);
-  spawn_free(&left_buf);
+  spawn_free(&xs);
 
   return LWGRP_SUCCESS;
 }
 
-int lwgrp_allreduce_uint64_max(uint64_t* buf, uint64_t count, const lwgrp* group)
+/* tree algorithms reduce to rank 0 and broadcast the result,
+ * which moves less data per proc than dissemination */
+static int lwgrp_barrier_tree(const lwgrp* group)
+{
+  uint64_t token = 0;
+  lwgrp_reduce_uint64_sum(&token, 1, 0, group);
+  lwgrp_bcast(&token, sizeof(token), 0, group);
+  return LWGRP_SUCCESS;
+}
+
+static int lwgrp_allreduce_uint64_tree(uint64_t* buf, uint64_t count, int max, const lwgrp* group)
+{
+  if (! max) {
+    lwgrp_reduce_uint64_sum(buf, count, 0, group);
+  } else {
+    lwgrp_reduce_uint64_max(buf, count, 0, group);
+  }
+  lwgrp_bcast(buf, count * sizeof(uint64_t), 0, group);
+  return LWGRP_SUCCESS;
+}
+
+static int lwgrp_allgather_strmap_tree(strmap* map, const lwgrp* group)
+{
+  lwgrp_gather_strmap(map, 0, group);
+  lwgrp_bcast_strmap(map, 0, group);
+  return LWGRP_SUCCESS;
+}
+
+/* double scan over the 2^d channels */
+static int lwgrp_double_scan_uint64_sum_dissem(const uint64_t* buf, uint64_t* ltr, uint64_t* rtl, uint64_t count, const lwgrp* group)
+{
+  lwgrp_scan_args args;
+  args.count = count;
+  args.type  = LWGRP_TYPE_UINT64;
+  args.op    = LWGRP_OP_SUM;
+  args.bytes = count * sizeof(uint64_t);
+
+  /* both scans start from our own values */
+  memcpy(ltr, buf, args.bytes);
+  memcpy(rtl, buf, args.bytes);
+
+  return lwgrp_scan_rounds(ltr, rtl, args.bytes, lwgrp_scan_fn_op, &args, group);
+}
+
+static int lwgrp_barrier_untraced(const lwgrp* group)
 {
+  /* use shared memory if group has it */
+  if (group->shm != NULL) {
+    return lwgrp_shm_barrier(group);
+  }
+
+  /* pick algorithm from tuning table */
+  lwgrp_alg alg = lwgrp_tune_select(group, LWGRP_COLL_BARRIER, 0);
+  if (alg == LWGRP_ALG_RADIX) {
+    return lwgrp_barrier_radix(group);
+  }
+  if (alg == LWGRP_ALG_TREE) {
+    return lwgrp_barrier_tree(group);
+  }
+
   int64_t rank  = group->rank;
   int64_t ranks = group->size;
 
-  size_t buf_size = count * sizeof(uint64_t);
-  uint64_t* left_buf  = SPAWN_MALLOC(buf_size);
-  uint64_t* right_buf = SPAWN_MALLOC(buf_size);
+  char c = 'A';
+  void* buf = (void*) &c;
+  size_t buf_size = 1;
 
-  int i;
   int round = 0;
   int64_t dist = 1;
   while (dist < ranks) {
+    SPAWN_TRACE_INSTANT("lwgrp_round", round);
+
     /* send message left */
     if (rank - dist >= 0) {
       spawn_net_channel* ch = group->list_left[round];
@@ -1677,132 +1892,124 @@ int lwgrp_allreduce_uint64_max(uint64_t* buf, uint64_t count, const lwgrp* group
     /* recv message from left */
     if (rank - dist >= 0) {
       spawn_net_channel* ch = group->list_left[round];
-      spawn_net_read(ch, left_buf, buf_size);
+      spawn_net_read(ch, buf, buf_size);
     }
 
     /* recv message from right */
     if (rank + dist < ranks) {
       spawn_net_channel* ch = group->list_right[round];
-      spawn_net_read(ch, right_buf, buf_size);
-    }
-
-    /* merge received maps with our current map */
-    if (rank - dist >= 0) {
-      for (i = 0; i < count; i++) {
-        if (left_buf[i] > buf[i]) {
-          buf[i] = left_buf[i];
-        }
-      }
-    }
-    if (rank + dist < ranks) {
-      for (i = 0; i < count; i++) {
-        if (right_buf[i] > buf[i]) {
-          buf[i] = right_buf[i];
-        }
-      }
+      spawn_net_read(ch, buf, buf_size);
     }
 
     dist <<= 1;
     round++;
   }
 
-  spawn_free(&right_buf);
-  spawn_free(&left_buf);
-
   return LWGRP_SUCCESS;
 }
 
-/* compute prefix sum across procs of a vector of uint64_t values */
-int lwgrp_scan_uint64_sum_blocking(uint64_t* buf, uint64_t count, const lwgrp* group)
+int lwgrp_barrier(const lwgrp* group)
 {
-  int64_t rank  = group->rank;
-  int64_t ranks = group->size;
+  SPAWN_TRACE_BEGIN("lwgrp_barrier", group->size);
+  int rc = lwgrp_barrier_untraced(group);
+  SPAWN_TRACE_END("lwgrp_barrier", group->size);
+  return rc;
+}
 
-  size_t buf_size = count * sizeof(uint64_t);
-  uint64_t* recv_buf = SPAWN_MALLOC(buf_size);
+static int lwgrp_allreduce_uint64_sum_untraced(uint64_t* buf, uint64_t count, const lwgrp* group)
+{
+  /* use shared memory if group has it */
+  if (group->shm != NULL) {
+    return lwgrp_shm_allreduce_uint64_sum(buf, count, group);
+  }
 
-  int i;
-  int round = 0;
-  int64_t dist = 1;
-  while (dist < ranks) {
-    /* compute our relative rank for this round */
-    int64_t relrank  = (rank >> round);
+  /* pick algorithm from tuning table */
+  size_t buf_size = count * sizeof(uint64_t);
+  lwgrp_alg alg = lwgrp_tune_select(group, LWGRP_COLL_ALLREDUCE, buf_size);
+  if (alg == LWGRP_ALG_TREE) {
+    return lwgrp_allreduce_uint64_tree(buf, count, 0, group);
+  }
 
-    if (relrank & 0x1) {
-      /* we're odd in this round */
+  uint64_t* left_buf  = SPAWN_MALLOC(buf_size);
+  uint64_t* right_buf = SPAWN_MALLOC(buf_size);
 
-      /* exchange data with left partner */
-      if (rank - dist >= 0) {
-        spawn_net_channel* ch = group->list_left[round];
-        spawn_net_read(ch, recv_buf, buf_size);
-      }
+  int rc;
+  if (alg == LWGRP_ALG_RADIX) {
+    rc = lwgrp_double_scan_uint64_sum_radix(buf, left_buf, right_buf, count, group);
+  } else {
+    rc = lwgrp_double_scan_uint64_sum_dissem(buf, left_buf, right_buf, count, group);
+  }
 
-      /* exchange data with right partner */
-      if (rank + dist < ranks) {
-        spawn_net_channel* ch = group->list_right[round];
-        spawn_net_write(ch, buf, buf_size);
-      }
-    } else {
-      /* we're even in this round */
+  /* set output buffer to be sum of left and right values,
+   * minus our input buffer to avoid double counting */
+  int i;
+  for (i = 0; i < count; i++) {
+    buf[i] = left_buf[i] + right_buf[i] - buf[i];
+  }
 
-      /* exchange data with right partner */
-      if (rank + dist < ranks) {
-        spawn_net_channel* ch = group->list_right[round];
-        spawn_net_write(ch, buf, buf_size);
-      }
+  spawn_free(&right_buf);
+  spawn_free(&left_buf);
 
-      /* exchange data with left partner */
-      if (rank - dist >= 0) {
-        spawn_net_channel* ch = group->list_left[round];
-        spawn_net_read(ch, recv_buf, buf_size);
-      }
-    }
+  return rc;
+}
 
-    /* merge received maps with our current map */
-    if (rank - dist >= 0) {
-      for (i = 0; i < count; i++) {
-        buf[i] += recv_buf[i];
-      }
-    }
+int lwgrp_allreduce_uint64_sum(uint64_t* buf, uint64_t count, const lwgrp* group)
+{
+  SPAWN_TRACE_BEGIN("lwgrp_allreduce_uint64_sum", (int64_t) count);
+  int rc = lwgrp_allreduce_uint64_sum_untraced(buf, count, group);
+  SPAWN_TRACE_END("lwgrp_allreduce_uint64_sum", (int64_t) count);
+  return rc;
+}
 
-    dist <<= 1;
-    round++;
+static int lwgrp_allreduce_uint64_max_untraced(uint64_t* buf, uint64_t count, const lwgrp* group)
+{
+  /* use shared memory if group has it */
+  if (group->shm != NULL) {
+    return lwgrp_shm_allreduce_uint64_max(buf, count, group);
   }
 
-  spawn_free(&recv_buf);
-
-  return LWGRP_SUCCESS;
-}
+  /* pick algorithm from tuning table */
+  lwgrp_alg alg = lwgrp_tune_select(group, LWGRP_COLL_ALLREDUCE, count * sizeof(uint64_t));
+  if (alg == LWGRP_ALG_RADIX) {
+    return lwgrp_allreduce_uint64_max_radix(buf, count, group);
+  }
+  if (alg == LWGRP_ALG_TREE) {
+    return lwgrp_allreduce_uint64_tree(buf, count, 1, group);
+  }
 
-/* compute prefix sum across procs of a vector of uint64_t values */
-int lwgrp_scan_uint64_sum(uint64_t* buf, uint64_t count, const lwgrp* group)
-{
   int64_t rank  = group->rank;
   int64_t ranks = group->size;
 
   size_t buf_size = count * sizeof(uint64_t);
-  uint64_t* recv_buf = SPAWN_MALLOC(buf_size);
+  uint64_t* left_buf  = SPAWN_MALLOC(buf_size);
+  uint64_t* right_buf = SPAWN_MALLOC(buf_size);
 
   int i;
   int round = 0;
   int64_t dist = 1;
   while (dist < ranks) {
-    /* exchange data with right partner */
-    if (rank + dist < ranks) {
-      spawn_net_channel* ch = group->list_right[round];
-      spawn_net_write(ch, buf, buf_size);
-    }
-
-    /* exchange data with left partner */
-    if (rank - dist >= 0) {
-      spawn_net_channel* ch = group->list_left[round];
-      spawn_net_read(ch, recv_buf, buf_size);
-    }
+    /* exchange values with left and right partners */
+    lwgrp_xchg xs[2];
+    lwgrp_xchg_pair(xs, group, round, dist);
+    lwgrp_xchg_send(&xs[0], buf, buf_size);
+    lwgrp_xchg_recv(&xs[0], left_buf, buf_size);
+    lwgrp_xchg_send(&xs[1], buf, buf_size);
+    lwgrp_xchg_recv(&xs[1], right_buf, buf_size);
+    lwgrp_exchange(xs, 2);
 
     /* merge received maps with our current map */
     if (rank - dist >= 0) {
       for (i = 0; i < count; i++) {
-        buf[i] += recv_buf[i];
+        if (left_buf[i] > buf[i]) {
+          buf[i] = left_buf[i];
+        }
+      }
+    }
+    if (rank + dist < ranks) {
+      for (i = 0; i < count; i++) {
+        if (right_buf[i] > buf[i]) {
+          buf[i] = right_buf[i];
+        }
       }
     }
 
@@ -1810,288 +2017,1512 @@ int lwgrp_scan_uint64_sum(uint64_t* buf, uint64_t count, const lwgrp* group)
     round++;
   }
 
-  spawn_free(&recv_buf);
+  spawn_free(&right_buf);
+  spawn_free(&left_buf);
 
   return LWGRP_SUCCESS;
 }
 
-int lwgrp_double_scan_uint64_sum_blocking(const uint64_t* buf, uint64_t* ltr, uint64_t* rtl, uint64_t count, const lwgrp* group)
+int lwgrp_allreduce_uint64_max(uint64_t* buf, uint64_t count, const lwgrp* group)
 {
-  int64_t rank  = group->rank;
-  int64_t ranks = group->size;
-
-  size_t buf_size = count * sizeof(uint64_t);
-  uint64_t* left_send  = SPAWN_MALLOC(buf_size);
-  uint64_t* left_recv  = SPAWN_MALLOC(buf_size);
-  uint64_t* right_send = SPAWN_MALLOC(buf_size);
-  uint64_t* right_recv = SPAWN_MALLOC(buf_size);
+  SPAWN_TRACE_BEGIN("lwgrp_allreduce_uint64_max", (int64_t) count);
+  int rc = lwgrp_allreduce_uint64_max_untraced(buf, count, group);
+  SPAWN_TRACE_END("lwgrp_allreduce_uint64_max", (int64_t) count);
+  return rc;
+}
 
-  /* initialize outgoing buffers */
-  int i;
-  for (i = 0; i < count; i++) {
-      left_send[i]  = buf[i];
-      right_send[i] = buf[i];
+/* compute prefix sum across procs of a vector of uint64_t values */
+int lwgrp_scan_uint64_sum(uint64_t* buf, uint64_t count, const lwgrp* group)
+{
+  return lwgrp_scan(buf, buf, count, LWGRP_TYPE_UINT64, LWGRP_OP_SUM, group);
+}
+
+int lwgrp_scan(
+  const void* sendbuf,
+  void* recvbuf,
+  uint64_t count,
+  lwgrp_type type,
+  lwgrp_op op,
+  const lwgrp* group)
+{
+  lwgrp_scan_args args;
+  args.count = count;
+  args.type  = type;
+  args.op    = op;
+  args.bytes = count * lwgrp_type_size(type);
+
+  if (recvbuf != sendbuf) {
+    memcpy(recvbuf, sendbuf, args.bytes);
+  }
+
+  return lwgrp_scan_rounds(recvbuf, NULL, args.bytes, lwgrp_scan_fn_op, &args, group);
+}
+
+int lwgrp_exscan(
+  const void* sendbuf,
+  void* recvbuf,
+  uint64_t count,
+  lwgrp_type type,
+  lwgrp_op op,
+  const lwgrp* group)
+{
+  lwgrp_scan_args args;
+  args.count = count;
+  args.type  = type;
+  args.op    = op;
+  args.bytes = count * lwgrp_type_size(type);
+
+  /* scan exclusive and inclusive results together,
+   * the exclusive result starts as the identity */
+  char* buf = (char*) SPAWN_MALLOC(2 * args.bytes);
+  lwgrp_op_identity(buf, count, type, op);
+  memcpy(buf + args.bytes, sendbuf, args.bytes);
+
+  int rc = lwgrp_scan_rounds(buf, NULL, 2 * args.bytes, lwgrp_scan_fn_exscan, &args, group);
+
+  memcpy(recvbuf, buf, args.bytes);
+  spawn_free(&buf);
+
+  return rc;
+}
+
+int lwgrp_segmented_scan(
+  int flag,
+  const void* sendbuf,
+  void* recvbuf,
+  uint64_t count,
+  lwgrp_type type,
+  lwgrp_op op,
+  const lwgrp* group)
+{
+  lwgrp_scan_args args;
+  args.count = count;
+  args.type  = type;
+  args.op    = op;
+  args.bytes = count * lwgrp_type_size(type);
+
+  /* scan our flag along with our values */
+  char* buf = (char*) SPAWN_MALLOC(sizeof(uint64_t) + args.bytes);
+  uint64_t* flag_ptr = (uint64_t*) buf;
+  *flag_ptr = (flag != 0);
+  memcpy(buf + sizeof(uint64_t), sendbuf, args.bytes);
+
+  int rc = lwgrp_scan_rounds(buf, NULL, sizeof(uint64_t) + args.bytes, lwgrp_scan_fn_segmented, &args, group);
+
+  memcpy(recvbuf, buf + sizeof(uint64_t), args.bytes);
+  spawn_free(&buf);
+
+  return rc;
+}
+
+int lwgrp_double_scan_uint64_sum(const uint64_t* buf, uint64_t* ltr, uint64_t* rtl, uint64_t count, const lwgrp* group)
+{
+  /* use radix algorithm if group has one */
+  if (group->radix > 2) {
+    return lwgrp_double_scan_uint64_sum_radix(buf, ltr, rtl, count, group);
   }
 
+  return lwgrp_double_scan_uint64_sum_dissem(buf, ltr, rtl, count, group);
+}
+
+static int lwgrp_allgather_strmap_untraced(strmap* map, const lwgrp* group)
+{
+  /* procs must agree on the map size if the tuning table picks
+   * algorithms by size, since each proc holds a different map */
+  size_t bytes = 0;
+  if (lwgrp_tune_sized(group, LWGRP_COLL_ALLGATHER)) {
+    uint64_t max_size = (uint64_t) strmap_pack_size(map);
+    lwgrp_allreduce_uint64_max(&max_size, 1, group);
+    bytes = (size_t) max_size;
+  }
+
+  /* pick algorithm from tuning table */
+  lwgrp_alg alg = lwgrp_tune_select(group, LWGRP_COLL_ALLGATHER, bytes);
+  if (alg == LWGRP_ALG_RADIX) {
+    return lwgrp_allgather_strmap_radix(map, group);
+  }
+  if (alg == LWGRP_ALG_TREE) {
+    return lwgrp_allgather_strmap_tree(map, group);
+  }
+
+  int64_t ranks = group->size;
+
   int round = 0;
   int64_t dist = 1;
   while (dist < ranks) {
-    /* compute our relative rank for this round */
-    int64_t relrank  = (rank >> round);
+    /* pack our current map */
+    size_t pack_size = strmap_pack_size(map);
+    void* pack_buf = SPAWN_MALLOC(pack_size);
+    strmap_pack(pack_buf, map);
+
+    /* exchange maps with left and right partners */
+    lwgrp_xchg xs[2];
+    lwgrp_xchg_pair(xs, group, round, dist);
+    lwgrp_xchg_send(&xs[0], pack_buf, pack_size);
+    lwgrp_xchg_recv(&xs[0], NULL, 0);
+    lwgrp_xchg_send(&xs[1], pack_buf, pack_size);
+    lwgrp_xchg_recv(&xs[1], NULL, 0);
+    lwgrp_exchange(xs, 2);
 
-    if (relrank & 0x1) {
-      /* we're odd in this round */
-
-      /* exchange data with left partner */
-      if (rank - dist >= 0) {
-        /* recv then send */
-        spawn_net_channel* ch = group->list_left[round];
-        spawn_net_read(ch, left_recv, buf_size);
-        spawn_net_write(ch, left_send, buf_size);
+    /* merge received maps with our current map */
+    int i;
+    for (i = 0; i < 2; i++) {
+      if (xs[i].recv != NULL) {
+        strmap_unpack(xs[i].recv, map);
+        spawn_free(&xs[i].recv);
       }
+    }
+    spawn_free(&pack_buf);
 
-      /* exchange data with right partner */
-      if (rank + dist < ranks) {
-        /* send then recv */
-        spawn_net_channel* ch = group->list_right[round];
-        spawn_net_write(ch, right_send, buf_size);
-        spawn_net_read(ch, right_recv, buf_size);
-      }
-    } else {
-      /* we're even in this round */
+    dist <<= 1;
+    round++;
+  }
 
-      /* exchange data with right partner */
-      if (rank + dist < ranks) {
-        /* send then recv */
-        spawn_net_channel* ch = group->list_right[round];
-        spawn_net_write(ch, right_send, buf_size);
-        spawn_net_read(ch, right_recv, buf_size);
-      }
+  return LWGRP_SUCCESS;
+}
 
-      /* exchange data with left partner */
-      if (rank - dist >= 0) {
-        /* recv then send */
-        spawn_net_channel* ch = group->list_left[round];
-        spawn_net_read(ch, left_recv, buf_size);
-        spawn_net_write(ch, left_send, buf_size);
+int lwgrp_allgather_strmap(strmap* map, const lwgrp* group)
+{
+  SPAWN_TRACE_BEGIN("lwgrp_allgather_strmap", group->size);
+  int rc = lwgrp_allgather_strmap_untraced(map, group);
+  SPAWN_TRACE_END("lwgrp_allgather_strmap", group->size);
+  return rc;
+}
+
+/* after the round with distance 2^d, each proc holds the blocks of
+ * all procs within 2^(d+1)-1 hops, so partners can compute which
+ * blocks the other is missing and send just those */
+static int lwgrp_allgather_untraced(const void* sendbuf, void* recvbuf, size_t size, const lwgrp* group)
+{
+  /* use shared memory if group has it */
+  if (group->shm != NULL) {
+    return lwgrp_shm_allgather(sendbuf, recvbuf, size, group);
+  }
+
+  int64_t rank  = group->rank;
+  int64_t ranks = group->size;
+
+  /* copy our own block into place */
+  char* buf = (char*) recvbuf;
+  memcpy(buf + rank * size, sendbuf, size);
+
+  /* range of blocks we have */
+  int64_t lo = rank;
+  int64_t hi = rank;
+
+  int round = 0;
+  int64_t dist = 1;
+  while (dist < ranks) {
+    /* after this round, we'll hold blocks within 2*dist-1 hops */
+    int64_t next_lo = rank - 2 * dist + 1;
+    if (next_lo < 0) {
+      next_lo = 0;
+    }
+    int64_t next_hi = rank + 2 * dist - 1;
+    if (next_hi > ranks - 1) {
+      next_hi = ranks - 1;
+    }
+
+    /* left partner already holds blocks up to our rank - 1,
+     * and it sends us the blocks below our current range,
+     * the mirror holds for our right partner */
+    lwgrp_xchg xs[2];
+    lwgrp_xchg_pair(xs, group, round, dist);
+    lwgrp_xchg_send(&xs[0], buf + rank * size, (size_t) (hi - rank + 1) * size);
+    lwgrp_xchg_recv(&xs[0], buf + next_lo * size, (size_t) (lo - next_lo) * size);
+    lwgrp_xchg_send(&xs[1], buf + lo * size, (size_t) (rank - lo + 1) * size);
+    lwgrp_xchg_recv(&xs[1], buf + (hi + 1) * size, (size_t) (next_hi - hi) * size);
+    lwgrp_exchange(xs, 2);
+
+    lo = next_lo;
+    hi = next_hi;
+
+    dist <<= 1;
+    round++;
+  }
+
+  return LWGRP_SUCCESS;
+}
+
+int lwgrp_allgather(const void* sendbuf, void* recvbuf, size_t size, const lwgrp* group)
+{
+  SPAWN_TRACE_BEGIN("lwgrp_allgather", (int64_t) size);
+  int rc = lwgrp_allgather_untraced(sendbuf, recvbuf, size, group);
+  SPAWN_TRACE_END("lwgrp_allgather", (int64_t) size);
+  return rc;
+}
+
+/* Rooted collectives use a binomial tree on each side of the root.
+ * Procs to the right of the root number themselves i = rank - root,
+ * and in the round with distance 2^d, proc i < 2^d exchanges data
+ * with proc i + 2^d over the 2^d channels.  Procs to the left of the
+ * root do the same with left and right swapped, and the root is
+ * proc 0 on both sides.  Each side is described by the channels
+ * leading away from the root (to children) and the channels leading
+ * back toward the root (to parents). */
+
+/* forward data from proc 0 to all n procs on one side of root */
+static void lwgrp_bcast_side(
+  void* buf, size_t buf_size, int64_t i, int64_t n,
+  spawn_net_channel** children, spawn_net_channel** parents)
+{
+  int round = 0;
+  int64_t dist = 1;
+  while (dist < n) {
+    if (i < dist) {
+      /* we have the data, send it to our child if we have one */
+      if (i + dist < n) {
+        spawn_net_write(children[round], buf, buf_size);
       }
+    } else if (i < dist * 2) {
+      /* get data from our parent */
+      spawn_net_read(parents[round], buf, buf_size);
     }
 
-    /* merge received maps with our current map */
-    if (rank - dist >= 0) {
-      for (i = 0; i < count; i++) {
-        right_send[i] += left_recv[i];
+    dist <<= 1;
+    round++;
+  }
+}
+
+/* forward map from proc 0 to all n procs on one side of root */
+static void lwgrp_bcast_strmap_side(
+  strmap* map, int64_t i, int64_t n,
+  spawn_net_channel** children, spawn_net_channel** parents)
+{
+  int round = 0;
+  int64_t dist = 1;
+  while (dist < n) {
+    if (i < dist) {
+      /* we have the map, send it to our child if we have one */
+      if (i + dist < n) {
+        spawn_net_write_strmap(children[round], map);
       }
+    } else if (i < dist * 2) {
+      /* get map from our parent */
+      spawn_net_read_strmap(parents[round], map);
     }
-    if (rank + dist < ranks) {
-      for (i = 0; i < count; i++) {
-        left_send[i] += right_recv[i];
+
+    dist <<= 1;
+    round++;
+  }
+}
+
+/* merge maps from all n procs on one side of root into proc 0,
+ * runs the rounds of the broadcast tree in reverse order, values
+ * for duplicate keys are combined with fn if given, otherwise the
+ * value from the child wins */
+static void lwgrp_gather_strmap_side(
+  strmap* map, strmap_combine_fn fn, int64_t i, int64_t n,
+  spawn_net_channel** children, spawn_net_channel** parents)
+{
+  /* find the first round that is not needed */
+  int round = 0;
+  int64_t dist = 1;
+  while (dist < n) {
+    dist <<= 1;
+    round++;
+  }
+
+  while (round > 0) {
+    dist >>= 1;
+    round--;
+
+    if (i < dist) {
+      /* merge map from our child if we have one */
+      if (i + dist < n) {
+        strmap* tmp = strmap_new();
+        spawn_net_read_strmap(children[round], tmp);
+        if (fn != NULL) {
+          strmap_merge_combine(map, tmp, fn);
+        } else {
+          strmap_merge(map, tmp);
+        }
+        strmap_delete(&tmp);
       }
+    } else if (i < dist * 2) {
+      /* we have merged maps from all of our children,
+       * send result to our parent */
+      spawn_net_write_strmap(parents[round], map);
     }
+  }
+}
+
+/* reduce values from all n procs on one side of root into proc 0,
+ * runs the rounds of the broadcast tree in reverse order */
+static void lwgrp_reduce_uint64_side(
+  uint64_t* buf, uint64_t count, int max, int64_t i, int64_t n,
+  spawn_net_channel** children, spawn_net_channel** parents)
+{
+  size_t buf_size = count * sizeof(uint64_t);
+  uint64_t* recv = SPAWN_MALLOC(buf_size);
 
+  /* find the first round that is not needed */
+  int round = 0;
+  int64_t dist = 1;
+  while (dist < n) {
     dist <<= 1;
     round++;
   }
 
-  for (i = 0; i < count; i++) {
-    ltr[i] = right_send[i];
-    rtl[i] = left_send[i];
+  uint64_t j;
+  while (round > 0) {
+    dist >>= 1;
+    round--;
+
+    if (i < dist) {
+      /* merge values from our child if we have one */
+      if (i + dist < n) {
+        spawn_net_read(children[round], recv, buf_size);
+        for (j = 0; j < count; j++) {
+          if (! max) {
+            buf[j] += recv[j];
+          } else if (recv[j] > buf[j]) {
+            buf[j] = recv[j];
+          }
+        }
+      }
+    } else if (i < dist * 2) {
+      /* we have values from all of our children,
+       * send result to our parent */
+      spawn_net_write(parents[round], buf, buf_size);
+    }
   }
 
-  spawn_free(&right_recv);
-  spawn_free(&right_send);
-  spawn_free(&left_recv);
-  spawn_free(&left_send);
+  spawn_free(&recv);
+}
+
+static int lwgrp_bcast_untraced(void* buf, size_t buf_size, int64_t root, const lwgrp* group)
+{
+  /* use shared memory if group has it */
+  if (group->shm != NULL) {
+    return lwgrp_shm_bcast(buf, buf_size, root, group);
+  }
+
+  int64_t rank  = group->rank;
+  int64_t ranks = group->size;
+
+  /* procs from root to the end of the group */
+  if (rank >= root) {
+    lwgrp_bcast_side(buf, buf_size, rank - root, ranks - root,
+      group->list_right, group->list_left
+    );
+  }
+
+  /* procs from the start of the group to the root */
+  if (rank <= root) {
+    lwgrp_bcast_side(buf, buf_size, root - rank, root + 1,
+      group->list_left, group->list_right
+    );
+  }
 
   return LWGRP_SUCCESS;
 }
 
-int lwgrp_double_scan_uint64_sum(const uint64_t* buf, uint64_t* ltr, uint64_t* rtl, uint64_t count, const lwgrp* group)
+int lwgrp_bcast(void* buf, size_t buf_size, int64_t root, const lwgrp* group)
+{
+  SPAWN_TRACE_BEGIN("lwgrp_bcast", (int64_t) buf_size);
+  int rc = lwgrp_bcast_untraced(buf, buf_size, root, group);
+  SPAWN_TRACE_END("lwgrp_bcast", (int64_t) buf_size);
+  return rc;
+}
+
+int lwgrp_bcast_strmap(strmap* map, int64_t root, const lwgrp* group)
 {
   int64_t rank  = group->rank;
   int64_t ranks = group->size;
 
-  size_t buf_size = count * sizeof(uint64_t);
-  uint64_t* left_send  = SPAWN_MALLOC(buf_size);
-  uint64_t* left_recv  = SPAWN_MALLOC(buf_size);
-  uint64_t* right_send = SPAWN_MALLOC(buf_size);
-  uint64_t* right_recv = SPAWN_MALLOC(buf_size);
+  /* procs from root to the end of the group */
+  if (rank >= root) {
+    lwgrp_bcast_strmap_side(map, rank - root, ranks - root,
+      group->list_right, group->list_left
+    );
+  }
 
-  /* initialize outgoing buffers */
-  int i;
+  /* procs from the start of the group to the root */
+  if (rank <= root) {
+    lwgrp_bcast_strmap_side(map, root - rank, root + 1,
+      group->list_left, group->list_right
+    );
+  }
+
+  return LWGRP_SUCCESS;
+}
+
+static int lwgrp_gather_strmap_combine(strmap* map, strmap_combine_fn fn, int64_t root, const lwgrp* group)
+{
+  int64_t rank  = group->rank;
+  int64_t ranks = group->size;
+
+  /* procs from root to the end of the group */
+  if (rank >= root) {
+    lwgrp_gather_strmap_side(map, fn, rank - root, ranks - root,
+      group->list_right, group->list_left
+    );
+  }
+
+  /* procs from the start of the group to the root */
+  if (rank <= root) {
+    lwgrp_gather_strmap_side(map, fn, root - rank, root + 1,
+      group->list_left, group->list_right
+    );
+  }
+
+  return LWGRP_SUCCESS;
+}
+
+int lwgrp_gather_strmap(strmap* map, int64_t root, const lwgrp* group)
+{
+  return lwgrp_gather_strmap_combine(map, NULL, root, group);
+}
+
+int lwgrp_reduce_strmap(strmap* map, strmap_combine_fn fn, int64_t root, const lwgrp* group)
+{
+  return lwgrp_gather_strmap_combine(map, fn, root, group);
+}
+
+int lwgrp_allreduce_strmap(strmap* map, strmap_combine_fn fn, const lwgrp* group)
+{
+  /* combine entries up the tree to rank 0, then send the result
+   * back down, every key held by any proc is in the result, so it
+   * replaces all of our values */
+  lwgrp_gather_strmap_combine(map, fn, 0, group);
+  lwgrp_bcast_strmap(map, 0, group);
+  return LWGRP_SUCCESS;
+}
+
+static int lwgrp_reduce_uint64(uint64_t* buf, uint64_t count, int max, int64_t root, const lwgrp* group)
+{
+  int64_t rank  = group->rank;
+  int64_t ranks = group->size;
+
+  /* procs from root to the end of the group */
+  if (rank >= root) {
+    lwgrp_reduce_uint64_side(buf, count, max, rank - root, ranks - root,
+      group->list_right, group->list_left
+    );
+  }
+
+  /* procs from the start of the group to the root */
+  if (rank <= root) {
+    lwgrp_reduce_uint64_side(buf, count, max, root - rank, root + 1,
+      group->list_left, group->list_right
+    );
+  }
+
+  return LWGRP_SUCCESS;
+}
+
+int lwgrp_reduce_uint64_sum(uint64_t* buf, uint64_t count, int64_t root, const lwgrp* group)
+{
+  return lwgrp_reduce_uint64(buf, count, 0, root, group);
+}
+
+int lwgrp_reduce_uint64_max(uint64_t* buf, uint64_t count, int64_t root, const lwgrp* group)
+{
+  return lwgrp_reduce_uint64(buf, count, 1, root, group);
+}
+
+/* alltoall messages are broken into blocks, each records the rank
+ * that contributed the block, the rank it is destined for, and a
+ * pointer to its data */
+typedef struct lwgrp_block_t {
+  int64_t src;      /* rank that contributed the block */
+  int64_t dst;      /* rank the block is destined for */
+  uint64_t size;    /* number of bytes of data in block */
+  const char* data; /* pointer to block data */
+} lwgrp_block;
+
+/* each block is packed with a src, dst, and size header */
+#define LWGRP_BLOCK_HDR_SIZE (3 * 8)
+
+/* once the data held in transit on a process exceeds this many bytes,
+ * alltoall switches from a single Bruck exchange to a sequence of
+ * exchanges, each of which only moves a window of destinations */
+#define LWGRP_ALLTOALL_INFLIGHT (1024 * 1024)
+
+/* pack list of blocks into a newly allocated buffer,
+ * returns buffer and sets its size in bytes */
+static void* lwgrp_blocks_pack(
+  const lwgrp_block* blocks,
+  uint64_t count,
+  size_t* size)
+{
+  /* compute number of bytes needed to pack blocks */
+  size_t bytes = 8;
+  uint64_t i;
   for (i = 0; i < count; i++) {
-      left_send[i]  = buf[i];
-      right_send[i] = buf[i];
+    bytes += LWGRP_BLOCK_HDR_SIZE + (size_t) blocks[i].size;
   }
 
-  int round = 0;
-  int64_t dist = 1;
-  while (dist < ranks) {
-    /* send data left */
-    if (rank - dist >= 0) {
-      spawn_net_channel* ch = group->list_left[round];
-      spawn_net_write(ch, left_send, buf_size);
-    }
+  /* allocate buffer */
+  char* buf = (char*) SPAWN_MALLOC(bytes);
+  char* ptr = buf;
 
-    /* send data right */
-    if (rank + dist < ranks) {
-      /* send then recv */
-      spawn_net_channel* ch = group->list_right[round];
-      spawn_net_write(ch, right_send, buf_size);
-    }
+  /* pack number of blocks followed by headers for each block */
+  ptr += spawn_pack_uint64(ptr, count);
+  for (i = 0; i < count; i++) {
+    ptr += spawn_pack_uint64(ptr, (uint64_t) blocks[i].src);
+    ptr += spawn_pack_uint64(ptr, (uint64_t) blocks[i].dst);
+    ptr += spawn_pack_uint64(ptr, blocks[i].size);
+  }
 
-    /* recv data from left */
-    if (rank - dist >= 0) {
-      spawn_net_channel* ch = group->list_left[round];
-      spawn_net_read(ch, left_recv, buf_size);
+  /* then pack data for each block */
+  for (i = 0; i < count; i++) {
+    size_t block_size = (size_t) blocks[i].size;
+    if (block_size > 0) {
+      memcpy(ptr, blocks[i].data, block_size);
+      ptr += block_size;
     }
+  }
 
-    /* recv data from right */
-    if (rank + dist < ranks) {
-      spawn_net_channel* ch = group->list_right[round];
-      spawn_net_read(ch, right_recv, buf_size);
+  *size = bytes;
+  return buf;
+}
+
+/* unpack blocks from buffer and append them to list,
+ * data pointers refer to memory in buf, returns number of blocks
+ * added to list */
+static uint64_t lwgrp_blocks_unpack(const void* buf, lwgrp_block* blocks)
+{
+  /* get number of blocks */
+  uint64_t count;
+  const char* ptr = (const char*) buf;
+  ptr += spawn_unpack_uint64(ptr, &count);
+
+  /* data for first block starts after all headers */
+  const char* data = ptr + count * LWGRP_BLOCK_HDR_SIZE;
+
+  /* unpack header for each block and point to its data */
+  uint64_t i;
+  for (i = 0; i < count; i++) {
+    uint64_t src, dst, size;
+    ptr += spawn_unpack_uint64(ptr, &src);
+    ptr += spawn_unpack_uint64(ptr, &dst);
+    ptr += spawn_unpack_uint64(ptr, &size);
+    blocks[i].src  = (int64_t) src;
+    blocks[i].dst  = (int64_t) dst;
+    blocks[i].size = size;
+    blocks[i].data = data;
+    data += (size_t) size;
+  }
+
+  return count;
+}
+
+/* returns number of blocks packed in buffer */
+static uint64_t lwgrp_blocks_count(const void* buf)
+{
+  uint64_t count;
+  spawn_unpack_uint64(buf, &count);
+  return count;
+}
+
+/* copy block destined for us into its place in recvbuf, returns
+ * LWGRP_FAILURE if it does not have the size we expect */
+static int lwgrp_block_deliver(
+  const lwgrp_block* block,
+  void* recvbuf,
+  const uint64_t* recvcounts,
+  const uint64_t* recvdispls)
+{
+  int64_t src = block->src;
+  if (block->size != recvcounts[src]) {
+    SPAWN_ERR("Received %llu bytes from rank %lld but expected %llu",
+      (unsigned long long) block->size, (long long) src,
+      (unsigned long long) recvcounts[src]
+    );
+    return LWGRP_FAILURE;
+  }
+  if (block->size > 0) {
+    char* ptr = (char*) recvbuf + recvdispls[src];
+    memcpy(ptr, block->data, (size_t) block->size);
+  }
+  return LWGRP_SUCCESS;
+}
+
+/* Executes a Bruck exchange on blocks for which the distance between
+ * source and destination falls in the range [lo, hi).  Bruck's
+ * algorithm rotates blocks locally so that each is indexed by its
+ * offset from the current rank and then forwards all blocks whose
+ * offset has bit d set to the process 2^d hops away in round d.
+ * Since our chain does not wrap around, we use signed offsets:
+ * blocks with positive offsets are forwarded to the right and blocks
+ * with negative offsets are forwarded to the left.  Each block only
+ * moves towards its destination, so it never leaves the chain.
+ * On input, blocks lists count blocks held by the calling process,
+ * all of which it contributed and which point into its send buffer.
+ * Blocks that reach us are copied to recvbuf as they arrive, and on
+ * output, blocks lists the blocks outside of the range, which never
+ * moved.  Since blocks only move away from their source, a block we
+ * hold points into our send buffer if we contributed it and into a
+ * store of received data otherwise, so each round only copies the
+ * blocks in transit within the range. */
+static int lwgrp_alltoall_bruck(
+  lwgrp_block** pblocks,
+  uint64_t* pcount,
+  int64_t lo,
+  int64_t hi,
+  void* recvbuf,
+  const uint64_t* recvcounts,
+  const uint64_t* recvdispls,
+  const lwgrp* group)
+{
+  int64_t rank  = group->rank;
+  int64_t ranks = group->size;
+
+  lwgrp_block* blocks = *pblocks;
+  uint64_t count = *pcount;
+  char* store = NULL;
+
+  /* allocate space to hold list of blocks we send in each direction,
+   * plus the list of blocks we keep */
+  size_t list_bytes = count * sizeof(lwgrp_block);
+  lwgrp_block* left_blocks  = (lwgrp_block*) SPAWN_MALLOC(list_bytes);
+  lwgrp_block* right_blocks = (lwgrp_block*) SPAWN_MALLOC(list_bytes);
+
+  int rc = LWGRP_SUCCESS;
+  int round = 0;
+  int64_t dist = 1;
+  while (dist < ranks && dist < hi) {
+    /* select blocks that must be forwarded in this round */
+    uint64_t left_count  = 0;
+    uint64_t right_count = 0;
+    uint64_t keep_count  = 0;
+    uint64_t i;
+    for (i = 0; i < count; i++) {
+      /* skip blocks outside of our current window */
+      int64_t offset = blocks[i].dst - rank;
+      int64_t distance = blocks[i].dst - blocks[i].src;
+      if (distance < 0) {
+        distance = -distance;
+      }
+      if (distance < lo || distance >= hi) {
+        blocks[keep_count++] = blocks[i];
+        continue;
+      }
+
+      /* forward block if bit for this round is set in its offset */
+      if (offset > 0 && (offset & dist)) {
+        right_blocks[right_count++] = blocks[i];
+      } else if (offset < 0 && ((-offset) & dist)) {
+        left_blocks[left_count++] = blocks[i];
+      } else {
+        blocks[keep_count++] = blocks[i];
+      }
     }
 
-    /* merge received maps with our current map */
-    if (rank - dist >= 0) {
-      for (i = 0; i < count; i++) {
-        right_send[i] += left_recv[i];
+    /* pack blocks to send in each direction */
+    size_t left_size, right_size;
+    void* left_send  = lwgrp_blocks_pack(left_blocks,  left_count,  &left_size);
+    void* right_send = lwgrp_blocks_pack(right_blocks, right_count, &right_size);
+
+    /* exchange blocks with our partners */
+    lwgrp_xchg xs[2];
+    lwgrp_xchg_pair(xs, group, round, dist);
+    lwgrp_xchg_send(&xs[0], left_send, left_size);
+    lwgrp_xchg_recv(&xs[0], NULL, 0);
+    lwgrp_xchg_send(&xs[1], right_send, right_size);
+    lwgrp_xchg_recv(&xs[1], NULL, 0);
+    lwgrp_exchange(xs, 2);
+    void* left_recv  = xs[0].recv;
+    void* right_recv = xs[1].recv;
+
+    spawn_free(&right_send);
+    spawn_free(&left_send);
+
+    /* count number of blocks we hold after this round */
+    uint64_t new_count = keep_count;
+    if (left_recv != NULL) {
+      new_count += lwgrp_blocks_count(left_recv);
+    }
+    if (right_recv != NULL) {
+      new_count += lwgrp_blocks_count(right_recv);
+    }
+
+    /* grow our block lists if needed */
+    if (new_count > count) {
+      list_bytes = new_count * sizeof(lwgrp_block);
+      lwgrp_block* new_blocks = (lwgrp_block*) SPAWN_MALLOC(list_bytes);
+      memcpy(new_blocks, blocks, keep_count * sizeof(lwgrp_block));
+      spawn_free(&blocks);
+      blocks = new_blocks;
+
+      spawn_free(&left_blocks);
+      spawn_free(&right_blocks);
+      left_blocks  = (lwgrp_block*) SPAWN_MALLOC(list_bytes);
+      right_blocks = (lwgrp_block*) SPAWN_MALLOC(list_bytes);
+    }
+
+    /* append blocks we received */
+    count = keep_count;
+    if (left_recv != NULL) {
+      count += lwgrp_blocks_unpack(left_recv, &blocks[count]);
+    }
+    if (right_recv != NULL) {
+      count += lwgrp_blocks_unpack(right_recv, &blocks[count]);
+    }
+
+    /* deliver blocks that reached us and drop them from our list,
+     * then copy data of blocks still in transit into a new store,
+     * so we can free buffers from earlier rounds */
+    uint64_t held = 0;
+    size_t store_size = 0;
+    for (i = 0; i < count; i++) {
+      if (i >= keep_count && blocks[i].dst == rank) {
+        if (lwgrp_block_deliver(&blocks[i], recvbuf, recvcounts, recvdispls) != LWGRP_SUCCESS) {
+          rc = LWGRP_FAILURE;
+        }
+        continue;
+      }
+      if (blocks[i].src != rank) {
+        store_size += (size_t) blocks[i].size;
       }
+      blocks[held++] = blocks[i];
     }
-    if (rank + dist < ranks) {
-      for (i = 0; i < count; i++) {
-        left_send[i] += right_recv[i];
+    count = held;
+
+    char* new_store = (char*) SPAWN_MALLOC(store_size);
+    char* ptr = new_store;
+    for (i = 0; i < count; i++) {
+      if (blocks[i].src == rank) {
+        continue;
       }
+      size_t block_size = (size_t) blocks[i].size;
+      if (block_size > 0) {
+        memcpy(ptr, blocks[i].data, block_size);
+      }
+      blocks[i].data = ptr;
+      ptr += block_size;
     }
+    spawn_free(&store);
+    spawn_free(&left_recv);
+    spawn_free(&right_recv);
+    store = new_store;
 
     dist <<= 1;
     round++;
   }
 
-  for (i = 0; i < count; i++) {
-    ltr[i] = right_send[i];
-    rtl[i] = left_send[i];
+  /* every block in the range has been delivered by now,
+   * so the store holds nothing we still point to */
+  spawn_free(&store);
+  spawn_free(&right_blocks);
+  spawn_free(&left_blocks);
+
+  *pblocks = blocks;
+  *pcount  = count;
+
+  return rc;
+}
+
+/* given a list of blocks to send, deliver each to its destination,
+ * and copy the block from rank i to recvdispls[i] in recvbuf, where
+ * we expect recvcounts[i] bytes */
+static int lwgrp_alltoall_blocks(
+  lwgrp_block** pblocks,
+  uint64_t* pcount,
+  uint64_t max_block,
+  void* recvbuf,
+  const uint64_t* recvcounts,
+  const uint64_t* recvdispls,
+  const lwgrp* group)
+{
+  int64_t rank  = group->rank;
+  int64_t ranks = group->size;
+
+  /* determine how many destinations we can process at once,
+   * while keeping data held in transit on each process under
+   * our limit, for small blocks we execute a single Bruck exchange,
+   * and for large blocks we exchange a window of destinations
+   * at a time */
+  int64_t window = ranks;
+  uint64_t inflight = 2 * max_block * (uint64_t) ranks;
+  if (max_block > 0 && inflight > LWGRP_ALLTOALL_INFLIGHT) {
+    window = (int64_t) (LWGRP_ALLTOALL_INFLIGHT / (2 * max_block));
+    if (window < 1) {
+      window = 1;
+    }
   }
 
-  spawn_free(&right_recv);
-  spawn_free(&right_send);
-  spawn_free(&left_recv);
-  spawn_free(&left_send);
+  /* distance 0 is our own block, which never moves */
+  int rc = LWGRP_SUCCESS;
+  lwgrp_block* blocks = *pblocks;
+  uint64_t count = 0;
+  uint64_t i;
+  for (i = 0; i < *pcount; i++) {
+    if (blocks[i].dst == rank) {
+      if (lwgrp_block_deliver(&blocks[i], recvbuf, recvcounts, recvdispls) != LWGRP_SUCCESS) {
+        rc = LWGRP_FAILURE;
+      }
+      continue;
+    }
+    blocks[count++] = blocks[i];
+  }
+  *pcount = count;
+
+  /* process blocks for each window of distances */
+  int64_t lo = 1;
+  while (lo < ranks) {
+    int64_t hi = lo + window;
+    int tmp_rc = lwgrp_alltoall_bruck(pblocks, pcount, lo, hi,
+      recvbuf, recvcounts, recvdispls, group
+    );
+    if (tmp_rc != LWGRP_SUCCESS) {
+      rc = tmp_rc;
+    }
+    lo = hi;
+  }
 
-  return LWGRP_SUCCESS;
+  return rc;
 }
 
-int lwgrp_allgather_strmap_blocking(strmap* map, const lwgrp* group)
+static int lwgrp_alltoall_untraced(
+  const void* sendbuf,
+  void* recvbuf,
+  size_t size,
+  const lwgrp* group)
 {
   int64_t rank  = group->rank;
   int64_t ranks = group->size;
 
-  int round = 0;
-  int64_t dist = 1;
-  while (dist < ranks) {
-    /* create temps to hold maps received from left and right */
-    strmap* map_left = strmap_new();
-    strmap* map_right = strmap_new();
+  /* nothing to do if there is no data */
+  if (size == 0) {
+    return LWGRP_SUCCESS;
+  }
 
-    /* compute our relative rank for this round */
-    int64_t relrank  = (rank >> round);
+  /* build list of blocks, one for each destination,
+   * along with where each source's block goes in recvbuf */
+  uint64_t count = (uint64_t) ranks;
+  lwgrp_block* blocks = (lwgrp_block*) SPAWN_MALLOC(count * sizeof(lwgrp_block));
+  uint64_t* recvcounts = (uint64_t*) SPAWN_MALLOC(count * sizeof(uint64_t));
+  uint64_t* recvdispls = (uint64_t*) SPAWN_MALLOC(count * sizeof(uint64_t));
+  int64_t i;
+  for (i = 0; i < ranks; i++) {
+    blocks[i].src  = rank;
+    blocks[i].dst  = i;
+    blocks[i].size = (uint64_t) size;
+    blocks[i].data = (const char*) sendbuf + i * size;
+    recvcounts[i] = (uint64_t) size;
+    recvdispls[i] = (uint64_t) (i * size);
+  }
 
-    if (relrank & 0x1) {
-      /* we're odd in this round */
+  /* deliver blocks */
+  int rc = lwgrp_alltoall_blocks(&blocks, &count, (uint64_t) size,
+    recvbuf, recvcounts, recvdispls, group
+  );
 
-      /* exchange data with left partner */
-      if (rank - dist >= 0) {
-        /* recv then send */
-        spawn_net_channel* ch = group->list_left[round];
-        spawn_net_read_strmap(ch, map_left);
-        spawn_net_write_strmap(ch, map);
-      }
+  spawn_free(&recvdispls);
+  spawn_free(&recvcounts);
+  spawn_free(&blocks);
 
-      /* exchange data with right partner */
-      if (rank + dist < ranks) {
-        /* send then recv */
-        spawn_net_channel* ch = group->list_right[round];
-        spawn_net_write_strmap(ch, map);
-        spawn_net_read_strmap(ch, map_right);
-      }
-    } else {
-      /* we're even in this round */
+  return rc;
+}
 
-      /* exchange data with right partner */
-      if (rank + dist < ranks) {
-        /* send then recv */
-        spawn_net_channel* ch = group->list_right[round];
-        spawn_net_write_strmap(ch, map);
-        spawn_net_read_strmap(ch, map_right);
-      }
+int lwgrp_alltoall(
+  const void* sendbuf,
+  void* recvbuf,
+  size_t size,
+  const lwgrp* group)
+{
+  SPAWN_TRACE_BEGIN("lwgrp_alltoall", (int64_t) size);
+  int rc = lwgrp_alltoall_untraced(sendbuf, recvbuf, size, group);
+  SPAWN_TRACE_END("lwgrp_alltoall", (int64_t) size);
+  return rc;
+}
 
-      /* exchange data with left partner */
-      if (rank - dist >= 0) {
-        /* recv then send */
-        spawn_net_channel* ch = group->list_left[round];
-        spawn_net_read_strmap(ch, map_left);
-        spawn_net_write_strmap(ch, map);
-      }
+int lwgrp_alltoallv(
+  const void* sendbuf,
+  const uint64_t* sendcounts,
+  const uint64_t* senddispls,
+  void* recvbuf,
+  const uint64_t* recvcounts,
+  const uint64_t* recvdispls,
+  const lwgrp* group)
+{
+  int64_t rank  = group->rank;
+  int64_t ranks = group->size;
+
+  /* build list of blocks, skipping empty ones */
+  uint64_t max_block = 0;
+  uint64_t count = 0;
+  lwgrp_block* blocks = (lwgrp_block*) SPAWN_MALLOC(ranks * sizeof(lwgrp_block));
+  int64_t i;
+  for (i = 0; i < ranks; i++) {
+    uint64_t block_size = sendcounts[i];
+    if (block_size > 0) {
+      blocks[count].src  = rank;
+      blocks[count].dst  = i;
+      blocks[count].size = block_size;
+      blocks[count].data = (const char*) sendbuf + senddispls[i];
+      count++;
+    }
+    if (block_size > max_block) {
+      max_block = block_size;
     }
+  }
 
-    /* merge received maps with our current map */
-    strmap_merge(map, map_left);
-    strmap_merge(map, map_right);
-    strmap_delete(&map_left);
-    strmap_delete(&map_right);
+  /* all procs must agree on the window size, so get max block size */
+  lwgrp_allreduce_uint64_max(&max_block, 1, group);
+
+  /* deliver blocks */
+  int rc = lwgrp_alltoall_blocks(&blocks, &count, max_block,
+    recvbuf, recvcounts, recvdispls, group
+  );
+
+  spawn_free(&blocks);
+
+  return rc;
+}
 
+/* message types used in sparse exchange */
+enum lwgrp_sparse_type {
+  SPARSE_DATA    = 1, /* piece of payload to be delivered to dst */
+  SPARSE_ACK     = 2, /* acknowledges delivery of a payload to src */
+  SPARSE_BARRIER = 3, /* barrier token for a given round */
+  SPARSE_FIN     = 4, /* sender will not send more on this channel */
+  SPARSE_CREDIT  = 5, /* receiver read a DATA or ACK frame */
+};
+
+/* sparse frames are prefixed with type, src, dst, offset or round,
+ * total payload size, and number of payload bytes in this frame */
+#define LWGRP_SPARSE_HDR_SIZE (6 * 8)
+
+/* frame waiting to be written to a channel */
+typedef struct lwgrp_sparse_frame_t {
+  char header[LWGRP_SPARSE_HDR_SIZE];
+  const char* data; /* payload bytes of this frame */
+  size_t len;       /* number of bytes in data */
+  void* owned;      /* buffer to free once written, may be NULL */
+  struct lwgrp_sparse_frame_t* next;
+} lwgrp_sparse_frame;
+
+/* one of our dissemination channels and the frames queued on it */
+typedef struct lwgrp_sparse_link_t {
+  const spawn_net_channel* ch;
+  lwgrp_sparse_frame* head;
+  lwgrp_sparse_frame* tail;
+  int inflight;     /* frames written that have not been credited */
+} lwgrp_sparse_link;
+
+/* payload we are still receiving from a source, pieces from one
+ * source arrive in order, so there is at most one per source */
+typedef struct lwgrp_sparse_partial_t {
+  int64_t src;
+  uint64_t size;
+  uint64_t recvd;
+  char* data;
+  struct lwgrp_sparse_partial_t* next;
+} lwgrp_sparse_partial;
+
+/* tracks messages received in sparse exchange */
+typedef struct lwgrp_sparse_recv_t {
+  int64_t  src;   /* rank that sent the message */
+  uint64_t seq;   /* order in which message arrived */
+  uint64_t size;  /* number of bytes in message */
+  void*    data;  /* message payload */
+} lwgrp_sparse_recv;
+
+/* orders received messages by source rank, then by arrival */
+static int lwgrp_sparse_recv_cmp(const void* a_ptr, const void* b_ptr)
+{
+  const lwgrp_sparse_recv* a = (const lwgrp_sparse_recv*) a_ptr;
+  const lwgrp_sparse_recv* b = (const lwgrp_sparse_recv*) b_ptr;
+  if (a->src != b->src) {
+    return (a->src < b->src) ? -1 : 1;
+  }
+  if (a->seq != b->seq) {
+    return (a->seq < b->seq) ? -1 : 1;
+  }
+  return 0;
+}
+
+/* append message to receive list, doubling its capacity if needed */
+static void lwgrp_sparse_append(
+  lwgrp_sparse_recv** plist,
+  uint64_t* pmax,
+  uint64_t* pcount,
+  int64_t src,
+  uint64_t size,
+  void* data)
+{
+  lwgrp_sparse_recv* list = *plist;
+  uint64_t count = *pcount;
+
+  /* grow list if it's full */
+  if (count == *pmax) {
+    uint64_t max = *pmax * 2;
+    lwgrp_sparse_recv* new_list = (lwgrp_sparse_recv*) SPAWN_MALLOC(
+      max * sizeof(lwgrp_sparse_recv)
+    );
+    memcpy(new_list, list, count * sizeof(lwgrp_sparse_recv));
+    spawn_free(&list);
+    list = new_list;
+    *plist = list;
+    *pmax  = max;
+  }
+
+  list[count].src  = src;
+  list[count].seq  = count;
+  list[count].size = size;
+  list[count].data = data;
+  *pcount = count + 1;
+}
+
+/* pack header for sparse frame into buffer */
+static void lwgrp_sparse_header(
+  char* header,
+  uint64_t type,
+  int64_t src,
+  int64_t dst,
+  uint64_t offset,
+  uint64_t size,
+  uint64_t len)
+{
+  char* ptr = header;
+  ptr += spawn_pack_uint64(ptr, type);
+  ptr += spawn_pack_uint64(ptr, (uint64_t) src);
+  ptr += spawn_pack_uint64(ptr, (uint64_t) dst);
+  ptr += spawn_pack_uint64(ptr, offset);
+  ptr += spawn_pack_uint64(ptr, size);
+  ptr += spawn_pack_uint64(ptr, len);
+}
+
+/* returns the link that moves a frame furthest towards the given
+ * destination without passing it, each hop at least halves the
+ * remaining distance, so a frame takes at most log(N) hops, and
+ * frames from one source to one destination stay in order */
+static lwgrp_sparse_link* lwgrp_sparse_route(lwgrp_sparse_link* links, int64_t dst, const lwgrp* group)
+{
+  /* compute distance to destination */
+  int64_t offset = dst - group->rank;
+  int64_t distance = (offset > 0) ? offset : -offset;
+
+  /* find the largest power of two that does not exceed distance */
+  int round = 0;
+  int64_t dist = 1;
+  while ((dist << 1) <= distance) {
     dist <<= 1;
     round++;
   }
 
-  return LWGRP_SUCCESS;
+  /* links alternate left and right for each round */
+  return &links[2 * round + ((offset > 0) ? 1 : 0)];
 }
 
-int lwgrp_allgather_strmap(strmap* map, const lwgrp* group)
+/* queue frame on link, it is written once the link has credit */
+static void lwgrp_sparse_queue(lwgrp_sparse_link* link, lwgrp_sparse_frame* frame)
+{
+  frame->next = NULL;
+  if (link->tail != NULL) {
+    link->tail->next = frame;
+  } else {
+    link->head = frame;
+  }
+  link->tail = frame;
+}
+
+/* write header-only frame that needs no credit */
+static void lwgrp_sparse_control(const lwgrp_sparse_link* link, uint64_t type, int64_t rank, uint64_t round)
+{
+  char header[LWGRP_SPARSE_HDR_SIZE];
+  lwgrp_sparse_header(header, type, rank, rank, round, 0, 0);
+  spawn_net_write(link->ch, header, LWGRP_SPARSE_HDR_SIZE);
+}
+
+/* write queued frames until link runs out of credit,
+ * returns 1 if we wrote anything */
+static int lwgrp_sparse_flush(lwgrp_sparse_link* link)
+{
+  int progress = 0;
+  while (link->head != NULL && link->inflight < LWGRP_XCHG_WINDOW) {
+    lwgrp_sparse_frame* frame = link->head;
+    link->head = frame->next;
+    if (link->head == NULL) {
+      link->tail = NULL;
+    }
+
+    /* header and payload go in separate writes to match the
+     * separate reads on the receiving side */
+    spawn_net_write(link->ch, frame->header, LWGRP_SPARSE_HDR_SIZE);
+    if (frame->len > 0) {
+      spawn_net_write(link->ch, frame->data, frame->len);
+    }
+    link->inflight++;
+
+    spawn_free(&frame->owned);
+    spawn_free(&frame);
+    progress = 1;
+  }
+  return progress;
+}
+
+/* send barrier tokens to left and right partners for given round */
+static void lwgrp_sparse_tokens(lwgrp_sparse_link* links, int round, const lwgrp* group)
 {
   int64_t rank  = group->rank;
   int64_t ranks = group->size;
+  int64_t dist  = ((int64_t) 1) << round;
 
-  int round = 0;
+  if (rank - dist >= 0) {
+    lwgrp_sparse_control(&links[2 * round], SPARSE_BARRIER, rank, (uint64_t) round);
+  }
+
+  if (rank + dist < ranks) {
+    lwgrp_sparse_control(&links[2 * round + 1], SPARSE_BARRIER, rank, (uint64_t) round);
+  }
+}
+
+/* Exchanges messages with a sparse set of ranks using the NBX
+ * algorithm from Hoefler, Siebert, and Lumsdaine, "Scalable
+ * Communication Protocols for Dynamic Sparse Data Exchange",
+ * PPoPP 2010.  Each message is routed to its destination over the
+ * dissemination channels we already hold, and the destination
+ * returns an ack along the same path.  Once all of its messages
+ * have been acked, a process enters a non-blocking barrier, and it
+ * continues to forward traffic until the barrier completes. When
+ * the barrier completes, all messages have been delivered.  A
+ * process may complete the barrier and start its next operation
+ * on the group before its neighbors see the barrier complete, so
+ * each process ends by sending a fin on every channel and draining
+ * channels until it receives a fin on each.  This way, we never
+ * read data that belongs to the next operation.  The cost depends
+ * on the number of messages rather than the group size, aside from
+ * the log(N) rounds of the barrier.
+ *
+ * Two procs routing large payloads to each other would deadlock if
+ * both blocked writing whole payloads, so, as in the exchange engine,
+ * payloads are cut into chunks that fit our share of
+ * LWGRP_XCHG_BUDGET, and each channel may have at most
+ * LWGRP_XCHG_WINDOW data and ack frames that the receiver has not
+ * credited.  Frames queue on their channel until it has credit, and
+ * the receiver returns a credit as soon as it reads a frame, even
+ * one it will forward, so writes never block for long and we keep
+ * reading from every channel while frames wait to go out. */
+int lwgrp_sparse_exchange(
+  int64_t send_count,
+  const int64_t* send_ranks,
+  const void** send_bufs,
+  const uint64_t* send_sizes,
+  int64_t* recv_count,
+  int64_t** recv_ranks,
+  void*** recv_bufs,
+  uint64_t** recv_sizes,
+  const lwgrp* group)
+{
+  int64_t rank  = group->rank;
+  int64_t ranks = group->size;
+
+  /* list of received messages, we grow this as needed */
+  uint64_t recv_max = 16;
+  uint64_t recvs = 0;
+  lwgrp_sparse_recv* recv_list = (lwgrp_sparse_recv*) SPAWN_MALLOC(
+    recv_max * sizeof(lwgrp_sparse_recv)
+  );
+
+  /* set up a link for the left and right channel of each round,
+   * and build list of channels we'll wait on */
+  int rounds = 0;
   int64_t dist = 1;
   while (dist < ranks) {
-    /* create temps to hold maps received from left and right */
-    strmap* map_left = strmap_new();
-    strmap* map_right = strmap_new();
+    dist <<= 1;
+    rounds++;
+  }
+  lwgrp_sparse_link* links = (lwgrp_sparse_link*) SPAWN_MALLOC(
+    (2 * rounds + 1) * sizeof(lwgrp_sparse_link)
+  );
+  const spawn_net_channel** chs = (const spawn_net_channel**) SPAWN_MALLOC(
+    (2 * rounds + 1) * sizeof(spawn_net_channel*)
+  );
+  lwgrp_sparse_link** ch_links = (lwgrp_sparse_link**) SPAWN_MALLOC(
+    (2 * rounds + 1) * sizeof(lwgrp_sparse_link*)
+  );
+  int nchs = 0;
+  int i;
+  for (i = 0; i < 2 * rounds; i++) {
+    lwgrp_sparse_link* link = &links[i];
+    int round = i / 2;
+    link->ch = (i % 2 == 0) ? group->list_left[round] : group->list_right[round];
+    link->head = NULL;
+    link->tail = NULL;
+    link->inflight = 0;
+    if (link->ch != SPAWN_NET_CHANNEL_NULL) {
+      chs[nchs] = link->ch;
+      ch_links[nchs] = link;
+      nchs++;
+    }
+  }
 
-    /* send map left */
-    if (rank - dist >= 0) {
-      spawn_net_channel* ch = group->list_left[round];
-      spawn_net_write_strmap(ch, map);
+  /* split our budget across the channels we may write to */
+  size_t chunk = LWGRP_XCHG_MIN_CHUNK;
+  if (nchs > 0) {
+    chunk = LWGRP_XCHG_BUDGET / (LWGRP_XCHG_WINDOW * nchs);
+    if (chunk < LWGRP_XCHG_MIN_CHUNK) {
+      chunk = LWGRP_XCHG_MIN_CHUNK;
     }
+  }
 
-    /* send map right */
-    if (rank + dist < ranks) {
-      spawn_net_channel* ch = group->list_right[round];
-      spawn_net_write_strmap(ch, map);
+  /* track number of barrier tokens received in each round */
+  int* tokens = (int*) SPAWN_MALLOC((rounds + 1) * sizeof(int));
+  for (i = 0; i < rounds + 1; i++) {
+    tokens[i] = 0;
+  }
+
+  /* queue our messages in pieces, we keep any sent to ourself */
+  int rc = LWGRP_SUCCESS;
+  int64_t pending_acks = 0;
+  int64_t j;
+  for (j = 0; j < send_count; j++) {
+    int64_t dst = send_ranks[j];
+    uint64_t size = send_sizes[j];
+    if (dst < 0 || dst >= ranks) {
+      SPAWN_ERR("Invalid destination rank %lld in group of size %lld",
+        (long long) dst, (long long) ranks
+      );
+      rc = LWGRP_FAILURE;
+      continue;
     }
 
-    /* recv map from left */
-    if (rank - dist >= 0) {
-      spawn_net_channel* ch = group->list_left[round];
-      spawn_net_read_strmap(ch, map_left);
+    if (dst == rank) {
+      /* copy message to receive list */
+      void* data = SPAWN_MALLOC((size_t) size);
+      if (size > 0) {
+        memcpy(data, send_bufs[j], (size_t) size);
+      }
+      lwgrp_sparse_append(&recv_list, &recv_max, &recvs, rank, size, data);
+      continue;
     }
 
-    /* recv map from right */
-    if (rank + dist < ranks) {
-      spawn_net_channel* ch = group->list_right[round];
-      spawn_net_read_strmap(ch, map_right);
+    /* an empty message still takes one frame */
+    lwgrp_sparse_link* link = lwgrp_sparse_route(links, dst, group);
+    uint64_t offset = 0;
+    do {
+      uint64_t len = size - offset;
+      if (len > (uint64_t) chunk) {
+        len = (uint64_t) chunk;
+      }
+      lwgrp_sparse_frame* frame = (lwgrp_sparse_frame*) SPAWN_MALLOC(sizeof(lwgrp_sparse_frame));
+      lwgrp_sparse_header(frame->header, SPARSE_DATA, rank, dst, offset, size, len);
+      frame->data  = (const char*) send_bufs[j] + offset;
+      frame->len   = (size_t) len;
+      frame->owned = NULL;
+      lwgrp_sparse_queue(link, frame);
+      offset += len;
+    } while (offset < size);
+    pending_acks++;
+  }
+
+  /* we remove channels from this list as they deliver their fin */
+  const spawn_net_channel** wait_chs = (const spawn_net_channel**) SPAWN_MALLOC(
+    (2 * rounds + 1) * sizeof(spawn_net_channel*)
+  );
+  for (i = 0; i < nchs; i++) {
+    wait_chs[i] = chs[i];
+  }
+
+  /* process incoming frames until the barrier completes */
+  lwgrp_sparse_partial* partials = NULL;
+  int in_barrier = 0;
+  int round = 0;
+  int sent_fin = 0;
+  int fins = 0;
+  while (1) {
+    /* write whatever our links have credit for */
+    for (i = 0; i < nchs; i++) {
+      lwgrp_sparse_flush(ch_links[i]);
+    }
+
+    /* enter barrier once all of our messages have been acked */
+    if (! in_barrier && pending_acks == 0) {
+      in_barrier = 1;
+      if (round < rounds) {
+        lwgrp_sparse_tokens(links, round, group);
+      }
     }
 
-    /* merge received maps with our current map */
-    strmap_merge(map, map_left);
-    strmap_merge(map, map_right);
-    strmap_delete(&map_left);
-    strmap_delete(&map_right);
+    /* advance through barrier rounds as tokens arrive */
+    while (in_barrier && round < rounds) {
+      dist = ((int64_t) 1) << round;
+      int expected = 0;
+      if (rank - dist >= 0) {
+        expected++;
+      }
+      if (rank + dist < ranks) {
+        expected++;
+      }
+      if (tokens[round] < expected) {
+        break;
+      }
 
-    dist <<= 1;
-    round++;
+      /* got all tokens for this round, start the next one */
+      round++;
+      if (round < rounds) {
+        lwgrp_sparse_tokens(links, round, group);
+      }
+    }
+
+    /* all messages have been delivered once barrier completes,
+     * so nothing is left in our queues, send fin on each channel */
+    if (in_barrier && round == rounds && ! sent_fin) {
+      for (i = 0; i < nchs; i++) {
+        lwgrp_sparse_control(ch_links[i], SPARSE_FIN, rank, 0);
+      }
+      sent_fin = 1;
+    }
+
+    /* we're done once we've received a fin on every channel */
+    if (sent_fin && fins == nchs) {
+      break;
+    }
+
+    /* wait for a frame on one of our channels */
+    int index = -1;
+    int wait_rc = spawn_net_wait(0, NULL, nchs, wait_chs, &index);
+    if (wait_rc != SPAWN_SUCCESS || index < 0) {
+      SPAWN_ERR("Failed to wait on sparse exchange channels");
+      rc = LWGRP_FAILURE;
+      break;
+    }
+    lwgrp_sparse_link* link = ch_links[index];
+
+    /* read frame header */
+    lwgrp_sparse_frame* frame = (lwgrp_sparse_frame*) SPAWN_MALLOC(sizeof(lwgrp_sparse_frame));
+    uint64_t type, src, dst, offset, size, len;
+    spawn_net_read(link->ch, frame->header, LWGRP_SPARSE_HDR_SIZE);
+    char* ptr = frame->header;
+    ptr += spawn_unpack_uint64(ptr, &type);
+    ptr += spawn_unpack_uint64(ptr, &src);
+    ptr += spawn_unpack_uint64(ptr, &dst);
+    ptr += spawn_unpack_uint64(ptr, &offset);
+    ptr += spawn_unpack_uint64(ptr, &size);
+    ptr += spawn_unpack_uint64(ptr, &len);
+
+    /* frames other than data and acks carry no payload or credit */
+    if (type != SPARSE_DATA && type != SPARSE_ACK) {
+      if (type == SPARSE_FIN) {
+        /* stop waiting on a channel once we get its fin */
+        wait_chs[index] = SPAWN_NET_CHANNEL_NULL;
+        fins++;
+      } else if (type == SPARSE_BARRIER) {
+        /* barrier tokens are not routed */
+        if (offset < (uint64_t) rounds) {
+          tokens[offset]++;
+        }
+      } else if (type == SPARSE_CREDIT) {
+        link->inflight--;
+      } else {
+        SPAWN_ERR("Unknown sparse exchange message type %llu", (unsigned long long) type);
+      }
+      spawn_free(&frame);
+      continue;
+    }
+
+    /* read payload and let the sender know it can send more */
+    frame->owned = SPAWN_MALLOC((size_t) len);
+    if (len > 0) {
+      spawn_net_read(link->ch, frame->owned, (size_t) len);
+    }
+    frame->data = (const char*) frame->owned;
+    frame->len  = (size_t) len;
+    lwgrp_sparse_control(link, SPARSE_CREDIT, rank, 0);
+
+    /* forward frame if it's not for us */
+    if ((int64_t) dst != rank) {
+      lwgrp_sparse_queue(lwgrp_sparse_route(links, (int64_t) dst, group), frame);
+      continue;
+    }
+
+    if (type == SPARSE_ACK) {
+      pending_acks--;
+      spawn_free(&frame->owned);
+      spawn_free(&frame);
+      continue;
+    }
+
+    /* find the message this piece belongs to */
+    lwgrp_sparse_partial* p = partials;
+    lwgrp_sparse_partial** prev = &partials;
+    while (p != NULL && p->src != (int64_t) src) {
+      prev = &p->next;
+      p = p->next;
+    }
+    if (p == NULL) {
+      p = (lwgrp_sparse_partial*) SPAWN_MALLOC(sizeof(lwgrp_sparse_partial));
+      p->src   = (int64_t) src;
+      p->size  = size;
+      p->recvd = 0;
+      p->data  = (char*) SPAWN_MALLOC((size_t) size);
+      p->next  = partials;
+      partials = p;
+      prev = &partials;
+    }
+    if (offset != p->recvd || offset + len > p->size) {
+      SPAWN_ERR("Sparse exchange piece at offset %llu out of order", (unsigned long long) offset);
+      rc = LWGRP_FAILURE;
+    } else if (len > 0) {
+      memcpy(p->data + offset, frame->data, (size_t) len);
+      p->recvd += len;
+    }
+    spawn_free(&frame->owned);
+    spawn_free(&frame);
+
+    /* once we have the whole message, add it to our receive list,
+     * and queue an ack back to its source */
+    if (p->recvd == p->size) {
+      *prev = p->next;
+      lwgrp_sparse_append(&recv_list, &recv_max, &recvs, p->src, p->size, p->data);
+
+      lwgrp_sparse_frame* ack = (lwgrp_sparse_frame*) SPAWN_MALLOC(sizeof(lwgrp_sparse_frame));
+      lwgrp_sparse_header(ack->header, SPARSE_ACK, rank, p->src, 0, 0, 0);
+      ack->data  = NULL;
+      ack->len   = 0;
+      ack->owned = NULL;
+      lwgrp_sparse_queue(lwgrp_sparse_route(links, p->src, group), ack);
+
+      spawn_free(&p);
+    }
   }
 
-  return LWGRP_SUCCESS;
+  /* free anything left behind after an error */
+  while (partials != NULL) {
+    lwgrp_sparse_partial* p = partials;
+    partials = p->next;
+    spawn_free(&p->data);
+    spawn_free(&p);
+  }
+  for (i = 0; i < 2 * rounds; i++) {
+    while (links[i].head != NULL) {
+      lwgrp_sparse_frame* frame = links[i].head;
+      links[i].head = frame->next;
+      spawn_free(&frame->owned);
+      spawn_free(&frame);
+    }
+  }
+
+  /* sort received messages by source rank */
+  qsort(recv_list, (size_t) recvs, sizeof(lwgrp_sparse_recv), lwgrp_sparse_recv_cmp);
+
+  /* copy received messages to output arrays */
+  int64_t* ranks_out = (int64_t*)  SPAWN_MALLOC(recvs * sizeof(int64_t));
+  void** bufs_out    = (void**)    SPAWN_MALLOC(recvs * sizeof(void*));
+  uint64_t* sizes_out = (uint64_t*) SPAWN_MALLOC(recvs * sizeof(uint64_t));
+  uint64_t k;
+  for (k = 0; k < recvs; k++) {
+    ranks_out[k] = recv_list[k].src;
+    bufs_out[k]  = recv_list[k].data;
+    sizes_out[k] = recv_list[k].size;
+  }
+
+  *recv_count = (int64_t) recvs;
+  *recv_ranks = ranks_out;
+  *recv_bufs  = bufs_out;
+  *recv_sizes = sizes_out;
+
+  spawn_free(&wait_chs);
+  spawn_free(&tokens);
+  spawn_free(&ch_links);
+  spawn_free(&chs);
+  spawn_free(&links);
+  spawn_free(&recv_list);
+
+  return rc;
 }
@@ -14,6 +14,7 @@
 
 #include "spawn_net.h"
 #include "strmap.h"
+#include "spawn_stats.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -41,9 +42,45 @@ typedef struct lwgrp {
   int64_t list_size; /* number of elements in channel lists */
   spawn_net_channel** list_left;  /* process addresses for 2^d hops to the left */
   spawn_net_channel** list_right; /* process addresses for 2^d hops to the right */
+  int64_t radix;        /* radix of dissemination collectives, at least 2 */
+  int64_t radix_rounds; /* number of rounds in radix collectives */
+  spawn_net_channel** radix_left;  /* process addresses for j*radix^r hops to the left */
+  spawn_net_channel** radix_right; /* process addresses for j*radix^r hops to the right */
   spawn_net_endpoint* ep; /* pointer to endpoint to accept connections */
+  struct lwgrp_shm_t* shm; /* shared memory segment if attached, NULL otherwise */
 } lwgrp;
 
+/* element types for typed collectives */
+typedef enum lwgrp_type_enum {
+  LWGRP_TYPE_UINT64 = 0,
+  LWGRP_TYPE_INT64  = 1,
+  LWGRP_TYPE_DOUBLE = 2,
+} lwgrp_type;
+
+/* operations for typed collectives */
+typedef enum lwgrp_op_enum {
+  LWGRP_OP_SUM = 0,
+  LWGRP_OP_MIN = 1,
+  LWGRP_OP_MAX = 2,
+} lwgrp_op;
+
+/* two-level view of a group, procs on the same node form a node
+ * group, and the first proc on each node is its leader, an optional
+ * socket level splits each node group by socket */
+typedef struct lwgrp_hier {
+  const lwgrp* world; /* input group, not owned by the hierarchy */
+  lwgrp* node;        /* procs on the same node as the current process */
+  lwgrp* leaders;     /* leaders of all nodes, NULL if not a leader */
+  lwgrp* socket;      /* procs on the same socket and node, NULL without socket level */
+  lwgrp* sockets;     /* leaders of sockets on our node, NULL if not a socket leader */
+} lwgrp_hier;
+
+/* handle to a distributed key-value store over a group */
+typedef struct lwgrp_kvs_t lwgrp_kvs;
+
+/* handle to an outstanding non-blocking collective */
+typedef struct lwgrp_request_t lwgrp_request;
+
 /* create and returns a group given group size, rank, and spawn_net info */
 lwgrp* lwgrp_create(
   int64_t size, /* number of ranks in group */
@@ -54,12 +91,46 @@ lwgrp* lwgrp_create(
   spawn_net_endpoint* ep /* our endpoint on which to accept connections */
 );
 
+/* create a group as in lwgrp_create, whose barrier, allreduce, and
+ * allgather use radix-1 partners in each direction per round to
+ * complete in log_radix(size) rounds, radix=2 is the same as lwgrp_create */
+lwgrp* lwgrp_create_radix(
+  int64_t size, /* number of ranks in group */
+  int64_t rank, /* our rank within the group in range [0,size) */
+  const char* name, /* our endpoint name */
+  const char* left, /* endpoint name of rank one less (ignored if proc is first) */
+  const char* right,/* endpoint name of rank one more (ignored if proc is last) */
+  spawn_net_endpoint* ep, /* our endpoint on which to accept connections */
+  int64_t radix     /* number of partners per direction per round plus one */
+);
+
+/* join two groups end to end into a new group, the procs of the low
+ * group come first, the input groups remain valid */
+lwgrp* lwgrp_merge(
+  const lwgrp* group,         /* group of the calling proc */
+  spawn_net_channel* bridge,  /* channel between the last proc of the low group and
+                               * the first proc of the high group, NULL on all others */
+  int high                    /* 0 if our group is the low group, 1 if high */
+);
+
 /* split a group into groups consisting of all procs with the same string */
 lwgrp* lwgrp_split_str(
   const lwgrp* comm, /* input group */
   const char* str    /* string on which to split procs (color), can't be NULL */
 );
 
+/* split a group by string and by color within each string using a
+ * single sort, outer gets procs with the same string and inner gets
+ * procs with the same string and color, both order procs by color
+ * and then by rank in comm */
+int lwgrp_split_str_multi(
+  const lwgrp* comm, /* input group */
+  const char* str,   /* string on which to split procs, can't be NULL */
+  int64_t color,     /* color on which to split procs within each string */
+  lwgrp** outer,     /* output group of procs with same string */
+  lwgrp** inner      /* output group of procs with same string and color */
+);
+
 /* split a group into groups consisting of all procs with the same color,
  * order by key and rank in comm */
 lwgrp* lwgrp_split(
@@ -68,6 +139,14 @@ lwgrp* lwgrp_split(
   int64_t key        /* key value */
 );
 
+/* create a group of the same procs ordered by locality key and then
+ * by rank, so that procs with equal keys are neighbors, keys like
+ * "rack/switch/host" cluster at each level, NULL uses the hostname */
+lwgrp* lwgrp_reorder(
+  const lwgrp* group,  /* input group */
+  const char* locality /* locality key of calling proc, may be NULL */
+);
+
 /* free a group and drop connections */
 int lwgrp_free(lwgrp** pgroup);
 
@@ -90,15 +169,261 @@ int lwgrp_allreduce_uint64_sum(uint64_t* buf, uint64_t count, const lwgrp* group
 /* compute maximum across procs of a vector of uint64_t values */
 int lwgrp_allreduce_uint64_max(uint64_t* buf, uint64_t count, const lwgrp* group);
 
+/* sum counters of channels the calling process uses in group */
+int lwgrp_stats(const lwgrp* group, spawn_net_stats* stats);
+
+/* sum stats across procs in group, e.g., values from lwgrp_stats */
+int lwgrp_allreduce_stats(spawn_net_stats* stats, const lwgrp* group);
+
+/* gather metrics snapshots from all procs in group and write the sum
+ * and max over procs of each metric to path on root */
+int lwgrp_stats_dump(const char* path, spawn_stats_format format, int64_t root, const lwgrp* group);
+
+/* get number of groups and of channels they hold not yet freed */
+int lwgrp_counts(uint64_t* groups, uint64_t* channels);
+
 /* compute prefix sum across procs of a vector of uint64_t values */
 int lwgrp_scan_uint64_sum(uint64_t* buf, uint64_t count, const lwgrp* group);
 
+/* inclusive scan of count elements of type with op,
+ * sendbuf and recvbuf may be the same buffer */
+int lwgrp_scan(const void* sendbuf, void* recvbuf, uint64_t count, lwgrp_type type, lwgrp_op op, const lwgrp* group);
+
+/* exclusive scan of count elements of type with op,
+ * rank 0 receives the identity of op */
+int lwgrp_exscan(const void* sendbuf, void* recvbuf, uint64_t count, lwgrp_type type, lwgrp_op op, const lwgrp* group);
+
+/* inclusive scan that restarts at each proc whose flag is set */
+int lwgrp_segmented_scan(int flag, const void* sendbuf, void* recvbuf, uint64_t count, lwgrp_type type, lwgrp_op op, const lwgrp* group);
+
 /* compute prefix sum across procs of a vector of uint64_t values */
 int lwgrp_double_scan_uint64_sum(const uint64_t* buf, uint64_t* left, uint64_t* right, uint64_t count, const lwgrp* group);
 
 /* gather strmap from all procs */
 int lwgrp_allgather_strmap(strmap* map, const lwgrp* group);
 
+/* gather size bytes from sendbuf on each proc into recvbuf,
+ * the block from rank i is stored at i*size in recvbuf */
+int lwgrp_allgather(const void* sendbuf, void* recvbuf, size_t size, const lwgrp* group);
+
+/* copy buf_size bytes in buf from root to all procs */
+int lwgrp_bcast(void* buf, size_t buf_size, int64_t root, const lwgrp* group);
+
+/* merge strmap from root into map on all procs */
+int lwgrp_bcast_strmap(strmap* map, int64_t root, const lwgrp* group);
+
+/* merge strmap from all procs into map on root */
+int lwgrp_gather_strmap(strmap* map, int64_t root, const lwgrp* group);
+
+/* merge strmap from all procs into map on root,
+ * values for keys on more than one proc are combined with fn */
+int lwgrp_reduce_strmap(strmap* map, strmap_combine_fn fn, int64_t root, const lwgrp* group);
+
+/* merge strmap from all procs into map on all procs,
+ * values for keys on more than one proc are combined with fn */
+int lwgrp_allreduce_strmap(strmap* map, strmap_combine_fn fn, const lwgrp* group);
+
+/* compute sum across procs of a vector of uint64_t values, result on root */
+int lwgrp_reduce_uint64_sum(uint64_t* buf, uint64_t count, int64_t root, const lwgrp* group);
+
+/* compute maximum across procs of a vector of uint64_t values, result on root */
+int lwgrp_reduce_uint64_max(uint64_t* buf, uint64_t count, int64_t root, const lwgrp* group);
+
+/* send size bytes from sendbuf to each proc, the block for rank i
+ * starts at i*size in sendbuf and the block from rank i is stored
+ * at i*size in recvbuf */
+int lwgrp_alltoall(const void* sendbuf, void* recvbuf, size_t size, const lwgrp* group);
+
+/* send sendcounts[i] bytes starting at senddispls[i] in sendbuf to
+ * rank i, store recvcounts[i] bytes from rank i at recvdispls[i] in
+ * recvbuf, counts and displacements are given in bytes */
+int lwgrp_alltoallv(
+  const void* sendbuf,
+  const uint64_t* sendcounts,
+  const uint64_t* senddispls,
+  void* recvbuf,
+  const uint64_t* recvcounts,
+  const uint64_t* recvdispls,
+  const lwgrp* group
+);
+
+/* send send_sizes[i] bytes from send_bufs[i] to rank send_ranks[i] for
+ * each of send_count messages, where the set of ranks is not known by
+ * the receivers, returns the number of messages received along with
+ * newly allocated arrays of source ranks, buffers, and sizes ordered
+ * by source rank, caller must free each buffer and each array,
+ * returns LWGRP_FAILURE if any destination is not in the group,
+ * though messages to valid destinations are still delivered */
+int lwgrp_sparse_exchange(
+  int64_t send_count,
+  const int64_t* send_ranks,
+  const void** send_bufs,
+  const uint64_t* send_sizes,
+  int64_t* recv_count,
+  int64_t** recv_ranks,
+  void*** recv_bufs,
+  uint64_t** recv_sizes,
+  const lwgrp* group
+);
+
+/* Non-blocking collectives return a request that must be completed
+ * with lwgrp_test or lwgrp_wait.  Buffers passed to the collective
+ * must not be accessed until it completes, and a process must not
+ * call blocking collectives on a group while it has outstanding
+ * requests on that group.  Requests on the same group complete in
+ * the order they were started. */
+
+/* start a barrier on the group */
+int lwgrp_ibarrier(const lwgrp* group, lwgrp_request** req);
+
+/* start sum across procs of a vector of uint64_t values */
+int lwgrp_iallreduce_uint64_sum(uint64_t* buf, uint64_t count, const lwgrp* group, lwgrp_request** req);
+
+/* start maximum across procs of a vector of uint64_t values */
+int lwgrp_iallreduce_uint64_max(uint64_t* buf, uint64_t count, const lwgrp* group, lwgrp_request** req);
+
+/* start prefix sum across procs of a vector of uint64_t values */
+int lwgrp_iscan_uint64_sum(uint64_t* buf, uint64_t count, const lwgrp* group, lwgrp_request** req);
+
+/* start gather of strmap from all procs */
+int lwgrp_iallgather_strmap(strmap* map, const lwgrp* group, lwgrp_request** req);
+
+/* make progress on outstanding requests, sets flag to 1 and frees
+ * the request if it has completed, 0 otherwise */
+int lwgrp_test(lwgrp_request** req, int* flag);
+
+/* block until request completes and free it */
+int lwgrp_wait(lwgrp_request** req);
+
+/* Persistent collectives precompute their communication schedule and
+ * allocate scratch space once, then each lwgrp_start reruns the
+ * collective on the buffer given at init.  lwgrp_test and lwgrp_wait
+ * leave persistent requests allocated, so they can be started again,
+ * and lwgrp_request_free releases them. */
+
+/* create persistent barrier on the group */
+int lwgrp_barrier_init(const lwgrp* group, lwgrp_request** req);
+
+/* create persistent sum across procs of a vector of uint64_t values */
+int lwgrp_allreduce_uint64_sum_init(uint64_t* buf, uint64_t count, const lwgrp* group, lwgrp_request** req);
+
+/* create persistent maximum across procs of a vector of uint64_t values */
+int lwgrp_allreduce_uint64_max_init(uint64_t* buf, uint64_t count, const lwgrp* group, lwgrp_request** req);
+
+/* create persistent prefix sum across procs of a vector of uint64_t values */
+int lwgrp_scan_uint64_sum_init(uint64_t* buf, uint64_t count, const lwgrp* group, lwgrp_request** req);
+
+/* start a persistent request */
+int lwgrp_start(lwgrp_request* req);
+
+/* free an inactive persistent request */
+int lwgrp_request_free(lwgrp_request** req);
+
+/* start background thread to progress outstanding requests */
+int lwgrp_progress_start(void);
+
+/* stop background progress thread */
+int lwgrp_progress_stop(void);
+
+/* Procs in a group on the same node can attach a shared memory
+ * segment to the group, after which lwgrp_barrier, the allreduces,
+ * lwgrp_bcast, and lwgrp_allgather on that group run through shared
+ * memory rather than sending messages over the group channels. */
+
+/* collectively map a shared memory segment with slots of slot_size
+ * bytes per proc (0 for default), fails if procs are not on the same node */
+int lwgrp_shm_attach(lwgrp* group, size_t slot_size);
+
+/* unmap shared memory segment, group then falls back to messages */
+int lwgrp_shm_detach(lwgrp* group);
+
+/* Barrier, allreduce, and allgather_strmap pick among dissemination,
+ * radix, and tree algorithms with a decision table keyed by transport,
+ * group size, and message size.  The table is read from the file in
+ * LWGRP_TUNE_FILE if set, and LWGRP_TUNE_BARRIER, LWGRP_TUNE_ALLREDUCE,
+ * and LWGRP_TUNE_ALLGATHER may name an algorithm to force: dissem,
+ * radix, or tree.  All procs must use the same table. */
+
+/* time each algorithm on group and record the fastest in the table */
+int lwgrp_tune_run(const lwgrp* group);
+
+/* merge entries from file into the table */
+int lwgrp_tune_load(const char* file);
+
+/* write table to file, typically called by a single proc */
+int lwgrp_tune_save(const char* file);
+
+/* copy file at path on root to dest_path on every node of group,
+ * one proc per node writes the file while forwarding it down a
+ * pipelined binary tree, returns once the file is on our node.  Procs
+ * with the same value of $LWGRP_FILE_NODE share one copy, or the same
+ * hostname if it is not set. */
+int lwgrp_bcast_file(const char* path, const char* dest_path, int64_t root, const lwgrp* group);
+
+/* estimate offset of our clock from that of rank 0 with ping-pongs
+ * that spread from rank 0 over the dissemination channels, and drift
+ * from the change since our last sync, trace events are then written
+ * in the time of rank 0, call again later to refine drift */
+int lwgrp_clock_sync(const lwgrp* group);
+
+/* The key-value store spreads entries across the procs of a group by
+ * hash of key.  Puts are buffered and delivered to their owners at
+ * the next fence, and gets fetch values from owners on demand through
+ * a service thread on each proc.  Requires TCP endpoints. */
+
+/* create key-value store over group, collective over group */
+lwgrp_kvs* lwgrp_kvs_create(const lwgrp* group);
+
+/* free key-value store, collective over group */
+int lwgrp_kvs_free(lwgrp_kvs** pkvs);
+
+/* record key/value pair to be stored at the next fence */
+int lwgrp_kvs_put(lwgrp_kvs* kvs, const char* key, const char* val);
+
+/* store all pending puts, collective over group */
+int lwgrp_kvs_fence(lwgrp_kvs* kvs);
+
+/* returns value of key stored by a previous fence, or NULL if not
+ * found, the value is valid until the next fence */
+const char* lwgrp_kvs_get(lwgrp_kvs* kvs, const char* key);
+
+/* Hierarchical collectives run in three steps: procs on each node
+ * combine data on their leader, leaders run the collective across
+ * nodes, and leaders hand the result back to procs on their node.
+ * Traffic between nodes then scales with the number of nodes rather
+ * than the number of procs. */
+
+/* build node and leader groups for world, procs with the same node
+ * string are on the same node, uses hostname if node is NULL */
+lwgrp_hier* lwgrp_hier_create(const lwgrp* world, const char* node);
+
+/* build socket, node, and leader groups for world, procs with the
+ * same node string and socket id share a socket, detects socket with
+ * lwgrp_socket_id if socket is negative */
+lwgrp_hier* lwgrp_hier_create_socket(const lwgrp* world, const char* node, int64_t socket);
+
+/* returns NUMA node or socket id of the cpus the calling process may
+ * run on from sysfs, or -1 if unknown or if they span sockets */
+int64_t lwgrp_socket_id(void);
+
+/* free node and leader groups, world group is not freed */
+int lwgrp_hier_free(lwgrp_hier** phier);
+
+/* execute a barrier on the world group */
+int lwgrp_hier_barrier(const lwgrp_hier* hier);
+
+/* compute sum across procs of a vector of uint64_t values */
+int lwgrp_hier_allreduce_uint64_sum(uint64_t* buf, uint64_t count, const lwgrp_hier* hier);
+
+/* compute maximum across procs of a vector of uint64_t values */
+int lwgrp_hier_allreduce_uint64_max(uint64_t* buf, uint64_t count, const lwgrp_hier* hier);
+
+/* copy buf_size bytes in buf from root (rank in world) to all procs */
+int lwgrp_hier_bcast(void* buf, size_t buf_size, int64_t root, const lwgrp_hier* hier);
+
+/* gather strmap from all procs */
+int lwgrp_hier_allgather_strmap(strmap* map, const lwgrp_hier* hier);
+
 #ifdef __cplusplus
 }
 #endif
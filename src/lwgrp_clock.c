@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667277.
+ * All rights reserved.
+ * This file is part of the SpawnNet library.
+ * For details, see https://github.com/hpc/spawnnet
+ * Please also read the LICENSE file.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lwgrp.h"
+#include "spawn_internal.h"
+
+/* Rank 0 defines global time.  In round d, procs with rank less than
+ * 2^d have their offset to global time and each serves pings from
+ * the proc 2^d hops to its right over the dissemination channels.
+ * The pinging proc notes its local time before and after each ping,
+ * and the root replies with its global time.  Taking the ping with the
+ * shortest round trip, the reply was sent within rtt/2 of the local
+ * midpoint, so offset = reply - midpoint to within half the excess
+ * over the one-way latency, and all procs are synced after log2(N)
+ * rounds.  A single sync only lasts a few milliseconds, too short to
+ * measure drift, so drift comes from the change in offset since the
+ * previous sync of the same process. */
+
+/* pings per pair, the one with the shortest round trip wins */
+#define LWGRP_CLOCK_PINGS (32)
+
+/* least nanoseconds between syncs to estimate drift */
+#define LWGRP_CLOCK_DRIFT_MIN (1000000000)
+
+/* returns global time in nanoseconds given current clock mapping */
+static int64_t lwgrp_clock_global(void)
+{
+  int64_t offset, base;
+  double drift;
+  spawn_trace_get_clock(&offset, &drift, &base);
+  int64_t t = spawn_trace_time_ns();
+  return t + offset + (int64_t) (drift * (double) (t - base));
+}
+
+/* answer pings from child with our global time */
+static int lwgrp_clock_serve(const spawn_net_channel* ch)
+{
+  int i;
+  for (i = 0; i < LWGRP_CLOCK_PINGS; i++) {
+    char c;
+    if (spawn_net_read(ch, &c, sizeof(c)) != SPAWN_SUCCESS) {
+      return LWGRP_FAILURE;
+    }
+    int64_t now = lwgrp_clock_global();
+    if (spawn_net_write(ch, &now, sizeof(now)) != SPAWN_SUCCESS) {
+      return LWGRP_FAILURE;
+    }
+  }
+  return LWGRP_SUCCESS;
+}
+
+/* ping parent and set our clock mapping from its replies */
+static int lwgrp_clock_ping(const spawn_net_channel* ch)
+{
+  int64_t best_rtt    = -1;
+  int64_t best_offset = 0;
+  int64_t best_time   = 0;
+
+  int i;
+  for (i = 0; i < LWGRP_CLOCK_PINGS; i++) {
+    char c = 'C';
+    int64_t remote;
+    int64_t t0 = spawn_trace_time_ns();
+    if (spawn_net_write(ch, &c, sizeof(c)) != SPAWN_SUCCESS ||
+        spawn_net_read(ch, &remote, sizeof(remote)) != SPAWN_SUCCESS)
+    {
+      return LWGRP_FAILURE;
+    }
+    int64_t t1 = spawn_trace_time_ns();
+
+    int64_t rtt = t1 - t0;
+    if (best_rtt < 0 || rtt < best_rtt) {
+      best_rtt    = rtt;
+      best_time   = t0 + rtt / 2;
+      best_offset = remote - best_time;
+    }
+  }
+
+  /* estimate drift from the offset we measured last time */
+  int64_t offset, base;
+  double drift;
+  spawn_trace_get_clock(&offset, &drift, &base);
+  if (base != 0 && best_time - base >= LWGRP_CLOCK_DRIFT_MIN) {
+    drift = (double) (best_offset - offset) / (double) (best_time - base);
+  }
+  spawn_trace_set_clock(best_offset, drift, best_time);
+
+  return LWGRP_SUCCESS;
+}
+
+int lwgrp_clock_sync(const lwgrp* group)
+{
+  int64_t rank  = group->rank;
+  int64_t ranks = group->size;
+
+  SPAWN_TRACE_BEGIN("lwgrp_clock_sync", ranks);
+
+  /* root clock is global time */
+  if (rank == 0) {
+    spawn_trace_set_clock(0, 0.0, spawn_trace_time_ns());
+  }
+
+  int rc = LWGRP_SUCCESS;
+  int round = 0;
+  int64_t dist = 1;
+  while (dist < ranks && rc == LWGRP_SUCCESS) {
+    if (rank < dist && rank + dist < ranks) {
+      /* we have our offset, serve the proc dist hops to the right */
+      rc = lwgrp_clock_serve(group->list_right[round]);
+    } else if (rank >= dist && rank < dist * 2) {
+      /* get our offset from the proc dist hops to the left */
+      rc = lwgrp_clock_ping(group->list_left[round]);
+    }
+
+    dist <<= 1;
+    round++;
+  }
+
+  SPAWN_TRACE_END("lwgrp_clock_sync", ranks);
+
+  return rc;
+}
@@ -0,0 +1,342 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667277.
+ * All rights reserved.
+ * This file is part of the SpawnNet library.
+ * For details, see https://github.com/hpc/spawnnet
+ * Please also read the LICENSE file.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "lwgrp.h"
+#include "spawn_internal.h"
+
+/* One proc per node writes the file: the root on its own node and
+ * rank 0 of the node group elsewhere.  The writers are ordered
+ * starting at the root and form a binary tree, and the file flows
+ * down the tree in chunks, so each writer receives a chunk from its
+ * parent, forwards it to its children, and writes it to local
+ * storage while the next chunk is in flight.  Each writer sends the
+ * file at most twice, and a chunk reaches the last writer after
+ * O(log N) hops, so staging takes about 2 * file_size / bandwidth
+ * plus O(log N) chunk times, rather than one chunk time per node as
+ * in a chain.
+ *
+ * A writer can only reach writers a power of two hops away, so the
+ * tree is built on those channels.  A writer that covers a range of
+ * writers after it hands the first d - 1 of them to its neighbor and
+ * the rest to the writer d hops away, where d is the power of two
+ * that splits the range most evenly. */
+
+/* size of chunks sent down the tree */
+#define LWGRP_FILE_CHUNK (1024 * 1024)
+
+/* header sent ahead of file data */
+typedef struct lwgrp_file_hdr_t {
+  uint64_t size; /* size of file in bytes, UINT64_MAX if root failed */
+  uint64_t mode; /* permission bits of file */
+} lwgrp_file_hdr;
+
+/* at most two children per writer */
+#define LWGRP_FILE_CHILDREN (2)
+
+/* given a writer covering the len - 1 writers after it, returns
+ * power of two d that splits them most evenly between the neighbor,
+ * which covers the next d - 1, and the writer d hops away, which
+ * covers the remaining len - d */
+static int64_t lwgrp_file_split(int64_t len)
+{
+  int64_t best = 1;
+  int64_t best_max = len - 1;
+  int64_t d;
+  for (d = 2; d <= len - 1; d <<= 1) {
+    int64_t max = (d - 1 > len - d) ? d - 1 : len - d;
+    if (max < best_max) {
+      best = d;
+      best_max = max;
+    }
+  }
+  return best;
+}
+
+/* returns index of channel list for a distance that is a power of two */
+static int lwgrp_file_round(int64_t dist)
+{
+  int round = 0;
+  while (((int64_t) 1 << round) < dist) {
+    round++;
+  }
+  return round;
+}
+
+/* find our parent and children in the tree of writers rooted at
+ * rank 0, returns number of children */
+static int lwgrp_file_tree(
+  const lwgrp* writers,
+  const spawn_net_channel** parent,
+  const spawn_net_channel** children)
+{
+  int64_t rank = writers->rank;
+
+  /* walk down from the root to find the range we cover */
+  int64_t pos = 0;
+  int64_t len = writers->size;
+  *parent = NULL;
+  while (pos != rank) {
+    int64_t d = lwgrp_file_split(len);
+    int64_t dist;
+    if (d > 1 && rank < pos + d) {
+      dist = 1;
+      len  = d - 1;
+    } else {
+      dist = d;
+      len  = len - d;
+    }
+    pos += dist;
+    if (pos == rank) {
+      *parent = writers->list_left[lwgrp_file_round(dist)];
+    }
+  }
+
+  /* forward to the neighbor and to the writer d hops away */
+  int count = 0;
+  if (len > 1) {
+    int64_t d = lwgrp_file_split(len);
+    if (d > 1) {
+      children[count++] = writers->list_right[0];
+    }
+    children[count++] = writers->list_right[lwgrp_file_round(d)];
+  }
+  return count;
+}
+
+/* write header to each child */
+static void lwgrp_file_write_hdr(
+  const lwgrp_file_hdr* hdr,
+  const spawn_net_channel** children,
+  int nchildren)
+{
+  int i;
+  for (i = 0; i < nchildren; i++) {
+    spawn_net_write(children[i], hdr, sizeof(lwgrp_file_hdr));
+  }
+}
+
+/* write size bytes to fd, retrying on short writes */
+static int lwgrp_file_write(int fd, const char* path, const void* buf, size_t size)
+{
+  const char* ptr = (const char*) buf;
+  size_t total = 0;
+  while (total < size) {
+    ssize_t count = write(fd, ptr + total, size - total);
+    if (count > 0) {
+      total += (size_t) count;
+    } else if (count < 0 && errno == EINTR) {
+      continue;
+    } else {
+      SPAWN_ERR("Failed to write %s (write() errno=%d %s)", path, errno, strerror(errno));
+      return LWGRP_FAILURE;
+    }
+  }
+  return LWGRP_SUCCESS;
+}
+
+/* root sends file down the tree, and copies it to dest_path
+ * if that differs from path */
+static int lwgrp_file_send(
+  const char* path,
+  const char* dest_path,
+  const spawn_net_channel** children,
+  int nchildren)
+{
+  lwgrp_file_hdr hdr;
+  hdr.size = UINT64_MAX;
+  hdr.mode = 0;
+
+  int fd = open(path, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) < 0) {
+    SPAWN_ERR("Failed to open %s (errno=%d %s)", path, errno, strerror(errno));
+    if (fd >= 0) {
+      close(fd);
+    }
+    lwgrp_file_write_hdr(&hdr, children, nchildren);
+    return LWGRP_FAILURE;
+  }
+  hdr.size = (uint64_t) st.st_size;
+  hdr.mode = (uint64_t) (st.st_mode & 07777);
+  lwgrp_file_write_hdr(&hdr, children, nchildren);
+
+  /* map the file to copy it locally */
+  int rc = LWGRP_SUCCESS;
+  int dest = -1;
+  void* map = NULL;
+  if (strcmp(path, dest_path) != 0) {
+    dest = open(dest_path, O_WRONLY | O_CREAT | O_TRUNC, (mode_t) hdr.mode);
+    if (dest < 0) {
+      SPAWN_ERR("Failed to open %s (open() errno=%d %s)", dest_path, errno, strerror(errno));
+      rc = LWGRP_FAILURE;
+    }
+  }
+  if (dest >= 0 && hdr.size > 0) {
+    map = mmap(NULL, (size_t) hdr.size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+      SPAWN_ERR("Failed to map %s (mmap() errno=%d %s)", path, errno, strerror(errno));
+      map = NULL;
+      rc = LWGRP_FAILURE;
+    }
+  }
+
+  uint64_t offset = 0;
+  while (offset < hdr.size) {
+    size_t count = LWGRP_FILE_CHUNK;
+    if (hdr.size - offset < (uint64_t) count) {
+      count = (size_t) (hdr.size - offset);
+    }
+
+    /* send chunk, then copy it while it moves down the tree */
+    int i;
+    for (i = 0; i < nchildren; i++) {
+      spawn_net_sendfile(children[i], fd, (off_t) offset, count);
+    }
+    if (dest >= 0 && map != NULL) {
+      if (lwgrp_file_write(dest, dest_path, (char*) map + offset, count) != LWGRP_SUCCESS) {
+        close(dest);
+        dest = -1;
+        rc = LWGRP_FAILURE;
+      }
+    }
+
+    offset += (uint64_t) count;
+  }
+
+  if (map != NULL) {
+    munmap(map, (size_t) hdr.size);
+  }
+  if (dest >= 0) {
+    close(dest);
+  }
+  close(fd);
+
+  return rc;
+}
+
+/* receive file from parent, forward it to our children,
+ * and write it to dest_path */
+static int lwgrp_file_recv(
+  const char* dest_path,
+  const spawn_net_channel* parent,
+  const spawn_net_channel** children,
+  int nchildren)
+{
+  lwgrp_file_hdr hdr;
+  spawn_net_read(parent, &hdr, sizeof(hdr));
+  lwgrp_file_write_hdr(&hdr, children, nchildren);
+  if (hdr.size == UINT64_MAX) {
+    return LWGRP_FAILURE;
+  }
+
+  /* keep forwarding even if we fail to write, so procs below us
+   * still get the file */
+  int rc = LWGRP_SUCCESS;
+  int dest = open(dest_path, O_WRONLY | O_CREAT | O_TRUNC, (mode_t) hdr.mode);
+  if (dest < 0) {
+    SPAWN_ERR("Failed to open %s (open() errno=%d %s)", dest_path, errno, strerror(errno));
+    rc = LWGRP_FAILURE;
+  }
+
+  char* buf = (char*) SPAWN_MALLOC(LWGRP_FILE_CHUNK);
+  uint64_t offset = 0;
+  while (offset < hdr.size) {
+    size_t count = LWGRP_FILE_CHUNK;
+    if (hdr.size - offset < (uint64_t) count) {
+      count = (size_t) (hdr.size - offset);
+    }
+
+    spawn_net_read(parent, buf, count);
+    int i;
+    for (i = 0; i < nchildren; i++) {
+      spawn_net_write(children[i], buf, count);
+    }
+    if (dest >= 0) {
+      if (lwgrp_file_write(dest, dest_path, buf, count) != LWGRP_SUCCESS) {
+        close(dest);
+        dest = -1;
+        rc = LWGRP_FAILURE;
+      }
+    }
+
+    offset += (uint64_t) count;
+  }
+  spawn_free(&buf);
+
+  if (dest >= 0) {
+    close(dest);
+  }
+
+  return rc;
+}
+
+int lwgrp_bcast_file(const char* path, const char* dest_path, int64_t root, const lwgrp* group)
+{
+  int64_t rank  = group->rank;
+  int64_t ranks = group->size;
+
+  /* procs on the same node share one copy, unless told otherwise */
+  char hostname[HOST_NAME_MAX + 1];
+  const char* node_name = getenv("LWGRP_FILE_NODE");
+  if (node_name == NULL) {
+    if (gethostname(hostname, sizeof(hostname)) < 0) {
+      SPAWN_ERR("Failed gethostname()");
+      return LWGRP_FAILURE;
+    }
+    hostname[HOST_NAME_MAX] = '\0';
+    node_name = hostname;
+  }
+
+  /* the root writes for its own node, rank 0 of the node group
+   * writes for the others */
+  lwgrp* node = lwgrp_split_str(group, node_name);
+  uint64_t has_root = (rank == root);
+  lwgrp_allreduce_uint64_max(&has_root, 1, node);
+  int writer = has_root ? (rank == root) : (lwgrp_rank(node) == 0);
+
+  /* order writers by rank starting at the root */
+  int64_t key = (rank - root + ranks) % ranks;
+  lwgrp* writers = lwgrp_split(group, writer ? 0 : 1, key);
+
+  uint64_t failed = 0;
+  if (writer) {
+    const spawn_net_channel* parent;
+    const spawn_net_channel* children[LWGRP_FILE_CHILDREN];
+    int nchildren = lwgrp_file_tree(writers, &parent, children);
+    int rc;
+    if (rank == root) {
+      rc = lwgrp_file_send(path, dest_path, children, nchildren);
+    } else {
+      rc = lwgrp_file_recv(dest_path, parent, children, nchildren);
+    }
+    failed = (rc != LWGRP_SUCCESS);
+  }
+
+  /* procs return once their node has the file */
+  lwgrp_allreduce_uint64_max(&failed, 1, node);
+
+  lwgrp_free(&writers);
+  lwgrp_free(&node);
+
+  return failed ? LWGRP_FAILURE : LWGRP_SUCCESS;
+}
@@ -0,0 +1,381 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667277.
+ * All rights reserved.
+ * This file is part of the SpawnNet library.
+ * For details, see https://github.com/hpc/spawnnet
+ * Please also read the LICENSE file.
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sched.h>
+#include <dirent.h>
+
+#include "lwgrp.h"
+#include "spawn_internal.h"
+
+/* The node group holds all procs that share a node string, ordered
+ * by their rank in the world group, so the leader of each node is
+ * the node proc with the lowest world rank.  The leader group is
+ * created by splitting the world group on node rank, which keeps
+ * each split small, and procs other than leaders free their piece.
+ *
+ * With a socket level, the node group is ordered by socket id and
+ * then world rank, procs on the same socket of a node form a socket
+ * group, and the first proc of each socket joins a group with the
+ * other socket leaders on its node.  Data then moves within a socket
+ * before it crosses the socket interconnect, and the node leader is
+ * the first proc of the first socket. */
+
+/* reads a single integer from a sysfs file, returns -1 on error */
+static int64_t lwgrp_read_sys_int(const char* path)
+{
+  int64_t value = -1;
+  FILE* fp = fopen(path, "r");
+  if (fp != NULL) {
+    long long v;
+    if (fscanf(fp, "%lld", &v) == 1) {
+      value = (int64_t) v;
+    }
+    fclose(fp);
+  }
+  return value;
+}
+
+/* returns the NUMA node of a cpu from its nodeN link in sysfs,
+ * or -1 if the kernel does not list one */
+static int64_t lwgrp_cpu_numa(int cpu)
+{
+  char path[256];
+  snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+
+  int64_t numa = -1;
+  DIR* dir = opendir(path);
+  if (dir != NULL) {
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+      long long id;
+      if (sscanf(entry->d_name, "node%lld", &id) == 1) {
+        numa = (int64_t) id;
+        break;
+      }
+    }
+    closedir(dir);
+  }
+  return numa;
+}
+
+int64_t lwgrp_socket_id(void)
+{
+  cpu_set_t mask;
+  if (sched_getaffinity(0, sizeof(mask), &mask) != 0) {
+    return -1;
+  }
+
+  /* all cpus we may run on must agree on the socket */
+  int64_t socket = -1;
+  int cpu;
+  for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (! CPU_ISSET(cpu, &mask)) {
+      continue;
+    }
+
+    /* prefer the NUMA node, fall back to the physical package */
+    int64_t id = lwgrp_cpu_numa(cpu);
+    if (id < 0) {
+      char path[256];
+      snprintf(path, sizeof(path),
+        "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu
+      );
+      id = lwgrp_read_sys_int(path);
+    }
+
+    /* give up if we can't tell, or if we span sockets */
+    if (id < 0 || (socket >= 0 && id != socket)) {
+      return -1;
+    }
+    socket = id;
+  }
+
+  return socket;
+}
+
+lwgrp_hier* lwgrp_hier_create(const lwgrp* world, const char* node)
+{
+  /* use our hostname if caller did not name our node */
+  char hostname[HOST_NAME_MAX + 1];
+  if (node == NULL) {
+    if (gethostname(hostname, sizeof(hostname)) < 0) {
+      SPAWN_ERR("Failed gethostname()");
+      return NULL;
+    }
+    hostname[HOST_NAME_MAX] = '\0';
+    node = hostname;
+  }
+
+  lwgrp_hier* hier = (lwgrp_hier*) SPAWN_MALLOC(sizeof(lwgrp_hier));
+  hier->world   = world;
+  hier->socket  = NULL;
+  hier->sockets = NULL;
+
+  /* get group of procs on same node */
+  hier->node = lwgrp_split_str(world, node);
+
+  /* get group of leaders (procs having same rank in node group) */
+  int64_t color = lwgrp_rank(hier->node);
+  int64_t key   = lwgrp_rank(world);
+  hier->leaders = lwgrp_split(world, color, key);
+
+  /* only leaders keep their group */
+  if (color != 0) {
+    lwgrp_free(&hier->leaders);
+  }
+
+  return hier;
+}
+
+lwgrp_hier* lwgrp_hier_create_socket(const lwgrp* world, const char* node, int64_t socket)
+{
+  /* use our hostname if caller did not name our node */
+  char hostname[HOST_NAME_MAX + 1];
+  if (node == NULL) {
+    if (gethostname(hostname, sizeof(hostname)) < 0) {
+      SPAWN_ERR("Failed gethostname()");
+      return NULL;
+    }
+    hostname[HOST_NAME_MAX] = '\0';
+    node = hostname;
+  }
+
+  /* look up our socket if caller did not name it */
+  if (socket < 0) {
+    socket = lwgrp_socket_id();
+  }
+
+  lwgrp_hier* hier = (lwgrp_hier*) SPAWN_MALLOC(sizeof(lwgrp_hier));
+  hier->world = world;
+
+  /* get groups of procs on same node and same socket in one sort */
+  lwgrp_split_str_multi(world, node, socket, &hier->node, &hier->socket);
+
+  /* get group of socket leaders on our node */
+  int64_t color = lwgrp_rank(hier->socket);
+  int64_t key   = lwgrp_rank(hier->node);
+  hier->sockets = lwgrp_split(hier->node, color, key);
+  if (color != 0) {
+    lwgrp_free(&hier->sockets);
+  }
+
+  /* get group of node leaders */
+  color = lwgrp_rank(hier->node);
+  key   = lwgrp_rank(world);
+  hier->leaders = lwgrp_split(world, color, key);
+  if (color != 0) {
+    lwgrp_free(&hier->leaders);
+  }
+
+  return hier;
+}
+
+int lwgrp_hier_free(lwgrp_hier** phier)
+{
+  if (phier == NULL) {
+    return LWGRP_FAILURE;
+  }
+
+  lwgrp_hier* hier = *phier;
+  if (hier != NULL) {
+    if (hier->leaders != NULL) {
+      lwgrp_free(&hier->leaders);
+    }
+    if (hier->sockets != NULL) {
+      lwgrp_free(&hier->sockets);
+    }
+    if (hier->socket != NULL) {
+      lwgrp_free(&hier->socket);
+    }
+    lwgrp_free(&hier->node);
+    spawn_free(phier);
+  }
+
+  return LWGRP_SUCCESS;
+}
+
+/* reduce values from procs on our node to our leader,
+ * within our socket first if we have a socket level */
+static void lwgrp_hier_reduce_node(uint64_t* buf, uint64_t count, int max, const lwgrp_hier* hier)
+{
+  if (hier->socket == NULL) {
+    if (! max) {
+      lwgrp_reduce_uint64_sum(buf, count, 0, hier->node);
+    } else {
+      lwgrp_reduce_uint64_max(buf, count, 0, hier->node);
+    }
+    return;
+  }
+
+  if (! max) {
+    lwgrp_reduce_uint64_sum(buf, count, 0, hier->socket);
+    if (hier->sockets != NULL) {
+      lwgrp_reduce_uint64_sum(buf, count, 0, hier->sockets);
+    }
+  } else {
+    lwgrp_reduce_uint64_max(buf, count, 0, hier->socket);
+    if (hier->sockets != NULL) {
+      lwgrp_reduce_uint64_max(buf, count, 0, hier->sockets);
+    }
+  }
+}
+
+/* copy data from our leader to procs on our node,
+ * across socket leaders first if we have a socket level */
+static void lwgrp_hier_bcast_node(void* buf, size_t buf_size, const lwgrp_hier* hier)
+{
+  if (hier->socket == NULL) {
+    lwgrp_bcast(buf, buf_size, 0, hier->node);
+    return;
+  }
+
+  if (hier->sockets != NULL) {
+    lwgrp_bcast(buf, buf_size, 0, hier->sockets);
+  }
+  lwgrp_bcast(buf, buf_size, 0, hier->socket);
+}
+
+/* merge maps from procs on our node to our leader */
+static void lwgrp_hier_gather_strmap_node(strmap* map, const lwgrp_hier* hier)
+{
+  if (hier->socket == NULL) {
+    lwgrp_gather_strmap(map, 0, hier->node);
+    return;
+  }
+
+  lwgrp_gather_strmap(map, 0, hier->socket);
+  if (hier->sockets != NULL) {
+    lwgrp_gather_strmap(map, 0, hier->sockets);
+  }
+}
+
+/* copy map from our leader to procs on our node */
+static void lwgrp_hier_bcast_strmap_node(strmap* map, const lwgrp_hier* hier)
+{
+  if (hier->socket == NULL) {
+    lwgrp_bcast_strmap(map, 0, hier->node);
+    return;
+  }
+
+  if (hier->sockets != NULL) {
+    lwgrp_bcast_strmap(map, 0, hier->sockets);
+  }
+  lwgrp_bcast_strmap(map, 0, hier->socket);
+}
+
+int lwgrp_hier_barrier(const lwgrp_hier* hier)
+{
+  /* wait for all procs on our node to reach our leader */
+  uint64_t token = 0;
+  lwgrp_hier_reduce_node(&token, 1, 0, hier);
+
+  /* wait for all leaders */
+  if (hier->leaders != NULL) {
+    lwgrp_barrier(hier->leaders);
+  }
+
+  /* release procs on our node */
+  lwgrp_hier_bcast_node(&token, sizeof(token), hier);
+
+  return LWGRP_SUCCESS;
+}
+
+int lwgrp_hier_allreduce_uint64_sum(uint64_t* buf, uint64_t count, const lwgrp_hier* hier)
+{
+  /* sum values on our node to our leader */
+  lwgrp_hier_reduce_node(buf, count, 0, hier);
+
+  /* sum values across leaders */
+  if (hier->leaders != NULL) {
+    lwgrp_allreduce_uint64_sum(buf, count, hier->leaders);
+  }
+
+  /* copy result to procs on our node */
+  lwgrp_hier_bcast_node(buf, count * sizeof(uint64_t), hier);
+
+  return LWGRP_SUCCESS;
+}
+
+int lwgrp_hier_allreduce_uint64_max(uint64_t* buf, uint64_t count, const lwgrp_hier* hier)
+{
+  /* compute max of values on our node to our leader */
+  lwgrp_hier_reduce_node(buf, count, 1, hier);
+
+  /* compute max across leaders */
+  if (hier->leaders != NULL) {
+    lwgrp_allreduce_uint64_max(buf, count, hier->leaders);
+  }
+
+  /* copy result to procs on our node */
+  lwgrp_hier_bcast_node(buf, count * sizeof(uint64_t), hier);
+
+  return LWGRP_SUCCESS;
+}
+
+int lwgrp_hier_bcast(void* buf, size_t buf_size, int64_t root, const lwgrp_hier* hier)
+{
+  /* find node rank of root if it is on our node, this only
+   * involves procs on our node */
+  uint64_t root_node = 0;
+  if (lwgrp_rank(hier->world) == root) {
+    root_node = (uint64_t) lwgrp_rank(hier->node) + 1;
+  }
+  lwgrp_allreduce_uint64_max(&root_node, 1, hier->node);
+
+  /* if root is on our node, copy its data to all procs on our node,
+   * including our leader */
+  if (root_node > 0) {
+    lwgrp_bcast(buf, buf_size, (int64_t) root_node - 1, hier->node);
+  }
+
+  /* copy data from leader of root node to other leaders */
+  if (hier->leaders != NULL) {
+    /* find rank of leader on root node */
+    uint64_t root_leader = 0;
+    if (root_node > 0) {
+      root_leader = (uint64_t) lwgrp_rank(hier->leaders) + 1;
+    }
+    lwgrp_allreduce_uint64_max(&root_leader, 1, hier->leaders);
+
+    lwgrp_bcast(buf, buf_size, (int64_t) root_leader - 1, hier->leaders);
+  }
+
+  /* copy data from our leader to procs on our node */
+  if (root_node == 0) {
+    lwgrp_hier_bcast_node(buf, buf_size, hier);
+  }
+
+  return LWGRP_SUCCESS;
+}
+
+int lwgrp_hier_allgather_strmap(strmap* map, const lwgrp_hier* hier)
+{
+  /* merge maps from procs on our node to our leader */
+  lwgrp_hier_gather_strmap_node(map, hier);
+
+  /* gather maps across leaders */
+  if (hier->leaders != NULL) {
+    lwgrp_allgather_strmap(map, hier->leaders);
+  }
+
+  /* copy result to procs on our node */
+  lwgrp_hier_bcast_strmap_node(map, hier);
+
+  return LWGRP_SUCCESS;
+}
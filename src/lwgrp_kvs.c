@@ -0,0 +1,661 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667277.
+ * All rights reserved.
+ * This file is part of the SpawnNet library.
+ * For details, see https://github.com/hpc/spawnnet
+ * Please also read the LICENSE file.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <pthread.h>
+
+#include "lwgrp.h"
+#include "spawn_internal.h"
+
+/* Each key is owned by the proc whose rank is the hash of the key
+ * modulo the group size, and each proc stores only the entries it
+ * owns.  Puts are buffered until a fence, which delivers them to
+ * their owners with lwgrp_sparse_exchange, so the fence costs one
+ * sparse exchange regardless of how many keys each proc puts.
+ *
+ * Gets are served on demand by a service thread on each proc.  The
+ * service thread owns a second endpoint and a copy of the group
+ * built on it, so its channels never carry traffic from collectives
+ * on the caller's group.  A request travels toward the owner over
+ * the 2^d channels, taking the longest hop that does not pass the
+ * owner, so it reaches the owner in at most log2(N) hops, and the
+ * reply travels back to the origin the same way.  The caller hands
+ * requests to its own service thread over a local channel, and gets
+ * cache each value until the next fence.
+ *
+ * Two service threads may forward messages to each other at the same
+ * time, so they must never block in a write that waits on the other
+ * to read.  Between service threads, each message is split into
+ * frames of at most LWGRP_KVS_CHUNK bytes and queued on the channel
+ * of its next hop.  A thread may have at most LWGRP_KVS_WINDOW frames
+ * on a channel that the other side has not yet credited, which keeps
+ * every write within the transport buffers, and it reads whatever
+ * arrives while frames wait for credits.
+ *
+ * The service thread waits on its channels while the main thread
+ * communicates on the caller's group, which the FIFO transport does
+ * not support, since all channels of a process share one pipe and
+ * packet queue, so the store requires TCP. */
+
+/* message types between service threads */
+#define LWGRP_KVS_GET      (1) /* request for value of key */
+#define LWGRP_KVS_REPLY    (2) /* value of key returned to origin */
+#define LWGRP_KVS_SHUTDOWN (3) /* tells service thread to exit */
+
+/* frame types on channels between service threads */
+#define LWGRP_KVS_FRAME_DATA   (1) /* carries part of a message */
+#define LWGRP_KVS_FRAME_CREDIT (2) /* lets sender write another frame */
+
+/* max bytes of message in one frame */
+#define LWGRP_KVS_CHUNK (16384)
+
+/* number of frames a thread may have uncredited on a channel */
+#define LWGRP_KVS_WINDOW (2)
+
+/* header of messages between service threads, followed by key_len
+ * bytes of key and val_len bytes of value */
+typedef struct lwgrp_kvs_msg_t {
+  uint64_t type;    /* message type */
+  int64_t origin;   /* rank of proc that issued the get */
+  int64_t owner;    /* rank of proc that owns the key */
+  uint64_t found;   /* whether the owner has the key */
+  uint64_t key_len; /* length of key including terminating NUL */
+  uint64_t val_len; /* length of value including terminating NUL */
+} lwgrp_kvs_msg;
+
+/* header of frames between service threads, followed by len bytes */
+typedef struct lwgrp_kvs_frame_t {
+  uint64_t type;  /* frame type */
+  uint64_t total; /* size of message the frame belongs to */
+  uint64_t len;   /* number of bytes of message in frame */
+} lwgrp_kvs_frame;
+
+/* message waiting to be sent on a link */
+typedef struct lwgrp_kvs_out_t {
+  char* buf;     /* packed message */
+  uint64_t size; /* size of packed message */
+  uint64_t sent; /* number of bytes written so far */
+  struct lwgrp_kvs_out_t* next;
+} lwgrp_kvs_out;
+
+/* state of a channel between service threads */
+typedef struct lwgrp_kvs_link_t {
+  const spawn_net_channel* ch; /* channel to other service thread */
+  lwgrp_kvs_out* head;  /* messages waiting to be sent */
+  lwgrp_kvs_out* tail;  /* last message waiting to be sent */
+  int inflight;         /* frames written but not yet credited */
+  char* recv;           /* message being received */
+  uint64_t recv_size;   /* size of message being received */
+  uint64_t recvd;       /* bytes of message received so far */
+} lwgrp_kvs_link;
+
+struct lwgrp_kvs_t {
+  const lwgrp* group;       /* group given by caller */
+  spawn_net_endpoint* ep;   /* endpoint of service thread */
+  lwgrp* net;               /* copy of group on service endpoint */
+  spawn_net_channel* local; /* main thread side of local channel */
+  spawn_net_channel* svc;   /* service thread side of local channel */
+  strmap* store;            /* entries we own */
+  strmap* puts;             /* puts since the last fence */
+  strmap* cache;            /* values fetched since the last fence */
+  pthread_mutex_t mutex;    /* protects store */
+  pthread_t thread;         /* service thread */
+};
+
+/* FNV-1a hash of key */
+static uint64_t lwgrp_kvs_hash(const char* key)
+{
+  uint64_t hash = 14695981039346656037ULL;
+  const unsigned char* ptr = (const unsigned char*) key;
+  while (*ptr != '\0') {
+    hash ^= (uint64_t) *ptr;
+    hash *= 1099511628211ULL;
+    ptr++;
+  }
+  return hash;
+}
+
+/* returns rank of proc that owns key */
+static int64_t lwgrp_kvs_owner(const lwgrp_kvs* kvs, const char* key)
+{
+  return (int64_t) (lwgrp_kvs_hash(key) % (uint64_t) kvs->group->size);
+}
+
+/* returns link of next hop from our rank toward target rank, where
+ * links holds the left and right links of each round, or NULL if
+ * target is our own rank */
+static lwgrp_kvs_link* lwgrp_kvs_route(const lwgrp_kvs* kvs, lwgrp_kvs_link* links, int64_t target)
+{
+  const lwgrp* net = kvs->net;
+  if (target == net->rank) {
+    return NULL;
+  }
+
+  /* take the longest 2^d hop that does not pass the target */
+  int64_t dist = target - net->rank;
+  if (dist < 0) {
+    dist = -dist;
+  }
+  int round = 0;
+  while ((((int64_t) 1) << (round + 1)) <= dist) {
+    round++;
+  }
+
+  if (target > net->rank) {
+    return &links[2 * round + 1];
+  }
+  return &links[2 * round];
+}
+
+/* write message header, key, and value to channel */
+static void lwgrp_kvs_write(const spawn_net_channel* ch, const lwgrp_kvs_msg* msg, const char* key, const char* val)
+{
+  spawn_net_write(ch, msg, sizeof(lwgrp_kvs_msg));
+  if (msg->key_len > 0) {
+    spawn_net_write(ch, key, msg->key_len);
+  }
+  if (msg->val_len > 0) {
+    spawn_net_write(ch, val, msg->val_len);
+  }
+}
+
+/* read message header, key, and value from channel,
+ * returns newly allocated key and value, or NULL if empty */
+static void lwgrp_kvs_read(const spawn_net_channel* ch, lwgrp_kvs_msg* msg, char** key, char** val)
+{
+  spawn_net_read(ch, msg, sizeof(lwgrp_kvs_msg));
+  *key = NULL;
+  *val = NULL;
+  if (msg->key_len > 0) {
+    *key = (char*) SPAWN_MALLOC(msg->key_len);
+    spawn_net_read(ch, *key, msg->key_len);
+  }
+  if (msg->val_len > 0) {
+    *val = (char*) SPAWN_MALLOC(msg->val_len);
+    spawn_net_read(ch, *val, msg->val_len);
+  }
+}
+
+/* pack message header, key, and value into a new buffer */
+static char* lwgrp_kvs_pack(const lwgrp_kvs_msg* msg, const char* key, const char* val, uint64_t* size)
+{
+  *size = sizeof(lwgrp_kvs_msg) + msg->key_len + msg->val_len;
+  char* buf = (char*) SPAWN_MALLOC(*size);
+  char* ptr = buf;
+  memcpy(ptr, msg, sizeof(lwgrp_kvs_msg));
+  ptr += sizeof(lwgrp_kvs_msg);
+  if (msg->key_len > 0) {
+    memcpy(ptr, key, msg->key_len);
+    ptr += msg->key_len;
+  }
+  if (msg->val_len > 0) {
+    memcpy(ptr, val, msg->val_len);
+  }
+  return buf;
+}
+
+/* write frames queued on link until the window is full */
+static void lwgrp_kvs_flush(lwgrp_kvs_link* link)
+{
+  while (link->head != NULL && link->inflight < LWGRP_KVS_WINDOW) {
+    lwgrp_kvs_out* out = link->head;
+
+    uint64_t len = out->size - out->sent;
+    if (len > LWGRP_KVS_CHUNK) {
+      len = LWGRP_KVS_CHUNK;
+    }
+
+    lwgrp_kvs_frame frame;
+    frame.type  = LWGRP_KVS_FRAME_DATA;
+    frame.total = out->size;
+    frame.len   = len;
+    spawn_net_write(link->ch, &frame, sizeof(frame));
+    spawn_net_write(link->ch, out->buf + out->sent, len);
+    out->sent += len;
+    link->inflight++;
+
+    /* drop message once it is all written */
+    if (out->sent == out->size) {
+      link->head = out->next;
+      if (link->head == NULL) {
+        link->tail = NULL;
+      }
+      spawn_free(&out->buf);
+      spawn_free(&out);
+    }
+  }
+}
+
+/* queue message for the next hop toward target, or write it to our
+ * main thread if target is our rank, the main thread is waiting on
+ * its reply, so that write completes */
+static void lwgrp_kvs_send(
+  lwgrp_kvs* kvs,
+  lwgrp_kvs_link* links,
+  int64_t target,
+  const lwgrp_kvs_msg* msg,
+  const char* key,
+  const char* val)
+{
+  lwgrp_kvs_link* link = lwgrp_kvs_route(kvs, links, target);
+  if (link == NULL) {
+    lwgrp_kvs_write(kvs->svc, msg, key, val);
+    return;
+  }
+
+  lwgrp_kvs_out* out = (lwgrp_kvs_out*) SPAWN_MALLOC(sizeof(lwgrp_kvs_out));
+  out->buf  = lwgrp_kvs_pack(msg, key, val, &out->size);
+  out->sent = 0;
+  out->next = NULL;
+  if (link->tail != NULL) {
+    link->tail->next = out;
+  } else {
+    link->head = out;
+  }
+  link->tail = out;
+
+  lwgrp_kvs_flush(link);
+}
+
+/* read one frame from link, returns newly allocated message once its
+ * last frame arrives, and NULL otherwise */
+static char* lwgrp_kvs_recv(lwgrp_kvs_link* link)
+{
+  lwgrp_kvs_frame frame;
+  spawn_net_read(link->ch, &frame, sizeof(frame));
+
+  if (frame.type == LWGRP_KVS_FRAME_CREDIT) {
+    /* other side read one of our frames, so we can send another */
+    link->inflight--;
+    lwgrp_kvs_flush(link);
+    return NULL;
+  }
+
+  /* messages arrive one after another on each channel */
+  if (link->recv == NULL) {
+    link->recv      = (char*) SPAWN_MALLOC(frame.total);
+    link->recv_size = frame.total;
+    link->recvd     = 0;
+  }
+  spawn_net_read(link->ch, link->recv + link->recvd, frame.len);
+  link->recvd += frame.len;
+
+  /* we've read the frame, so let the sender write another */
+  lwgrp_kvs_frame credit;
+  credit.type  = LWGRP_KVS_FRAME_CREDIT;
+  credit.total = 0;
+  credit.len   = 0;
+  spawn_net_write(link->ch, &credit, sizeof(credit));
+
+  if (link->recvd < link->recv_size) {
+    return NULL;
+  }
+
+  char* buf = link->recv;
+  link->recv = NULL;
+  return buf;
+}
+
+/* accepts connection from main thread on service endpoint */
+static void* lwgrp_kvs_accept(void* arg)
+{
+  lwgrp_kvs* kvs = (lwgrp_kvs*) arg;
+  kvs->svc = spawn_net_accept(kvs->ep);
+  return NULL;
+}
+
+/* serves gets and forwards messages until told to stop */
+static void* lwgrp_kvs_service(void* arg)
+{
+  lwgrp_kvs* kvs = (lwgrp_kvs*) arg;
+  const lwgrp* net = kvs->net;
+
+  /* set up left and right link for each round */
+  int64_t nlinks = 2 * net->list_size;
+  lwgrp_kvs_link* links = (lwgrp_kvs_link*) SPAWN_MALLOC(nlinks * sizeof(lwgrp_kvs_link));
+  memset(links, 0, nlinks * sizeof(lwgrp_kvs_link));
+
+  /* wait on local channel and all 2^d channels, remembering the
+   * link of each channel, the local channel has none */
+  int nchs = 0;
+  const spawn_net_channel** chs = (const spawn_net_channel**) SPAWN_MALLOC(
+    (nlinks + 1) * sizeof(spawn_net_channel*)
+  );
+  lwgrp_kvs_link** chlinks = (lwgrp_kvs_link**) SPAWN_MALLOC(
+    (nlinks + 1) * sizeof(lwgrp_kvs_link*)
+  );
+  chs[nchs]     = kvs->svc;
+  chlinks[nchs] = NULL;
+  nchs++;
+  int64_t i;
+  for (i = 0; i < net->list_size; i++) {
+    links[2 * i].ch     = net->list_left[i];
+    links[2 * i + 1].ch = net->list_right[i];
+    if (net->list_left[i] != SPAWN_NET_CHANNEL_NULL) {
+      chs[nchs]     = net->list_left[i];
+      chlinks[nchs] = &links[2 * i];
+      nchs++;
+    }
+    if (net->list_right[i] != SPAWN_NET_CHANNEL_NULL) {
+      chs[nchs]     = net->list_right[i];
+      chlinks[nchs] = &links[2 * i + 1];
+      nchs++;
+    }
+  }
+
+  int running = 1;
+  while (running) {
+    int index;
+    if (spawn_net_wait(0, NULL, nchs, chs, &index) != SPAWN_SUCCESS) {
+      SPAWN_ERR("Failed to wait on key-value service channels");
+      break;
+    }
+
+    lwgrp_kvs_msg msg;
+    char* key = NULL;
+    char* val = NULL;
+    lwgrp_kvs_link* link = chlinks[index];
+    if (link == NULL) {
+      /* requests from our main thread come whole */
+      lwgrp_kvs_read(chs[index], &msg, &key, &val);
+    } else {
+      /* messages from other service threads come in frames */
+      char* buf = lwgrp_kvs_recv(link);
+      if (buf == NULL) {
+        continue;
+      }
+      memcpy(&msg, buf, sizeof(msg));
+      char* ptr = buf + sizeof(msg);
+      if (msg.key_len > 0) {
+        key = (char*) SPAWN_MALLOC(msg.key_len);
+        memcpy(key, ptr, msg.key_len);
+        ptr += msg.key_len;
+      }
+      if (msg.val_len > 0) {
+        val = (char*) SPAWN_MALLOC(msg.val_len);
+        memcpy(val, ptr, msg.val_len);
+      }
+      spawn_free(&buf);
+    }
+
+    if (msg.type == LWGRP_KVS_SHUTDOWN) {
+      running = 0;
+    } else if (msg.type == LWGRP_KVS_GET && msg.owner == net->rank) {
+      /* we own the key, look it up and send the value back */
+      pthread_mutex_lock(&kvs->mutex);
+      const char* value = strmap_get(kvs->store, key);
+      spawn_free(&val);
+      if (value != NULL) {
+        val = SPAWN_STRDUP(value);
+      }
+      pthread_mutex_unlock(&kvs->mutex);
+
+      msg.type    = LWGRP_KVS_REPLY;
+      msg.found   = (val != NULL);
+      msg.val_len = (val != NULL) ? strlen(val) + 1 : 0;
+      lwgrp_kvs_send(kvs, links, msg.origin, &msg, key, val);
+    } else if (msg.type == LWGRP_KVS_GET) {
+      /* forward request toward owner */
+      lwgrp_kvs_send(kvs, links, msg.owner, &msg, key, val);
+    } else {
+      /* forward reply toward origin, which may be our main thread */
+      lwgrp_kvs_send(kvs, links, msg.origin, &msg, key, val);
+    }
+
+    spawn_free(&val);
+    spawn_free(&key);
+  }
+
+  /* no gets are outstanding once we're told to stop, so the queues
+   * are empty, but free any message left partly received */
+  for (i = 0; i < nlinks; i++) {
+    spawn_free(&links[i].recv);
+  }
+
+  spawn_free(&chlinks);
+  spawn_free(&chs);
+  spawn_free(&links);
+
+  return NULL;
+}
+
+lwgrp_kvs* lwgrp_kvs_create(const lwgrp* group)
+{
+  /* service thread needs a transport that lets threads wait on
+   * different channels at the same time */
+  if (spawn_net_get_type(group->ep) != SPAWN_NET_TYPE_TCP) {
+    SPAWN_ERR("Key-value store requires TCP endpoints");
+    return NULL;
+  }
+
+  lwgrp_kvs* kvs = (lwgrp_kvs*) SPAWN_MALLOC(sizeof(lwgrp_kvs));
+  kvs->group = group;
+  kvs->store = strmap_new();
+  kvs->puts  = strmap_new();
+  kvs->cache = strmap_new();
+  pthread_mutex_init(&kvs->mutex, NULL);
+
+  /* open endpoint for service thread */
+  kvs->ep = spawn_net_open(SPAWN_NET_TYPE_TCP);
+  const char* name = spawn_net_name(kvs->ep);
+
+  /* trade service endpoint names with our neighbors */
+  uint64_t max_len = (uint64_t) (strlen(name) + 1);
+  lwgrp_allreduce_uint64_max(&max_len, 1, group);
+  char* names = (char*) SPAWN_MALLOC(3 * max_len);
+  memset(names, 0, 3 * max_len);
+  strcpy(names, name);
+  lwgrp_shift(names, names + max_len, names + 2 * max_len, max_len, group);
+
+  /* build copy of group on service endpoint */
+  kvs->net = lwgrp_create(
+    group->size, group->rank, name, names + max_len, names + 2 * max_len, kvs->ep
+  );
+  spawn_free(&names);
+
+  /* connect main thread to service thread, we can't block in both
+   * connect and accept at once, so the thread accepts on its own,
+   * no other procs connect to this endpoint after lwgrp_create */
+  pthread_create(&kvs->thread, NULL, lwgrp_kvs_accept, kvs);
+  kvs->local = spawn_net_connect(name);
+  pthread_join(kvs->thread, NULL);
+
+  /* start serving gets */
+  pthread_create(&kvs->thread, NULL, lwgrp_kvs_service, kvs);
+
+  /* wait for all service threads to start */
+  lwgrp_barrier(group);
+
+  return kvs;
+}
+
+int lwgrp_kvs_free(lwgrp_kvs** pkvs)
+{
+  if (pkvs == NULL) {
+    return LWGRP_FAILURE;
+  }
+
+  lwgrp_kvs* kvs = *pkvs;
+  if (kvs != NULL) {
+    /* once all procs are here, no gets are outstanding */
+    lwgrp_barrier(kvs->group);
+
+    /* stop our service thread */
+    lwgrp_kvs_msg msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = LWGRP_KVS_SHUTDOWN;
+    lwgrp_kvs_write(kvs->local, &msg, NULL, NULL);
+    pthread_join(kvs->thread, NULL);
+
+    /* all service threads must stop before we drop their channels */
+    lwgrp_barrier(kvs->group);
+
+    spawn_net_disconnect(&kvs->local);
+    spawn_net_disconnect(&kvs->svc);
+    lwgrp_free(&kvs->net);
+    spawn_net_close(&kvs->ep);
+
+    pthread_mutex_destroy(&kvs->mutex);
+    strmap_delete(&kvs->cache);
+    strmap_delete(&kvs->puts);
+    strmap_delete(&kvs->store);
+    spawn_free(pkvs);
+  }
+
+  return LWGRP_SUCCESS;
+}
+
+int lwgrp_kvs_put(lwgrp_kvs* kvs, const char* key, const char* val)
+{
+  strmap_set(kvs->puts, key, val);
+  return LWGRP_SUCCESS;
+}
+
+int lwgrp_kvs_fence(lwgrp_kvs* kvs)
+{
+  const lwgrp* group = kvs->group;
+
+  /* count our puts, each goes to at most one owner */
+  uint64_t nputs = 0;
+  strmap_node* node;
+  for (node = strmap_node_first(kvs->puts);
+       node != NULL;
+       node = strmap_node_next(node))
+  {
+    nputs++;
+  }
+
+  /* collect puts into one map for each owner */
+  int64_t nowners = 0;
+  int64_t* owners = (int64_t*) SPAWN_MALLOC((nputs + 1) * sizeof(int64_t));
+  strmap** maps = (strmap**) SPAWN_MALLOC((nputs + 1) * sizeof(strmap*));
+  for (node = strmap_node_first(kvs->puts);
+       node != NULL;
+       node = strmap_node_next(node))
+  {
+    const char* key = strmap_node_key(node);
+    const char* val = strmap_node_value(node);
+    int64_t owner = lwgrp_kvs_owner(kvs, key);
+
+    int64_t i = 0;
+    while (i < nowners && owners[i] != owner) {
+      i++;
+    }
+    if (i == nowners) {
+      owners[i] = owner;
+      maps[i] = strmap_new();
+      nowners++;
+    }
+    strmap_set(maps[i], key, val);
+  }
+
+  /* pack each map */
+  const void** bufs = (const void**) SPAWN_MALLOC((nowners + 1) * sizeof(void*));
+  uint64_t* sizes = (uint64_t*) SPAWN_MALLOC((nowners + 1) * sizeof(uint64_t));
+  int64_t i;
+  for (i = 0; i < nowners; i++) {
+    sizes[i] = (uint64_t) strmap_pack_size(maps[i]);
+    void* buf = SPAWN_MALLOC(sizes[i]);
+    strmap_pack(buf, maps[i]);
+    bufs[i] = buf;
+  }
+
+  /* deliver puts to owners, this does not complete on any proc
+   * until all procs have sent their puts */
+  int64_t recv_count;
+  int64_t* recv_ranks;
+  void** recv_bufs;
+  uint64_t* recv_sizes;
+  int rc = lwgrp_sparse_exchange(
+    nowners, owners, bufs, sizes,
+    &recv_count, &recv_ranks, &recv_bufs, &recv_sizes, group
+  );
+
+  /* add entries we own to our store */
+  pthread_mutex_lock(&kvs->mutex);
+  for (i = 0; i < recv_count; i++) {
+    strmap_unpack(recv_bufs[i], kvs->store);
+    spawn_free(&recv_bufs[i]);
+  }
+  pthread_mutex_unlock(&kvs->mutex);
+
+  spawn_free(&recv_sizes);
+  spawn_free(&recv_bufs);
+  spawn_free(&recv_ranks);
+
+  for (i = 0; i < nowners; i++) {
+    void* buf = (void*) bufs[i];
+    spawn_free(&buf);
+    strmap_delete(&maps[i]);
+  }
+  spawn_free(&sizes);
+  spawn_free(&bufs);
+  spawn_free(&maps);
+  spawn_free(&owners);
+
+  /* start the next epoch, values may have changed */
+  strmap_delete(&kvs->puts);
+  strmap_delete(&kvs->cache);
+  kvs->puts  = strmap_new();
+  kvs->cache = strmap_new();
+
+  /* all procs must add their entries before anyone gets them */
+  lwgrp_barrier(group);
+
+  return rc;
+}
+
+const char* lwgrp_kvs_get(lwgrp_kvs* kvs, const char* key)
+{
+  /* check values we already have */
+  const char* value = strmap_get(kvs->cache, key);
+  if (value != NULL) {
+    return value;
+  }
+
+  /* look up key in our store if we own it */
+  int64_t owner = lwgrp_kvs_owner(kvs, key);
+  if (owner == kvs->group->rank) {
+    pthread_mutex_lock(&kvs->mutex);
+    value = strmap_get(kvs->store, key);
+    if (value != NULL) {
+      strmap_set(kvs->cache, key, value);
+    }
+    pthread_mutex_unlock(&kvs->mutex);
+    return strmap_get(kvs->cache, key);
+  }
+
+  /* otherwise send request to owner through our service thread */
+  lwgrp_kvs_msg msg;
+  msg.type    = LWGRP_KVS_GET;
+  msg.origin  = kvs->group->rank;
+  msg.owner   = owner;
+  msg.found   = 0;
+  msg.key_len = strlen(key) + 1;
+  msg.val_len = 0;
+  lwgrp_kvs_write(kvs->local, &msg, key, NULL);
+
+  /* wait for reply */
+  char* reply_key;
+  char* reply_val;
+  lwgrp_kvs_read(kvs->local, &msg, &reply_key, &reply_val);
+  if (msg.found) {
+    strmap_set(kvs->cache, key, reply_val);
+  }
+  spawn_free(&reply_val);
+  spawn_free(&reply_key);
+
+  return strmap_get(kvs->cache, key);
+}
@@ -0,0 +1,826 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667277.
+ * All rights reserved.
+ * This file is part of the SpawnNet library.
+ * For details, see https://github.com/hpc/spawnnet
+ * Please also read the LICENSE file.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include "lwgrp.h"
+#include "lwgrp_xchg.h"
+#include "spawn_internal.h"
+
+/* Non-blocking collectives execute the same algorithms as their
+ * blocking counterparts in lwgrp.c.  When a request is created, we
+ * unroll the rounds of its algorithm into a flat schedule of steps,
+ * which lists the exchange with the partners of each round along
+ * with the arithmetic to merge received data.  A request executes
+ * its steps in order.  Barrier rounds send a single one-byte token
+ * to each partner with one write, since the payload is fixed and
+ * always fits in the transport buffers.  Other exchange steps use
+ * the chunked exchange
+ * engine in lwgrp_xchg.c, driven with lwgrp_xchg_test, which only
+ * writes as many chunks as the window allows and only reads frames
+ * that have arrived, so progress never blocks on a partner that has
+ * not yet reached the same round, no matter how large the buffers.
+ *
+ * Persistent requests keep their schedule and scratch buffers, so
+ * each lwgrp_start just resets the step counter and reruns the
+ * schedule without allocating memory or computing partners again.
+ *
+ * Active requests are kept in a list in the order they were started.
+ * Requests on different groups progress independently, while
+ * requests on the same group progress one at a time in the order
+ * they were started, so that messages from one collective are never
+ * consumed by another.  A single mutex protects the list and all
+ * communication done by the engine, so requests may be driven from
+ * lwgrp_test and lwgrp_wait in any thread or from the optional
+ * progress thread.  Since the engine never waits on a partner, a
+ * slow request does not hold up others while it holds the mutex. */
+
+/* kinds of steps in a schedule */
+typedef enum lwgrp_step_kind_enum {
+  LWGRP_STEP_XCHG = 1,     /* exchange with count partners in a */
+  LWGRP_STEP_TOKEN,        /* swap one-byte token with count partners in a */
+  LWGRP_STEP_XCHG_STRMAP,  /* exchange map in b with count partners in a */
+  LWGRP_STEP_COPY,         /* copy count values from b to a */
+  LWGRP_STEP_SUM,          /* add count values in b into a */
+  LWGRP_STEP_MAX,          /* set a to max of a and b for count values */
+  LWGRP_STEP_TOTAL,        /* set a to b + c - a for count values */
+} lwgrp_step_kind;
+
+typedef struct lwgrp_step_t {
+  lwgrp_step_kind kind; /* operation to execute */
+  void* a;        /* target buffer */
+  void* b;        /* first source buffer */
+  void* c;        /* second source buffer */
+  uint64_t count; /* number of values to copy or merge, or partners */
+} lwgrp_step;
+
+struct lwgrp_request_t {
+  const lwgrp* group; /* group on which collective executes */
+  int persistent;     /* whether request is freed on completion */
+  int complete;       /* set to 1 when collective has finished */
+  int rc;             /* return code of collective */
+  int nsteps;         /* number of steps in schedule */
+  int step;           /* index of next step to execute */
+  int started;        /* whether current step has been started */
+  lwgrp_step* steps;  /* schedule of steps */
+  int nxchgs;         /* number of exchanges in use */
+  lwgrp_xchg* xchgs;  /* exchange with each partner of each round */
+  uint64_t* scratch;  /* scratch buffers for reductions and scans */
+  char* packed;       /* map packed for sending in allgather */
+  struct lwgrp_request_t* next; /* next request in active list */
+};
+
+/* list of active requests in the order they were started */
+static lwgrp_request* lwgrp_nb_head = NULL;
+static lwgrp_request* lwgrp_nb_tail = NULL;
+
+/* protects active list and all communication done by the engine */
+static pthread_mutex_t lwgrp_nb_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* progress thread sleeps on this when the active list is empty */
+static pthread_cond_t lwgrp_nb_cond = PTHREAD_COND_INITIALIZER;
+
+static pthread_t lwgrp_nb_thread;
+static int lwgrp_nb_thread_running = 0;
+static int lwgrp_nb_thread_stop    = 0;
+
+/* returns number of rounds in dissemination algorithms on group */
+static int lwgrp_nb_rounds(const lwgrp* group)
+{
+  int rounds = 0;
+  int64_t dist = 1;
+  while (dist < group->size) {
+    dist <<= 1;
+    rounds++;
+  }
+  return rounds;
+}
+
+/* allocate a new request with room for max_steps steps
+ * and an exchange with two partners in each round */
+static lwgrp_request* lwgrp_nb_new(const lwgrp* group, int max_steps)
+{
+  int rounds = lwgrp_nb_rounds(group);
+  lwgrp_request* req = (lwgrp_request*) SPAWN_MALLOC(sizeof(lwgrp_request));
+  req->group      = group;
+  req->persistent = 0;
+  req->complete   = 1;
+  req->rc         = LWGRP_SUCCESS;
+  req->nsteps     = 0;
+  req->step       = 0;
+  req->started    = 0;
+  req->steps      = (lwgrp_step*) SPAWN_MALLOC(max_steps * sizeof(lwgrp_step));
+  req->nxchgs     = 0;
+  req->xchgs      = (lwgrp_xchg*) SPAWN_MALLOC(2 * rounds * sizeof(lwgrp_xchg));
+  req->scratch    = NULL;
+  req->packed     = NULL;
+  req->next       = NULL;
+  return req;
+}
+
+/* free request, its schedule, and scratch buffers */
+static void lwgrp_nb_free(lwgrp_request** preq)
+{
+  lwgrp_request* req = *preq;
+  if (req != NULL) {
+    spawn_free(&req->steps);
+    spawn_free(&req->xchgs);
+    spawn_free(&req->scratch);
+    spawn_free(&req->packed);
+  }
+  spawn_free(preq);
+}
+
+/* append a step to the schedule of a request */
+static void lwgrp_nb_add(
+  lwgrp_request* req,
+  lwgrp_step_kind kind,
+  void* a,
+  void* b,
+  void* c,
+  uint64_t count)
+{
+  lwgrp_step* step = &req->steps[req->nsteps];
+  step->kind  = kind;
+  step->a     = a;
+  step->b     = b;
+  step->c     = c;
+  step->count = count;
+  req->nsteps++;
+}
+
+/* append an exchange step with the left and right partners of a
+ * round, either may be NULL, returns the pair of exchanges, where
+ * element 0 is the left partner and 1 the right */
+static lwgrp_xchg* lwgrp_nb_pair(
+  lwgrp_request* req,
+  lwgrp_step_kind kind,
+  const spawn_net_channel* left,
+  const spawn_net_channel* right,
+  void* b)
+{
+  lwgrp_xchg* xs = &req->xchgs[req->nxchgs];
+  req->nxchgs += 2;
+  lwgrp_xchg_init(&xs[0], left);
+  lwgrp_xchg_init(&xs[1], right);
+  lwgrp_nb_add(req, kind, xs, b, NULL, 2);
+  return xs;
+}
+
+/* build schedule for barrier */
+static lwgrp_request* lwgrp_nb_barrier(const lwgrp* group)
+{
+  int64_t rank  = group->rank;
+  int64_t ranks = group->size;
+
+  int rounds = lwgrp_nb_rounds(group);
+  lwgrp_request* req = lwgrp_nb_new(group, rounds);
+  int round = 0;
+  int64_t dist = 1;
+  while (dist < ranks) {
+    spawn_net_channel* left  = (rank - dist >= 0)    ? group->list_left[round]  : NULL;
+    spawn_net_channel* right = (rank + dist < ranks) ? group->list_right[round] : NULL;
+    lwgrp_nb_pair(req, LWGRP_STEP_TOKEN, left, right, NULL);
+    dist <<= 1;
+    round++;
+  }
+
+  return req;
+}
+
+/* build schedule for allreduce sum, uses a double scan as in
+ * lwgrp_allreduce_uint64_sum */
+static lwgrp_request* lwgrp_nb_allreduce_sum(uint64_t* buf, uint64_t count, const lwgrp* group)
+{
+  int64_t rank  = group->rank;
+  int64_t ranks = group->size;
+
+  int rounds = lwgrp_nb_rounds(group);
+  lwgrp_request* req = lwgrp_nb_new(group, 3 * rounds + 3);
+
+  size_t buf_size = count * sizeof(uint64_t);
+  req->scratch = (uint64_t*) SPAWN_MALLOC(4 * buf_size);
+  uint64_t* left_send  = req->scratch;
+  uint64_t* right_send = req->scratch + count;
+  uint64_t* left_recv  = req->scratch + 2 * count;
+  uint64_t* right_recv = req->scratch + 3 * count;
+
+  /* initialize outgoing buffers */
+  lwgrp_nb_add(req, LWGRP_STEP_COPY, left_send,  buf, NULL, count);
+  lwgrp_nb_add(req, LWGRP_STEP_COPY, right_send, buf, NULL, count);
+
+  int round = 0;
+  int64_t dist = 1;
+  while (dist < ranks) {
+    spawn_net_channel* left  = (rank - dist >= 0)    ? group->list_left[round]  : NULL;
+    spawn_net_channel* right = (rank + dist < ranks) ? group->list_right[round] : NULL;
+    lwgrp_xchg* xs = lwgrp_nb_pair(req, LWGRP_STEP_XCHG, left, right, NULL);
+    lwgrp_xchg_send(&xs[0], left_send,  buf_size);
+    lwgrp_xchg_recv(&xs[0], left_recv,  buf_size);
+    lwgrp_xchg_send(&xs[1], right_send, buf_size);
+    lwgrp_xchg_recv(&xs[1], right_recv, buf_size);
+    if (left != NULL) {
+      lwgrp_nb_add(req, LWGRP_STEP_SUM, right_send, left_recv, NULL, count);
+    }
+    if (right != NULL) {
+      lwgrp_nb_add(req, LWGRP_STEP_SUM, left_send, right_recv, NULL, count);
+    }
+    dist <<= 1;
+    round++;
+  }
+
+  /* set output buffer to be sum of left and right values,
+   * minus our input buffer to avoid double counting */
+  lwgrp_nb_add(req, LWGRP_STEP_TOTAL, buf, right_send, left_send, count);
+
+  return req;
+}
+
+/* build schedule for allreduce max */
+static lwgrp_request* lwgrp_nb_allreduce_max(uint64_t* buf, uint64_t count, const lwgrp* group)
+{
+  int64_t rank  = group->rank;
+  int64_t ranks = group->size;
+
+  int rounds = lwgrp_nb_rounds(group);
+  lwgrp_request* req = lwgrp_nb_new(group, 3 * rounds);
+
+  size_t buf_size = count * sizeof(uint64_t);
+  req->scratch = (uint64_t*) SPAWN_MALLOC(2 * buf_size);
+  uint64_t* left_recv  = req->scratch;
+  uint64_t* right_recv = req->scratch + count;
+
+  int round = 0;
+  int64_t dist = 1;
+  while (dist < ranks) {
+    spawn_net_channel* left  = (rank - dist >= 0)    ? group->list_left[round]  : NULL;
+    spawn_net_channel* right = (rank + dist < ranks) ? group->list_right[round] : NULL;
+    lwgrp_xchg* xs = lwgrp_nb_pair(req, LWGRP_STEP_XCHG, left, right, NULL);
+    lwgrp_xchg_send(&xs[0], buf, buf_size);
+    lwgrp_xchg_recv(&xs[0], left_recv, buf_size);
+    lwgrp_xchg_send(&xs[1], buf, buf_size);
+    lwgrp_xchg_recv(&xs[1], right_recv, buf_size);
+    if (left != NULL) {
+      lwgrp_nb_add(req, LWGRP_STEP_MAX, buf, left_recv, NULL, count);
+    }
+    if (right != NULL) {
+      lwgrp_nb_add(req, LWGRP_STEP_MAX, buf, right_recv, NULL, count);
+    }
+    dist <<= 1;
+    round++;
+  }
+
+  return req;
+}
+
+/* build schedule for inclusive prefix sum */
+static lwgrp_request* lwgrp_nb_scan_sum(uint64_t* buf, uint64_t count, const lwgrp* group)
+{
+  int64_t rank  = group->rank;
+  int64_t ranks = group->size;
+
+  int rounds = lwgrp_nb_rounds(group);
+  lwgrp_request* req = lwgrp_nb_new(group, 2 * rounds);
+
+  size_t buf_size = count * sizeof(uint64_t);
+  req->scratch = (uint64_t*) SPAWN_MALLOC(buf_size);
+  uint64_t* recv = req->scratch;
+
+  int round = 0;
+  int64_t dist = 1;
+  while (dist < ranks) {
+    spawn_net_channel* left  = (rank - dist >= 0)    ? group->list_left[round]  : NULL;
+    spawn_net_channel* right = (rank + dist < ranks) ? group->list_right[round] : NULL;
+    lwgrp_xchg* xs = lwgrp_nb_pair(req, LWGRP_STEP_XCHG, left, right, NULL);
+    lwgrp_xchg_recv(&xs[0], recv, buf_size);
+    lwgrp_xchg_send(&xs[1], buf, buf_size);
+    if (left != NULL) {
+      lwgrp_nb_add(req, LWGRP_STEP_SUM, buf, recv, NULL, count);
+    }
+    dist <<= 1;
+    round++;
+  }
+
+  return req;
+}
+
+/* build schedule for allgather of strmap, the map is packed when its
+ * exchange step starts, since it grows with each round */
+static lwgrp_request* lwgrp_nb_allgather_strmap(strmap* map, const lwgrp* group)
+{
+  int64_t rank  = group->rank;
+  int64_t ranks = group->size;
+
+  int rounds = lwgrp_nb_rounds(group);
+  lwgrp_request* req = lwgrp_nb_new(group, rounds);
+
+  int round = 0;
+  int64_t dist = 1;
+  while (dist < ranks) {
+    spawn_net_channel* left  = (rank - dist >= 0)    ? group->list_left[round]  : NULL;
+    spawn_net_channel* right = (rank + dist < ranks) ? group->list_right[round] : NULL;
+    lwgrp_xchg* xs = lwgrp_nb_pair(req, LWGRP_STEP_XCHG_STRMAP, left, right, map);
+    int i;
+    for (i = 0; i < 2; i++) {
+      lwgrp_xchg_send(&xs[i], NULL, 0);
+      lwgrp_xchg_recv(&xs[i], NULL, 0);
+    }
+    dist <<= 1;
+    round++;
+  }
+
+  return req;
+}
+
+/* start exchange step, packing map for a strmap exchange */
+static void lwgrp_nb_xchg_start(lwgrp_request* req, lwgrp_step* step)
+{
+  lwgrp_xchg* xs = (lwgrp_xchg*) step->a;
+  int count = (int) step->count;
+
+  if (step->kind == LWGRP_STEP_XCHG_STRMAP) {
+    strmap* map = (strmap*) step->b;
+    size_t size = strmap_pack_size(map);
+    req->packed = (char*) SPAWN_MALLOC(size);
+    strmap_pack(req->packed, map);
+
+    int i;
+    for (i = 0; i < count; i++) {
+      lwgrp_xchg_send(&xs[i], req->packed, size);
+      lwgrp_xchg_recv(&xs[i], NULL, 0);
+    }
+  }
+
+  lwgrp_xchg_start(xs, count);
+}
+
+/* finish exchange step, merging maps for a strmap exchange */
+static void lwgrp_nb_xchg_finish(lwgrp_request* req, lwgrp_step* step)
+{
+  if (step->kind == LWGRP_STEP_XCHG_STRMAP) {
+    lwgrp_xchg* xs = (lwgrp_xchg*) step->a;
+    strmap* map = (strmap*) step->b;
+    int i;
+    for (i = 0; i < (int) step->count; i++) {
+      if (xs[i].recv != NULL) {
+        strmap_unpack(xs[i].recv, map);
+        spawn_free(&xs[i].recv);
+      }
+    }
+    spawn_free(&req->packed);
+  }
+}
+
+/* write our token to each partner if we have not already and read
+ * tokens that have arrived, a token step only tracks whether the
+ * token was written (size_sent) and read (size_recvd) in each
+ * exchange, sets flag to 1 once all tokens have been swapped */
+static int lwgrp_nb_token_test(lwgrp_xchg* xs, int count, int* flag, int* progress)
+{
+  int rc = LWGRP_SUCCESS;
+  int waiting = 0;
+
+  int i;
+  for (i = 0; i < count; i++) {
+    lwgrp_xchg* x = &xs[i];
+    if (x->ch == NULL) {
+      continue;
+    }
+
+    char token = 'A';
+    if (! x->size_sent) {
+      spawn_net_write(x->ch, &token, 1);
+      x->size_sent = 1;
+      *progress = 1;
+    }
+
+    if (! x->size_recvd) {
+      int ready = 0;
+      spawn_net_probe(x->ch, &ready);
+      if (ready) {
+        if (spawn_net_read(x->ch, &token, 1) != SPAWN_SUCCESS) {
+          rc = LWGRP_FAILURE;
+        }
+        x->size_recvd = 1;
+        *progress = 1;
+      } else {
+        waiting++;
+      }
+    }
+  }
+
+  *flag = (waiting == 0);
+  return rc;
+}
+
+/* remove request from active list, must hold lock */
+static void lwgrp_nb_unlink(lwgrp_request* req)
+{
+  lwgrp_request* prev = NULL;
+  lwgrp_request* curr = lwgrp_nb_head;
+  while (curr != NULL && curr != req) {
+    prev = curr;
+    curr = curr->next;
+  }
+  if (curr == NULL) {
+    return;
+  }
+
+  if (prev == NULL) {
+    lwgrp_nb_head = curr->next;
+  } else {
+    prev->next = curr->next;
+  }
+  if (lwgrp_nb_tail == curr) {
+    lwgrp_nb_tail = prev;
+  }
+  curr->next = NULL;
+}
+
+/* execute steps of request until it completes or must wait on a
+ * partner, returns 1 if any step was executed, must hold lock */
+static int lwgrp_nb_advance(lwgrp_request* req)
+{
+  int progress = 0;
+
+  while (req->step < req->nsteps) {
+    lwgrp_step* step = &req->steps[req->step];
+
+    int rc = LWGRP_SUCCESS;
+    uint64_t* a = (uint64_t*) step->a;
+    uint64_t* b = (uint64_t*) step->b;
+    uint64_t* c = (uint64_t*) step->c;
+    uint64_t i;
+    switch (step->kind) {
+    case LWGRP_STEP_XCHG:
+    case LWGRP_STEP_XCHG_STRMAP:
+      {
+        if (! req->started) {
+          lwgrp_nb_xchg_start(req, step);
+          req->started = 1;
+          progress = 1;
+        }
+
+        /* send and receive what we can, come back later if the
+         * exchange is not done */
+        int flag = 0;
+        rc = lwgrp_xchg_test((lwgrp_xchg*) step->a, (int) step->count, &flag, &progress);
+        if (! flag) {
+          return progress;
+        }
+        lwgrp_nb_xchg_finish(req, step);
+      }
+      break;
+    case LWGRP_STEP_TOKEN:
+      {
+        lwgrp_xchg* xs = (lwgrp_xchg*) step->a;
+        if (! req->started) {
+          for (i = 0; i < step->count; i++) {
+            xs[i].size_sent  = 0;
+            xs[i].size_recvd = 0;
+          }
+          req->started = 1;
+        }
+
+        int flag = 0;
+        rc = lwgrp_nb_token_test(xs, (int) step->count, &flag, &progress);
+        if (! flag) {
+          return progress;
+        }
+      }
+      break;
+    case LWGRP_STEP_COPY:
+      memcpy(a, b, step->count * sizeof(uint64_t));
+      break;
+    case LWGRP_STEP_SUM:
+      for (i = 0; i < step->count; i++) {
+        a[i] += b[i];
+      }
+      break;
+    case LWGRP_STEP_MAX:
+      for (i = 0; i < step->count; i++) {
+        if (b[i] > a[i]) {
+          a[i] = b[i];
+        }
+      }
+      break;
+    case LWGRP_STEP_TOTAL:
+      for (i = 0; i < step->count; i++) {
+        a[i] = b[i] + c[i] - a[i];
+      }
+      break;
+    }
+
+    if (rc != LWGRP_SUCCESS) {
+      req->rc = LWGRP_FAILURE;
+    }
+
+    req->step++;
+    req->started = 0;
+    progress = 1;
+  }
+
+  /* all steps are done, so remove request from active list */
+  req->complete = 1;
+  lwgrp_nb_unlink(req);
+
+  return 1;
+}
+
+/* advance all active requests, returns 1 if any made progress,
+ * must hold lock */
+static int lwgrp_nb_progress(void)
+{
+  int progress = 0;
+
+  lwgrp_request* req = lwgrp_nb_head;
+  while (req != NULL) {
+    /* get next pointer now, since request is removed
+     * from list when it completes */
+    lwgrp_request* next = req->next;
+
+    /* skip this request if an earlier one on the same group
+     * is still active */
+    int blocked = 0;
+    lwgrp_request* earlier = lwgrp_nb_head;
+    while (earlier != req) {
+      if (earlier->group == req->group) {
+        blocked = 1;
+        break;
+      }
+      earlier = earlier->next;
+    }
+
+    if (! blocked && lwgrp_nb_advance(req)) {
+      progress = 1;
+    }
+
+    req = next;
+  }
+
+  return progress;
+}
+
+/* append request to active list and start it */
+static void lwgrp_nb_start(lwgrp_request* req)
+{
+  pthread_mutex_lock(&lwgrp_nb_mutex);
+
+  /* reset state to run schedule from the beginning */
+  req->complete = 0;
+  req->rc       = LWGRP_SUCCESS;
+  req->step     = 0;
+  req->started  = 0;
+  req->next     = NULL;
+
+  if (lwgrp_nb_head == NULL) {
+    lwgrp_nb_head = req;
+  }
+  if (lwgrp_nb_tail != NULL) {
+    lwgrp_nb_tail->next = req;
+  }
+  lwgrp_nb_tail = req;
+
+  /* get things moving so our first sends go out now */
+  lwgrp_nb_progress();
+
+  /* wake progress thread if it's sleeping */
+  pthread_cond_signal(&lwgrp_nb_cond);
+
+  pthread_mutex_unlock(&lwgrp_nb_mutex);
+}
+
+int lwgrp_ibarrier(const lwgrp* group, lwgrp_request** preq)
+{
+  lwgrp_request* req = lwgrp_nb_barrier(group);
+  *preq = req;
+  lwgrp_nb_start(req);
+  return LWGRP_SUCCESS;
+}
+
+int lwgrp_iallreduce_uint64_sum(uint64_t* buf, uint64_t count, const lwgrp* group, lwgrp_request** preq)
+{
+  lwgrp_request* req = lwgrp_nb_allreduce_sum(buf, count, group);
+  *preq = req;
+  lwgrp_nb_start(req);
+  return LWGRP_SUCCESS;
+}
+
+int lwgrp_iallreduce_uint64_max(uint64_t* buf, uint64_t count, const lwgrp* group, lwgrp_request** preq)
+{
+  lwgrp_request* req = lwgrp_nb_allreduce_max(buf, count, group);
+  *preq = req;
+  lwgrp_nb_start(req);
+  return LWGRP_SUCCESS;
+}
+
+int lwgrp_iscan_uint64_sum(uint64_t* buf, uint64_t count, const lwgrp* group, lwgrp_request** preq)
+{
+  lwgrp_request* req = lwgrp_nb_scan_sum(buf, count, group);
+  *preq = req;
+  lwgrp_nb_start(req);
+  return LWGRP_SUCCESS;
+}
+
+int lwgrp_iallgather_strmap(strmap* map, const lwgrp* group, lwgrp_request** preq)
+{
+  lwgrp_request* req = lwgrp_nb_allgather_strmap(map, group);
+  *preq = req;
+  lwgrp_nb_start(req);
+  return LWGRP_SUCCESS;
+}
+
+int lwgrp_barrier_init(const lwgrp* group, lwgrp_request** preq)
+{
+  lwgrp_request* req = lwgrp_nb_barrier(group);
+  req->persistent = 1;
+  *preq = req;
+  return LWGRP_SUCCESS;
+}
+
+int lwgrp_allreduce_uint64_sum_init(uint64_t* buf, uint64_t count, const lwgrp* group, lwgrp_request** preq)
+{
+  lwgrp_request* req = lwgrp_nb_allreduce_sum(buf, count, group);
+  req->persistent = 1;
+  *preq = req;
+  return LWGRP_SUCCESS;
+}
+
+int lwgrp_allreduce_uint64_max_init(uint64_t* buf, uint64_t count, const lwgrp* group, lwgrp_request** preq)
+{
+  lwgrp_request* req = lwgrp_nb_allreduce_max(buf, count, group);
+  req->persistent = 1;
+  *preq = req;
+  return LWGRP_SUCCESS;
+}
+
+int lwgrp_scan_uint64_sum_init(uint64_t* buf, uint64_t count, const lwgrp* group, lwgrp_request** preq)
+{
+  lwgrp_request* req = lwgrp_nb_scan_sum(buf, count, group);
+  req->persistent = 1;
+  *preq = req;
+  return LWGRP_SUCCESS;
+}
+
+int lwgrp_start(lwgrp_request* req)
+{
+  if (req == NULL || ! req->persistent) {
+    SPAWN_ERR("Can only start persistent requests");
+    return LWGRP_FAILURE;
+  }
+  if (! req->complete) {
+    SPAWN_ERR("Request is already active");
+    return LWGRP_FAILURE;
+  }
+  lwgrp_nb_start(req);
+  return LWGRP_SUCCESS;
+}
+
+int lwgrp_request_free(lwgrp_request** preq)
+{
+  lwgrp_request* req = *preq;
+  if (req != NULL && ! req->complete) {
+    SPAWN_ERR("Can't free an active request");
+    return LWGRP_FAILURE;
+  }
+  lwgrp_nb_free(preq);
+  return LWGRP_SUCCESS;
+}
+
+int lwgrp_test(lwgrp_request** preq, int* flag)
+{
+  /* a NULL request is complete */
+  lwgrp_request* req = *preq;
+  if (req == NULL) {
+    *flag = 1;
+    return LWGRP_SUCCESS;
+  }
+
+  pthread_mutex_lock(&lwgrp_nb_mutex);
+  if (! req->complete) {
+    lwgrp_nb_progress();
+  }
+  int complete = req->complete;
+  pthread_mutex_unlock(&lwgrp_nb_mutex);
+
+  /* free request once it completes, unless it's persistent */
+  int rc = LWGRP_SUCCESS;
+  *flag = complete;
+  if (complete) {
+    rc = req->rc;
+    if (! req->persistent) {
+      lwgrp_nb_free(preq);
+    }
+  }
+
+  return rc;
+}
+
+int lwgrp_wait(lwgrp_request** preq)
+{
+  /* a NULL request is complete */
+  lwgrp_request* req = *preq;
+  if (req == NULL) {
+    return LWGRP_SUCCESS;
+  }
+
+  pthread_mutex_lock(&lwgrp_nb_mutex);
+  while (! req->complete) {
+    /* if nothing is ready, let other threads run before we poll again */
+    if (! lwgrp_nb_progress() && ! req->complete) {
+      pthread_mutex_unlock(&lwgrp_nb_mutex);
+      sched_yield();
+      pthread_mutex_lock(&lwgrp_nb_mutex);
+    }
+  }
+  pthread_mutex_unlock(&lwgrp_nb_mutex);
+
+  int rc = req->rc;
+  if (! req->persistent) {
+    lwgrp_nb_free(preq);
+  }
+  return rc;
+}
+
+/* body of progress thread, polls active requests until stopped */
+static void* lwgrp_nb_thread_main(void* arg)
+{
+  (void) arg;
+  pthread_mutex_lock(&lwgrp_nb_mutex);
+  while (! lwgrp_nb_thread_stop) {
+    /* sleep until a request is started */
+    if (lwgrp_nb_head == NULL) {
+      pthread_cond_wait(&lwgrp_nb_cond, &lwgrp_nb_mutex);
+      continue;
+    }
+
+    /* if nothing is ready, let other threads run before we poll again */
+    if (! lwgrp_nb_progress()) {
+      pthread_mutex_unlock(&lwgrp_nb_mutex);
+      sched_yield();
+      pthread_mutex_lock(&lwgrp_nb_mutex);
+    }
+  }
+  pthread_mutex_unlock(&lwgrp_nb_mutex);
+  return NULL;
+}
+
+int lwgrp_progress_start(void)
+{
+  /* claim the thread under the lock, so concurrent
+   * calls start only one */
+  pthread_mutex_lock(&lwgrp_nb_mutex);
+  if (lwgrp_nb_thread_running) {
+    pthread_mutex_unlock(&lwgrp_nb_mutex);
+    return LWGRP_SUCCESS;
+  }
+  lwgrp_nb_thread_stop    = 0;
+  lwgrp_nb_thread_running = 1;
+
+  /* the thread waits for the lock before it does anything */
+  int rc = pthread_create(&lwgrp_nb_thread, NULL, lwgrp_nb_thread_main, NULL);
+  if (rc != 0) {
+    lwgrp_nb_thread_running = 0;
+    pthread_mutex_unlock(&lwgrp_nb_mutex);
+    SPAWN_ERR("Failed to start lwgrp progress thread rc=%d", rc);
+    return LWGRP_FAILURE;
+  }
+  pthread_mutex_unlock(&lwgrp_nb_mutex);
+
+  return LWGRP_SUCCESS;
+}
+
+int lwgrp_progress_stop(void)
+{
+  /* only one caller joins the thread */
+  pthread_mutex_lock(&lwgrp_nb_mutex);
+  if (! lwgrp_nb_thread_running || lwgrp_nb_thread_stop) {
+    pthread_mutex_unlock(&lwgrp_nb_mutex);
+    return LWGRP_SUCCESS;
+  }
+  lwgrp_nb_thread_stop = 1;
+  pthread_cond_signal(&lwgrp_nb_cond);
+  pthread_mutex_unlock(&lwgrp_nb_mutex);
+
+  pthread_join(lwgrp_nb_thread, NULL);
+
+  pthread_mutex_lock(&lwgrp_nb_mutex);
+  lwgrp_nb_thread_running = 0;
+  pthread_mutex_unlock(&lwgrp_nb_mutex);
+
+  return LWGRP_SUCCESS;
+}
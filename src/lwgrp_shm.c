@@ -0,0 +1,334 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667277.
+ * All rights reserved.
+ * This file is part of the SpawnNet library.
+ * For details, see https://github.com/hpc/spawnnet
+ * Please also read the LICENSE file.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "lwgrp.h"
+#include "lwgrp_shm.h"
+#include "spawn_internal.h"
+
+/* All procs in a node group map one shared memory segment.  The
+ * segment starts with a barrier counter and a sense flag, each on
+ * its own cache line, followed by two sets of per-proc slots.
+ *
+ * Barrier is sense-reversing: each proc flips its local sense and
+ * increments the counter, the last proc to arrive resets the counter
+ * and publishes the new sense, and the others spin until the shared
+ * sense matches their own.
+ *
+ * Data collectives write into the slots, execute a barrier, then
+ * read from the slots.  Consecutive operations alternate between
+ * the two slot sets, so a proc may write its next slot as soon as
+ * it leaves a barrier.  Before anyone can write to a set again, all
+ * procs must pass the barrier of the operation in between, which
+ * they only enter after reading from the set.  So each operation
+ * needs one barrier.  Data larger than a slot is sent in chunks,
+ * with one operation per chunk. */
+
+#define LWGRP_SHM_LINE (64)
+
+/* spin this many times before yielding the processor */
+#define LWGRP_SHM_SPINS (1000)
+
+/* default size of each slot in bytes */
+#define LWGRP_SHM_SLOT (4096)
+
+/* header at the start of the segment */
+typedef struct lwgrp_shm_header_t {
+  uint64_t count; /* number of procs that have reached the barrier */
+  char pad1[LWGRP_SHM_LINE - sizeof(uint64_t)];
+  uint64_t sense; /* flips each time all procs reach the barrier */
+  char pad2[LWGRP_SHM_LINE - sizeof(uint64_t)];
+} lwgrp_shm_header;
+
+struct lwgrp_shm_t {
+  void* base;       /* start of mapped segment */
+  size_t size;      /* size of mapped segment in bytes */
+  size_t slot_size; /* number of bytes of data in each slot */
+  size_t slot_step; /* distance between slots, rounded up to cache line */
+  uint64_t sense;   /* our local barrier sense */
+  uint64_t op;      /* number of operations, selects the slot set */
+};
+
+/* counter to give each segment we create a unique name */
+static uint64_t lwgrp_shm_next_id = 0;
+
+/* returns pointer to slot for given rank in current slot set */
+static char* lwgrp_shm_slot(const struct lwgrp_shm_t* shm, int64_t ranks, int64_t rank)
+{
+  int64_t set = (int64_t) (shm->op & 1);
+  char* slots = (char*) shm->base + sizeof(lwgrp_shm_header);
+  return slots + (set * ranks + rank) * shm->slot_step;
+}
+
+int lwgrp_shm_attach(lwgrp* group, size_t slot_size)
+{
+  /* nothing to do if already attached */
+  if (group->shm != NULL) {
+    return LWGRP_SUCCESS;
+  }
+
+  if (slot_size == 0) {
+    slot_size = LWGRP_SHM_SLOT;
+  }
+
+  int64_t rank  = group->rank;
+  int64_t ranks = group->size;
+
+  /* compute size of segment */
+  size_t slot_step = (slot_size + LWGRP_SHM_LINE - 1) / LWGRP_SHM_LINE * LWGRP_SHM_LINE;
+  size_t size = sizeof(lwgrp_shm_header) + 2 * ranks * slot_step;
+
+  /* rank 0 creates the segment and sends its name to others,
+   * an empty name means it failed */
+  char name[256];
+  memset(name, 0, sizeof(name));
+  void* base = MAP_FAILED;
+  if (rank == 0) {
+    snprintf(name, sizeof(name), "/lwgrp.%d.%llu",
+      (int) getpid(), (unsigned long long) lwgrp_shm_next_id
+    );
+    lwgrp_shm_next_id++;
+
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, S_IRUSR | S_IWUSR);
+    if (fd >= 0) {
+      if (ftruncate(fd, size) == 0) {
+        base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      }
+      if (base == MAP_FAILED) {
+        SPAWN_ERR("Failed to create shared memory segment %s (errno=%d %s)", name, errno, strerror(errno));
+        shm_unlink(name);
+      } else {
+        memset(base, 0, size);
+      }
+      close(fd);
+    } else {
+      SPAWN_ERR("Failed to open shared memory segment %s (errno=%d %s)", name, errno, strerror(errno));
+    }
+
+    if (base == MAP_FAILED) {
+      name[0] = '\0';
+    }
+  }
+  lwgrp_bcast(name, sizeof(name), 0, group);
+
+  /* give up if rank 0 failed */
+  if (name[0] == '\0') {
+    return LWGRP_FAILURE;
+  }
+
+  /* others map the segment */
+  if (rank != 0) {
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd >= 0) {
+      base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      close(fd);
+    }
+    if (base == MAP_FAILED) {
+      SPAWN_ERR("Failed to map shared memory segment %s (errno=%d %s)", name, errno, strerror(errno));
+    }
+  }
+
+  /* check that everyone mapped the segment, procs on different nodes
+   * will fail here, after this rank 0 can remove the name */
+  uint64_t failed = (base == MAP_FAILED);
+  lwgrp_allreduce_uint64_max(&failed, 1, group);
+  if (rank == 0) {
+    shm_unlink(name);
+  }
+  if (failed) {
+    if (base != MAP_FAILED) {
+      munmap(base, size);
+    }
+    return LWGRP_FAILURE;
+  }
+
+  struct lwgrp_shm_t* shm = (struct lwgrp_shm_t*) SPAWN_MALLOC(sizeof(struct lwgrp_shm_t));
+  shm->base      = base;
+  shm->size      = size;
+  shm->slot_size = slot_size;
+  shm->slot_step = slot_step;
+  shm->sense     = 0;
+  shm->op        = 0;
+
+  group->shm = shm;
+
+  return LWGRP_SUCCESS;
+}
+
+int lwgrp_shm_detach(lwgrp* group)
+{
+  struct lwgrp_shm_t* shm = group->shm;
+  if (shm != NULL) {
+    munmap(shm->base, shm->size);
+    spawn_free(&group->shm);
+  }
+  return LWGRP_SUCCESS;
+}
+
+int lwgrp_shm_barrier(const lwgrp* group)
+{
+  struct lwgrp_shm_t* shm = group->shm;
+  lwgrp_shm_header* header = (lwgrp_shm_header*) shm->base;
+
+  /* flip our sense */
+  uint64_t sense = shm->sense ^ 1;
+  shm->sense = sense;
+
+  uint64_t count = __atomic_add_fetch(&header->count, 1, __ATOMIC_ACQ_REL);
+  if (count == (uint64_t) group->size) {
+    /* we're last, reset counter and release everyone */
+    __atomic_store_n(&header->count, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&header->sense, sense, __ATOMIC_RELEASE);
+  } else {
+    /* wait for last proc to flip the shared sense */
+    int spins = 0;
+    while (__atomic_load_n(&header->sense, __ATOMIC_ACQUIRE) != sense) {
+      spins++;
+      if (spins >= LWGRP_SHM_SPINS) {
+        sched_yield();
+        spins = 0;
+      }
+    }
+  }
+
+  return LWGRP_SUCCESS;
+}
+
+static int lwgrp_shm_allreduce_uint64(uint64_t* buf, uint64_t count, int max, const lwgrp* group)
+{
+  struct lwgrp_shm_t* shm = group->shm;
+  int64_t ranks = group->size;
+
+  /* number of elements that fit in a slot */
+  uint64_t chunk = shm->slot_size / sizeof(uint64_t);
+
+  uint64_t offset = 0;
+  while (offset < count) {
+    uint64_t n = count - offset;
+    if (n > chunk) {
+      n = chunk;
+    }
+
+    /* copy our values into our slot */
+    uint64_t* mine = (uint64_t*) lwgrp_shm_slot(shm, ranks, group->rank);
+    memcpy(mine, buf + offset, n * sizeof(uint64_t));
+
+    lwgrp_shm_barrier(group);
+
+    /* reduce values from all slots in rank order, so every proc
+     * computes the same result */
+    int64_t i;
+    uint64_t j;
+    uint64_t* first = (uint64_t*) lwgrp_shm_slot(shm, ranks, 0);
+    memcpy(buf + offset, first, n * sizeof(uint64_t));
+    for (i = 1; i < ranks; i++) {
+      uint64_t* slot = (uint64_t*) lwgrp_shm_slot(shm, ranks, i);
+      for (j = 0; j < n; j++) {
+        if (! max) {
+          buf[offset + j] += slot[j];
+        } else if (slot[j] > buf[offset + j]) {
+          buf[offset + j] = slot[j];
+        }
+      }
+    }
+
+    shm->op++;
+    offset += n;
+  }
+
+  return LWGRP_SUCCESS;
+}
+
+int lwgrp_shm_allreduce_uint64_sum(uint64_t* buf, uint64_t count, const lwgrp* group)
+{
+  return lwgrp_shm_allreduce_uint64(buf, count, 0, group);
+}
+
+int lwgrp_shm_allreduce_uint64_max(uint64_t* buf, uint64_t count, const lwgrp* group)
+{
+  return lwgrp_shm_allreduce_uint64(buf, count, 1, group);
+}
+
+int lwgrp_shm_bcast(void* buf, size_t buf_size, int64_t root, const lwgrp* group)
+{
+  struct lwgrp_shm_t* shm = group->shm;
+  int64_t ranks = group->size;
+
+  char* ptr = (char*) buf;
+  size_t offset = 0;
+  while (offset < buf_size) {
+    size_t n = buf_size - offset;
+    if (n > shm->slot_size) {
+      n = shm->slot_size;
+    }
+
+    /* root writes to its slot, then all others read it */
+    char* slot = lwgrp_shm_slot(shm, ranks, root);
+    if (group->rank == root) {
+      memcpy(slot, ptr + offset, n);
+    }
+
+    lwgrp_shm_barrier(group);
+
+    if (group->rank != root) {
+      memcpy(ptr + offset, slot, n);
+    }
+
+    shm->op++;
+    offset += n;
+  }
+
+  return LWGRP_SUCCESS;
+}
+
+int lwgrp_shm_allgather(const void* sendbuf, void* recvbuf, size_t size, const lwgrp* group)
+{
+  struct lwgrp_shm_t* shm = group->shm;
+  int64_t ranks = group->size;
+
+  const char* src = (const char*) sendbuf;
+  char* dst = (char*) recvbuf;
+  size_t offset = 0;
+  while (offset < size) {
+    size_t n = size - offset;
+    if (n > shm->slot_size) {
+      n = shm->slot_size;
+    }
+
+    /* each proc writes its block to its slot */
+    char* mine = lwgrp_shm_slot(shm, ranks, group->rank);
+    memcpy(mine, src + offset, n);
+
+    lwgrp_shm_barrier(group);
+
+    /* copy the rank-indexed table out of shared memory */
+    int64_t i;
+    for (i = 0; i < ranks; i++) {
+      char* slot = lwgrp_shm_slot(shm, ranks, i);
+      memcpy(dst + i * size + offset, slot, n);
+    }
+
+    shm->op++;
+    offset += n;
+  }
+
+  return LWGRP_SUCCESS;
+}
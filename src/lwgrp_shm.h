@@ -0,0 +1,35 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667277.
+ * All rights reserved.
+ * This file is part of the SpawnNet library.
+ * For details, see https://github.com/hpc/spawnnet
+ * Please also read the LICENSE file.
+*/
+
+#ifndef LWGRP_SHM_H
+#define LWGRP_SHM_H
+
+#include "lwgrp.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int lwgrp_shm_barrier(const lwgrp* group);
+
+int lwgrp_shm_allreduce_uint64_sum(uint64_t* buf, uint64_t count, const lwgrp* group);
+
+int lwgrp_shm_allreduce_uint64_max(uint64_t* buf, uint64_t count, const lwgrp* group);
+
+int lwgrp_shm_bcast(void* buf, size_t buf_size, int64_t root, const lwgrp* group);
+
+int lwgrp_shm_allgather(const void* sendbuf, void* recvbuf, size_t size, const lwgrp* group);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LWGRP_SHM_H */
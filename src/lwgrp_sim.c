@@ -0,0 +1,323 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667277.
+ * All rights reserved.
+ * This file is part of the SpawnNet library.
+ * For details, see https://github.com/hpc/spawnnet
+ * Please also read the LICENSE file.
+*/
+
+/* Runs lwgrp collectives over the simulated network and reports
+ * virtual completion time, per-rank traffic, and the critical path
+ * of each collective.
+ *
+ *   lwgrp_sim [-n ranks] [-l latency_us] [-b bandwidth_MBps]
+ *             [-o overhead_us] [-s bytes] [-c colors] [-t stack_KB]
+ *             [-p] [op ...]
+ *
+ * Ops are create, barrier, allreduce, scan, bcast, split, and
+ * allgather, run in the order given after the group is created.
+ * Allgather needs ranks * bytes of memory on each rank. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "spawn_internal.h"
+#include "lwgrp.h"
+
+/* most ops we run in one simulation, the group create is op 0 */
+#define SIM_MAX_OPS (32)
+
+typedef struct sim_params_t {
+  int64_t ranks;
+  size_t bytes;   /* message size for ops that take one */
+  int64_t colors; /* number of groups split makes */
+  int nops;
+  const char* ops[SIM_MAX_OPS];
+  double* start;  /* time each rank starts each op */
+  double* end;    /* time each rank finishes each op */
+  uint64_t* sent; /* bytes each rank sends in each op */
+  uint64_t* msgs; /* messages each rank sends in each op */
+  uint64_t errors;
+} sim_params;
+
+/* run op on group, returns LWGRP_SUCCESS if result checks out */
+static int sim_op(const char* op, sim_params* p, lwgrp* group)
+{
+  int64_t rank  = lwgrp_rank(group);
+  int64_t ranks = lwgrp_size(group);
+
+  int rc = LWGRP_SUCCESS;
+  if (strcmp(op, "barrier") == 0) {
+    rc = lwgrp_barrier(group);
+  } else if (strcmp(op, "allreduce") == 0 || strcmp(op, "scan") == 0) {
+    uint64_t count = (p->bytes + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+    if (count == 0) {
+      count = 1;
+    }
+    uint64_t* buf = (uint64_t*) SPAWN_MALLOC(count * sizeof(uint64_t));
+    uint64_t i;
+    for (i = 0; i < count; i++) {
+      buf[i] = 1;
+    }
+    int scan = (strcmp(op, "scan") == 0);
+    if (scan) {
+      lwgrp_scan_uint64_sum(buf, count, group);
+    } else {
+      lwgrp_allreduce_uint64_sum(buf, count, group);
+    }
+    uint64_t expect = scan ? (uint64_t) (rank + 1) : (uint64_t) ranks;
+    if (buf[0] != expect || buf[count - 1] != expect) {
+      rc = LWGRP_FAILURE;
+    }
+    spawn_free(&buf);
+  } else if (strcmp(op, "bcast") == 0) {
+    size_t size = (p->bytes > 0) ? p->bytes : 1;
+    char* buf = (char*) SPAWN_MALLOC(size);
+    memset(buf, (rank == 0) ? 'a' : 0, size);
+    lwgrp_bcast(buf, size, 0, group);
+    if (buf[0] != 'a' || buf[size - 1] != 'a') {
+      rc = LWGRP_FAILURE;
+    }
+    spawn_free(&buf);
+  } else if (strcmp(op, "split") == 0) {
+    lwgrp* sub = lwgrp_split(group, rank % p->colors, rank);
+    if (sub == NULL) {
+      rc = LWGRP_FAILURE;
+    }
+    lwgrp_free(&sub);
+  } else if (strcmp(op, "allgather") == 0) {
+    size_t size = (p->bytes > 0) ? p->bytes : 1;
+    char* send = (char*) SPAWN_MALLOC(size);
+    char* recv = (char*) SPAWN_MALLOC(size * ranks);
+    memset(send, (char) rank, size);
+    rc = lwgrp_allgather(send, recv, size, group);
+    if (recv[size * (ranks - 1)] != (char) (ranks - 1)) {
+      rc = LWGRP_FAILURE;
+    }
+    spawn_free(&recv);
+    spawn_free(&send);
+  } else {
+    rc = LWGRP_FAILURE;
+  }
+
+  return rc;
+}
+
+/* record time and traffic of rank at the start or end of op */
+static void sim_mark(sim_params* p, int64_t rank, int op, int end)
+{
+  int64_t idx = op * p->ranks + rank;
+  uint64_t sent, recv, msgs;
+  spawn_net_sim_counts(&sent, &recv, &msgs);
+  if (end) {
+    p->end[idx]   = spawn_net_sim_time();
+    p->sent[idx] += sent;
+    p->msgs[idx] += msgs;
+  } else {
+    p->start[idx] = spawn_net_sim_time();
+    p->sent[idx]  = - sent;
+    p->msgs[idx]  = - msgs;
+  }
+}
+
+static void sim_main(int64_t rank, void* arg)
+{
+  sim_params* p = (sim_params*) arg;
+  int64_t ranks = p->ranks;
+
+  spawn_net_endpoint* ep = spawn_net_open(SPAWN_NET_TYPE_SIM);
+
+  char* left  = NULL;
+  char* right = NULL;
+  if (rank > 0) {
+    left = SPAWN_STRDUPF("SIM:%lld", (long long) (rank - 1));
+  }
+  if (rank < ranks - 1) {
+    right = SPAWN_STRDUPF("SIM:%lld", (long long) (rank + 1));
+  }
+
+  spawn_net_sim_phase(0);
+  sim_mark(p, rank, 0, 0);
+  lwgrp* group = lwgrp_create(ranks, rank, spawn_net_name(ep), left, right, ep);
+  sim_mark(p, rank, 0, 1);
+
+  int i;
+  for (i = 1; i < p->nops; i++) {
+    spawn_net_sim_phase(i);
+    sim_mark(p, rank, i, 0);
+    if (sim_op(p->ops[i], p, group) != LWGRP_SUCCESS) {
+      p->errors++;
+    }
+    sim_mark(p, rank, i, 1);
+  }
+
+  lwgrp_free(&group);
+  spawn_free(&right);
+  spawn_free(&left);
+  spawn_net_close(&ep);
+}
+
+static void sim_usage(void)
+{
+  printf("Usage: lwgrp_sim [-n ranks] [-l latency_us] [-b bandwidth_MBps] [-o overhead_us]\n");
+  printf("                 [-s bytes] [-c colors] [-t stack_KB] [-p] [op ...]\n");
+  printf("  ops: barrier allreduce scan bcast split allgather\n");
+}
+
+int main(int argc, char* argv[])
+{
+  sim_params params;
+  memset(&params, 0, sizeof(params));
+  params.ranks  = 1024;
+  params.bytes  = 8;
+  params.colors = 16;
+
+  spawn_net_sim_model model;
+  model.latency   = 1.0e-6;
+  model.bandwidth = 10.0e9;
+  model.overhead  = 0.2e-6;
+
+  size_t stack_size = 0;
+  int print_path = 0;
+
+  /* counters for millions of simulated channels would not fit in
+   * memory, leave them off unless asked */
+  setenv("SPAWN_NET_STATS", "0", 0);
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:l:b:o:s:c:t:ph")) != -1) {
+    switch (opt) {
+    case 'n':
+      params.ranks = atoll(optarg);
+      break;
+    case 'l':
+      model.latency = atof(optarg) * 1.0e-6;
+      break;
+    case 'b':
+      model.bandwidth = atof(optarg) * 1.0e6;
+      break;
+    case 'o':
+      model.overhead = atof(optarg) * 1.0e-6;
+      break;
+    case 's':
+      params.bytes = (size_t) atoll(optarg);
+      break;
+    case 'c':
+      params.colors = atoll(optarg);
+      break;
+    case 't':
+      stack_size = (size_t) atoll(optarg) * 1024;
+      break;
+    case 'p':
+      print_path = 1;
+      break;
+    default:
+      sim_usage();
+      return (opt == 'h') ? 0 : 1;
+    }
+  }
+  if (params.ranks < 1 || params.colors < 1 || model.bandwidth <= 0.0) {
+    sim_usage();
+    return 1;
+  }
+
+  /* create always runs first */
+  params.ops[params.nops++] = "create";
+  int i;
+  for (i = optind; i < argc; i++) {
+    if (strcmp(argv[i], "create") == 0) {
+      continue;
+    }
+    if (strcmp(argv[i], "barrier")   != 0 &&
+        strcmp(argv[i], "allreduce") != 0 &&
+        strcmp(argv[i], "scan")      != 0 &&
+        strcmp(argv[i], "bcast")     != 0 &&
+        strcmp(argv[i], "split")     != 0 &&
+        strcmp(argv[i], "allgather") != 0)
+    {
+      printf("Unknown op %s\n", argv[i]);
+      sim_usage();
+      return 1;
+    }
+    if (params.nops == SIM_MAX_OPS) {
+      printf("Too many ops, at most %d\n", SIM_MAX_OPS - 1);
+      return 1;
+    }
+    params.ops[params.nops++] = argv[i];
+  }
+  if (params.nops == 1) {
+    params.ops[params.nops++] = "barrier";
+    params.ops[params.nops++] = "allreduce";
+    params.ops[params.nops++] = "bcast";
+    params.ops[params.nops++] = "split";
+  }
+
+  size_t count = (size_t) params.nops * (size_t) params.ranks;
+  params.start = (double*)   SPAWN_MALLOC(count * sizeof(double));
+  params.end   = (double*)   SPAWN_MALLOC(count * sizeof(double));
+  params.sent  = (uint64_t*) SPAWN_MALLOC(count * sizeof(uint64_t));
+  params.msgs  = (uint64_t*) SPAWN_MALLOC(count * sizeof(uint64_t));
+  memset(params.start, 0, count * sizeof(double));
+  memset(params.end,   0, count * sizeof(double));
+  memset(params.sent,  0, count * sizeof(uint64_t));
+  memset(params.msgs,  0, count * sizeof(uint64_t));
+
+  printf("ranks=%lld latency=%.3fus bandwidth=%.1fMB/s overhead=%.3fus bytes=%llu\n",
+    (long long) params.ranks, model.latency * 1e6, model.bandwidth / 1e6,
+    model.overhead * 1e6, (unsigned long long) params.bytes
+  );
+
+  int rc = spawn_net_sim_run(params.ranks, &model, stack_size, sim_main, &params);
+
+  /* an op spans from the first rank to start it to the last to end it */
+  printf("%-10s %12s %8s %12s %12s %10s\n",
+    "op", "time_us", "hops", "max_bytes", "avg_bytes", "max_msgs"
+  );
+  for (i = 0; i < params.nops; i++) {
+    double start = 0.0, end = 0.0;
+    uint64_t max_sent = 0, total_sent = 0, max_msgs = 0;
+    int64_t r;
+    for (r = 0; r < params.ranks; r++) {
+      int64_t idx = i * params.ranks + r;
+      if (r == 0 || params.start[idx] < start) {
+        start = params.start[idx];
+      }
+      if (r == 0 || params.end[idx] > end) {
+        end = params.end[idx];
+      }
+      if (params.sent[idx] > max_sent) {
+        max_sent = params.sent[idx];
+      }
+      if (params.msgs[idx] > max_msgs) {
+        max_msgs = params.msgs[idx];
+      }
+      total_sent += params.sent[idx];
+    }
+    printf("%-10s %12.3f %8lld %12llu %12.1f %10llu\n",
+      params.ops[i], (end - start) * 1e6, (long long) spawn_net_sim_path(i, NULL),
+      (unsigned long long) max_sent, (double) total_sent / (double) params.ranks,
+      (unsigned long long) max_msgs
+    );
+    if (print_path) {
+      spawn_net_sim_path(i, stdout);
+    }
+  }
+
+  if (params.errors > 0) {
+    printf("%llu ops returned wrong results\n", (unsigned long long) params.errors);
+    rc = 1;
+  }
+
+  spawn_free(&params.msgs);
+  spawn_free(&params.sent);
+  spawn_free(&params.end);
+  spawn_free(&params.start);
+
+  return rc;
+}
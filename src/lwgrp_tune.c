@@ -0,0 +1,426 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667277.
+ * All rights reserved.
+ * This file is part of the SpawnNet library.
+ * For details, see https://github.com/hpc/spawnnet
+ * Please also read the LICENSE file.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "lwgrp.h"
+#include "lwgrp_tune.h"
+#include "spawn_internal.h"
+
+/* The decision table records the algorithm to use for each
+ * collective, keyed by transport type, group size bucket, and
+ * message size bucket, where the bucket of a value is the ceiling
+ * of its log2.  lwgrp_tune_run fills entries by timing each
+ * algorithm on a group, and the table can be saved to and loaded
+ * from a text file with one entry per line:
+ *
+ *   <transport> <collective> <size bucket> <bytes bucket> <algorithm>
+ *
+ * For a lookup, we use the entry from the nearest measured group
+ * size bucket, and within that the nearest measured bytes bucket at
+ * or below ours, then above ours.  With no entry, a collective uses
+ * its radix algorithm if the group has one and dissemination
+ * otherwise.
+ *
+ * The table is loaded from the file named in LWGRP_TUNE_FILE on
+ * first use, and LWGRP_TUNE_BARRIER, LWGRP_TUNE_ALLREDUCE, and
+ * LWGRP_TUNE_ALLGATHER force an algorithm by name.  All procs in a
+ * group must see the same table and settings, since they each pick
+ * the algorithm on their own. */
+
+#define LWGRP_TUNE_TRANSPORTS (6)
+#define LWGRP_TUNE_BUCKETS    (32)
+
+/* number of timed iterations for each algorithm and size */
+#define LWGRP_TUNE_ITERS (10)
+
+static char lwgrp_tune_table[LWGRP_TUNE_TRANSPORTS][LWGRP_COLL_COUNT][LWGRP_TUNE_BUCKETS][LWGRP_TUNE_BUCKETS];
+
+/* algorithms forced by environment variables */
+static lwgrp_alg lwgrp_tune_env[LWGRP_COLL_COUNT];
+
+/* algorithm forced while benchmarking */
+static lwgrp_alg lwgrp_tune_forced = LWGRP_ALG_DEFAULT;
+
+static int lwgrp_tune_initialized = 0;
+
+static const char* lwgrp_transport_names[LWGRP_TUNE_TRANSPORTS] = {
+  "null", "tcp", "fifo", "ibud", "inproc", "sim"
+};
+
+static const char* lwgrp_coll_names[LWGRP_COLL_COUNT] = {
+  "barrier", "allreduce", "allgather"
+};
+
+static const char* lwgrp_coll_envs[LWGRP_COLL_COUNT] = {
+  "LWGRP_TUNE_BARRIER", "LWGRP_TUNE_ALLREDUCE", "LWGRP_TUNE_ALLGATHER"
+};
+
+static const char* lwgrp_alg_names[LWGRP_ALG_COUNT] = {
+  "default", "dissem", "radix", "tree"
+};
+
+/* returns index of name in list, or -1 if not found */
+static int lwgrp_tune_index(const char** names, int count, const char* name)
+{
+  int i;
+  for (i = 0; i < count; i++) {
+    if (strcmp(names[i], name) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/* returns ceiling(log2(value)), limited to the table size */
+static int lwgrp_tune_bucket(uint64_t value)
+{
+  int bucket = 0;
+  while (bucket < LWGRP_TUNE_BUCKETS - 1 &&
+         (((uint64_t) 1) << bucket) < value)
+  {
+    bucket++;
+  }
+  return bucket;
+}
+
+/* returns table index of transport used by group */
+static int lwgrp_tune_transport(const lwgrp* group)
+{
+  int type = 0;
+  if (group->ep != NULL) {
+    type = group->ep->type;
+  }
+  if (type < 0 || type >= LWGRP_TUNE_TRANSPORTS) {
+    type = 0;
+  }
+  return type;
+}
+
+/* reads environment on first call */
+static void lwgrp_tune_init(void)
+{
+  if (lwgrp_tune_initialized) {
+    return;
+  }
+  lwgrp_tune_initialized = 1;
+
+  /* read forced algorithms */
+  int coll;
+  for (coll = 0; coll < LWGRP_COLL_COUNT; coll++) {
+    lwgrp_tune_env[coll] = LWGRP_ALG_DEFAULT;
+    const char* value = getenv(lwgrp_coll_envs[coll]);
+    if (value != NULL) {
+      int alg = lwgrp_tune_index(lwgrp_alg_names, LWGRP_ALG_COUNT, value);
+      if (alg < 0) {
+        SPAWN_ERR("Unknown algorithm %s=%s", lwgrp_coll_envs[coll], value);
+        continue;
+      }
+      lwgrp_tune_env[coll] = (lwgrp_alg) alg;
+    }
+  }
+
+  /* load decision table */
+  const char* file = getenv("LWGRP_TUNE_FILE");
+  if (file != NULL) {
+    lwgrp_tune_load(file);
+  }
+}
+
+/* returns nearest group size bucket that has any entries for coll,
+ * or -1 if there are none */
+static int lwgrp_tune_row(int transport, lwgrp_coll coll, int size_bucket)
+{
+  int dist;
+  for (dist = 0; dist < LWGRP_TUNE_BUCKETS; dist++) {
+    int side;
+    for (side = 0; side < 2; side++) {
+      int s = side ? size_bucket + dist : size_bucket - dist;
+      if (s < 0 || s >= LWGRP_TUNE_BUCKETS || (side && dist == 0)) {
+        continue;
+      }
+
+      const char* entries = lwgrp_tune_table[transport][coll][s];
+      int b;
+      for (b = 0; b < LWGRP_TUNE_BUCKETS; b++) {
+        if (entries[b] != LWGRP_ALG_DEFAULT) {
+          return s;
+        }
+      }
+    }
+  }
+  return -1;
+}
+
+/* looks up nearest measured entry for the given buckets */
+static lwgrp_alg lwgrp_tune_lookup(int transport, lwgrp_coll coll, int size_bucket, int bytes_bucket)
+{
+  int s = lwgrp_tune_row(transport, coll, size_bucket);
+  if (s < 0) {
+    return LWGRP_ALG_DEFAULT;
+  }
+
+  /* search down for the nearest message size, then up */
+  const char* entries = lwgrp_tune_table[transport][coll][s];
+  int b;
+  for (b = bytes_bucket; b >= 0; b--) {
+    if (entries[b] != LWGRP_ALG_DEFAULT) {
+      return (lwgrp_alg) entries[b];
+    }
+  }
+  for (b = bytes_bucket + 1; b < LWGRP_TUNE_BUCKETS; b++) {
+    if (entries[b] != LWGRP_ALG_DEFAULT) {
+      return (lwgrp_alg) entries[b];
+    }
+  }
+  return LWGRP_ALG_DEFAULT;
+}
+
+int lwgrp_tune_sized(const lwgrp* group, lwgrp_coll coll)
+{
+  lwgrp_tune_init();
+
+  /* forced algorithms do not depend on size */
+  if (lwgrp_tune_forced != LWGRP_ALG_DEFAULT ||
+      lwgrp_tune_env[coll] != LWGRP_ALG_DEFAULT)
+  {
+    return 0;
+  }
+
+  int transport   = lwgrp_tune_transport(group);
+  int size_bucket = lwgrp_tune_bucket((uint64_t) group->size);
+  int s = lwgrp_tune_row(transport, coll, size_bucket);
+  if (s < 0) {
+    return 0;
+  }
+
+  /* check whether entries name more than one algorithm */
+  const char* entries = lwgrp_tune_table[transport][coll][s];
+  char first = LWGRP_ALG_DEFAULT;
+  int b;
+  for (b = 0; b < LWGRP_TUNE_BUCKETS; b++) {
+    if (entries[b] == LWGRP_ALG_DEFAULT) {
+      continue;
+    }
+    if (first == LWGRP_ALG_DEFAULT) {
+      first = entries[b];
+    } else if (entries[b] != first) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+lwgrp_alg lwgrp_tune_select(const lwgrp* group, lwgrp_coll coll, size_t bytes)
+{
+  lwgrp_tune_init();
+
+  /* forced algorithms take precedence over the table */
+  lwgrp_alg alg = lwgrp_tune_forced;
+  if (alg == LWGRP_ALG_DEFAULT) {
+    alg = lwgrp_tune_env[coll];
+  }
+  if (alg == LWGRP_ALG_DEFAULT) {
+    int transport    = lwgrp_tune_transport(group);
+    int size_bucket  = lwgrp_tune_bucket((uint64_t) group->size);
+    int bytes_bucket = lwgrp_tune_bucket((uint64_t) bytes);
+    alg = lwgrp_tune_lookup(transport, coll, size_bucket, bytes_bucket);
+  }
+
+  /* fall back to dissemination if group has no radix channels */
+  if (alg == LWGRP_ALG_RADIX && group->radix <= 2) {
+    alg = LWGRP_ALG_DISSEM;
+  }
+
+  if (alg == LWGRP_ALG_DEFAULT) {
+    alg = (group->radix > 2) ? LWGRP_ALG_RADIX : LWGRP_ALG_DISSEM;
+  }
+
+  return alg;
+}
+
+int lwgrp_tune_load(const char* file)
+{
+  FILE* fp = fopen(file, "r");
+  if (fp == NULL) {
+    SPAWN_ERR("Failed to open tuning file %s", file);
+    return LWGRP_FAILURE;
+  }
+
+  char line[256];
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    /* skip comments and blank lines */
+    char transport_name[32], coll_name[32], alg_name[32];
+    int size_bucket, bytes_bucket;
+    if (line[0] == '#' ||
+        sscanf(line, "%31s %31s %d %d %31s", transport_name, coll_name,
+               &size_bucket, &bytes_bucket, alg_name) != 5)
+    {
+      continue;
+    }
+
+    int transport = lwgrp_tune_index(lwgrp_transport_names, LWGRP_TUNE_TRANSPORTS, transport_name);
+    int coll      = lwgrp_tune_index(lwgrp_coll_names, LWGRP_COLL_COUNT, coll_name);
+    int alg       = lwgrp_tune_index(lwgrp_alg_names, LWGRP_ALG_COUNT, alg_name);
+    if (transport < 0 || coll < 0 || alg < 0 ||
+        size_bucket < 0 || size_bucket >= LWGRP_TUNE_BUCKETS ||
+        bytes_bucket < 0 || bytes_bucket >= LWGRP_TUNE_BUCKETS)
+    {
+      SPAWN_ERR("Invalid entry in tuning file %s: %s", file, line);
+      continue;
+    }
+
+    lwgrp_tune_table[transport][coll][size_bucket][bytes_bucket] = (char) alg;
+  }
+
+  fclose(fp);
+
+  return LWGRP_SUCCESS;
+}
+
+int lwgrp_tune_save(const char* file)
+{
+  FILE* fp = fopen(file, "w");
+  if (fp == NULL) {
+    SPAWN_ERR("Failed to open tuning file %s", file);
+    return LWGRP_FAILURE;
+  }
+
+  fprintf(fp, "# lwgrp decision table\n");
+  fprintf(fp, "# transport collective size_bucket bytes_bucket algorithm\n");
+
+  int transport, coll, s, b;
+  for (transport = 0; transport < LWGRP_TUNE_TRANSPORTS; transport++) {
+    for (coll = 0; coll < LWGRP_COLL_COUNT; coll++) {
+      for (s = 0; s < LWGRP_TUNE_BUCKETS; s++) {
+        for (b = 0; b < LWGRP_TUNE_BUCKETS; b++) {
+          int alg = lwgrp_tune_table[transport][coll][s][b];
+          if (alg != LWGRP_ALG_DEFAULT) {
+            fprintf(fp, "%s %s %d %d %s\n",
+              lwgrp_transport_names[transport], lwgrp_coll_names[coll],
+              s, b, lwgrp_alg_names[alg]
+            );
+          }
+        }
+      }
+    }
+  }
+
+  fclose(fp);
+
+  return LWGRP_SUCCESS;
+}
+
+/* returns current time in microseconds */
+static uint64_t lwgrp_tune_usecs(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (uint64_t) tv.tv_sec * 1000000 + (uint64_t) tv.tv_usec;
+}
+
+/* runs one instance of coll with bytes per proc */
+static void lwgrp_tune_exec(const lwgrp* group, lwgrp_coll coll, size_t bytes, uint64_t* buf, char* value)
+{
+  if (coll == LWGRP_COLL_BARRIER) {
+    lwgrp_barrier(group);
+  } else if (coll == LWGRP_COLL_ALLREDUCE) {
+    lwgrp_allreduce_uint64_sum(buf, bytes / sizeof(uint64_t), group);
+  } else {
+    strmap* map = strmap_new();
+    strmap_setf(map, "%lld=%s", (long long) group->rank, value);
+    lwgrp_allgather_strmap(map, group);
+    strmap_delete(&map);
+  }
+}
+
+/* returns max time across group in microseconds to run coll
+ * with bytes per proc using the given algorithm */
+static uint64_t lwgrp_tune_time(const lwgrp* group, lwgrp_coll coll, lwgrp_alg alg, size_t bytes)
+{
+  /* allocate input for allreduce and allgather */
+  uint64_t count = bytes / sizeof(uint64_t) + 1;
+  uint64_t* buf = (uint64_t*) SPAWN_MALLOC(count * sizeof(uint64_t));
+  memset(buf, 0, count * sizeof(uint64_t));
+  char* value = (char*) SPAWN_MALLOC(bytes + 1);
+  memset(value, 'x', bytes);
+  value[bytes] = '\0';
+
+  /* start together after one untimed run */
+  lwgrp_tune_forced = alg;
+  lwgrp_tune_exec(group, coll, bytes, buf, value);
+  lwgrp_tune_forced = LWGRP_ALG_DEFAULT;
+  lwgrp_barrier(group);
+
+  lwgrp_tune_forced = alg;
+  uint64_t start = lwgrp_tune_usecs();
+  int i;
+  for (i = 0; i < LWGRP_TUNE_ITERS; i++) {
+    lwgrp_tune_exec(group, coll, bytes, buf, value);
+  }
+  uint64_t elapsed = lwgrp_tune_usecs() - start;
+  lwgrp_tune_forced = LWGRP_ALG_DEFAULT;
+
+  /* all procs need the same result to pick the same algorithm */
+  lwgrp_allreduce_uint64_max(&elapsed, 1, group);
+
+  spawn_free(&value);
+  spawn_free(&buf);
+
+  return elapsed;
+}
+
+int lwgrp_tune_run(const lwgrp* group)
+{
+  lwgrp_tune_init();
+
+  /* message sizes to measure for each collective, ending with 0 */
+  static const size_t sizes[LWGRP_COLL_COUNT][4] = {
+    {1, 0},
+    {8, 1024, 65536, 0},
+    {8, 1024, 16384, 0},
+  };
+
+  int transport   = lwgrp_tune_transport(group);
+  int size_bucket = lwgrp_tune_bucket((uint64_t) group->size);
+
+  int coll;
+  for (coll = 0; coll < LWGRP_COLL_COUNT; coll++) {
+    int i;
+    for (i = 0; sizes[coll][i] != 0; i++) {
+      size_t bytes = sizes[coll][i];
+
+      /* time each algorithm the group supports */
+      lwgrp_alg best = LWGRP_ALG_DEFAULT;
+      uint64_t best_time = 0;
+      int alg;
+      for (alg = LWGRP_ALG_DISSEM; alg < LWGRP_ALG_COUNT; alg++) {
+        if (alg == LWGRP_ALG_RADIX && group->radix <= 2) {
+          continue;
+        }
+        uint64_t t = lwgrp_tune_time(group, (lwgrp_coll) coll, (lwgrp_alg) alg, bytes);
+        if (best == LWGRP_ALG_DEFAULT || t < best_time) {
+          best = (lwgrp_alg) alg;
+          best_time = t;
+        }
+      }
+
+      int bytes_bucket = lwgrp_tune_bucket((uint64_t) bytes);
+      lwgrp_tune_table[transport][coll][size_bucket][bytes_bucket] = (char) best;
+    }
+  }
+
+  return LWGRP_SUCCESS;
+}
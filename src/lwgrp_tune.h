@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667277.
+ * All rights reserved.
+ * This file is part of the SpawnNet library.
+ * For details, see https://github.com/hpc/spawnnet
+ * Please also read the LICENSE file.
+*/
+
+#ifndef LWGRP_TUNE_H
+#define LWGRP_TUNE_H
+
+#include "lwgrp.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* collectives that have more than one algorithm */
+typedef enum lwgrp_coll_enum {
+  LWGRP_COLL_BARRIER   = 0,
+  LWGRP_COLL_ALLREDUCE = 1,
+  LWGRP_COLL_ALLGATHER = 2,
+  LWGRP_COLL_COUNT     = 3, /* number of collectives */
+} lwgrp_coll;
+
+/* algorithms a collective may run */
+typedef enum lwgrp_alg_enum {
+  LWGRP_ALG_DEFAULT = 0, /* radix if the group has one, else dissemination */
+  LWGRP_ALG_DISSEM  = 1, /* dissemination over the 2^d channels */
+  LWGRP_ALG_RADIX   = 2, /* dissemination over the radix channels */
+  LWGRP_ALG_TREE    = 3, /* binomial reduce to rank 0 and broadcast */
+  LWGRP_ALG_COUNT   = 4, /* number of algorithms */
+} lwgrp_alg;
+
+/* returns algorithm to use for coll on group with bytes per proc,
+ * never returns LWGRP_ALG_DEFAULT or an algorithm the group lacks */
+lwgrp_alg lwgrp_tune_select(const lwgrp* group, lwgrp_coll coll, size_t bytes);
+
+/* returns 1 if the algorithm for coll on group depends on message
+ * size, in which case procs must agree on the size before selecting */
+int lwgrp_tune_sized(const lwgrp* group, lwgrp_coll coll);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LWGRP_TUNE_H */
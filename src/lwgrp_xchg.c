@@ -0,0 +1,306 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667277.
+ * All rights reserved.
+ * This file is part of the SpawnNet library.
+ * For details, see https://github.com/hpc/spawnnet
+ * Please also read the LICENSE file.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lwgrp.h"
+#include "lwgrp_xchg.h"
+#include "spawn_internal.h"
+
+/* see lwgrp_xchg.h for a description of the exchange engine */
+
+enum lwgrp_xchg_frame {
+  LWGRP_XCHG_SIZE     = 1, /* total length of message */
+  LWGRP_XCHG_DATA     = 2, /* chunk of message */
+  LWGRP_XCHG_DATA_ACK = 3, /* chunk of message that must be acked */
+  LWGRP_XCHG_ACK      = 4, /* ack of a DATA_ACK chunk */
+};
+
+/* prepare exchange with partner on given channel, which may be NULL */
+void lwgrp_xchg_init(lwgrp_xchg* x, const spawn_net_channel* ch)
+{
+  memset(x, 0, sizeof(lwgrp_xchg));
+  x->ch = ch;
+}
+
+/* send size bytes from buf to partner */
+void lwgrp_xchg_send(lwgrp_xchg* x, const void* buf, size_t size)
+{
+  x->flags |= LWGRP_XCHG_SEND;
+  x->send = (const char*) buf;
+  x->send_size = size;
+}
+
+/* receive message from partner into buf, which holds up to size bytes,
+ * if buf is NULL, a buffer is allocated to fit the message */
+void lwgrp_xchg_recv(lwgrp_xchg* x, void* buf, size_t size)
+{
+  x->flags |= LWGRP_XCHG_RECV;
+  x->recv = (char*) buf;
+  x->recv_size = size;
+}
+
+/* number of acks sender must get back before it has sent all chunks */
+static uint64_t lwgrp_xchg_acks(uint64_t chunks)
+{
+  if (chunks > LWGRP_XCHG_WINDOW) {
+    return chunks - LWGRP_XCHG_WINDOW;
+  }
+  return 0;
+}
+
+/* returns 1 if we have sent everything and received all acks */
+static int lwgrp_xchg_send_done(const lwgrp_xchg* x)
+{
+  if (! (x->flags & LWGRP_XCHG_SEND)) {
+    return 1;
+  }
+  return x->size_sent &&
+         x->sent == x->chunks &&
+         x->acks == lwgrp_xchg_acks(x->chunks);
+}
+
+/* returns 1 if we have received the full message */
+static int lwgrp_xchg_recv_done(const lwgrp_xchg* x)
+{
+  if (! (x->flags & LWGRP_XCHG_RECV)) {
+    return 1;
+  }
+  return x->size_recvd && x->recvd == x->recv_size;
+}
+
+/* write as many frames to partner as window allows,
+ * returns 1 if we wrote anything */
+static int lwgrp_xchg_write(lwgrp_xchg* x)
+{
+  int progress = 0;
+
+  /* send size of message */
+  if (! x->size_sent) {
+    uint64_t hdr[2];
+    hdr[0] = LWGRP_XCHG_SIZE;
+    hdr[1] = (uint64_t) x->send_size;
+    spawn_net_write(x->ch, hdr, sizeof(hdr));
+    x->size_sent = 1;
+    progress = 1;
+  }
+
+  /* send chunks until window is full */
+  while (x->sent < x->chunks && x->sent - x->acks < LWGRP_XCHG_WINDOW) {
+    size_t offset = (size_t) x->sent * x->chunk;
+    size_t bytes = x->send_size - offset;
+    if (bytes > x->chunk) {
+      bytes = x->chunk;
+    }
+
+    /* ask for an ack if we need one before sending a later chunk,
+     * some transports deliver data in units of the writes that sent
+     * it, so the header and data go in separate writes to match the
+     * separate reads on the receiving side */
+    uint64_t hdr[2];
+    hdr[0] = LWGRP_XCHG_DATA;
+    if (x->sent + LWGRP_XCHG_WINDOW < x->chunks) {
+      hdr[0] = LWGRP_XCHG_DATA_ACK;
+    }
+    hdr[1] = (uint64_t) bytes;
+    spawn_net_write(x->ch, hdr, sizeof(hdr));
+    spawn_net_write(x->ch, x->send + offset, bytes);
+
+    x->sent++;
+    progress = 1;
+  }
+
+  return progress;
+}
+
+/* read one frame from partner and process it */
+static int lwgrp_xchg_read(lwgrp_xchg* x)
+{
+  uint64_t hdr[2];
+  if (spawn_net_read(x->ch, hdr, sizeof(hdr)) != SPAWN_SUCCESS) {
+    return LWGRP_FAILURE;
+  }
+
+  uint64_t type  = hdr[0];
+  uint64_t value = hdr[1];
+  if (type == LWGRP_XCHG_ACK) {
+    x->acks++;
+  } else if (type == LWGRP_XCHG_SIZE) {
+    size_t size = (size_t) value;
+    if (x->recv == NULL) {
+      x->recv = (char*) SPAWN_MALLOC(size);
+    } else if (size > x->recv_size) {
+      SPAWN_ERR("Received %llu bytes into buffer of %llu bytes",
+        (unsigned long long) size, (unsigned long long) x->recv_size
+      );
+      return LWGRP_FAILURE;
+    }
+    x->recv_size  = size;
+    x->size_recvd = 1;
+  } else if (type == LWGRP_XCHG_DATA || type == LWGRP_XCHG_DATA_ACK) {
+    size_t bytes = (size_t) value;
+    if (x->recvd + bytes > x->recv_size) {
+      SPAWN_ERR("Received chunk beyond end of message");
+      return LWGRP_FAILURE;
+    }
+    spawn_net_read(x->ch, x->recv + x->recvd, bytes);
+    x->recvd += bytes;
+
+    /* let sender know it can send more */
+    if (type == LWGRP_XCHG_DATA_ACK) {
+      hdr[0] = LWGRP_XCHG_ACK;
+      hdr[1] = 0;
+      spawn_net_write(x->ch, hdr, sizeof(hdr));
+    }
+  } else {
+    SPAWN_ERR("Unknown exchange frame type %llu", (unsigned long long) type);
+    return LWGRP_FAILURE;
+  }
+
+  return LWGRP_SUCCESS;
+}
+
+void lwgrp_xchg_start(lwgrp_xchg* xs, int count)
+{
+  /* split our budget across active partners */
+  int i;
+  int active = 0;
+  for (i = 0; i < count; i++) {
+    if (xs[i].ch != NULL) {
+      active++;
+    }
+  }
+  if (active == 0) {
+    return;
+  }
+
+  size_t chunk = LWGRP_XCHG_BUDGET / (LWGRP_XCHG_WINDOW * active);
+  if (chunk < LWGRP_XCHG_MIN_CHUNK) {
+    chunk = LWGRP_XCHG_MIN_CHUNK;
+  }
+
+  for (i = 0; i < count; i++) {
+    lwgrp_xchg* x = &xs[i];
+    x->chunk      = chunk;
+    x->chunks     = (x->send_size + chunk - 1) / chunk;
+    x->size_sent  = 0;
+    x->sent       = 0;
+    x->acks       = 0;
+    x->size_recvd = 0;
+    x->recvd      = 0;
+  }
+}
+
+/* make one pass over partners, writing what the window allows and
+ * reading one frame from each partner that has one waiting, if chs
+ * is not NULL, it is filled with channels of partners that are not
+ * done, returns number of such partners in waiting */
+static int lwgrp_xchg_pass(
+  lwgrp_xchg* xs,
+  int count,
+  const spawn_net_channel** chs,
+  int* waiting,
+  int* progress)
+{
+  int i;
+  *waiting = 0;
+  for (i = 0; i < count; i++) {
+    lwgrp_xchg* x = &xs[i];
+    if (x->ch == NULL) {
+      continue;
+    }
+
+    /* send what we can */
+    if (x->flags & LWGRP_XCHG_SEND) {
+      *progress |= lwgrp_xchg_write(x);
+    }
+
+    /* nothing to read if we have all data and acks from partner */
+    if (lwgrp_xchg_send_done(x) && lwgrp_xchg_recv_done(x)) {
+      continue;
+    }
+    if (chs != NULL) {
+      chs[*waiting] = x->ch;
+    }
+    (*waiting)++;
+
+    /* read a frame if one is waiting */
+    int flag = 0;
+    spawn_net_probe(x->ch, &flag);
+    if (flag) {
+      if (lwgrp_xchg_read(x) != LWGRP_SUCCESS) {
+        return LWGRP_FAILURE;
+      }
+      *progress = 1;
+
+      /* the frame may have finished this partner */
+      if (lwgrp_xchg_send_done(x) && lwgrp_xchg_recv_done(x)) {
+        (*waiting)--;
+      }
+    }
+  }
+  return LWGRP_SUCCESS;
+}
+
+int lwgrp_xchg_test(lwgrp_xchg* xs, int count, int* flag, int* progress)
+{
+  int waiting = 0;
+  int rc = lwgrp_xchg_pass(xs, count, NULL, &waiting, progress);
+  *flag = (waiting == 0 || rc != LWGRP_SUCCESS);
+  return rc;
+}
+
+int lwgrp_exchange(lwgrp_xchg* xs, int count)
+{
+  int i;
+  int active = 0;
+  for (i = 0; i < count; i++) {
+    if (xs[i].ch != NULL) {
+      active++;
+    }
+  }
+  if (active == 0) {
+    return LWGRP_SUCCESS;
+  }
+  SPAWN_TRACE_BEGIN("lwgrp_round", active);
+
+  lwgrp_xchg_start(xs, count);
+
+  /* list of channels we still need to hear from */
+  const spawn_net_channel** chs = (const spawn_net_channel**) SPAWN_MALLOC(active * sizeof(spawn_net_channel*));
+
+  int rc = LWGRP_SUCCESS;
+  while (rc == LWGRP_SUCCESS) {
+    int progress = 0;
+    int waiting  = 0;
+    rc = lwgrp_xchg_pass(xs, count, chs, &waiting, &progress);
+
+    /* done once no partner has anything left for us */
+    if (waiting == 0 || rc != LWGRP_SUCCESS) {
+      break;
+    }
+
+    /* block until some partner sends us something */
+    if (! progress) {
+      int index;
+      spawn_net_wait(0, NULL, waiting, chs, &index);
+    }
+  }
+
+  spawn_free(&chs);
+
+  SPAWN_TRACE_END("lwgrp_round", active);
+
+  return rc;
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667277.
+ * All rights reserved.
+ * This file is part of the SpawnNet library.
+ * For details, see https://github.com/hpc/spawnnet
+ * Please also read the LICENSE file.
+*/
+
+#ifndef LWGRP_XCHG_H
+#define LWGRP_XCHG_H
+
+#include "lwgrp.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Exchange engine: the collectives exchange data with one or more
+ * partners in each round.  Writing everything before reading
+ * deadlocks once messages exceed what the transport buffers, since
+ * both partners block in write, while ordering reads and writes by
+ * rank serializes the two directions.  Instead, each message is
+ * split into chunks, and a sender may have at most
+ * LWGRP_XCHG_WINDOW chunks outstanding to a partner before the
+ * partner acknowledges reading them.  The amount of data in flight
+ * is bounded by LWGRP_XCHG_BUDGET, which fits in the buffering of
+ * our transports, so writes always complete, and we read whatever
+ * has arrived from any partner while waiting for acks.
+ *
+ * Each message starts with a SIZE frame that carries its total
+ * length, followed by DATA frames.  A sender only asks for an ack
+ * (DATA_ACK) on chunks it needs acked to send later chunks, so the
+ * receiver sends exactly the acks the sender consumes, and messages
+ * that fit in the window need no acks at all.
+ *
+ * lwgrp_exchange blocks until all partners are done, while
+ * lwgrp_xchg_test only writes what the window allows and only reads
+ * frames that have arrived, so non-blocking collectives can drive an
+ * exchange a little at a time. */
+
+#define LWGRP_XCHG_SEND (0x1)
+#define LWGRP_XCHG_RECV (0x2)
+
+/* total bytes we allow in flight to all partners */
+#define LWGRP_XCHG_BUDGET (32768)
+
+/* number of chunks a sender may have outstanding to one partner */
+#define LWGRP_XCHG_WINDOW (2)
+
+/* smallest chunk size to use with many partners */
+#define LWGRP_XCHG_MIN_CHUNK (1024)
+
+/* describes the exchange with one partner */
+typedef struct lwgrp_xchg_t {
+  const spawn_net_channel* ch; /* channel to partner, NULL to skip */
+  int flags;           /* LWGRP_XCHG_SEND and/or LWGRP_XCHG_RECV */
+  const char* send;    /* data to send to partner */
+  size_t send_size;    /* number of bytes to send */
+  char* recv;          /* buffer for data from partner, allocated if NULL */
+  size_t recv_size;    /* capacity of recv on input, bytes received on output */
+  size_t chunk;        /* chunk size for sending */
+  int size_sent;       /* whether we have sent our SIZE frame */
+  uint64_t chunks;     /* total number of chunks to send */
+  uint64_t sent;       /* number of chunks sent */
+  uint64_t acks;       /* number of acks received */
+  int size_recvd;      /* whether we have received the SIZE frame */
+  size_t recvd;        /* number of bytes received */
+} lwgrp_xchg;
+
+/* prepare exchange with partner on given channel, which may be NULL */
+void lwgrp_xchg_init(lwgrp_xchg* x, const spawn_net_channel* ch);
+
+/* send size bytes from buf to partner */
+void lwgrp_xchg_send(lwgrp_xchg* x, const void* buf, size_t size);
+
+/* receive message from partner into buf, which holds up to size bytes,
+ * if buf is NULL, a buffer is allocated to fit the message */
+void lwgrp_xchg_recv(lwgrp_xchg* x, void* buf, size_t size);
+
+/* set chunk sizes and clear progress of exchange with each partner
+ * in list, call before lwgrp_xchg_test and again to rerun it */
+void lwgrp_xchg_start(lwgrp_xchg* xs, int count);
+
+/* write and read what we can without waiting on a partner, sets flag
+ * to 1 once the exchange is done, and progress to 1 if we wrote or
+ * read anything */
+int lwgrp_xchg_test(lwgrp_xchg* xs, int count, int* flag, int* progress);
+
+/* exchange messages with each partner in list, sends and receives
+ * to all partners progress together and complete at any size */
+int lwgrp_exchange(lwgrp_xchg* xs, int count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LWGRP_XCHG_H */
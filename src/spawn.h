@@ -26,7 +26,22 @@
 /* send strmap and strings via spawn_net calls */
 #include "spawn_net_util.h"
 
+/* learn endpoint names of ring neighbors without PMI */
+#include "spawn_boot.h"
+
+/* launch agents in a tree */
+#include "spawn_tree.h"
+
 /* groups and collectives over spawn_net calls */
 #include "lwgrp.h"
 
+/* serve PMI2 wire protocol to launched procs */
+#include "spawn_pmi2.h"
+
+/* record events to view in chrome://tracing or Perfetto */
+#include "spawn_trace.h"
+
+/* snapshot counters and memory footprint as JSON or Prometheus text */
+#include "spawn_stats.h"
+
 #endif /* SPAWN_H */
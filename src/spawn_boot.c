@@ -0,0 +1,273 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667277.
+ * All rights reserved.
+ * This file is part of the SpawnNet library.
+ * For details, see https://github.com/hpc/spawnnet
+ * Please also read the LICENSE file.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "spawn_internal.h"
+#include "spawn_boot.h"
+
+/* The service and any concentrators under it form a tree of
+ * servers.  A proc registers with the server named in
+ * $SPAWN_BOOT_ROOT, which is either the service or a concentrator
+ * the launcher runs near the proc, such as one per node, and each
+ * concentrator registers with its own parent in the same way.  A
+ * registration carries the names of all ranks below the registrant,
+ * so a server knows it has heard from its whole subtree once it has
+ * names for each of the ranks it serves.  A concentrator then
+ * registers the names it gathered with its parent, and the service
+ * answers.  On the way back down, each server sends each of its
+ * registrants the names of its ranks plus the ranks next to them, or
+ * the full table.  A proc only ever connects to its parent, and only
+ * the top level of concentrators connects to the service, so with
+ * concentrators in a tree of degree k, the service accepts k
+ * connections and the bootstrap takes O(log_k N) rounds. */
+
+/* a server that gathers names from registrants */
+typedef struct spawn_boot_server_t {
+  int64_t count;              /* number of ranks we serve */
+  int64_t nregs;              /* number of registrants */
+  spawn_net_channel** chs;    /* channel to each registrant */
+  strmap** regs;              /* names of ranks below each registrant */
+  strmap* names;              /* names of all ranks we serve */
+} spawn_boot_server;
+
+/* accepts registrations on ep until we have names for count ranks,
+ * if ranks is positive, each rank must fall in [0,ranks) */
+static int spawn_boot_gather(
+  const spawn_net_endpoint* ep,
+  int64_t count,
+  int64_t ranks,
+  spawn_boot_server* server)
+{
+  /* each registrant brings at least one rank */
+  server->count = count;
+  server->nregs = 0;
+  server->chs   = (spawn_net_channel**) SPAWN_MALLOC(count * sizeof(spawn_net_channel*));
+  server->regs  = (strmap**) SPAWN_MALLOC(count * sizeof(strmap*));
+  server->names = strmap_new();
+
+  int64_t have = 0;
+  while (have < count) {
+    spawn_net_channel* ch = spawn_net_accept(ep);
+    if (ch == SPAWN_NET_CHANNEL_NULL) {
+      SPAWN_ERR("Failed to accept boot connection");
+      return SPAWN_FAILURE;
+    }
+
+    strmap* reg = strmap_new();
+    int64_t index = server->nregs;
+    server->chs[index]  = ch;
+    server->regs[index] = reg;
+    server->nregs++;
+    spawn_net_read_strmap(ch, reg);
+
+    /* check that we know nothing yet of each rank in registration */
+    int64_t added = 0;
+    strmap_node* node;
+    for (node = strmap_node_first(reg); node != NULL; node = strmap_node_next(node)) {
+      const char* key = strmap_node_key(node);
+      int64_t rank = (int64_t) strtoll(key, NULL, 10);
+      if (rank < 0 || (ranks > 0 && rank >= ranks) ||
+          strmap_get(server->names, key) != NULL)
+      {
+        SPAWN_ERR("Invalid boot registration for rank %s", key);
+        return SPAWN_FAILURE;
+      }
+      added++;
+    }
+    if (added == 0 || have + added > count) {
+      SPAWN_ERR("Boot registration of %lld ranks, expected at most %lld",
+        (long long) added, (long long) (count - have)
+      );
+      return SPAWN_FAILURE;
+    }
+
+    strmap_merge(server->names, reg);
+    have += added;
+  }
+
+  return SPAWN_SUCCESS;
+}
+
+/* sends each registrant the size of the job, whether we send the full
+ * table, and the names it needs out of names */
+static void spawn_boot_scatter(
+  const spawn_boot_server* server,
+  int64_t ranks,
+  int table,
+  const strmap* names)
+{
+  strmap* info = strmap_new();
+  strmap_setf(info, "RANKS=%lld", (long long) ranks);
+  strmap_setf(info, "TABLE=%d",   table);
+
+  int64_t i;
+  for (i = 0; i < server->nregs; i++) {
+    spawn_net_channel* ch = server->chs[i];
+    spawn_net_write_strmap(ch, info);
+
+    if (table) {
+      spawn_net_write_strmap(ch, names);
+      continue;
+    }
+
+    /* send names of registrant's ranks and the ranks next to them */
+    strmap* sub = strmap_new();
+    strmap_node* node;
+    for (node = strmap_node_first(server->regs[i]); node != NULL; node = strmap_node_next(node)) {
+      int64_t rank = (int64_t) strtoll(strmap_node_key(node), NULL, 10);
+      int64_t r;
+      for (r = rank - 1; r <= rank + 1; r++) {
+        int64_t neighbor = (r + ranks) % ranks;
+        const char* name = strmap_getf(names, "%lld", (long long) neighbor);
+        if (name != NULL) {
+          strmap_setf(sub, "%lld=%s", (long long) neighbor, name);
+        }
+      }
+    }
+    spawn_net_write_strmap(ch, sub);
+    strmap_delete(&sub);
+  }
+
+  strmap_delete(&info);
+}
+
+/* disconnects registrants and frees server */
+static void spawn_boot_server_free(spawn_boot_server* server)
+{
+  int64_t i;
+  for (i = 0; i < server->nregs; i++) {
+    spawn_net_disconnect(&server->chs[i]);
+    strmap_delete(&server->regs[i]);
+  }
+  strmap_delete(&server->names);
+  spawn_free(&server->regs);
+  spawn_free(&server->chs);
+}
+
+/* connects to parent and registers names, then reads size of job,
+ * whether parent sends full table, and names we need into reply */
+static int spawn_boot_register(
+  const char* parent,
+  const strmap* names,
+  int64_t* ranks,
+  int* table,
+  strmap* reply)
+{
+  spawn_net_channel* ch = spawn_net_connect(parent);
+  if (ch == SPAWN_NET_CHANNEL_NULL) {
+    SPAWN_ERR("Failed to connect to boot server at %s", parent);
+    return SPAWN_FAILURE;
+  }
+
+  spawn_net_write_strmap(ch, names);
+  strmap* info = strmap_new();
+  spawn_net_read_strmap(ch, info);
+  spawn_net_read_strmap(ch, reply);
+  spawn_net_disconnect(&ch);
+
+  const char* ranks_str = strmap_get(info, "RANKS");
+  const char* table_str = strmap_get(info, "TABLE");
+  if (ranks_str == NULL || table_str == NULL) {
+    SPAWN_ERR("Invalid reply from boot server at %s", parent);
+    strmap_delete(&info);
+    return SPAWN_FAILURE;
+  }
+  *ranks = (int64_t) strtoll(ranks_str, NULL, 10);
+  *table = atoi(table_str);
+  strmap_delete(&info);
+
+  return SPAWN_SUCCESS;
+}
+
+int spawn_boot_serve(
+  const spawn_net_endpoint* ep,
+  int64_t ranks,
+  int table)
+{
+  spawn_boot_server server;
+  int rc = spawn_boot_gather(ep, ranks, ranks, &server);
+  if (rc == SPAWN_SUCCESS) {
+    spawn_boot_scatter(&server, ranks, table, server.names);
+  }
+  spawn_boot_server_free(&server);
+  return rc;
+}
+
+int spawn_boot_relay(
+  const char* parent,
+  const spawn_net_endpoint* ep,
+  int64_t count)
+{
+  spawn_boot_server server;
+  int rc = spawn_boot_gather(ep, count, 0, &server);
+  if (rc == SPAWN_SUCCESS) {
+    /* register our ranks as one with our parent and
+     * pass what it sends us down to our registrants */
+    int64_t ranks;
+    int table;
+    strmap* names = strmap_new();
+    rc = spawn_boot_register(parent, server.names, &ranks, &table, names);
+    if (rc == SPAWN_SUCCESS) {
+      spawn_boot_scatter(&server, ranks, table, names);
+    }
+    strmap_delete(&names);
+  }
+  spawn_boot_server_free(&server);
+  return rc;
+}
+
+int spawn_boot_ring(
+  const char* root,
+  int64_t rank,
+  const spawn_net_endpoint* ep,
+  int64_t* ranks,
+  char** left,
+  char** right,
+  strmap* table)
+{
+  strmap* reg = strmap_new();
+  strmap_setf(reg, "%lld=%s", (long long) rank, spawn_net_name(ep));
+
+  int64_t size;
+  int send_table;
+  strmap* names = strmap_new();
+  int rc = spawn_boot_register(root, reg, &size, &send_table, names);
+  strmap_delete(&reg);
+  if (rc != SPAWN_SUCCESS) {
+    strmap_delete(&names);
+    return rc;
+  }
+
+  /* pick out names of our neighbors */
+  int64_t rank_left  = (rank - 1 + size) % size;
+  int64_t rank_right = (rank + 1) % size;
+  const char* name_left  = strmap_getf(names, "%lld", (long long) rank_left);
+  const char* name_right = strmap_getf(names, "%lld", (long long) rank_right);
+  if (name_left == NULL || name_right == NULL) {
+    SPAWN_ERR("Failed to get names of neighbors from boot service");
+    rc = SPAWN_FAILURE;
+  }
+
+  *ranks = size;
+  *left  = SPAWN_STRDUP(name_left);
+  *right = SPAWN_STRDUP(name_right);
+  if (table != NULL && send_table) {
+    strmap_merge(table, names);
+  }
+
+  strmap_delete(&names);
+
+  return rc;
+}
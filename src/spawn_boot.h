@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667277.
+ * All rights reserved.
+ * This file is part of the SpawnNet library.
+ * For details, see https://github.com/hpc/spawnnet
+ * Please also read the LICENSE file.
+*/
+
+#ifndef SPAWN_BOOT_H
+#define SPAWN_BOOT_H
+
+#include <stdint.h>
+#include "strmap.h"
+#include "spawn_net.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The boot service lets procs learn the endpoint names of their ring
+ * neighbors without PMI.  A launcher opens an endpoint, passes its
+ * name to the procs it starts (the examples read $SPAWN_BOOT_ROOT),
+ * and serves it.  To keep the service from accepting a connection
+ * from every proc, a launcher may run concentrators in a tree below
+ * the service, for example one per node, and pass procs the name of
+ * their concentrator instead.  Each proc and concentrator connects
+ * only to its parent, and the exchange takes one round per level. */
+
+/* serve boot requests for ranks procs on ep, and if table is set,
+ * send the full table of names to every proc, returns once all procs
+ * have their names */
+int spawn_boot_serve(
+  const spawn_net_endpoint* ep, /* endpoint procs and concentrators connect to */
+  int64_t ranks, /* number of procs in job */
+  int table      /* whether to send the full table of names */
+);
+
+/* serve boot requests for count procs on ep as a concentrator under
+ * the service or concentrator at parent, count includes procs that
+ * register through concentrators below us, returns once all of our
+ * procs have their names */
+int spawn_boot_relay(
+  const char* parent,           /* endpoint name of our parent */
+  const spawn_net_endpoint* ep, /* endpoint procs and concentrators connect to */
+  int64_t count                 /* number of procs below us */
+);
+
+/* register our endpoint with the boot service or concentrator at
+ * root, returns size of job and newly allocated names of the procs
+ * whose rank is one less and one more than ours modulo the size of
+ * the job, and if table is not NULL and the service sends it, adds
+ * key/value pairs of rank and name for all procs into table */
+int spawn_boot_ring(
+  const char* root, /* endpoint name of boot service or concentrator */
+  int64_t rank,     /* our rank within the job in range [0,ranks) */
+  const spawn_net_endpoint* ep, /* our endpoint */
+  int64_t* ranks,   /* number of procs in job */
+  char** left,      /* endpoint name of rank one less */
+  char** right,     /* endpoint name of rank one more */
+  strmap* table     /* rank/name pairs of all procs, may be NULL */
+);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* SPAWN_BOOT_H */
@@ -17,12 +17,16 @@
 #include "spawn_net.h"
 #include "spawn_net_tcp.h"
 #include "spawn_net_fifo.h"
+#include "spawn_net_inproc.h"
+#include "spawn_net_sim.h"
 
 #ifdef HAVE_SPAWN_NET_IBUD
 #include "spawn_net_ib.h"
 #endif
 
 #include "spawn_net_util.h"
+#include "spawn_net_stats.h"
+#include "spawn_trace.h"
 
 #define SPAWN_SUCCESS (0)
 #define SPAWN_FAILURE (1)
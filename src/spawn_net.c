@@ -13,6 +13,7 @@
 #include <stdlib.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/mman.h>
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <string.h>
@@ -20,24 +21,40 @@
 #include <unistd.h>
 
 #include "spawn_internal.h"
+#include "spawn_stats.h"
 
 spawn_net_endpoint* spawn_net_open(spawn_net_type type)
 {
+  /* set up any $SPAWN_STATS dumps */
+  spawn_stats_init();
+
   /* open endpoint */
+  spawn_net_endpoint* ep;
   if (type == SPAWN_NET_TYPE_TCP) {
-    return spawn_net_open_tcp();
+    ep = spawn_net_open_tcp();
   } else if (type == SPAWN_NET_TYPE_FIFO) {
-    return spawn_net_open_fifo();
+    ep = spawn_net_open_fifo();
+  } else if (type == SPAWN_NET_TYPE_INPROC) {
+    ep = spawn_net_open_inproc();
+  } else if (type == SPAWN_NET_TYPE_SIM) {
+    ep = spawn_net_open_sim();
   }
 #ifdef HAVE_SPAWN_NET_IBUD
   else if (type == SPAWN_NET_TYPE_IBUD) {
-    return spawn_net_open_ib();
+    ep = spawn_net_open_ib();
   }
 #endif
   else {
     SPAWN_ERR("Unknown endpoint type %d", (int)type);
-    return SPAWN_NET_ENDPOINT_NULL;
+    ep = SPAWN_NET_ENDPOINT_NULL;
+  }
+
+  /* attach counters to new endpoint */
+  if (ep != SPAWN_NET_ENDPOINT_NULL) {
+    ep->stats = spawn_net_stats_new(ep->type, SPAWN_NET_CHANNEL_NULL);
   }
+
+  return ep;
 }
 
 int spawn_net_close(spawn_net_endpoint** pep)
@@ -56,21 +73,34 @@ int spawn_net_close(spawn_net_endpoint** pep)
     return SPAWN_SUCCESS;
   }
 
+  /* transport frees endpoint, so hold on to its counters */
+  spawn_net_stats* stats = ep->stats;
+  spawn_net_stats_close(stats, ep->type, SPAWN_NET_CHANNEL_NULL);
+
   /* otherwise, check the endpoint type */
+  int rc;
   if (ep->type == SPAWN_NET_TYPE_TCP) {
-    return spawn_net_close_tcp(pep);
+    rc = spawn_net_close_tcp(pep);
   } else if (ep->type == SPAWN_NET_TYPE_FIFO) {
-    return spawn_net_close_fifo(pep);
+    rc = spawn_net_close_fifo(pep);
+  } else if (ep->type == SPAWN_NET_TYPE_INPROC) {
+    rc = spawn_net_close_inproc(pep);
+  } else if (ep->type == SPAWN_NET_TYPE_SIM) {
+    rc = spawn_net_close_sim(pep);
   }
 #ifdef HAVE_SPAWN_NET_IBUD
   else if (ep->type == SPAWN_NET_TYPE_IBUD) {
-    return spawn_net_close_ib(pep);
+    rc = spawn_net_close_ib(pep);
   }
 #endif
   else {
     SPAWN_ERR("Unknown endpoint type %d", (int)ep->type);
-    return SPAWN_FAILURE;
+    rc = SPAWN_FAILURE;
   }
+
+  spawn_net_stats_free(&stats);
+
+  return rc;
 }
 
 const char* spawn_net_name(const spawn_net_endpoint* ep)
@@ -111,6 +141,10 @@ spawn_net_type spawn_net_infer_type(const char* name)
     return SPAWN_NET_TYPE_FIFO;
   } else if (strncmp(name, "IBUD:", 5) == 0) {
     return SPAWN_NET_TYPE_IBUD;
+  } else if (strncmp(name, "INPROC:", 7) == 0) {
+    return SPAWN_NET_TYPE_INPROC;
+  } else if (strncmp(name, "SIM:", 4) == 0) {
+    return SPAWN_NET_TYPE_SIM;
   } else {
     return SPAWN_NET_TYPE_NULL;
   }
@@ -121,21 +155,38 @@ spawn_net_channel* spawn_net_connect(const char* name)
   /* infer type by endpoint name */
   spawn_net_type type = spawn_net_infer_type(name);
 
+  SPAWN_TRACE_BEGIN("spawn_net_connect", 0);
+  uint64_t start = spawn_net_stats_now();
+
   /* call appropriate connect routine */
+  spawn_net_channel* ch;
   if (type == SPAWN_NET_TYPE_TCP) {
-    return spawn_net_connect_tcp(name);
+    ch = spawn_net_connect_tcp(name);
   } else if (type == SPAWN_NET_TYPE_FIFO) {
-    return spawn_net_connect_fifo(name);
+    ch = spawn_net_connect_fifo(name);
+  } else if (type == SPAWN_NET_TYPE_INPROC) {
+    ch = spawn_net_connect_inproc(name);
+  } else if (type == SPAWN_NET_TYPE_SIM) {
+    ch = spawn_net_connect_sim(name);
   }
 #ifdef HAVE_SPAWN_NET_IBUD
   else if (type == SPAWN_NET_TYPE_IBUD) {
-    return spawn_net_connect_ib(name);
+    ch = spawn_net_connect_ib(name);
   }
 #endif
   else {
     SPAWN_ERR("Unknown endpoint name format %s", name);
-    return SPAWN_NET_CHANNEL_NULL;
+    ch = SPAWN_NET_CHANNEL_NULL;
   }
+
+  /* attach counters to new channel */
+  if (ch != SPAWN_NET_CHANNEL_NULL) {
+    ch->stats = spawn_net_stats_new(ch->type, ch);
+    SPAWN_NET_STATS_HIST(ch->stats, connect_hist, start);
+  }
+
+  SPAWN_TRACE_END("spawn_net_connect", 0);
+  return ch;
 }
 
 spawn_net_channel* spawn_net_accept(const spawn_net_endpoint* ep)
@@ -145,21 +196,39 @@ spawn_net_channel* spawn_net_accept(const spawn_net_endpoint* ep)
     return SPAWN_NET_CHANNEL_NULL;
   }
 
+  SPAWN_TRACE_BEGIN("spawn_net_accept", 0);
+  uint64_t start = SPAWN_NET_STATS_START(ep->stats);
+
   /* otherwise, call real accept routine for endpoint type */
+  spawn_net_channel* ch;
   if (ep->type == SPAWN_NET_TYPE_TCP) {
-    return spawn_net_accept_tcp(ep);
+    ch = spawn_net_accept_tcp(ep);
   } else if (ep->type == SPAWN_NET_TYPE_FIFO) {
-    return spawn_net_accept_fifo(ep);
+    ch = spawn_net_accept_fifo(ep);
+  } else if (ep->type == SPAWN_NET_TYPE_INPROC) {
+    ch = spawn_net_accept_inproc(ep);
+  } else if (ep->type == SPAWN_NET_TYPE_SIM) {
+    ch = spawn_net_accept_sim(ep);
   }
 #ifdef HAVE_SPAWN_NET_IBUD
   else if (ep->type == SPAWN_NET_TYPE_IBUD) {
-    return spawn_net_accept_ib(ep);
+    ch = spawn_net_accept_ib(ep);
   }
 #endif
   else {
     SPAWN_ERR("Unknown endpoint type %d", ep->type);
-    return SPAWN_NET_CHANNEL_NULL;
+    ch = SPAWN_NET_CHANNEL_NULL;
   }
+
+  /* attach counters to new channel, and count accept on endpoint */
+  if (ch != SPAWN_NET_CHANNEL_NULL) {
+    ch->stats = spawn_net_stats_new(ch->type, ch);
+    SPAWN_NET_STATS_HIST(ch->stats, connect_hist, start);
+    SPAWN_NET_STATS_HIST(ep->stats, connect_hist, start);
+  }
+
+  SPAWN_TRACE_END("spawn_net_accept", 0);
+  return ch;
 }
 
 int spawn_net_disconnect(spawn_net_channel** pch)
@@ -178,21 +247,34 @@ int spawn_net_disconnect(spawn_net_channel** pch)
     return SPAWN_SUCCESS;
   }
 
+  /* transport frees channel, so hold on to its counters */
+  spawn_net_stats* stats = ch->stats;
+  spawn_net_stats_close(stats, ch->type, ch);
+
   /* otherwise, call close routine for channel type */
+  int rc;
   if (ch->type == SPAWN_NET_TYPE_TCP) {
-    return spawn_net_disconnect_tcp(pch);
+    rc = spawn_net_disconnect_tcp(pch);
   } else if (ch->type == SPAWN_NET_TYPE_FIFO) {
-    return spawn_net_disconnect_fifo(pch);
+    rc = spawn_net_disconnect_fifo(pch);
+  } else if (ch->type == SPAWN_NET_TYPE_INPROC) {
+    rc = spawn_net_disconnect_inproc(pch);
+  } else if (ch->type == SPAWN_NET_TYPE_SIM) {
+    rc = spawn_net_disconnect_sim(pch);
   }
 #ifdef HAVE_SPAWN_NET_IBUD
   else if (ch->type == SPAWN_NET_TYPE_IBUD) {
-    return spawn_net_disconnect_ib(pch);
+    rc = spawn_net_disconnect_ib(pch);
   }
 #endif
   else {
     SPAWN_ERR("Unknown channel type %d", ch->type);
-    return SPAWN_FAILURE;
+    rc = SPAWN_FAILURE;
   }
+
+  spawn_net_stats_free(&stats);
+
+  return rc;
 }
 
 int spawn_net_read(const spawn_net_channel* ch, void* buf, size_t size)
@@ -202,21 +284,38 @@ int spawn_net_read(const spawn_net_channel* ch, void* buf, size_t size)
     return SPAWN_SUCCESS;
   }
 
+  SPAWN_TRACE_BEGIN("spawn_net_read", (int64_t) size);
+  uint64_t start = SPAWN_NET_STATS_START(ch->stats);
+
   /* otherwise, call read routine for channel type */
+  int rc;
   if (ch->type == SPAWN_NET_TYPE_TCP) {
-    return spawn_net_read_tcp(ch, buf, size);
+    rc = spawn_net_read_tcp(ch, buf, size);
   } else if (ch->type == SPAWN_NET_TYPE_FIFO) {
-    return spawn_net_read_fifo(ch, buf, size);
+    rc = spawn_net_read_fifo(ch, buf, size);
+  } else if (ch->type == SPAWN_NET_TYPE_INPROC) {
+    rc = spawn_net_read_inproc(ch, buf, size);
+  } else if (ch->type == SPAWN_NET_TYPE_SIM) {
+    rc = spawn_net_read_sim(ch, buf, size);
   }
 #ifdef HAVE_SPAWN_NET_IBUD
   else if (ch->type == SPAWN_NET_TYPE_IBUD) {
-    return spawn_net_read_ib(ch, buf, size);
+    rc = spawn_net_read_ib(ch, buf, size);
   }
 #endif
   else {
     SPAWN_ERR("Unknown channel type %d", ch->type);
-    return SPAWN_FAILURE;
+    rc = SPAWN_FAILURE;
+  }
+
+  if (rc == SPAWN_SUCCESS) {
+    SPAWN_NET_STATS_ADD(ch->stats, bytes_recv, size);
+    SPAWN_NET_STATS_ADD(ch->stats, msgs_recv, 1);
+    SPAWN_NET_STATS_HIST(ch->stats, read_hist, start);
   }
+
+  SPAWN_TRACE_END("spawn_net_read", (int64_t) size);
+  return rc;
 }
 
 int spawn_net_write(const spawn_net_channel* ch, const void* buf, size_t size)
@@ -226,15 +325,101 @@ int spawn_net_write(const spawn_net_channel* ch, const void* buf, size_t size)
     return SPAWN_SUCCESS;
   }
 
+  SPAWN_TRACE_BEGIN("spawn_net_write", (int64_t) size);
+  uint64_t start = SPAWN_NET_STATS_START(ch->stats);
+
   /* otherwise, call write routine for channel type */
+  int rc;
   if (ch->type == SPAWN_NET_TYPE_TCP) {
-    return spawn_net_write_tcp(ch, buf, size);
+    rc = spawn_net_write_tcp(ch, buf, size);
   } else if (ch->type == SPAWN_NET_TYPE_FIFO) {
-    return spawn_net_write_fifo(ch, buf, size);
+    rc = spawn_net_write_fifo(ch, buf, size);
+  } else if (ch->type == SPAWN_NET_TYPE_INPROC) {
+    rc = spawn_net_write_inproc(ch, buf, size);
+  } else if (ch->type == SPAWN_NET_TYPE_SIM) {
+    rc = spawn_net_write_sim(ch, buf, size);
   }
 #ifdef HAVE_SPAWN_NET_IBUD
   else if (ch->type == SPAWN_NET_TYPE_IBUD) {
-    return spawn_net_write_ib(ch, buf, size);
+    rc = spawn_net_write_ib(ch, buf, size);
+  }
+#endif
+  else {
+    SPAWN_ERR("Unknown channel type %d", ch->type);
+    rc = SPAWN_FAILURE;
+  }
+
+  if (rc == SPAWN_SUCCESS) {
+    SPAWN_NET_STATS_ADD(ch->stats, bytes_sent, size);
+    SPAWN_NET_STATS_ADD(ch->stats, msgs_sent, 1);
+    SPAWN_NET_STATS_HIST(ch->stats, write_hist, start);
+  }
+
+  SPAWN_TRACE_END("spawn_net_write", (int64_t) size);
+  return rc;
+}
+
+int spawn_net_sendfile(const spawn_net_channel* ch, int fd, off_t offset, size_t size)
+{
+  /* write is a NOP for a null channel */
+  if (ch == SPAWN_NET_CHANNEL_NULL || size == 0) {
+    return SPAWN_SUCCESS;
+  }
+
+  /* TCP can send straight from the page cache */
+  if (ch->type == SPAWN_NET_TYPE_TCP) {
+    uint64_t start = SPAWN_NET_STATS_START(ch->stats);
+    int rc = spawn_net_sendfile_tcp(ch, fd, offset, size);
+    if (rc == SPAWN_SUCCESS) {
+      SPAWN_NET_STATS_ADD(ch->stats, bytes_sent, size);
+      SPAWN_NET_STATS_ADD(ch->stats, msgs_sent, 1);
+      SPAWN_NET_STATS_HIST(ch->stats, write_hist, start);
+    }
+    return rc;
+  }
+
+  /* otherwise map the range and write it, mmap needs an offset
+   * aligned to a page */
+  off_t page  = (off_t) sysconf(_SC_PAGESIZE);
+  off_t start = offset - (offset % page);
+  size_t len  = size + (size_t) (offset - start);
+  void* map = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, start);
+  if (map == MAP_FAILED) {
+    SPAWN_ERR("Failed to map file (mmap() errno=%d %s)", errno, strerror(errno));
+    return SPAWN_FAILURE;
+  }
+  int rc = spawn_net_write(ch, (char*) map + (offset - start), size);
+  munmap(map, len);
+
+  return rc;
+}
+
+int spawn_net_probe(const spawn_net_channel* ch, int* flag)
+{
+  /* check that we got a pointer to a return value */
+  if (flag == NULL) {
+    return SPAWN_FAILURE;
+  }
+
+  /* a null channel never has data */
+  if (ch == SPAWN_NET_CHANNEL_NULL) {
+    *flag = 0;
+    return SPAWN_SUCCESS;
+  }
+
+  /* otherwise, call probe routine for channel type */
+  if (ch->type == SPAWN_NET_TYPE_TCP) {
+    return spawn_net_probe_tcp(ch, flag);
+  } else if (ch->type == SPAWN_NET_TYPE_FIFO) {
+    return spawn_net_probe_fifo(ch, flag);
+  } else if (ch->type == SPAWN_NET_TYPE_INPROC) {
+    return spawn_net_probe_inproc(ch, flag);
+  } else if (ch->type == SPAWN_NET_TYPE_SIM) {
+    return spawn_net_probe_sim(ch, flag);
+  }
+#ifdef HAVE_SPAWN_NET_IBUD
+  else if (ch->type == SPAWN_NET_TYPE_IBUD) {
+    return spawn_net_probe_ib(ch, flag);
   }
 #endif
   else {
@@ -268,9 +453,11 @@ int spawn_net_wait(
 
   /* TODO: support mixing of channels */
 
-  /* check that all channels are of the same type */
+  /* check that all channels are of the same type, and note whether
+   * any keep counters, which they all do unless $SPAWN_NET_STATS=0 */
   int type_set = 0;
   spawn_net_type type;
+  spawn_net_stats* stats = NULL;
   int i;
   for (i = 0; i < neps; i++) {
     /* get pointer to endpoint */
@@ -292,6 +479,10 @@ int spawn_net_wait(
       SPAWN_ERR("Mixture of endpoint/channel types in array");
       return SPAWN_FAILURE;
     }
+
+    if (ep->stats != NULL) {
+      stats = ep->stats;
+    }
   }
 
   for (i = 0; i < nchs; i++) {
@@ -314,24 +505,49 @@ int spawn_net_wait(
       SPAWN_ERR("Mixture of endpoint/channel types in array");
       return SPAWN_FAILURE;
     }
+
+    if (ch->stats != NULL) {
+      stats = ch->stats;
+    }
   }
 
+  SPAWN_TRACE_BEGIN("spawn_net_wait", (int64_t) (neps + nchs));
+  uint64_t start = SPAWN_NET_STATS_START(stats);
+
   /* otherwise, call write routine for channel type */
+  int rc;
   if (type == SPAWN_NET_TYPE_TCP) {
-    return spawn_net_wait_tcp(neps, eps, nchs, chs, index);
+    rc = spawn_net_wait_tcp(neps, eps, nchs, chs, index);
   }
-#if 0
   else if (type == SPAWN_NET_TYPE_FIFO) {
-    SPAWN_ERR("spawn_net_wait unsupported for FIFO channels");
+    rc = spawn_net_wait_fifo(neps, eps, nchs, chs, index);
+  }
+  else if (type == SPAWN_NET_TYPE_INPROC) {
+    rc = spawn_net_wait_inproc(neps, eps, nchs, chs, index);
+  }
+  else if (type == SPAWN_NET_TYPE_SIM) {
+    rc = spawn_net_wait_sim(neps, eps, nchs, chs, index);
   }
-#endif
 #ifdef HAVE_SPAWN_NET_IBUD
   else if (type == SPAWN_NET_TYPE_IBUD) {
-    return spawn_net_wait_ib(neps, eps, nchs, chs, index);
+    rc = spawn_net_wait_ib(neps, eps, nchs, chs, index);
   }
 #endif
   else {
     SPAWN_ERR("Unknown channel type %d", type);
-    return SPAWN_FAILURE;
+    rc = SPAWN_FAILURE;
   }
+
+  /* charge time we waited to whichever one was ready */
+  if (stats != NULL && rc == SPAWN_SUCCESS && *index >= 0) {
+    if (*index < neps) {
+      stats = eps[*index]->stats;
+    } else {
+      stats = chs[*index - neps]->stats;
+    }
+    SPAWN_NET_STATS_ADD(stats, wait_ns, spawn_net_stats_now() - start);
+  }
+
+  SPAWN_TRACE_END("spawn_net_wait", (int64_t) (neps + nchs));
+  return rc;
 }
@@ -13,6 +13,8 @@
 #define SPAWN_NET_H
 
 #include <stdlib.h>
+#include <stdint.h>
+#include <sys/types.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -26,13 +28,38 @@ typedef enum spawn_net_type_enum {
   SPAWN_NET_TYPE_TCP  = 1, /* TCP sockets */
   SPAWN_NET_TYPE_FIFO = 2, /* FIFO/pipe */
   SPAWN_NET_TYPE_IBUD = 3, /* IB UD */
+  SPAWN_NET_TYPE_INPROC = 4, /* threads in same process */
+  SPAWN_NET_TYPE_SIM  = 5, /* virtual ranks in simulator */
 } spawn_net_type;
 
+/* number of bins in latency histograms, bin i counts operations
+ * that took at least spawn_net_stats_bin_ns(i) nanoseconds, there are
+ * four bins per power of two, and the last bin counts everything
+ * that took at least 7 * 2^30 ns, about 7.5 seconds */
+#define SPAWN_NET_STATS_BINS (128)
+
+/* counters kept for each endpoint and channel, all uint64_t so a
+ * group can sum them with one lwgrp_allreduce_uint64_sum */
+typedef struct spawn_net_stats_struct {
+  uint64_t bytes_sent; /* bytes written */
+  uint64_t bytes_recv; /* bytes read */
+  uint64_t msgs_sent;  /* calls to write or sendfile */
+  uint64_t msgs_recv;  /* calls to read */
+  uint64_t syscalls;   /* system calls the transport made for reads and writes */
+  uint64_t wait_ns;    /* nanoseconds in spawn_net_wait until this one was ready */
+  uint64_t retries;    /* transfers retried after EINTR, a short count, or a full window */
+  uint64_t resends;    /* packets the transport sent again after a timeout */
+  uint64_t read_hist[SPAWN_NET_STATS_BINS];    /* latency of reads */
+  uint64_t write_hist[SPAWN_NET_STATS_BINS];   /* latency of writes */
+  uint64_t connect_hist[SPAWN_NET_STATS_BINS]; /* latency of connects and accepts */
+} spawn_net_stats;
+
 /* represents an endpoint which others may connect to */
 typedef struct spawn_net_endpoint_struct {
   int type;         /* network type for endpoint */
   const char* name; /* address of endpoint */
   void* data;       /* network-specific data */
+  spawn_net_stats* stats; /* counters, NULL if $SPAWN_NET_STATS=0 */
 } spawn_net_endpoint;
 
 /* represents an open, reliable channel between two endpoints */
@@ -40,6 +67,7 @@ typedef struct spawn_net_channel_struct {
   int type;                 /* network type for channel */
   const char* name;         /* printable name of channel */
   void* data;               /* network-specific data */
+  spawn_net_stats* stats;   /* counters, NULL if $SPAWN_NET_STATS=0 */
 } spawn_net_channel;
 
 /* given an endpoint name, identify and return its type */
@@ -72,6 +100,14 @@ int spawn_net_read(const spawn_net_channel* ch, void* buf, size_t size);
 /* write size bytes from buffer into connection */
 int spawn_net_write(const spawn_net_channel* ch, const void* buf, size_t size);
 
+/* write size bytes starting at offset of open file fd into connection,
+ * without copying through user memory where the transport allows */
+int spawn_net_sendfile(const spawn_net_channel* ch, int fd, off_t offset, size_t size);
+
+/* set flag to 1 if data is waiting to be read on connection,
+ * 0 otherwise, does not block */
+int spawn_net_probe(const spawn_net_channel* ch, int* flag);
+
 /* wait for data on list of connections, return index of pending comm,
  * if index < neps, it points to an endpoint, otherwise it points to
  * the channel at (index - neps)  */
@@ -83,6 +119,23 @@ int spawn_net_wait(
   int* index                      /* returns index of active item */
 );
 
+/* Statistics are on unless $SPAWN_NET_STATS is 0, counters are
+ * updated with relaxed atomics, so reading them while other threads
+ * use the channel gives a recent but not exact snapshot */
+
+/* copy counters of channel into stats, all zero if stats are off */
+int spawn_net_channel_stats(const spawn_net_channel* ch, spawn_net_stats* stats);
+
+/* copy counters of endpoint into stats, which count accepts and waits
+ * that returned the endpoint */
+int spawn_net_endpoint_stats(const spawn_net_endpoint* ep, spawn_net_stats* stats);
+
+/* add each counter and histogram bin of src into dst */
+int spawn_net_stats_add(spawn_net_stats* dst, const spawn_net_stats* src);
+
+/* returns least latency in nanoseconds counted in histogram bin */
+uint64_t spawn_net_stats_bin_ns(int bin);
+
 /* TODO: isend/irecv/waitall */
 
 #ifdef __cplusplus
@@ -133,6 +133,8 @@ typedef struct spawn_packet_t {
 /* packet queue */
 static spawn_packet* queue_head = NULL;
 static spawn_packet* queue_tail = NULL;
+static uint64_t queue_packets = 0; /* number of packets in queue */
+static uint64_t queue_bytes   = 0; /* payload bytes in queue */
 
 /* structure allocated and stored as extra state in spawn_net_endpoint */
 typedef struct spawn_epdata_t {
@@ -324,6 +326,9 @@ static void queue_progress()
         queue_tail->next = p;
       }
       queue_tail = p;
+
+      __atomic_fetch_add(&queue_packets, 1, __ATOMIC_RELAXED);
+      __atomic_fetch_add(&queue_bytes, p->size, __ATOMIC_RELAXED);
     }
 
     /* look for next packet */
@@ -361,9 +366,19 @@ static void queue_extract(spawn_packet* prev, spawn_packet* curr)
   /* set current's next pointer to NULL */
   curr->next = NULL;
 
+  __atomic_fetch_sub(&queue_packets, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_sub(&queue_bytes, curr->size, __ATOMIC_RELAXED);
+
   return;
 }
 
+int spawn_net_queue_fifo(uint64_t* packets, uint64_t* bytes)
+{
+  *packets = __atomic_load_n(&queue_packets, __ATOMIC_RELAXED);
+  *bytes   = __atomic_load_n(&queue_bytes, __ATOMIC_RELAXED);
+  return SPAWN_SUCCESS;
+}
+
 /* determine whether specified packet matches type and source id */
 static int packet_match(spawn_packet* p, uint64_t type, uint64_t src)
 {
@@ -469,7 +484,7 @@ spawn_net_endpoint* spawn_net_open_fifo()
     }
 
     /* open fifo for reading */
-    g_fd = open(g_path, O_RDONLY | O_NONBLOCK);
+    g_fd = open(g_path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
     if (g_fd < 0) {
       SPAWN_ERR("Failed to open fifo at '%s'", g_path);
       unlink(g_path);
@@ -567,8 +582,8 @@ static int open_for_write(const char* name)
   const char* path = name;
   path += 5;
 
-  /* open fifo for writing */
-  int fd = open(path, O_WRONLY);
+  /* open fifo for writing, procs we exec should not inherit it */
+  int fd = open(path, O_WRONLY | O_CLOEXEC);
   if (fd < 0) {
     SPAWN_ERR("Failed to open FIFO for writing %s", path);
     return -1;
@@ -907,3 +922,109 @@ int spawn_net_write_fifo(const spawn_net_channel* ch, const void* buf, size_t si
 
   return rc;
 }
+
+/* check whether a message is waiting on channel without blocking */
+int spawn_net_probe_fifo(const spawn_net_channel* ch, int* flag)
+{
+  /* get FIFO channel data */
+  spawn_chdata* chdata = (spawn_chdata*) ch->data;
+  if (chdata == NULL) {
+    return SPAWN_FAILURE;
+  }
+
+  /* pull any packets off the wire */
+  queue_progress();
+
+  /* scan queue for a matching packet */
+  *flag = 0;
+  spawn_packet* curr = queue_head;
+  while (curr != NULL) {
+    if (packet_match(curr, PKT_MESSAGE, chdata->readid)) {
+      *flag = 1;
+      break;
+    }
+    curr = curr->next;
+  }
+
+  return SPAWN_SUCCESS;
+}
+
+/* wait until a connection request is pending on an endpoint or a
+ * message is pending on a channel, return its index */
+int spawn_net_wait_fifo(
+  int neps,
+  const spawn_net_endpoint** eps,
+  int nchs,
+  const spawn_net_channel** chs,
+  int* index)
+{
+  /* bail out if endpoint and channel arrays are empty */
+  if (eps == NULL && chs == NULL) {
+    return SPAWN_FAILURE;
+  }
+
+  /* all endpoints share a single pipe, so find the first valid one */
+  int ep_index = -1;
+  int i;
+  for (i = 0; i < neps; i++) {
+    if (eps[i] != SPAWN_NET_ENDPOINT_NULL) {
+      ep_index = i;
+      break;
+    }
+  }
+
+  /* check that we have at least one valid endpoint or channel */
+  int valid = (ep_index != -1);
+  for (i = 0; i < nchs; i++) {
+    if (chs[i] != SPAWN_NET_CHANNEL_NULL) {
+      valid = 1;
+      break;
+    }
+  }
+
+  /* if all endpoints and channels are NULL,
+   * we can't wait on any of them */
+  if (! valid) {
+    *index = -1;
+    return SPAWN_SUCCESS;
+  }
+
+  /* drain packets from our pipe until we find one that
+   * matches an endpoint or channel */
+  while (1) {
+    queue_progress();
+
+    /* scan queue for a matching packet */
+    spawn_packet* curr = queue_head;
+    while (curr != NULL) {
+      /* connection requests match any of our endpoints */
+      if (ep_index != -1 && curr->type == PKT_CONNECT) {
+        *index = ep_index;
+        return SPAWN_SUCCESS;
+      }
+
+      /* check whether message is for one of our channels */
+      if (curr->type == PKT_MESSAGE) {
+        for (i = 0; i < nchs; i++) {
+          /* skip NULL channels */
+          const spawn_net_channel* ch = chs[i];
+          if (ch == SPAWN_NET_CHANNEL_NULL) {
+            continue;
+          }
+
+          /* check whether packet matches channel read id */
+          spawn_chdata* chdata = (spawn_chdata*) ch->data;
+          if (chdata != NULL && packet_match(curr, PKT_MESSAGE, chdata->readid)) {
+            *index = i + neps;
+            return SPAWN_SUCCESS;
+          }
+        }
+      }
+
+      /* go to next packet */
+      curr = curr->next;
+    }
+  }
+
+  return SPAWN_SUCCESS;
+}
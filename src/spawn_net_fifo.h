@@ -32,6 +32,20 @@ int spawn_net_read_fifo(const spawn_net_channel* ch, void* buf, size_t size);
 
 int spawn_net_write_fifo(const spawn_net_channel* ch, const void* buf, size_t size);
 
+int spawn_net_probe_fifo(const spawn_net_channel* ch, int* flag);
+
+int spawn_net_wait_fifo(
+  int neps,
+  const spawn_net_endpoint** eps,
+  int nchs,
+  const spawn_net_channel** chs,
+  int* index
+);
+
+/* get number and payload bytes of packets read from our pipe
+ * that are waiting to be matched to a read */
+int spawn_net_queue_fifo(uint64_t* packets, uint64_t* bytes);
+
 #ifdef __cplusplus
 }
 #endif
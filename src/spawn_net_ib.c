@@ -3725,6 +3725,82 @@ int spawn_net_write_ib(const spawn_net_channel* ch, const void* buf, size_t size
     return ret;
 }
 
+/* sets flag to 1 if a message is pending on the channel */
+int spawn_net_probe_ib(const spawn_net_channel* ch, int* flag)
+{
+    /* get pointer to vc from channel data field */
+    vc_t* vc = (vc_t*) ch->data;
+    if (vc == NULL) {
+        return SPAWN_FAILURE;
+    }
+
+    /* check for entry in apprecv queue */
+    comm_lock();
+    *flag = apprecv_window_test(&vc->app_recv_window);
+    comm_unlock();
+
+    return SPAWN_SUCCESS;
+}
+
+/* fill in counters the vc keeps for the reliability protocol */
+int spawn_net_stats_ib(const spawn_net_channel* ch, spawn_net_stats* stats)
+{
+    /* get pointer to vc from channel data field */
+    vc_t* vc = (vc_t*) ch->data;
+    if (vc == NULL) {
+        return SPAWN_FAILURE;
+    }
+
+    /* sends that waited in the extended window for the send window
+     * to open count as retries */
+    comm_lock();
+    stats->resends = vc->resend_count;
+    stats->retries = vc->ext_win_send_count;
+    comm_unlock();
+
+    return SPAWN_SUCCESS;
+}
+
+/* get vbuf pool usage and number of packets waiting in send windows
+ * and for ACKs summed over all vcs */
+int spawn_net_queue_ib(
+  uint64_t* vbufs,
+  uint64_t* vbufs_free,
+  uint64_t* vbuf_bytes,
+  uint64_t* unacked,
+  uint64_t* queued)
+{
+    *vbufs      = 0;
+    *vbufs_free = 0;
+    *vbuf_bytes = 0;
+    *unacked    = 0;
+    *queued     = 0;
+
+    /* nothing to count until an endpoint is open */
+    if (g_count_open == 0) {
+        return SPAWN_SUCCESS;
+    }
+
+    comm_lock();
+
+    *vbufs      = (uint64_t) ud_vbuf_num_allocated;
+    *vbufs_free = (uint64_t) ud_vbuf_num_free;
+    *vbuf_bytes = (uint64_t) ud_vbuf_num_allocated * (sizeof(vbuf) + rdma_default_ud_mtu);
+    *unacked    = (uint64_t) proc.unack_queue.count;
+
+    uint64_t i;
+    for (i = 0; i < g_ud_vc_infos; i++) {
+        vc_t* vc = g_ud_vc_info[i];
+        if (vc != NULL) {
+            *queued += (uint64_t) vc->ext_window.count;
+        }
+    }
+
+    comm_unlock();
+
+    return SPAWN_SUCCESS;
+}
+
 /* this waits until one of the specified channels has a message
  * pending, and then it sets index to the index of that channel,
  * index is set to -1 if none of the channels are valid */
@@ -32,6 +32,26 @@ int spawn_net_read_ib(const spawn_net_channel* ch, void* buf, size_t size);
 
 int spawn_net_write_ib(const spawn_net_channel* ch, const void* buf, size_t size);
 
+int spawn_net_probe_ib(const spawn_net_channel* ch, int* flag);
+
+int spawn_net_stats_ib(const spawn_net_channel* ch, spawn_net_stats* stats);
+
+int spawn_net_queue_ib(
+  uint64_t* vbufs,
+  uint64_t* vbufs_free,
+  uint64_t* vbuf_bytes,
+  uint64_t* unacked,
+  uint64_t* queued
+);
+
+int spawn_net_wait_ib(
+  int neps,
+  const spawn_net_endpoint** eps,
+  int nchs,
+  const spawn_net_channel** chs,
+  int* index
+);
+
 #ifdef __cplusplus
 }
 #endif
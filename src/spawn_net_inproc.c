@@ -0,0 +1,610 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667277.
+ * All rights reserved.
+ * This file is part of the SpawnNet library.
+ * For details, see https://github.com/hpc/spawnnet
+ * Please also read the LICENSE file.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "spawn_internal.h"
+
+/* This transport connects threads of a single process.  Each endpoint
+ * takes the next id from a process-wide counter, and it registers
+ * itself in a table of pages indexed by id, which is read without
+ * locks.  The endpoint name is "INPROC:<id>".
+ *
+ * A connection is a pair of single-producer, single-consumer byte
+ * rings, one per direction.  The writer only advances the tail and
+ * the reader only advances the head, so neither side takes a lock to
+ * move data.  A thread that finds a ring full or empty sleeps on a
+ * condition variable, and the other side only takes the lock to wake
+ * it if someone is sleeping.
+ *
+ * Writes of INPROC_HANDOFF bytes or more that don't fit in the free
+ * space of the ring skip it.  The writer lends its buffer to the
+ * reader and blocks until the reader has copied the data straight
+ * out of it, so large messages are copied once rather than into and
+ * back out of the ring.  A write that fits goes through the ring, so
+ * like the other transports, a write only waits on the reader once
+ * its buffers are full.
+ *
+ * Connect queues the new connection on the endpoint and returns right
+ * away, and accept takes connections off of that queue.  The
+ * connection is freed once both sides have disconnected.  Since
+ * another thread may be looking up an endpoint while it is closed,
+ * close removes the endpoint from the table but keeps its small
+ * internal state around for the life of the process. */
+
+/* bytes in each ring, must be a power of two */
+#define INPROC_RING_SIZE (64 * 1024)
+
+/* writes this large are handed to the reader rather than copied
+ * through the ring, if the ring can't hold them */
+#define INPROC_HANDOFF (16 * 1024)
+
+/* endpoint table is INPROC_PAGES pages of INPROC_PAGE_SIZE entries */
+#define INPROC_PAGE_SIZE (1024)
+#define INPROC_PAGES     (1024)
+
+/* lets a thread sleep until another changes some state, wakers
+ * skip the lock when nobody is sleeping */
+typedef struct inproc_signal_t {
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  uint64_t seq; /* bumped on each wakeup */
+  int sleepers; /* number of threads between sleep_begin and sleep_end */
+} inproc_signal;
+
+/* one direction of a connection */
+typedef struct inproc_ring_t {
+  char* buf;            /* ring buffer of INPROC_RING_SIZE bytes */
+  uint64_t head;        /* bytes consumed, only advanced by reader */
+  uint64_t tail;        /* bytes produced, only advanced by writer */
+  const char* big;      /* next byte of buffer lent by writer */
+  uint64_t big_size;    /* bytes of lent buffer reader has yet to copy */
+  int reader_closed;    /* reader has disconnected */
+  int writer_closed;    /* writer has disconnected */
+  inproc_signal signal; /* wakes reader or writer */
+} inproc_ring;
+
+/* state shared by both sides of a connection */
+typedef struct inproc_conn_t {
+  inproc_ring ring[2]; /* connector writes ring[0], acceptor writes ring[1] */
+  int refs;            /* number of sides yet to disconnect */
+  struct inproc_conn_t* next; /* link in accept queue of endpoint */
+} inproc_conn;
+
+/* structure allocated and stored as extra state in spawn_net_endpoint */
+typedef struct spawn_epdata_t {
+  uint64_t id;         /* index of endpoint in table */
+  int closed;          /* endpoint has been closed */
+  inproc_conn* head;   /* oldest connection waiting to be accepted */
+  inproc_conn* tail;   /* newest connection waiting to be accepted */
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+} spawn_epdata;
+
+/* structure allocated and stored as extra state in spawn_net_channel */
+typedef struct spawn_chdata_t {
+  inproc_conn* conn; /* connection shared with peer */
+  inproc_ring* in;   /* ring we read from */
+  inproc_ring* out;  /* ring we write to */
+} spawn_chdata;
+
+/* table of endpoints, pages are allocated as ids reach them */
+static spawn_epdata** g_pages[INPROC_PAGES];
+static uint64_t g_next_id = 0;
+
+/* woken on any event that spawn_net_wait may be waiting for */
+static inproc_signal g_signal = {
+  PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0
+};
+
+static void inproc_signal_init(inproc_signal* s)
+{
+  pthread_mutex_init(&s->mutex, NULL);
+  pthread_cond_init(&s->cond, NULL);
+  s->seq = 0;
+  s->sleepers = 0;
+}
+
+static void inproc_signal_destroy(inproc_signal* s)
+{
+  pthread_cond_destroy(&s->cond);
+  pthread_mutex_destroy(&s->mutex);
+}
+
+/* announce that we may sleep, call before checking the condition
+ * we sleep on, and pass the returned value to inproc_sleep */
+static uint64_t inproc_sleep_begin(inproc_signal* s)
+{
+  __atomic_add_fetch(&s->sleepers, 1, __ATOMIC_SEQ_CST);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  pthread_mutex_lock(&s->mutex);
+  uint64_t seq = s->seq;
+  pthread_mutex_unlock(&s->mutex);
+  return seq;
+}
+
+/* sleep until woken after sleep_begin returned seq */
+static void inproc_sleep(inproc_signal* s, uint64_t seq)
+{
+  pthread_mutex_lock(&s->mutex);
+  while (s->seq == seq) {
+    pthread_cond_wait(&s->cond, &s->mutex);
+  }
+  pthread_mutex_unlock(&s->mutex);
+}
+
+static void inproc_sleep_end(inproc_signal* s)
+{
+  __atomic_sub_fetch(&s->sleepers, 1, __ATOMIC_SEQ_CST);
+}
+
+/* wake all sleepers, call after publishing the state change */
+static void inproc_wake(inproc_signal* s)
+{
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&s->sleepers, __ATOMIC_SEQ_CST) > 0) {
+    pthread_mutex_lock(&s->mutex);
+    s->seq++;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->mutex);
+  }
+}
+
+/* returns endpoint registered with id, or NULL if there is none */
+static spawn_epdata* inproc_lookup(uint64_t id)
+{
+  uint64_t page = id / INPROC_PAGE_SIZE;
+  if (page >= INPROC_PAGES) {
+    return NULL;
+  }
+  spawn_epdata** entries = __atomic_load_n(&g_pages[page], __ATOMIC_ACQUIRE);
+  if (entries == NULL) {
+    return NULL;
+  }
+  return __atomic_load_n(&entries[id % INPROC_PAGE_SIZE], __ATOMIC_ACQUIRE);
+}
+
+/* store epdata in table at id, allocating the page if needed */
+static int inproc_register(uint64_t id, spawn_epdata* epdata)
+{
+  uint64_t page = id / INPROC_PAGE_SIZE;
+  if (page >= INPROC_PAGES) {
+    SPAWN_ERR("Too many in-process endpoints opened");
+    return SPAWN_FAILURE;
+  }
+
+  spawn_epdata** entries = __atomic_load_n(&g_pages[page], __ATOMIC_ACQUIRE);
+  if (entries == NULL) {
+    /* another thread may be allocating the same page, the
+     * first one in wins */
+    size_t bytes = INPROC_PAGE_SIZE * sizeof(spawn_epdata*);
+    spawn_epdata** fresh = (spawn_epdata**) SPAWN_MALLOC(bytes);
+    memset(fresh, 0, bytes);
+    if (__atomic_compare_exchange_n(&g_pages[page], &entries, fresh,
+        0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+      entries = fresh;
+    } else {
+      spawn_free(&fresh);
+    }
+  }
+
+  __atomic_store_n(&entries[id % INPROC_PAGE_SIZE], epdata, __ATOMIC_RELEASE);
+  return SPAWN_SUCCESS;
+}
+
+static void inproc_ring_init(inproc_ring* ring)
+{
+  ring->buf = (char*) SPAWN_MALLOC(INPROC_RING_SIZE);
+  ring->head = 0;
+  ring->tail = 0;
+  ring->big = NULL;
+  ring->big_size = 0;
+  ring->reader_closed = 0;
+  ring->writer_closed = 0;
+  inproc_signal_init(&ring->signal);
+}
+
+static inproc_conn* inproc_conn_new(void)
+{
+  inproc_conn* conn = (inproc_conn*) SPAWN_MALLOC(sizeof(inproc_conn));
+  inproc_ring_init(&conn->ring[0]);
+  inproc_ring_init(&conn->ring[1]);
+  conn->refs = 2;
+  conn->next = NULL;
+  return conn;
+}
+
+/* mark our side of conn as closed, wake peer, and free conn
+ * if peer has already let go of it */
+static void inproc_conn_release(inproc_conn* conn, inproc_ring* in, inproc_ring* out)
+{
+  __atomic_store_n(&out->writer_closed, 1, __ATOMIC_RELEASE);
+  __atomic_store_n(&in->reader_closed, 1, __ATOMIC_RELEASE);
+  inproc_wake(&out->signal);
+  inproc_wake(&in->signal);
+  inproc_wake(&g_signal);
+
+  if (__atomic_sub_fetch(&conn->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+    int i;
+    for (i = 0; i < 2; i++) {
+      spawn_free(&conn->ring[i].buf);
+      inproc_signal_destroy(&conn->ring[i].signal);
+    }
+    spawn_free(&conn);
+  }
+}
+
+/* returns 1 if a read from ring would not block */
+static int inproc_ring_ready(inproc_ring* ring)
+{
+  if (__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) != ring->head ||
+      __atomic_load_n(&ring->big_size, __ATOMIC_ACQUIRE) > 0 ||
+      __atomic_load_n(&ring->writer_closed, __ATOMIC_ACQUIRE))
+  {
+    return 1;
+  }
+  return 0;
+}
+
+static spawn_net_channel* inproc_channel(const char* name, inproc_conn* conn, int side)
+{
+  spawn_chdata* chdata = (spawn_chdata*) SPAWN_MALLOC(sizeof(spawn_chdata));
+  chdata->conn = conn;
+  chdata->out  = &conn->ring[side];
+  chdata->in   = &conn->ring[1 - side];
+
+  spawn_net_channel* ch = (spawn_net_channel*) SPAWN_MALLOC(sizeof(spawn_net_channel));
+  ch->type = SPAWN_NET_TYPE_INPROC;
+  ch->name = SPAWN_STRDUP(name);
+  ch->data = (void*) chdata;
+
+  return ch;
+}
+
+spawn_net_endpoint* spawn_net_open_inproc()
+{
+  spawn_epdata* epdata = (spawn_epdata*) SPAWN_MALLOC(sizeof(spawn_epdata));
+  epdata->id     = __atomic_fetch_add(&g_next_id, 1, __ATOMIC_RELAXED);
+  epdata->closed = 0;
+  epdata->head   = NULL;
+  epdata->tail   = NULL;
+  pthread_mutex_init(&epdata->mutex, NULL);
+  pthread_cond_init(&epdata->cond, NULL);
+
+  if (inproc_register(epdata->id, epdata) != SPAWN_SUCCESS) {
+    pthread_cond_destroy(&epdata->cond);
+    pthread_mutex_destroy(&epdata->mutex);
+    spawn_free(&epdata);
+    return SPAWN_NET_ENDPOINT_NULL;
+  }
+
+  spawn_net_endpoint* ep = (spawn_net_endpoint*) SPAWN_MALLOC(sizeof(spawn_net_endpoint));
+  ep->type = SPAWN_NET_TYPE_INPROC;
+  ep->name = SPAWN_STRDUPF("INPROC:%llu", (unsigned long long) epdata->id);
+  ep->data = (void*) epdata;
+
+  return ep;
+}
+
+int spawn_net_close_inproc(spawn_net_endpoint** pep)
+{
+  spawn_net_endpoint* ep = *pep;
+  spawn_epdata* epdata = (spawn_epdata*) ep->data;
+
+  /* remove endpoint from table so no new lookups find it */
+  uint64_t id = epdata->id;
+  spawn_epdata** entries = __atomic_load_n(&g_pages[id / INPROC_PAGE_SIZE], __ATOMIC_ACQUIRE);
+  __atomic_store_n(&entries[id % INPROC_PAGE_SIZE], NULL, __ATOMIC_RELEASE);
+
+  /* refuse connects that found the endpoint before we removed it,
+   * and take any that were never accepted */
+  pthread_mutex_lock(&epdata->mutex);
+  epdata->closed = 1;
+  inproc_conn* conn = epdata->head;
+  __atomic_store_n(&epdata->head, NULL, __ATOMIC_RELEASE);
+  epdata->tail = NULL;
+  pthread_mutex_unlock(&epdata->mutex);
+
+  /* close our side of connections we never accepted */
+  while (conn != NULL) {
+    inproc_conn* next = conn->next;
+    inproc_conn_release(conn, &conn->ring[0], &conn->ring[1]);
+    conn = next;
+  }
+
+  /* epdata stays allocated, since a connect in another thread may
+   * still hold a pointer to it */
+  spawn_free(&ep->name);
+  spawn_free(pep);
+
+  return SPAWN_SUCCESS;
+}
+
+spawn_net_channel* spawn_net_connect_inproc(const char* name)
+{
+  unsigned long long id;
+  if (sscanf(name, "INPROC:%llu", &id) != 1) {
+    SPAWN_ERR("Invalid endpoint name %s", name);
+    return SPAWN_NET_CHANNEL_NULL;
+  }
+
+  spawn_epdata* epdata = inproc_lookup((uint64_t) id);
+  if (epdata == NULL) {
+    SPAWN_ERR("Failed to connect to %s (no such endpoint)", name);
+    return SPAWN_NET_CHANNEL_NULL;
+  }
+
+  /* queue connection on endpoint */
+  inproc_conn* conn = inproc_conn_new();
+  pthread_mutex_lock(&epdata->mutex);
+  if (epdata->closed) {
+    pthread_mutex_unlock(&epdata->mutex);
+    SPAWN_ERR("Failed to connect to %s (endpoint closed)", name);
+    conn->refs = 1;
+    inproc_conn_release(conn, &conn->ring[1], &conn->ring[0]);
+    return SPAWN_NET_CHANNEL_NULL;
+  }
+  if (epdata->tail != NULL) {
+    epdata->tail->next = conn;
+  } else {
+    __atomic_store_n(&epdata->head, conn, __ATOMIC_RELEASE);
+  }
+  epdata->tail = conn;
+  pthread_cond_broadcast(&epdata->cond);
+  pthread_mutex_unlock(&epdata->mutex);
+  inproc_wake(&g_signal);
+
+  return inproc_channel(name, conn, 0);
+}
+
+spawn_net_channel* spawn_net_accept_inproc(const spawn_net_endpoint* ep)
+{
+  spawn_epdata* epdata = (spawn_epdata*) ep->data;
+
+  /* wait for a connection request */
+  pthread_mutex_lock(&epdata->mutex);
+  while (epdata->head == NULL) {
+    pthread_cond_wait(&epdata->cond, &epdata->mutex);
+  }
+  inproc_conn* conn = epdata->head;
+  __atomic_store_n(&epdata->head, conn->next, __ATOMIC_RELEASE);
+  if (conn->next == NULL) {
+    epdata->tail = NULL;
+  }
+  pthread_mutex_unlock(&epdata->mutex);
+  conn->next = NULL;
+
+  return inproc_channel(ep->name, conn, 1);
+}
+
+int spawn_net_disconnect_inproc(spawn_net_channel** pch)
+{
+  spawn_net_channel* ch = *pch;
+  spawn_chdata* chdata = (spawn_chdata*) ch->data;
+
+  inproc_conn_release(chdata->conn, chdata->in, chdata->out);
+
+  spawn_free(&chdata);
+  spawn_free(&ch->name);
+  spawn_free(pch);
+
+  return SPAWN_SUCCESS;
+}
+
+int spawn_net_read_inproc(const spawn_net_channel* ch, void* buf, size_t size)
+{
+  spawn_chdata* chdata = (spawn_chdata*) ch->data;
+  inproc_ring* ring = chdata->in;
+
+  char* ptr = (char*) buf;
+  size_t total = 0;
+  while (total < size) {
+    size_t remaining = size - total;
+
+    /* drain the ring first, since it holds data written ahead
+     * of any lent buffer */
+    uint64_t head = ring->head;
+    uint64_t avail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) - head;
+    if (avail > 0) {
+      size_t count = (avail < (uint64_t) remaining) ? (size_t) avail : remaining;
+      size_t offset = (size_t) (head & (INPROC_RING_SIZE - 1));
+      size_t first = INPROC_RING_SIZE - offset;
+      if (first > count) {
+        first = count;
+      }
+      memcpy(ptr + total, ring->buf + offset, first);
+      memcpy(ptr + total + first, ring->buf, count - first);
+      __atomic_store_n(&ring->head, head + count, __ATOMIC_RELEASE);
+      inproc_wake(&ring->signal);
+      total += count;
+      continue;
+    }
+
+    /* then copy straight out of a lent buffer */
+    uint64_t big_size = __atomic_load_n(&ring->big_size, __ATOMIC_ACQUIRE);
+    if (big_size > 0) {
+      size_t count = (big_size < (uint64_t) remaining) ? (size_t) big_size : remaining;
+      memcpy(ptr + total, ring->big, count);
+      ring->big += count;
+      __atomic_store_n(&ring->big_size, big_size - count, __ATOMIC_RELEASE);
+      if (big_size == count) {
+        inproc_wake(&ring->signal);
+      }
+      total += count;
+      continue;
+    }
+
+    if (__atomic_load_n(&ring->writer_closed, __ATOMIC_ACQUIRE)) {
+      SPAWN_ERR("Failed to read from %s (peer disconnected)", ch->name);
+      return SPAWN_FAILURE;
+    }
+
+    /* nothing to read, sleep until writer changes something */
+    uint64_t seq = inproc_sleep_begin(&ring->signal);
+    if (! inproc_ring_ready(ring)) {
+      inproc_sleep(&ring->signal, seq);
+    }
+    inproc_sleep_end(&ring->signal);
+  }
+
+  return SPAWN_SUCCESS;
+}
+
+/* lend buf to reader and wait until it has copied all of it */
+static int inproc_handoff(const spawn_net_channel* ch, inproc_ring* ring, const void* buf, size_t size)
+{
+  ring->big = (const char*) buf;
+  __atomic_store_n(&ring->big_size, (uint64_t) size, __ATOMIC_RELEASE);
+  inproc_wake(&ring->signal);
+  inproc_wake(&g_signal);
+
+  while (__atomic_load_n(&ring->big_size, __ATOMIC_ACQUIRE) > 0) {
+    if (__atomic_load_n(&ring->reader_closed, __ATOMIC_ACQUIRE)) {
+      SPAWN_ERR("Failed to write to %s (peer disconnected)", ch->name);
+      return SPAWN_FAILURE;
+    }
+
+    uint64_t seq = inproc_sleep_begin(&ring->signal);
+    if (__atomic_load_n(&ring->big_size, __ATOMIC_ACQUIRE) > 0 &&
+        ! __atomic_load_n(&ring->reader_closed, __ATOMIC_ACQUIRE))
+    {
+      inproc_sleep(&ring->signal, seq);
+    }
+    inproc_sleep_end(&ring->signal);
+  }
+
+  return SPAWN_SUCCESS;
+}
+
+int spawn_net_write_inproc(const spawn_net_channel* ch, const void* buf, size_t size)
+{
+  spawn_chdata* chdata = (spawn_chdata*) ch->data;
+  inproc_ring* ring = chdata->out;
+
+  if (size >= INPROC_HANDOFF) {
+    uint64_t used = ring->tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    if ((uint64_t) size > INPROC_RING_SIZE - used) {
+      return inproc_handoff(ch, ring, buf, size);
+    }
+  }
+
+  const char* ptr = (const char*) buf;
+  size_t total = 0;
+  while (total < size) {
+    if (__atomic_load_n(&ring->reader_closed, __ATOMIC_ACQUIRE)) {
+      SPAWN_ERR("Failed to write to %s (peer disconnected)", ch->name);
+      return SPAWN_FAILURE;
+    }
+
+    uint64_t tail = ring->tail;
+    uint64_t used = tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    size_t space = INPROC_RING_SIZE - (size_t) used;
+    if (space == 0) {
+      /* ring is full, sleep until reader makes room */
+      uint64_t seq = inproc_sleep_begin(&ring->signal);
+      if (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == tail - INPROC_RING_SIZE &&
+          ! __atomic_load_n(&ring->reader_closed, __ATOMIC_ACQUIRE))
+      {
+        inproc_sleep(&ring->signal, seq);
+      }
+      inproc_sleep_end(&ring->signal);
+      continue;
+    }
+
+    size_t remaining = size - total;
+    size_t count = (space < remaining) ? space : remaining;
+    size_t offset = (size_t) (tail & (INPROC_RING_SIZE - 1));
+    size_t first = INPROC_RING_SIZE - offset;
+    if (first > count) {
+      first = count;
+    }
+    memcpy(ring->buf + offset, ptr + total, first);
+    memcpy(ring->buf, ptr + total + first, count - first);
+    __atomic_store_n(&ring->tail, tail + count, __ATOMIC_RELEASE);
+    inproc_wake(&ring->signal);
+    inproc_wake(&g_signal);
+    total += count;
+  }
+
+  return SPAWN_SUCCESS;
+}
+
+int spawn_net_probe_inproc(const spawn_net_channel* ch, int* flag)
+{
+  spawn_chdata* chdata = (spawn_chdata*) ch->data;
+  *flag = inproc_ring_ready(chdata->in);
+  return SPAWN_SUCCESS;
+}
+
+/* sets index to first endpoint with a pending connect or channel
+ * with data and returns 1, returns 0 if none are ready */
+static int inproc_find_ready(
+  int neps,
+  const spawn_net_endpoint** eps,
+  int nchs,
+  const spawn_net_channel** chs,
+  int* index)
+{
+  int i;
+  for (i = 0; i < neps; i++) {
+    const spawn_net_endpoint* ep = eps[i];
+    if (ep == SPAWN_NET_ENDPOINT_NULL) {
+      continue;
+    }
+    spawn_epdata* epdata = (spawn_epdata*) ep->data;
+    if (__atomic_load_n(&epdata->head, __ATOMIC_ACQUIRE) != NULL) {
+      *index = i;
+      return 1;
+    }
+  }
+
+  for (i = 0; i < nchs; i++) {
+    const spawn_net_channel* ch = chs[i];
+    if (ch == SPAWN_NET_CHANNEL_NULL) {
+      continue;
+    }
+    spawn_chdata* chdata = (spawn_chdata*) ch->data;
+    if (inproc_ring_ready(chdata->in)) {
+      *index = neps + i;
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+int spawn_net_wait_inproc(
+  int neps,
+  const spawn_net_endpoint** eps,
+  int nchs,
+  const spawn_net_channel** chs,
+  int* index)
+{
+  /* bail out if endpoint and channel arrays are empty */
+  if (eps == NULL && chs == NULL) {
+    return SPAWN_FAILURE;
+  }
+
+  while (! inproc_find_ready(neps, eps, nchs, chs, index)) {
+    uint64_t seq = inproc_sleep_begin(&g_signal);
+    if (! inproc_find_ready(neps, eps, nchs, chs, index)) {
+      inproc_sleep(&g_signal, seq);
+    }
+    inproc_sleep_end(&g_signal);
+  }
+
+  return SPAWN_SUCCESS;
+}
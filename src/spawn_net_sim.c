@@ -0,0 +1,1036 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667277.
+ * All rights reserved.
+ * This file is part of the SpawnNet library.
+ * For details, see https://github.com/hpc/spawnnet
+ * Please also read the LICENSE file.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <ucontext.h>
+#include <sys/mman.h>
+
+#include "spawn_internal.h"
+#include "spawn_net_sim.h"
+
+/* This transport runs many virtual ranks in one thread so that
+ * lwgrp algorithms can be timed at scales we cannot launch.  Each
+ * rank is a coroutine with its own stack, and a discrete-event
+ * scheduler always resumes the rank with the earliest virtual time,
+ * so runs are deterministic.  The endpoint name of a rank is
+ * "SIM:<rank>", and each rank may open one endpoint.  A connect may
+ * reach a rank before it opens its endpoint, in which case the
+ * connect waits to be accepted once the endpoint opens.
+ *
+ * Messages are charged with a LogGP-style model.  A write costs the
+ * sender the per-message overhead and then queues on its link, which
+ * sends bytes at the model bandwidth, and the data reaches the reader
+ * one latency after leaving the link.  Writes never block, and
+ * queues hold any amount of data, see spawn_net_sim.h.  A read
+ * completes at the later of the reader's clock and the arrival of the
+ * last byte it needs, plus the overhead.  Time spent computing
+ * between messages is not charged.
+ *
+ * When accept, probe, or wait find nothing that has arrived by the
+ * clock of the rank, the rank first yields until the scheduler
+ * reaches its clock, so every message that could have arrived by
+ * then has been sent.  A read on one channel needs no such care,
+ * since the bytes it gets do not depend on timing.
+ *
+ * To report the critical path, each message carries the path that
+ * led to its sender, and a reader whose clock is set by an arrival
+ * extends that path with a hop for the message.  Paths share tails,
+ * and they are reference counted so hops drop off once nothing
+ * leads back to them. */
+
+/* bytes of stack per rank when caller passes 0 */
+#define SIM_STACK_SIZE (256 * 1024)
+
+/* number of phases we track critical paths for */
+#define SIM_PHASES (64)
+
+/* one hop on a critical path */
+typedef struct sim_path_t {
+  int64_t from;     /* rank that sent message */
+  int64_t to;       /* rank that read message */
+  uint64_t bytes;   /* size of message */
+  double sent;      /* time message left sender */
+  double arrived;   /* time message reached reader */
+  int phase;        /* phase of reader when it read message */
+  int refs;         /* number of ranks, messages, and hops pointing here */
+  struct sim_path_t* prev; /* hop that led to sender */
+} sim_path;
+
+/* data from one write */
+typedef struct sim_seg_t {
+  char* data;       /* copy of data written */
+  size_t size;      /* bytes written */
+  size_t offset;    /* bytes already read */
+  double sent;      /* time data left sender */
+  double arrival;   /* time data reaches reader */
+  int64_t from;     /* sending rank */
+  sim_path* path;   /* path that led to sender */
+  struct sim_seg_t* next;
+} sim_seg;
+
+struct sim_rank_t;
+
+/* one direction of a connection */
+typedef struct sim_queue_t {
+  sim_seg* head;    /* oldest unread data */
+  sim_seg* tail;    /* newest data */
+  size_t bytes;     /* unread bytes in queue */
+  double last;      /* arrival of newest data, keeps data in order */
+  int closed;       /* writer has disconnected */
+  double closed_at; /* time reader learns writer disconnected */
+  int gone;         /* reader has disconnected */
+  struct sim_rank_t* reader; /* rank that reads queue */
+} sim_queue;
+
+/* state shared by both sides of a connection */
+typedef struct sim_conn_t {
+  sim_queue q[2];   /* connector writes q[0], acceptor writes q[1] */
+  int refs;         /* number of sides yet to disconnect */
+  int64_t from;     /* connecting rank */
+  double sent;      /* time of connect */
+  double arrival;   /* time connect reaches endpoint */
+  sim_path* path;   /* path that led to connector */
+  struct sim_conn_t* next; /* link in accept queue */
+} sim_conn;
+
+/* structure allocated and stored as extra state in spawn_net_endpoint */
+typedef struct spawn_epdata_t {
+  struct sim_rank_t* owner; /* rank that opened endpoint */
+  sim_conn* head;   /* connects waiting to be accepted, by arrival */
+} spawn_epdata;
+
+/* structure allocated and stored as extra state in spawn_net_channel */
+typedef struct spawn_chdata_t {
+  sim_conn* conn;   /* connection shared with peer */
+  sim_queue* in;    /* queue we read */
+  sim_queue* out;   /* queue we write */
+} spawn_chdata;
+
+typedef struct sim_rank_t {
+  int64_t rank;
+  ucontext_t ctx;   /* saved context while not running */
+  void* stack;      /* stack of coroutine */
+  int done;         /* rank has returned */
+  double clock;     /* virtual time of rank */
+  double work;      /* clock after the last message we charged */
+  double nic_free;  /* time our link is done sending queued writes */
+  double time;      /* time we are scheduled to resume */
+  uint64_t seq;     /* breaks ties in time, in order of scheduling */
+  int64_t pos;      /* index in heap, -1 if not scheduled */
+  int blocked;      /* waiting for a message or connect */
+  sim_queue* read_q;  /* queue we are reading, if blocked in read */
+  size_t read_size;   /* bytes needed from read_q */
+  int neps;           /* endpoints we wait on, if blocked in wait */
+  const spawn_net_endpoint** eps;
+  int nchs;           /* channels we wait on, if blocked in wait */
+  const spawn_net_channel** chs;
+  spawn_epdata* ep;   /* our endpoint, created early if a connect beats our open */
+  int ep_open;        /* we have opened our endpoint */
+  sim_path* path;     /* critical path that led to our clock */
+  int phase;          /* phase we are in */
+  uint64_t bytes_sent;
+  uint64_t bytes_recv;
+  uint64_t msgs_sent;
+} sim_rank;
+
+static spawn_net_sim_model g_model;
+static int64_t g_ranks_count = 0;
+static sim_rank* g_ranks     = NULL;
+static sim_rank* g_current   = NULL; /* rank now running, NULL in scheduler */
+static double g_now          = 0.0;  /* time of event being processed */
+static size_t g_stack_size   = 0;    /* bytes of stack per rank */
+static uint64_t g_seq        = 0;
+static ucontext_t g_sched_ctx;
+static void (*g_fn)(int64_t rank, void* arg) = NULL;
+static void* g_arg = NULL;
+
+/* heap of scheduled ranks ordered by (time, seq) */
+static sim_rank** g_heap  = NULL;
+static int64_t g_heap_len = 0;
+
+/* rank that finished each phase last and the path that led there */
+static double g_phase_end[SIM_PHASES];
+static sim_path* g_phase_path[SIM_PHASES];
+
+static sim_path* sim_path_ref(sim_path* path)
+{
+  if (path != NULL) {
+    path->refs++;
+  }
+  return path;
+}
+
+static void sim_path_release(sim_path* path)
+{
+  /* walk back while we drop the last reference, paths can
+   * be long so avoid recursion */
+  while (path != NULL) {
+    path->refs--;
+    if (path->refs > 0) {
+      break;
+    }
+    sim_path* prev = path->prev;
+    spawn_free(&path);
+    path = prev;
+  }
+}
+
+static int sim_heap_less(const sim_rank* a, const sim_rank* b)
+{
+  if (a->time != b->time) {
+    return a->time < b->time;
+  }
+  return a->seq < b->seq;
+}
+
+static void sim_heap_set(int64_t i, sim_rank* r)
+{
+  g_heap[i] = r;
+  r->pos = i;
+}
+
+static void sim_heap_up(int64_t i)
+{
+  sim_rank* r = g_heap[i];
+  while (i > 0) {
+    int64_t parent = (i - 1) / 2;
+    if (! sim_heap_less(r, g_heap[parent])) {
+      break;
+    }
+    sim_heap_set(i, g_heap[parent]);
+    i = parent;
+  }
+  sim_heap_set(i, r);
+}
+
+static void sim_heap_down(int64_t i)
+{
+  sim_rank* r = g_heap[i];
+  while (1) {
+    int64_t child = 2 * i + 1;
+    if (child >= g_heap_len) {
+      break;
+    }
+    if (child + 1 < g_heap_len && sim_heap_less(g_heap[child + 1], g_heap[child])) {
+      child++;
+    }
+    if (! sim_heap_less(g_heap[child], r)) {
+      break;
+    }
+    sim_heap_set(i, g_heap[child]);
+    i = child;
+  }
+  sim_heap_set(i, r);
+}
+
+static sim_rank* sim_heap_pop(void)
+{
+  sim_rank* r = g_heap[0];
+  r->pos = -1;
+  g_heap_len--;
+  if (g_heap_len > 0) {
+    sim_heap_set(0, g_heap[g_heap_len]);
+    sim_heap_down(0);
+  }
+  return r;
+}
+
+/* schedule rank to resume at time t, or move it earlier */
+static void sim_schedule(sim_rank* r, double t)
+{
+  if (r->pos >= 0) {
+    if (t < r->time) {
+      r->time = t;
+      r->seq  = g_seq++;
+      sim_heap_up(r->pos);
+    }
+    return;
+  }
+  r->time = t;
+  r->seq  = g_seq++;
+  sim_heap_set(g_heap_len, r);
+  g_heap_len++;
+  sim_heap_up(r->pos);
+}
+
+/* returns time reader learns of the next event on queue,
+ * -1 if there is none yet */
+static double sim_queue_ready(const sim_queue* q)
+{
+  if (q->head != NULL) {
+    return q->head->arrival;
+  }
+  if (q->closed) {
+    return q->closed_at;
+  }
+  return -1.0;
+}
+
+/* returns earliest time blocked rank may go on, -1 if not yet known */
+static double sim_ready_time(const sim_rank* r)
+{
+  double t = -1.0;
+  if (r->read_q != NULL) {
+    /* find arrival of last byte read needs */
+    const sim_queue* q = r->read_q;
+    if (q->bytes >= r->read_size) {
+      size_t need = r->read_size;
+      const sim_seg* seg = q->head;
+      while (seg != NULL) {
+        size_t avail = seg->size - seg->offset;
+        t = seg->arrival;
+        if (avail >= need) {
+          break;
+        }
+        need -= avail;
+        seg = seg->next;
+      }
+    } else if (q->closed) {
+      t = q->closed_at;
+    }
+  } else {
+    /* earliest event on any endpoint or channel we wait on */
+    int i;
+    for (i = 0; i < r->neps; i++) {
+      const spawn_net_endpoint* ep = r->eps[i];
+      if (ep == SPAWN_NET_ENDPOINT_NULL) {
+        continue;
+      }
+      const spawn_epdata* epdata = (const spawn_epdata*) ep->data;
+      if (epdata->head != NULL) {
+        double ready = epdata->head->arrival;
+        if (t < 0.0 || ready < t) {
+          t = ready;
+        }
+      }
+    }
+    for (i = 0; i < r->nchs; i++) {
+      const spawn_net_channel* ch = r->chs[i];
+      if (ch == SPAWN_NET_CHANNEL_NULL) {
+        continue;
+      }
+      const spawn_chdata* chdata = (const spawn_chdata*) ch->data;
+      double ready = sim_queue_ready(chdata->in);
+      if (ready >= 0.0 && (t < 0.0 || ready < t)) {
+        t = ready;
+      }
+    }
+  }
+
+  if (t >= 0.0 && t < r->clock) {
+    t = r->clock;
+  }
+  return t;
+}
+
+/* reschedule r if something it waits on has changed */
+static void sim_notify(sim_rank* r)
+{
+  if (r == NULL || ! r->blocked) {
+    return;
+  }
+  double t = sim_ready_time(r);
+  if (t >= 0.0) {
+    sim_schedule(r, t);
+  }
+}
+
+/* block until the event set up in r arrives */
+static void sim_block(sim_rank* r)
+{
+  r->blocked = 1;
+  sim_notify(r);
+  swapcontext(&r->ctx, &g_sched_ctx);
+  r->blocked = 0;
+  r->read_q  = NULL;
+  r->neps    = 0;
+  r->eps     = NULL;
+  r->nchs    = 0;
+  r->chs     = NULL;
+}
+
+/* yield until scheduler catches up to our clock */
+static void sim_sync(sim_rank* r)
+{
+  if (r->clock > g_now) {
+    sim_schedule(r, r->clock);
+    swapcontext(&r->ctx, &g_sched_ctx);
+  }
+}
+
+/* charge a write of size bytes, returns time data reaches q */
+static double sim_send(sim_rank* r, sim_queue* q, size_t size)
+{
+  if (r->nic_free > r->clock) {
+    r->clock = r->nic_free;
+  }
+  r->clock += g_model.overhead;
+  r->work = r->clock;
+  r->nic_free = r->clock + (double) size / g_model.bandwidth;
+  r->bytes_sent += (uint64_t) size;
+  r->msgs_sent++;
+
+  double arrival = r->nic_free + g_model.latency;
+  if (q != NULL) {
+    if (arrival < q->last) {
+      arrival = q->last;
+    }
+    q->last = arrival;
+  }
+  return arrival;
+}
+
+/* charge a read of a message from rank from, and extend our critical
+ * path with it if it arrived after we were done with earlier work */
+static void sim_recv(sim_rank* r, double arrival, int64_t from, double sent, uint64_t bytes, sim_path* path)
+{
+  if (arrival > r->work) {
+    sim_path* hop = (sim_path*) SPAWN_MALLOC(sizeof(sim_path));
+    hop->from    = from;
+    hop->to      = r->rank;
+    hop->bytes   = bytes;
+    hop->sent    = sent;
+    hop->arrived = arrival;
+    hop->phase   = r->phase;
+    hop->refs    = 1;
+    hop->prev    = sim_path_ref(path);
+    sim_path_release(r->path);
+    r->path = hop;
+  }
+  if (arrival > r->clock) {
+    r->clock = arrival;
+  }
+  r->clock += g_model.overhead;
+  r->work = r->clock;
+  r->bytes_recv += bytes;
+}
+
+static void sim_queue_free(sim_queue* q)
+{
+  while (q->head != NULL) {
+    sim_seg* seg = q->head;
+    q->head = seg->next;
+    sim_path_release(seg->path);
+    spawn_free(&seg->data);
+    spawn_free(&seg);
+  }
+  q->tail  = NULL;
+  q->bytes = 0;
+}
+
+/* close our side of conn and free it if peer has already */
+static void sim_conn_release(sim_conn* conn, sim_queue* in, sim_queue* out, double now)
+{
+  out->closed = 1;
+  out->closed_at = now + g_model.latency;
+  if (out->closed_at < out->last) {
+    out->closed_at = out->last;
+  }
+  sim_notify(out->reader);
+
+  in->gone = 1;
+  sim_queue_free(in);
+
+  conn->refs--;
+  if (conn->refs == 0) {
+    sim_queue_free(&conn->q[0]);
+    sim_queue_free(&conn->q[1]);
+    sim_path_release(conn->path);
+    spawn_free(&conn);
+  }
+}
+
+/* record when rank finished its current phase */
+static void sim_phase_end(sim_rank* r)
+{
+  int phase = r->phase;
+  if (phase < 0 || phase >= SIM_PHASES) {
+    return;
+  }
+  if (r->clock >= g_phase_end[phase]) {
+    sim_path_release(g_phase_path[phase]);
+    g_phase_path[phase] = sim_path_ref(r->path);
+    g_phase_end[phase]  = r->clock;
+  }
+}
+
+static void sim_entry(void)
+{
+  sim_rank* r = g_current;
+  g_fn(r->rank, g_arg);
+  sim_phase_end(r);
+  r->done = 1;
+
+  /* returning resumes scheduler through uc_link */
+}
+
+static sim_rank* sim_self(void)
+{
+  if (g_current == NULL) {
+    SPAWN_ERR("Simulated network used outside of spawn_net_sim_run");
+  }
+  return g_current;
+}
+
+int spawn_net_sim_run(
+  int64_t ranks,
+  const spawn_net_sim_model* model,
+  size_t stack_size,
+  void (*fn)(int64_t rank, void* arg),
+  void* arg)
+{
+  if (ranks <= 0 || model == NULL || fn == NULL) {
+    SPAWN_ERR("Invalid simulation parameters");
+    return SPAWN_FAILURE;
+  }
+  if (model->bandwidth <= 0.0) {
+    SPAWN_ERR("Simulated bandwidth must be positive");
+    return SPAWN_FAILURE;
+  }
+
+  /* kept in a global, since locals and arguments we change may be
+   * clobbered across the context switches below */
+  g_stack_size = (stack_size != 0) ? stack_size : SIM_STACK_SIZE;
+
+  /* drop paths from any earlier run */
+  int i;
+  for (i = 0; i < SIM_PHASES; i++) {
+    sim_path_release(g_phase_path[i]);
+    g_phase_path[i] = NULL;
+    g_phase_end[i]  = -1.0;
+  }
+
+  g_model = *model;
+  g_fn    = fn;
+  g_arg   = arg;
+  g_now   = 0.0;
+  g_seq   = 0;
+  g_ranks_count = ranks;
+  g_ranks = (sim_rank*) SPAWN_MALLOC(ranks * sizeof(sim_rank));
+  g_heap  = (sim_rank**) SPAWN_MALLOC(ranks * sizeof(sim_rank*));
+  g_heap_len = 0;
+
+  int rc = SPAWN_SUCCESS;
+  int64_t rank;
+  for (rank = 0; rank < ranks; rank++) {
+    sim_rank* r = &g_ranks[rank];
+    memset(r, 0, sizeof(sim_rank));
+    r->rank = rank;
+    r->pos  = -1;
+
+    /* only touched pages of the stack cost memory */
+    r->stack = mmap(NULL, g_stack_size, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0
+    );
+    if (r->stack == MAP_FAILED) {
+      SPAWN_ERR("Failed to allocate stack for rank %lld (mmap() errno=%d %s)",
+        (long long) rank, errno, strerror(errno)
+      );
+      r->stack = NULL;
+      r->done = 1;
+      rc = SPAWN_FAILURE;
+      continue;
+    }
+
+    getcontext(&r->ctx);
+    r->ctx.uc_stack.ss_sp   = r->stack;
+    r->ctx.uc_stack.ss_size = g_stack_size;
+    r->ctx.uc_link          = &g_sched_ctx;
+    makecontext(&r->ctx, sim_entry, 0);
+
+    sim_schedule(r, 0.0);
+  }
+
+  /* resume ranks in order of virtual time until all are done
+   * or blocked */
+  if (rc == SPAWN_SUCCESS) {
+    while (g_heap_len > 0) {
+      sim_rank* r = sim_heap_pop();
+      g_now = r->time;
+      if (r->clock < g_now) {
+        r->clock = g_now;
+      }
+
+      g_current = r;
+      swapcontext(&g_sched_ctx, &r->ctx);
+      g_current = NULL;
+
+      if (r->done && r->stack != NULL) {
+        munmap(r->stack, g_stack_size);
+        r->stack = NULL;
+      }
+    }
+  }
+
+  int64_t blocked = 0;
+  for (rank = 0; rank < ranks; rank++) {
+    sim_rank* r = &g_ranks[rank];
+    if (! r->done) {
+      blocked++;
+    }
+    if (r->stack != NULL) {
+      munmap(r->stack, g_stack_size);
+    }
+    sim_path_release(r->path);
+    if (r->ep != NULL) {
+      while (r->ep->head != NULL) {
+        sim_conn* conn = r->ep->head;
+        r->ep->head = conn->next;
+        sim_conn_release(conn, &conn->q[0], &conn->q[1], r->clock);
+      }
+      spawn_free(&r->ep);
+    }
+  }
+  if (blocked > 0) {
+    SPAWN_ERR("Simulation deadlocked with %lld ranks blocked", (long long) blocked);
+    rc = SPAWN_FAILURE;
+  }
+
+  /* state of deadlocked ranks leaks, since their stacks are gone */
+  spawn_free(&g_heap);
+  spawn_free(&g_ranks);
+  g_ranks_count = 0;
+
+  return rc;
+}
+
+double spawn_net_sim_time(void)
+{
+  sim_rank* r = sim_self();
+  if (r == NULL) {
+    return 0.0;
+  }
+  return r->clock;
+}
+
+int spawn_net_sim_counts(uint64_t* bytes_sent, uint64_t* bytes_recv, uint64_t* msgs_sent)
+{
+  sim_rank* r = sim_self();
+  if (r == NULL) {
+    return SPAWN_FAILURE;
+  }
+  *bytes_sent = r->bytes_sent;
+  *bytes_recv = r->bytes_recv;
+  *msgs_sent  = r->msgs_sent;
+  return SPAWN_SUCCESS;
+}
+
+int spawn_net_sim_phase(int phase)
+{
+  sim_rank* r = sim_self();
+  if (r == NULL) {
+    return SPAWN_FAILURE;
+  }
+  sim_phase_end(r);
+  r->phase = phase;
+  return SPAWN_SUCCESS;
+}
+
+int64_t spawn_net_sim_path(int phase, FILE* fp)
+{
+  if (phase < 0 || phase >= SIM_PHASES) {
+    return 0;
+  }
+
+  /* count hops of phase, the path runs backwards in time */
+  int64_t hops = 0;
+  sim_path* path = g_phase_path[phase];
+  while (path != NULL) {
+    if (path->phase == phase) {
+      hops++;
+    }
+    path = path->prev;
+  }
+  if (fp == NULL || hops == 0) {
+    return hops;
+  }
+
+  /* put hops in time order to print them */
+  sim_path** list = (sim_path**) SPAWN_MALLOC(hops * sizeof(sim_path*));
+  int64_t i = hops;
+  path = g_phase_path[phase];
+  while (path != NULL) {
+    if (path->phase == phase) {
+      list[--i] = path;
+    }
+    path = path->prev;
+  }
+
+  for (i = 0; i < hops; i++) {
+    sim_path* hop = list[i];
+    double wait = (i > 0) ? hop->sent - list[i - 1]->arrived : 0.0;
+    fprintf(fp, "  hop %lld: %lld -> %lld bytes=%llu sent=%.3fus arrived=%.3fus wire=%.3fus local=%.3fus\n",
+      (long long) i, (long long) hop->from, (long long) hop->to,
+      (unsigned long long) hop->bytes, hop->sent * 1e6, hop->arrived * 1e6,
+      (hop->arrived - hop->sent) * 1e6, wait * 1e6
+    );
+  }
+
+  spawn_free(&list);
+
+  return hops;
+}
+
+/* returns endpoint state of rank, creating it if needed */
+static spawn_epdata* sim_endpoint(sim_rank* r)
+{
+  if (r->ep == NULL) {
+    spawn_epdata* epdata = (spawn_epdata*) SPAWN_MALLOC(sizeof(spawn_epdata));
+    epdata->owner = r;
+    epdata->head  = NULL;
+    r->ep = epdata;
+  }
+  return r->ep;
+}
+
+spawn_net_endpoint* spawn_net_open_sim()
+{
+  sim_rank* r = sim_self();
+  if (r == NULL) {
+    return SPAWN_NET_ENDPOINT_NULL;
+  }
+  if (r->ep_open) {
+    SPAWN_ERR("Rank %lld already has a simulated endpoint", (long long) r->rank);
+    return SPAWN_NET_ENDPOINT_NULL;
+  }
+
+  spawn_epdata* epdata = sim_endpoint(r);
+  r->ep_open = 1;
+
+  spawn_net_endpoint* ep = (spawn_net_endpoint*) SPAWN_MALLOC(sizeof(spawn_net_endpoint));
+  ep->type = SPAWN_NET_TYPE_SIM;
+  ep->name = SPAWN_STRDUPF("SIM:%lld", (long long) r->rank);
+  ep->data = (void*) epdata;
+
+  return ep;
+}
+
+int spawn_net_close_sim(spawn_net_endpoint** pep)
+{
+  spawn_net_endpoint* ep = *pep;
+  spawn_epdata* epdata = (spawn_epdata*) ep->data;
+  sim_rank* r = epdata->owner;
+
+  /* refuse connects we never accepted */
+  while (epdata->head != NULL) {
+    sim_conn* conn = epdata->head;
+    epdata->head = conn->next;
+    sim_conn_release(conn, &conn->q[0], &conn->q[1], r->clock);
+  }
+
+  r->ep = NULL;
+  r->ep_open = 0;
+  spawn_free(&epdata);
+  spawn_free(&ep->name);
+  spawn_free(pep);
+
+  return SPAWN_SUCCESS;
+}
+
+static spawn_net_channel* sim_channel(const char* name, sim_conn* conn, int side)
+{
+  spawn_chdata* chdata = (spawn_chdata*) SPAWN_MALLOC(sizeof(spawn_chdata));
+  chdata->conn = conn;
+  chdata->out  = &conn->q[side];
+  chdata->in   = &conn->q[1 - side];
+
+  spawn_net_channel* ch = (spawn_net_channel*) SPAWN_MALLOC(sizeof(spawn_net_channel));
+  ch->type = SPAWN_NET_TYPE_SIM;
+  ch->name = SPAWN_STRDUP(name);
+  ch->data = (void*) chdata;
+
+  return ch;
+}
+
+spawn_net_channel* spawn_net_connect_sim(const char* name)
+{
+  sim_rank* r = sim_self();
+  if (r == NULL) {
+    return SPAWN_NET_CHANNEL_NULL;
+  }
+
+  long long id;
+  if (sscanf(name, "SIM:%lld", &id) != 1 || id < 0 || id >= g_ranks_count) {
+    SPAWN_ERR("Invalid endpoint name %s", name);
+    return SPAWN_NET_CHANNEL_NULL;
+  }
+  /* names are known before ranks open their endpoints, so a
+   * connect may come first and wait for the open */
+  sim_rank* target = &g_ranks[id];
+  if (target->done) {
+    SPAWN_ERR("Failed to connect to %s (no such endpoint)", name);
+    return SPAWN_NET_CHANNEL_NULL;
+  }
+  spawn_epdata* epdata = sim_endpoint(target);
+
+  sim_conn* conn = (sim_conn*) SPAWN_MALLOC(sizeof(sim_conn));
+  memset(conn, 0, sizeof(sim_conn));
+  conn->q[0].reader = epdata->owner;
+  conn->q[1].reader = r;
+  conn->refs = 2;
+
+  /* a connect costs the same as an empty message */
+  conn->from    = r->rank;
+  conn->arrival = sim_send(r, NULL, 0);
+  conn->sent    = r->clock;
+  conn->path    = sim_path_ref(r->path);
+
+  /* keep accept queue in order of arrival */
+  sim_conn** link = &epdata->head;
+  while (*link != NULL && (*link)->arrival <= conn->arrival) {
+    link = &(*link)->next;
+  }
+  conn->next = *link;
+  *link = conn;
+  sim_notify(epdata->owner);
+
+  return sim_channel(name, conn, 0);
+}
+
+spawn_net_channel* spawn_net_accept_sim(const spawn_net_endpoint* ep)
+{
+  sim_rank* r = sim_self();
+  if (r == NULL) {
+    return SPAWN_NET_CHANNEL_NULL;
+  }
+  spawn_epdata* epdata = (spawn_epdata*) ep->data;
+
+  /* wait until the earliest connect has arrived */
+  if (epdata->head == NULL || epdata->head->arrival > r->clock) {
+    sim_sync(r);
+  }
+  while (epdata->head == NULL || epdata->head->arrival > r->clock) {
+    const spawn_net_endpoint* eps[1] = {ep};
+    r->neps = 1;
+    r->eps  = eps;
+    sim_block(r);
+  }
+
+  sim_conn* conn = epdata->head;
+  epdata->head = conn->next;
+  conn->next = NULL;
+  sim_recv(r, conn->arrival, conn->from, conn->sent, 0, conn->path);
+
+  return sim_channel(ep->name, conn, 1);
+}
+
+int spawn_net_disconnect_sim(spawn_net_channel** pch)
+{
+  spawn_net_channel* ch = *pch;
+  spawn_chdata* chdata = (spawn_chdata*) ch->data;
+
+  sim_rank* r = sim_self();
+  double now = (r != NULL) ? r->clock : g_now;
+  sim_conn_release(chdata->conn, chdata->in, chdata->out, now);
+
+  spawn_free(&chdata);
+  spawn_free(&ch->name);
+  spawn_free(pch);
+
+  return SPAWN_SUCCESS;
+}
+
+int spawn_net_read_sim(const spawn_net_channel* ch, void* buf, size_t size)
+{
+  sim_rank* r = sim_self();
+  if (r == NULL) {
+    return SPAWN_FAILURE;
+  }
+  spawn_chdata* chdata = (spawn_chdata*) ch->data;
+  sim_queue* q = chdata->in;
+
+  /* wait for writer to send enough data */
+  if (q->bytes < size && ! q->closed) {
+    r->read_q    = q;
+    r->read_size = size;
+    sim_block(r);
+  }
+  if (q->bytes < size) {
+    SPAWN_ERR("Failed to read from %s (peer disconnected)", ch->name);
+    return SPAWN_FAILURE;
+  }
+
+  /* copy data out, the last segment we touch sets our arrival */
+  char* ptr = (char*) buf;
+  size_t total = 0;
+  double arrival = r->clock;
+  int64_t from   = -1;
+  double sent    = 0.0;
+  sim_path* path = NULL;
+  while (total < size) {
+    sim_seg* seg = q->head;
+    size_t count = seg->size - seg->offset;
+    if (count > size - total) {
+      count = size - total;
+    }
+    memcpy(ptr + total, seg->data + seg->offset, count);
+    seg->offset += count;
+    q->bytes    -= count;
+    total       += count;
+
+    arrival = seg->arrival;
+    from    = seg->from;
+    sent    = seg->sent;
+    sim_path_release(path);
+    path = sim_path_ref(seg->path);
+
+    if (seg->offset == seg->size) {
+      q->head = seg->next;
+      if (q->head == NULL) {
+        q->tail = NULL;
+      }
+      sim_path_release(seg->path);
+      spawn_free(&seg->data);
+      spawn_free(&seg);
+    }
+  }
+
+  if (size > 0) {
+    sim_recv(r, arrival, from, sent, (uint64_t) size, path);
+  }
+  sim_path_release(path);
+
+  return SPAWN_SUCCESS;
+}
+
+int spawn_net_write_sim(const spawn_net_channel* ch, const void* buf, size_t size)
+{
+  sim_rank* r = sim_self();
+  if (r == NULL) {
+    return SPAWN_FAILURE;
+  }
+  spawn_chdata* chdata = (spawn_chdata*) ch->data;
+  sim_queue* q = chdata->out;
+
+  if (q->gone) {
+    SPAWN_ERR("Failed to write to %s (peer disconnected)", ch->name);
+    return SPAWN_FAILURE;
+  }
+  if (size == 0) {
+    return SPAWN_SUCCESS;
+  }
+
+  sim_seg* seg = (sim_seg*) SPAWN_MALLOC(sizeof(sim_seg));
+  seg->data    = (char*) SPAWN_MALLOC(size);
+  memcpy(seg->data, buf, size);
+  seg->size    = size;
+  seg->offset  = 0;
+  seg->from    = r->rank;
+  seg->path    = sim_path_ref(r->path);
+  seg->arrival = sim_send(r, q, size);
+  seg->sent    = r->clock;
+  seg->next    = NULL;
+
+  if (q->tail != NULL) {
+    q->tail->next = seg;
+  } else {
+    q->head = seg;
+  }
+  q->tail   = seg;
+  q->bytes += size;
+  sim_notify(q->reader);
+
+  return SPAWN_SUCCESS;
+}
+
+int spawn_net_probe_sim(const spawn_net_channel* ch, int* flag)
+{
+  sim_rank* r = sim_self();
+  if (r == NULL) {
+    return SPAWN_FAILURE;
+  }
+  spawn_chdata* chdata = (spawn_chdata*) ch->data;
+
+  /* if nothing has arrived, catch up to our clock in case
+   * something is still on its way */
+  double ready = sim_queue_ready(chdata->in);
+  if (ready < 0.0 || ready > r->clock) {
+    sim_sync(r);
+    ready = sim_queue_ready(chdata->in);
+  }
+  *flag = (ready >= 0.0 && ready <= r->clock);
+
+  return SPAWN_SUCCESS;
+}
+
+int spawn_net_wait_sim(
+  int neps,
+  const spawn_net_endpoint** eps,
+  int nchs,
+  const spawn_net_channel** chs,
+  int* index)
+{
+  /* bail out if endpoint and channel arrays are empty */
+  if (eps == NULL && chs == NULL) {
+    return SPAWN_FAILURE;
+  }
+
+  sim_rank* r = sim_self();
+  if (r == NULL) {
+    return SPAWN_FAILURE;
+  }
+
+  int synced = 0;
+  while (1) {
+    /* pick the earliest event that has arrived by now */
+    int found = -1;
+    double found_time = 0.0;
+    int i;
+    for (i = 0; i < neps; i++) {
+      const spawn_net_endpoint* ep = eps[i];
+      if (ep == SPAWN_NET_ENDPOINT_NULL) {
+        continue;
+      }
+      const spawn_epdata* epdata = (const spawn_epdata*) ep->data;
+      if (epdata->head != NULL) {
+        double ready = epdata->head->arrival;
+        if (ready <= r->clock && (found < 0 || ready < found_time)) {
+          found = i;
+          found_time = ready;
+        }
+      }
+    }
+    for (i = 0; i < nchs; i++) {
+      const spawn_net_channel* ch = chs[i];
+      if (ch == SPAWN_NET_CHANNEL_NULL) {
+        continue;
+      }
+      const spawn_chdata* chdata = (const spawn_chdata*) ch->data;
+      double ready = sim_queue_ready(chdata->in);
+      if (ready >= 0.0 && ready <= r->clock && (found < 0 || ready < found_time)) {
+        found = neps + i;
+        found_time = ready;
+      }
+    }
+
+    if (found >= 0) {
+      *index = found;
+      return SPAWN_SUCCESS;
+    }
+
+    /* catch up to our clock in case something is on its way */
+    if (! synced) {
+      sim_sync(r);
+      synced = 1;
+      continue;
+    }
+
+    r->neps = neps;
+    r->eps  = eps;
+    r->nchs = nchs;
+    r->chs  = chs;
+    sim_block(r);
+  }
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667277.
+ * All rights reserved.
+ * This file is part of the SpawnNet library.
+ * For details, see https://github.com/hpc/spawnnet
+ * Please also read the LICENSE file.
+*/
+
+#ifndef SPAWN_NET_SIM_H
+#define SPAWN_NET_SIM_H
+
+#include <stdio.h>
+#include "spawn_internal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The SIM transport runs virtual ranks as coroutines in one thread
+ * and charges each message with the cost model below, see
+ * spawn_net_sim.c for details.
+ *
+ * Writes are unbounded: a write copies its data into the queue of
+ * the channel and returns at once, no matter how much unread data
+ * the queue holds.  Real transports buffer a limited amount, so code
+ * that writes large messages to a peer that is itself blocked in
+ * write deadlocks on TCP but runs to completion here.  The simulator
+ * can time algorithms, but it cannot find flow-control bugs, so test
+ * those on a real transport. */
+
+/* cost model charged to each message, times in seconds */
+typedef struct spawn_net_sim_model_t {
+  double latency;   /* time from leaving sender to reaching receiver */
+  double bandwidth; /* bytes per second sender can inject */
+  double overhead;  /* cpu time each side spends per message */
+} spawn_net_sim_model;
+
+/* run fn(rank, arg) as each of ranks virtual ranks in virtual time,
+ * ranks talk over SPAWN_NET_TYPE_SIM endpoints, returns once all
+ * ranks have returned or the rest are deadlocked */
+int spawn_net_sim_run(
+  int64_t ranks,                     /* number of virtual ranks */
+  const spawn_net_sim_model* model,  /* network cost model */
+  size_t stack_size,                 /* bytes of stack per rank */
+  void (*fn)(int64_t rank, void* arg), /* body run by each rank */
+  void* arg                          /* passed to fn */
+);
+
+/* returns virtual time of calling rank in seconds */
+double spawn_net_sim_time(void);
+
+/* returns traffic of calling rank so far */
+int spawn_net_sim_counts(
+  uint64_t* bytes_sent, /* bytes written */
+  uint64_t* bytes_recv, /* bytes read */
+  uint64_t* msgs_sent   /* messages written, including connects */
+);
+
+/* calling rank moves on to phase, phases count up from 0 */
+int spawn_net_sim_phase(int phase);
+
+/* walks the critical path of phase from the rank that finished it
+ * last, prints one line per message hop if fp is not NULL, returns
+ * number of hops, valid until the next run */
+int64_t spawn_net_sim_path(int phase, FILE* fp);
+
+spawn_net_endpoint* spawn_net_open_sim();
+
+int spawn_net_close_sim(spawn_net_endpoint** pep);
+
+spawn_net_channel* spawn_net_connect_sim(const char* name);
+
+spawn_net_channel* spawn_net_accept_sim(const spawn_net_endpoint* ep);
+
+int spawn_net_disconnect_sim(spawn_net_channel** pch);
+
+int spawn_net_read_sim(const spawn_net_channel* ch, void* buf, size_t size);
+
+int spawn_net_write_sim(const spawn_net_channel* ch, const void* buf, size_t size);
+
+int spawn_net_probe_sim(const spawn_net_channel* ch, int* flag);
+
+int spawn_net_wait_sim(
+  int neps,
+  const spawn_net_endpoint** eps,
+  int nchs,
+  const spawn_net_channel** chs,
+  int* index
+);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* SPAWN_NET_SIM_H */
@@ -0,0 +1,254 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667277.
+ * All rights reserved.
+ * This file is part of the SpawnNet library.
+ * For details, see https://github.com/hpc/spawnnet
+ * Please also read the LICENSE file.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "spawn_internal.h"
+
+/* Counters for each endpoint and channel live in a node on a list so
+ * that a snapshot can sum over all of them by transport type.  The
+ * counters are the first member of the node, so the pointer stored in
+ * the endpoint or channel is also the pointer to free.  On close, a
+ * node leaves the list and its counters fold into totals for its type,
+ * so totals cover the whole run. */
+
+/* one more than largest spawn_net_type */
+#define SPAWN_NET_STATS_TYPES (SPAWN_NET_TYPE_SIM + 1)
+
+typedef struct spawn_net_stats_node_t {
+  spawn_net_stats stats;         /* must be first */
+  int type;                      /* spawn_net_type of owner */
+  const spawn_net_channel* ch;   /* owning channel, NULL for endpoint */
+  struct spawn_net_stats_node_t* prev;
+  struct spawn_net_stats_node_t* next;
+} spawn_net_stats_node;
+
+/* whether to allocate counters, -1 until we read $SPAWN_NET_STATS */
+static int spawn_net_stats_enabled = -1;
+
+/* number of open endpoints and channels of each type */
+static uint64_t spawn_net_stats_eps[SPAWN_NET_STATS_TYPES];
+static uint64_t spawn_net_stats_chs[SPAWN_NET_STATS_TYPES];
+
+/* list of live counters and totals from closed ones, under lock */
+static pthread_mutex_t spawn_net_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static spawn_net_stats_node* spawn_net_stats_head = NULL;
+static spawn_net_stats spawn_net_stats_closed[SPAWN_NET_STATS_TYPES];
+
+/* returns array index for type, or -1 if out of range */
+static int spawn_net_stats_index(int type)
+{
+  if (type < 0 || type >= SPAWN_NET_STATS_TYPES) {
+    return -1;
+  }
+  return type;
+}
+
+spawn_net_stats* spawn_net_stats_new(int type, const spawn_net_channel* ch)
+{
+  int index = spawn_net_stats_index(type);
+  if (index >= 0) {
+    uint64_t* count = (ch == SPAWN_NET_CHANNEL_NULL) ? spawn_net_stats_eps : spawn_net_stats_chs;
+    __atomic_fetch_add(&count[index], 1, __ATOMIC_RELAXED);
+  }
+
+  /* racing threads all compute the same answer */
+  if (spawn_net_stats_enabled < 0) {
+    const char* value = getenv("SPAWN_NET_STATS");
+    spawn_net_stats_enabled = (value == NULL || atoi(value) != 0);
+  }
+  if (! spawn_net_stats_enabled) {
+    return NULL;
+  }
+
+  spawn_net_stats_node* node = (spawn_net_stats_node*) SPAWN_MALLOC(sizeof(spawn_net_stats_node));
+  memset(&node->stats, 0, sizeof(spawn_net_stats));
+  node->type = type;
+  node->ch   = ch;
+  node->prev = NULL;
+
+  /* insert at head of list */
+  pthread_mutex_lock(&spawn_net_stats_lock);
+  node->next = spawn_net_stats_head;
+  if (spawn_net_stats_head != NULL) {
+    spawn_net_stats_head->prev = node;
+  }
+  spawn_net_stats_head = node;
+  pthread_mutex_unlock(&spawn_net_stats_lock);
+
+  return &node->stats;
+}
+
+/* add counters of node to total, only wait time for endpoints since
+ * accepts are counted on the channels they create */
+static void spawn_net_stats_fold(spawn_net_stats* total, const spawn_net_stats_node* node)
+{
+  spawn_net_stats stats;
+  if (node->ch != SPAWN_NET_CHANNEL_NULL) {
+    spawn_net_channel_stats(node->ch, &stats);
+    spawn_net_stats_add(total, &stats);
+  } else {
+    total->wait_ns += __atomic_load_n(&node->stats.wait_ns, __ATOMIC_RELAXED);
+  }
+}
+
+int spawn_net_stats_close(spawn_net_stats* stats, int type, const spawn_net_channel* ch)
+{
+  int index = spawn_net_stats_index(type);
+  if (index >= 0) {
+    uint64_t* count = (ch == SPAWN_NET_CHANNEL_NULL) ? spawn_net_stats_eps : spawn_net_stats_chs;
+    __atomic_fetch_sub(&count[index], 1, __ATOMIC_RELAXED);
+  }
+
+  if (stats == NULL) {
+    return SPAWN_SUCCESS;
+  }
+
+  /* take node off list and add its counters to closed totals */
+  spawn_net_stats_node* node = (spawn_net_stats_node*) stats;
+  pthread_mutex_lock(&spawn_net_stats_lock);
+  if (node->prev != NULL) {
+    node->prev->next = node->next;
+  } else {
+    spawn_net_stats_head = node->next;
+  }
+  if (node->next != NULL) {
+    node->next->prev = node->prev;
+  }
+  node->prev = NULL;
+  node->next = NULL;
+  if (index >= 0) {
+    spawn_net_stats_fold(&spawn_net_stats_closed[index], node);
+  }
+  pthread_mutex_unlock(&spawn_net_stats_lock);
+
+  return SPAWN_SUCCESS;
+}
+
+int spawn_net_stats_free(spawn_net_stats** pstats)
+{
+  spawn_free(pstats);
+  return SPAWN_SUCCESS;
+}
+
+int spawn_net_stats_type(
+  int type,
+  spawn_net_stats* total,
+  uint64_t* endpoints,
+  uint64_t* channels)
+{
+  memset(total, 0, sizeof(spawn_net_stats));
+  *endpoints = 0;
+  *channels  = 0;
+
+  int index = spawn_net_stats_index(type);
+  if (index < 0) {
+    return SPAWN_FAILURE;
+  }
+
+  *endpoints = __atomic_load_n(&spawn_net_stats_eps[index], __ATOMIC_RELAXED);
+  *channels  = __atomic_load_n(&spawn_net_stats_chs[index], __ATOMIC_RELAXED);
+
+  pthread_mutex_lock(&spawn_net_stats_lock);
+  spawn_net_stats_add(total, &spawn_net_stats_closed[index]);
+  spawn_net_stats_node* node = spawn_net_stats_head;
+  while (node != NULL) {
+    if (node->type == type) {
+      spawn_net_stats_fold(total, node);
+    }
+    node = node->next;
+  }
+  pthread_mutex_unlock(&spawn_net_stats_lock);
+
+  return SPAWN_SUCCESS;
+}
+
+/* copy src into dst one counter at a time with relaxed loads */
+static void spawn_net_stats_copy(spawn_net_stats* dst, const spawn_net_stats* src)
+{
+  if (src == NULL) {
+    memset(dst, 0, sizeof(spawn_net_stats));
+    return;
+  }
+
+  uint64_t* d = (uint64_t*) dst;
+  const uint64_t* s = (const uint64_t*) src;
+  size_t count = sizeof(spawn_net_stats) / sizeof(uint64_t);
+  size_t i;
+  for (i = 0; i < count; i++) {
+    d[i] = __atomic_load_n(&s[i], __ATOMIC_RELAXED);
+  }
+}
+
+int spawn_net_channel_stats(const spawn_net_channel* ch, spawn_net_stats* stats)
+{
+  if (stats == NULL) {
+    return SPAWN_FAILURE;
+  }
+
+  if (ch == SPAWN_NET_CHANNEL_NULL) {
+    spawn_net_stats_copy(stats, NULL);
+    return SPAWN_SUCCESS;
+  }
+
+  spawn_net_stats_copy(stats, ch->stats);
+
+#ifdef HAVE_SPAWN_NET_IBUD
+  /* IB keeps its own counters on the vc */
+  if (ch->type == SPAWN_NET_TYPE_IBUD && ch->stats != NULL) {
+    spawn_net_stats_ib(ch, stats);
+  }
+#endif
+
+  return SPAWN_SUCCESS;
+}
+
+int spawn_net_endpoint_stats(const spawn_net_endpoint* ep, spawn_net_stats* stats)
+{
+  if (stats == NULL) {
+    return SPAWN_FAILURE;
+  }
+
+  if (ep == SPAWN_NET_ENDPOINT_NULL) {
+    spawn_net_stats_copy(stats, NULL);
+    return SPAWN_SUCCESS;
+  }
+
+  spawn_net_stats_copy(stats, ep->stats);
+  return SPAWN_SUCCESS;
+}
+
+int spawn_net_stats_add(spawn_net_stats* dst, const spawn_net_stats* src)
+{
+  /* every field is a uint64_t */
+  uint64_t* d = (uint64_t*) dst;
+  const uint64_t* s = (const uint64_t*) src;
+  size_t count = sizeof(spawn_net_stats) / sizeof(uint64_t);
+  size_t i;
+  for (i = 0; i < count; i++) {
+    d[i] += s[i];
+  }
+  return SPAWN_SUCCESS;
+}
+
+uint64_t spawn_net_stats_bin_ns(int bin)
+{
+  if (bin < 4) {
+    return (uint64_t) bin;
+  }
+  int e   = bin / 4 + 1;
+  int sub = bin % 4;
+  return (uint64_t) (4 + sub) << (e - 2);
+}
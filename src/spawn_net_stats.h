@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667277.
+ * All rights reserved.
+ * This file is part of the SpawnNet library.
+ * For details, see https://github.com/hpc/spawnnet
+ * Please also read the LICENSE file.
+*/
+
+#ifndef SPAWN_NET_STATS_H
+#define SPAWN_NET_STATS_H
+
+#include <stdint.h>
+#include <time.h>
+#include "spawn_net.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* count a new endpoint (ch is NULL) or channel of the given type,
+ * and allocate zeroed counters for it, returns NULL if
+ * $SPAWN_NET_STATS is 0 */
+spawn_net_stats* spawn_net_stats_new(int type, const spawn_net_channel* ch);
+
+/* count endpoint or channel as closed and fold its counters into
+ * totals for its type, call before the transport frees it */
+int spawn_net_stats_close(spawn_net_stats* stats, int type, const spawn_net_channel* ch);
+
+/* free counters allocated with spawn_net_stats_new */
+int spawn_net_stats_free(spawn_net_stats** pstats);
+
+/* get number of open endpoints and channels of given type, and sum of
+ * counters over all of its channels open and closed, along with
+ * time spent waiting on its endpoints */
+int spawn_net_stats_type(
+  int type,
+  spawn_net_stats* total,
+  uint64_t* endpoints,
+  uint64_t* channels
+);
+
+/* add value to field of stats if stats is not NULL */
+#define SPAWN_NET_STATS_ADD(stats, field, value) \
+    do { if ((stats) != NULL) { __atomic_fetch_add(&(stats)->field, (uint64_t) (value), __ATOMIC_RELAXED); } } while (0)
+
+/* returns start time for SPAWN_NET_STATS_HIST, only reads the clock
+ * if stats is not NULL */
+#define SPAWN_NET_STATS_START(stats) \
+    (((stats) != NULL) ? spawn_net_stats_now() : 0)
+
+/* count time since start in histogram field of stats if stats is not NULL */
+#define SPAWN_NET_STATS_HIST(stats, field, start) \
+    do { if ((stats) != NULL) { __atomic_fetch_add(&(stats)->field[spawn_net_stats_bin(spawn_net_stats_now() - (start))], 1, __ATOMIC_RELAXED); } } while (0)
+
+/* returns monotonic time in nanoseconds */
+static inline uint64_t spawn_net_stats_now(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t) t.tv_sec * 1000000000 + (uint64_t) t.tv_nsec;
+}
+
+/* returns histogram bin for latency of ns nanoseconds, bins 0-3 hold
+ * 0-3 ns, and beyond that, two bits below the leading one pick one of
+ * four bins for each power of two */
+static inline int spawn_net_stats_bin(uint64_t ns)
+{
+  if (ns < 4) {
+    return (int) ns;
+  }
+  int e = 63 - __builtin_clzll(ns);
+  int bin = (e - 1) * 4 + (int) ((ns >> (e - 2)) & 3);
+  if (bin >= SPAWN_NET_STATS_BINS) {
+    bin = SPAWN_NET_STATS_BINS - 1;
+  }
+  return bin;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* SPAWN_NET_STATS_H */
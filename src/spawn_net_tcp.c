@@ -13,16 +13,22 @@
 #include <stdlib.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/sendfile.h>
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
 
 #include "spawn_internal.h"
 
-static int spawn_net_tcp_backlog = 64;
+/* the boot service takes a connection from every proc at startup,
+ * so let the kernel queue as many as it allows rather than dropping
+ * connections while we accept, $SPAWN_TCP_BACKLOG overrides this */
+static int spawn_net_tcp_backlog = SOMAXCONN;
 
 typedef struct spawn_epdata_t {
     int fd; /* file descriptor of listening socket */
@@ -32,7 +38,8 @@ typedef struct spawn_chdata_t {
     int fd; /* file descriptor of connected TCP socket */
 } spawn_chdata;
 
-static int reliable_read(const char* name, int fd, void* buf, size_t size)
+/* counts system calls and retries in stats if not NULL */
+static int reliable_read(const char* name, spawn_net_stats* stats, int fd, void* buf, size_t size)
 {
   /* read from socket */
   size_t total = 0;
@@ -41,19 +48,23 @@ static int reliable_read(const char* name, int fd, void* buf, size_t size)
     /* compute number of bytes remaining and read */
     size_t remaining = size - total;
     ssize_t count = read(fd, ptr, remaining);
+    SPAWN_NET_STATS_ADD(stats, syscalls, 1);
     if (count > 0) {
       /* we read some bytes, update our count and pointer position */
       total += (size_t) count;
       ptr += count;
+      if (total < size) {
+        SPAWN_NET_STATS_ADD(stats, retries, 1);
+      }
     } else if (count == 0) {
       /* we can get this on EOF, e.g., remote socket closed normally,
        * however, since caller tried to read something, we return
        * an error */
       //SPAWN_ERR("Unexpected read of 0 bytes %s (read() errno=%d %s)", name, errno, strerror(errno));
       return SPAWN_FAILURE;
+    } else if (errno == EINTR) {
+      SPAWN_NET_STATS_ADD(stats, retries, 1);
     } else {
-      /* TODO: if EINTR, retry */
-
       SPAWN_ERR("Error reading socket %s (read() errno=%d %s)", name, errno, strerror(errno));
       return SPAWN_FAILURE;
     }
@@ -61,7 +72,8 @@ static int reliable_read(const char* name, int fd, void* buf, size_t size)
   return SPAWN_SUCCESS;
 }
 
-static int reliable_write(const char* name, int fd, const void* buf, size_t size)
+/* counts system calls and retries in stats if not NULL */
+static int reliable_write(const char* name, spawn_net_stats* stats, int fd, const void* buf, size_t size)
 {
   /* write to socket */
   size_t total = 0;
@@ -70,16 +82,20 @@ static int reliable_write(const char* name, int fd, const void* buf, size_t size
     /* compute number of bytes remaining and write */
     size_t remaining = size - total;
     ssize_t count = write(fd, ptr, remaining);
+    SPAWN_NET_STATS_ADD(stats, syscalls, 1);
     if (count > 0) {
       /* we wrote some bytes, update our count and pointer position */
       total += (size_t) count;
       ptr += count;
+      if (total < size) {
+        SPAWN_NET_STATS_ADD(stats, retries, 1);
+      }
     } else if (count == 0) {
       SPAWN_ERR("Unexpected write of 0 bytes %s (write() errno=%d %s)", name, errno, strerror(errno));
       return SPAWN_FAILURE;
+    } else if (errno == EINTR) {
+      SPAWN_NET_STATS_ADD(stats, retries, 1);
     } else {
-      /* TODO: if EINTR, retry */
-
       SPAWN_ERR("Error writing socket %s (write() errno=%d %s)", name, errno, strerror(errno));
       return SPAWN_FAILURE;
     }
@@ -159,6 +175,17 @@ static int spawn_net_set_tcp_nodelay(int fd)
   return SPAWN_SUCCESS;
 }
 
+/* mark socket close-on-exec, so procs we fork and exec do not
+ * inherit our listening socket or connections */
+static int spawn_net_set_cloexec(int fd)
+{
+  if (fcntl(fd, F_SETFD, FD_CLOEXEC) < 0) {
+    SPAWN_ERR("Failed to set FD_CLOEXEC (fcntl() errno=%d %s)", errno, strerror(errno));
+    return SPAWN_FAILURE;
+  }
+  return SPAWN_SUCCESS;
+}
+
 spawn_net_endpoint* spawn_net_open_tcp()
 {
   /* create a TCP socket, we'll take new connections on this socket */
@@ -168,7 +195,7 @@ spawn_net_endpoint* spawn_net_open_tcp()
   }
 
   /* set socket up for immediate send */
-  if (spawn_net_set_tcp_nodelay(fd)) {
+  if (spawn_net_set_cloexec(fd) || spawn_net_set_tcp_nodelay(fd)) {
     close(fd);
     return SPAWN_NET_ENDPOINT_NULL;
   }
@@ -188,7 +215,12 @@ spawn_net_endpoint* spawn_net_open_tcp()
   }
 
   /* listen for connections */
-  if (listen(fd, spawn_net_tcp_backlog) < 0) {
+  int backlog = spawn_net_tcp_backlog;
+  char* env;
+  if ((env = getenv("SPAWN_TCP_BACKLOG")) != NULL) {
+    backlog = atoi(env);
+  }
+  if (listen(fd, backlog) < 0) {
     SPAWN_ERR("Failed to set socket to listen (listen() errno=%d %s)", errno, strerror(errno));
     close(fd);
     return SPAWN_NET_ENDPOINT_NULL;
@@ -341,7 +373,7 @@ spawn_net_channel* spawn_net_connect_tcp(const char* name)
     return SPAWN_NET_CHANNEL_NULL;
   }
 
-  if (spawn_net_set_tcp_nodelay(fd)) {
+  if (spawn_net_set_cloexec(fd) || spawn_net_set_tcp_nodelay(fd)) {
     close(fd);
     return SPAWN_NET_CHANNEL_NULL;
   }
@@ -379,13 +411,13 @@ spawn_net_channel* spawn_net_connect_tcp(const char* name)
   int64_t len, len_net;
   len = (int64_t) (strlen(hostname) + 1);
   spawn_pack_uint64(&len_net, len);
-  if (reliable_write(ch_name, fd, &len_net, 8) != SPAWN_SUCCESS) {
+  if (reliable_write(ch_name, NULL, fd, &len_net, 8) != SPAWN_SUCCESS) {
     SPAWN_ERR("Failed to write length of name to %s", ch_name);
     free(ch_name);
     close(fd);
     return SPAWN_NET_CHANNEL_NULL;
   }
-  if (reliable_write(ch_name, fd, hostname, (size_t)len) != SPAWN_SUCCESS) {
+  if (reliable_write(ch_name, NULL, fd, hostname, (size_t)len) != SPAWN_SUCCESS) {
     SPAWN_ERR("Failed to write name to %s", ch_name);
     free(ch_name);
     close(fd);
@@ -423,7 +455,7 @@ spawn_net_channel* spawn_net_accept_tcp(const spawn_net_endpoint* ep)
     return SPAWN_NET_CHANNEL_NULL;
   }
 
-  if (spawn_net_set_tcp_nodelay(fd)) {
+  if (spawn_net_set_cloexec(fd) || spawn_net_set_tcp_nodelay(fd)) {
     close(fd);
     return SPAWN_NET_CHANNEL_NULL;
   }
@@ -435,7 +467,7 @@ spawn_net_channel* spawn_net_accept_tcp(const spawn_net_endpoint* ep)
 
   /* read length of name from remote side */
   uint64_t len, len_net;
-  if (reliable_read(tmp_remote_name, fd, &len_net, 8) != SPAWN_SUCCESS) {
+  if (reliable_read(tmp_remote_name, NULL, fd, &len_net, 8) != SPAWN_SUCCESS) {
     SPAWN_ERR("Failed to read length of name from %s", tmp_remote_name);
     spawn_free(&tmp_remote_name);
     close(fd);
@@ -445,7 +477,7 @@ spawn_net_channel* spawn_net_accept_tcp(const spawn_net_endpoint* ep)
 
   /* allocate memory and read remote name */
   char* remote = (char*) SPAWN_MALLOC((size_t)len);
-  if (reliable_read(tmp_remote_name, fd, remote, (size_t)len) != SPAWN_SUCCESS) {
+  if (reliable_read(tmp_remote_name, NULL, fd, remote, (size_t)len) != SPAWN_SUCCESS) {
     SPAWN_ERR("Failed to read name from %s", tmp_remote_name);
     spawn_free(&remote);
     spawn_free(&tmp_remote_name);
@@ -523,7 +555,7 @@ int spawn_net_read_tcp(const spawn_net_channel* ch, void* buf, size_t size)
   /* close the socket */
   int fd = chdata->fd;
   if (fd > 0) {
-    return reliable_read(ch->name, fd, buf, size);
+    return reliable_read(ch->name, ch->stats, fd, buf, size);
   }
   return SPAWN_SUCCESS;
 }
@@ -536,11 +568,74 @@ int spawn_net_write_tcp(const spawn_net_channel* ch, const void* buf, size_t siz
   /* write to socket */
   int fd = chdata->fd;
   if (fd > 0) {
-    return reliable_write(ch->name, fd, buf, size);
+    return reliable_write(ch->name, ch->stats, fd, buf, size);
   }
   return SPAWN_SUCCESS;
 }
 
+int spawn_net_sendfile_tcp(const spawn_net_channel* ch, int fd, off_t offset, size_t size)
+{
+  /* get pointer to TCP-specific channel data */
+  spawn_chdata* chdata = (spawn_chdata*) ch->data;
+
+  /* let the kernel copy from the file to the socket */
+  int sock = chdata->fd;
+  if (sock > 0) {
+    size_t total = 0;
+    while (total < size) {
+      ssize_t count = sendfile(sock, fd, &offset, size - total);
+      SPAWN_NET_STATS_ADD(ch->stats, syscalls, 1);
+      if (count > 0) {
+        total += (size_t) count;
+        if (total < size) {
+          SPAWN_NET_STATS_ADD(ch->stats, retries, 1);
+        }
+      } else if (count < 0 && errno == EINTR) {
+        SPAWN_NET_STATS_ADD(ch->stats, retries, 1);
+        continue;
+      } else {
+        SPAWN_ERR("Error sending file to socket %s (sendfile() errno=%d %s)", ch->name, errno, strerror(errno));
+        return SPAWN_FAILURE;
+      }
+    }
+  }
+  return SPAWN_SUCCESS;
+}
+
+int spawn_net_probe_tcp(const spawn_net_channel* ch, int* flag)
+{
+  /* get pointer to TCP-specific channel data */
+  spawn_chdata* chdata = (spawn_chdata*) ch->data;
+
+  /* assume nothing is ready */
+  *flag = 0;
+
+  /* poll socket without blocking */
+  int fd = chdata->fd;
+  if (fd > 0) {
+    struct pollfd pfd;
+    pfd.fd      = fd;
+    pfd.events  = POLLIN;
+    pfd.revents = 0;
+    int rc = poll(&pfd, 1, 0);
+    if (rc == -1) {
+      if (errno == EINTR) {
+        return SPAWN_SUCCESS;
+      }
+      SPAWN_ERR("Failed to poll socket %s errno=%d %s", ch->name, errno, strerror(errno));
+      return SPAWN_FAILURE;
+    }
+
+    /* report closed or failed sockets as ready,
+     * so the caller learns about it on its read */
+    if (rc > 0 && (pfd.revents & (POLLIN | POLLHUP | POLLERR))) {
+      *flag = 1;
+    }
+  }
+
+  return SPAWN_SUCCESS;
+}
+
 int spawn_net_wait_tcp(
   int neps,
   const spawn_net_endpoint** eps,
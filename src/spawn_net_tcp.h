@@ -32,6 +32,18 @@ int spawn_net_read_tcp(const spawn_net_channel* ch, void* buf, size_t size);
 
 int spawn_net_write_tcp(const spawn_net_channel* ch, const void* buf, size_t size);
 
+int spawn_net_sendfile_tcp(const spawn_net_channel* ch, int fd, off_t offset, size_t size);
+
+int spawn_net_probe_tcp(const spawn_net_channel* ch, int* flag);
+
+int spawn_net_wait_tcp(
+  int neps,
+  const spawn_net_endpoint** eps,
+  int nchs,
+  const spawn_net_channel** chs,
+  int* index
+);
+
 #ifdef __cplusplus
 }
 #endif
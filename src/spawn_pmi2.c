@@ -0,0 +1,758 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667277.
+ * All rights reserved.
+ * This file is part of the SpawnNet library.
+ * For details, see https://github.com/hpc/spawnnet
+ * Please also read the LICENSE file.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include "spawn_internal.h"
+#include "spawn_pmi2.h"
+
+/* A child first sends a PMI-1 style line:
+ *   cmd=init pmi_version=2 pmi_subversion=0\n
+ * and expects a line in reply.  After that, every PMI2 command and
+ * response is a 6 character decimal length, padded with spaces,
+ * followed by that many bytes of key=value; pairs, the first of which
+ * is cmd.  A semicolon within a value is escaped as two semicolons.
+ * If a request carries a thrid, the response echoes it.
+ *
+ * Launchers commit puts in rounds.  A launcher joins a round once
+ * all of its children are in a fence or done, and a launcher whose
+ * children are all done keeps joining rounds with no entries, so
+ * launchers with children still running complete their fences.  Each
+ * round also counts the launchers that are done, and all launchers
+ * leave once that count reaches the size of the group.  Rounds use
+ * non-blocking collectives, so a launcher keeps watching for aborts
+ * while it waits on other launchers.
+ *
+ * Before exec, each child writes its pid on its socket, so the
+ * launcher can kill it.  When a child calls abort, its launcher kills
+ * its other children and sends an abort message both ways along a
+ * ring of launchers on a group of its own, and each launcher that
+ * gets the message passes it on and kills its children. */
+
+/* length of the size field that precedes each command */
+#define SPAWN_PMI2_LEN_SIZE (6)
+
+/* states of a child */
+#define SPAWN_PMI2_NEW    (0) /* waiting on init line */
+#define SPAWN_PMI2_ACTIVE (1) /* serving commands */
+#define SPAWN_PMI2_FENCE  (2) /* waiting in fence */
+#define SPAWN_PMI2_WAIT   (3) /* waiting on node attribute */
+#define SPAWN_PMI2_DONE   (4) /* finalized or exited */
+
+/* message sent between launchers to abort the job */
+#define SPAWN_PMI2_ABORT (1)
+
+/* msecs to wait on children between checks for an abort,
+ * and while a round is in progress */
+#define SPAWN_PMI2_POLL_MS  (100)
+#define SPAWN_PMI2_ROUND_MS (1)
+
+struct spawn_pmi2_t {
+  const lwgrp* group; /* group of launchers */
+  lwgrp* ctl;         /* copy of group that carries abort messages */
+  char* jobid;        /* name of job */
+  char* mapping;      /* value of PMI_process_mapping, NULL if irregular */
+  int64_t ranks;      /* number of procs in job */
+  int64_t offset;     /* rank of our first child */
+  int64_t count;      /* number of our children */
+  int* fds;           /* our end of socket to each child */
+  pid_t* pids;        /* pid of each child, -1 until it sends it */
+  int* child_fds;     /* child end of socket to each child */
+  int* states;        /* state of each child */
+  strmap** held;      /* request held for each child in fence or wait */
+  strmap* store;      /* entries from all procs committed by fences */
+  strmap* puts;       /* entries from our children since last fence */
+  strmap* nodeattrs;  /* node attributes set by our children */
+};
+
+/* read size bytes from fd, retrying on EINTR,
+ * returns SPAWN_FAILURE on error or end of file */
+static int spawn_pmi2_read(int fd, void* buf, size_t size)
+{
+  char* ptr = (char*) buf;
+  size_t got = 0;
+  while (got < size) {
+    ssize_t n = read(fd, ptr + got, size - got);
+    if (n > 0) {
+      got += (size_t) n;
+    } else if (n < 0 && errno == EINTR) {
+      continue;
+    } else {
+      return SPAWN_FAILURE;
+    }
+  }
+  return SPAWN_SUCCESS;
+}
+
+/* write size bytes to fd, retrying on EINTR */
+static int spawn_pmi2_write(int fd, const void* buf, size_t size)
+{
+  const char* ptr = (const char*) buf;
+  size_t sent = 0;
+  while (sent < size) {
+    ssize_t n = write(fd, ptr + sent, size - sent);
+    if (n > 0) {
+      sent += (size_t) n;
+    } else if (n < 0 && errno == EINTR) {
+      continue;
+    } else {
+      return SPAWN_FAILURE;
+    }
+  }
+  return SPAWN_SUCCESS;
+}
+
+/* read PMI-1 style init line from child and answer it */
+static int spawn_pmi2_init(int fd)
+{
+  /* read up to newline, we only need to know the line arrived */
+  char c = '\0';
+  while (c != '\n') {
+    if (spawn_pmi2_read(fd, &c, 1) != SPAWN_SUCCESS) {
+      return SPAWN_FAILURE;
+    }
+  }
+
+  const char* reply = "cmd=response_to_init pmi_version=2 pmi_subversion=0 rc=0\n";
+  return spawn_pmi2_write(fd, reply, strlen(reply));
+}
+
+/* read a command from fd and parse its pairs into map */
+static int spawn_pmi2_recv(int fd, strmap* map)
+{
+  char len_str[SPAWN_PMI2_LEN_SIZE + 1];
+  if (spawn_pmi2_read(fd, len_str, SPAWN_PMI2_LEN_SIZE) != SPAWN_SUCCESS) {
+    return SPAWN_FAILURE;
+  }
+  len_str[SPAWN_PMI2_LEN_SIZE] = '\0';
+  size_t len = (size_t) atoi(len_str);
+
+  char* cmd = (char*) SPAWN_MALLOC(len + 1);
+  if (spawn_pmi2_read(fd, cmd, len) != SPAWN_SUCCESS) {
+    spawn_free(&cmd);
+    return SPAWN_FAILURE;
+  }
+  cmd[len] = '\0';
+
+  /* split into key=value; pairs, unescaping ;; in values */
+  char* val = (char*) SPAWN_MALLOC(len + 1);
+  size_t i = 0;
+  while (i < len) {
+    char* key = cmd + i;
+    while (i < len && cmd[i] != '=') {
+      i++;
+    }
+    if (i == len) {
+      break;
+    }
+    cmd[i++] = '\0';
+
+    size_t n = 0;
+    while (i < len) {
+      if (cmd[i] == ';') {
+        if (i + 1 < len && cmd[i + 1] == ';') {
+          i++;
+        } else {
+          break;
+        }
+      }
+      val[n++] = cmd[i++];
+    }
+    val[n] = '\0';
+    i++;
+
+    strmap_set(map, key, val);
+  }
+
+  spawn_free(&val);
+  spawn_free(&cmd);
+
+  return SPAWN_SUCCESS;
+}
+
+/* send response built from a NULL-terminated list of key and value
+ * strings, echoing thrid from the request if it has one */
+static int spawn_pmi2_send(int fd, const strmap* req, ...)
+{
+  const char* thrid = strmap_get(req, "thrid");
+
+  /* compute length of response */
+  size_t len = 0;
+  va_list args;
+  va_start(args, req);
+  const char* key;
+  while ((key = va_arg(args, const char*)) != NULL) {
+    const char* val = va_arg(args, const char*);
+    len += strlen(key) + strlen(val) + 2;
+    const char* ptr;
+    for (ptr = val; *ptr != '\0'; ptr++) {
+      if (*ptr == ';') {
+        len++;
+      }
+    }
+  }
+  va_end(args);
+  if (thrid != NULL) {
+    len += strlen("thrid") + strlen(thrid) + 2;
+  }
+
+  /* write length field followed by pairs */
+  char* buf = (char*) SPAWN_MALLOC(SPAWN_PMI2_LEN_SIZE + len + 1);
+  snprintf(buf, SPAWN_PMI2_LEN_SIZE + 1, "%-6lu", (unsigned long) len);
+  char* ptr = buf + SPAWN_PMI2_LEN_SIZE;
+  va_start(args, req);
+  while ((key = va_arg(args, const char*)) != NULL) {
+    const char* val = va_arg(args, const char*);
+    ptr += sprintf(ptr, "%s=", key);
+    for (; *val != '\0'; val++) {
+      if (*val == ';') {
+        *ptr++ = ';';
+      }
+      *ptr++ = *val;
+    }
+    *ptr++ = ';';
+  }
+  va_end(args);
+  if (thrid != NULL) {
+    ptr += sprintf(ptr, "thrid=%s;", thrid);
+  }
+
+  int rc = spawn_pmi2_write(fd, buf, SPAWN_PMI2_LEN_SIZE + len);
+  spawn_free(&buf);
+
+  return rc;
+}
+
+/* mark child as done and close its socket */
+static void spawn_pmi2_done(spawn_pmi2* pmi, int64_t index)
+{
+  pmi->states[index] = SPAWN_PMI2_DONE;
+  strmap_delete(&pmi->held[index]);
+  close(pmi->fds[index]);
+  pmi->fds[index] = -1;
+}
+
+/* release children waiting in fence */
+static void spawn_pmi2_release(spawn_pmi2* pmi)
+{
+  int64_t i;
+  for (i = 0; i < pmi->count; i++) {
+    if (pmi->states[i] == SPAWN_PMI2_FENCE) {
+      pmi->states[i] = SPAWN_PMI2_ACTIVE;
+      spawn_pmi2_send(pmi->fds[i], pmi->held[i],
+        "cmd", "kvs-fence-response", "rc", "0", NULL
+      );
+      strmap_delete(&pmi->held[i]);
+    }
+  }
+}
+
+/* kill all of our children that are still running */
+static void spawn_pmi2_kill(spawn_pmi2* pmi)
+{
+  int64_t i;
+  for (i = 0; i < pmi->count; i++) {
+    /* each child writes its pid first thing after fork,
+     * so we may need to read it here */
+    if (pmi->pids[i] < 0 && pmi->fds[i] >= 0) {
+      pid_t pid;
+      if (spawn_pmi2_read(pmi->fds[i], &pid, sizeof(pid)) == SPAWN_SUCCESS) {
+        pmi->pids[i] = pid;
+      }
+    }
+    if (pmi->pids[i] > 0) {
+      kill(pmi->pids[i], SIGKILL);
+    }
+    if (pmi->states[i] != SPAWN_PMI2_DONE) {
+      spawn_pmi2_done(pmi, i);
+    }
+  }
+}
+
+/* send abort message to launchers on our left and right, or only
+ * away from the side it came from, which may be NULL */
+static void spawn_pmi2_send_abort(spawn_pmi2* pmi, const spawn_net_channel* from)
+{
+  uint64_t msg = SPAWN_PMI2_ABORT;
+  spawn_net_channel* left  = pmi->ctl->list_left[0];
+  spawn_net_channel* right = pmi->ctl->list_right[0];
+  if (left != SPAWN_NET_CHANNEL_NULL && left != from) {
+    spawn_net_write(left, &msg, sizeof(msg));
+  }
+  if (right != SPAWN_NET_CHANNEL_NULL && right != from) {
+    spawn_net_write(right, &msg, sizeof(msg));
+  }
+}
+
+/* returns 1 if another launcher aborted the job, in which case we
+ * pass the message on, does not block */
+static int spawn_pmi2_check_abort(spawn_pmi2* pmi)
+{
+  const spawn_net_channel* chs[2];
+  chs[0] = pmi->ctl->list_left[0];
+  chs[1] = pmi->ctl->list_right[0];
+
+  int i;
+  for (i = 0; i < 2; i++) {
+    int flag = 0;
+    if (chs[i] != SPAWN_NET_CHANNEL_NULL) {
+      spawn_net_probe(chs[i], &flag);
+    }
+    if (flag) {
+      uint64_t msg;
+      spawn_net_read(chs[i], &msg, sizeof(msg));
+      spawn_pmi2_send_abort(pmi, chs[i]);
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/* answer children waiting on node attribute key */
+static void spawn_pmi2_wake(spawn_pmi2* pmi, const char* key, const char* val)
+{
+  int64_t i;
+  for (i = 0; i < pmi->count; i++) {
+    if (pmi->states[i] == SPAWN_PMI2_WAIT && strcmp(strmap_get(pmi->held[i], "key"), key) == 0) {
+      pmi->states[i] = SPAWN_PMI2_ACTIVE;
+      spawn_pmi2_send(pmi->fds[i], pmi->held[i],
+        "cmd", "info-getnodeattr-response", "rc", "0",
+        "found", "TRUE", "value", val, NULL
+      );
+      strmap_delete(&pmi->held[i]);
+    }
+  }
+}
+
+/* process one command from child index, returns 1 if the child
+ * called abort and 0 otherwise */
+static int spawn_pmi2_handle(spawn_pmi2* pmi, int64_t index)
+{
+  int abort = 0;
+  int fd = pmi->fds[index];
+
+  if (pmi->states[index] == SPAWN_PMI2_NEW && pmi->pids[index] < 0) {
+    /* the child sends its pid before it execs */
+    pid_t pid;
+    if (spawn_pmi2_read(fd, &pid, sizeof(pid)) != SPAWN_SUCCESS) {
+      spawn_pmi2_done(pmi, index);
+      return abort;
+    }
+    pmi->pids[index] = pid;
+    return abort;
+  }
+
+  if (pmi->states[index] == SPAWN_PMI2_NEW) {
+    if (spawn_pmi2_init(fd) != SPAWN_SUCCESS) {
+      spawn_pmi2_done(pmi, index);
+      return abort;
+    }
+    pmi->states[index] = SPAWN_PMI2_ACTIVE;
+    return abort;
+  }
+
+  strmap* req = strmap_new();
+  if (spawn_pmi2_recv(fd, req) != SPAWN_SUCCESS) {
+    /* child closed its socket */
+    strmap_delete(&req);
+    spawn_pmi2_done(pmi, index);
+    return abort;
+  }
+
+  const char* cmd = strmap_get(req, "cmd");
+  const char* key = strmap_get(req, "key");
+  if (cmd == NULL) {
+    cmd = "";
+  }
+
+  if (strcmp(cmd, "fullinit") == 0) {
+    char* rank = SPAWN_STRDUPF("%lld", (long long) (pmi->offset + index));
+    char* size = SPAWN_STRDUPF("%lld", (long long) pmi->ranks);
+    spawn_pmi2_send(fd, req,
+      "cmd", "fullinit-response", "rc", "0",
+      "pmi-version", "2", "pmi-subversion", "0",
+      "rank", rank, "size", size, "appnum", "0",
+      "debugged", "FALSE", "pmiverbose", "FALSE", NULL
+    );
+    spawn_free(&size);
+    spawn_free(&rank);
+  } else if (strcmp(cmd, "job-getid") == 0) {
+    spawn_pmi2_send(fd, req,
+      "cmd", "job-getid-response", "rc", "0", "jobid", pmi->jobid, NULL
+    );
+  } else if (strcmp(cmd, "kvs-put") == 0) {
+    const char* val = strmap_get(req, "value");
+    if (key != NULL && val != NULL) {
+      strmap_set(pmi->puts, key, val);
+    }
+    spawn_pmi2_send(fd, req, "cmd", "kvs-put-response", "rc", "0", NULL);
+  } else if (strcmp(cmd, "kvs-fence") == 0) {
+    /* answered once all of our children reach the fence */
+    pmi->states[index] = SPAWN_PMI2_FENCE;
+    pmi->held[index]   = req;
+    req = NULL;
+  } else if (strcmp(cmd, "kvs-get") == 0) {
+    const char* val = (key != NULL) ? strmap_get(pmi->store, key) : NULL;
+    if (val != NULL) {
+      spawn_pmi2_send(fd, req,
+        "cmd", "kvs-get-response", "rc", "0",
+        "found", "TRUE", "value", val, NULL
+      );
+    } else {
+      spawn_pmi2_send(fd, req,
+        "cmd", "kvs-get-response", "rc", "0", "found", "FALSE", NULL
+      );
+    }
+  } else if (strcmp(cmd, "info-putnodeattr") == 0) {
+    const char* val = strmap_get(req, "value");
+    if (key != NULL && val != NULL) {
+      strmap_set(pmi->nodeattrs, key, val);
+      spawn_pmi2_wake(pmi, key, val);
+    }
+    spawn_pmi2_send(fd, req, "cmd", "info-putnodeattr-response", "rc", "0", NULL);
+  } else if (strcmp(cmd, "info-getnodeattr") == 0) {
+    const char* val  = (key != NULL) ? strmap_get(pmi->nodeattrs, key) : NULL;
+    const char* wait = strmap_get(req, "wait");
+    if (val != NULL) {
+      spawn_pmi2_send(fd, req,
+        "cmd", "info-getnodeattr-response", "rc", "0",
+        "found", "TRUE", "value", val, NULL
+      );
+    } else if (key != NULL && wait != NULL && strcmp(wait, "TRUE") == 0) {
+      /* answered when a sibling puts the attribute */
+      pmi->states[index] = SPAWN_PMI2_WAIT;
+      pmi->held[index]   = req;
+      req = NULL;
+    } else {
+      spawn_pmi2_send(fd, req,
+        "cmd", "info-getnodeattr-response", "rc", "0", "found", "FALSE", NULL
+      );
+    }
+  } else if (strcmp(cmd, "info-getjobattr") == 0) {
+    if (key != NULL && strcmp(key, "PMI_process_mapping") == 0 && pmi->mapping != NULL) {
+      spawn_pmi2_send(fd, req,
+        "cmd", "info-getjobattr-response", "rc", "0",
+        "found", "TRUE", "value", pmi->mapping, NULL
+      );
+    } else {
+      spawn_pmi2_send(fd, req,
+        "cmd", "info-getjobattr-response", "rc", "0", "found", "FALSE", NULL
+      );
+    }
+  } else if (strcmp(cmd, "finalize") == 0) {
+    spawn_pmi2_send(fd, req, "cmd", "finalize-response", "rc", "0", NULL);
+    spawn_pmi2_done(pmi, index);
+  } else if (strcmp(cmd, "abort") == 0) {
+    const char* msg = strmap_get(req, "message");
+    SPAWN_ERR("Rank %lld called abort: %s",
+      (long long) (pmi->offset + index), (msg != NULL) ? msg : ""
+    );
+    spawn_pmi2_done(pmi, index);
+    abort = 1;
+  } else {
+    char* resp = SPAWN_STRDUPF("%s-response", cmd);
+    spawn_pmi2_send(fd, req,
+      "cmd", resp, "rc", "1", "errmsg", "unsupported command", NULL
+    );
+    spawn_free(&resp);
+  }
+
+  strmap_delete(&req);
+
+  return abort;
+}
+
+spawn_pmi2* spawn_pmi2_create(const lwgrp* group, int64_t count, const char* jobid)
+{
+  spawn_pmi2* pmi = (spawn_pmi2*) SPAWN_MALLOC(sizeof(spawn_pmi2));
+  pmi->group     = group;
+  pmi->jobid     = SPAWN_STRDUP(jobid);
+  pmi->mapping   = NULL;
+  pmi->count     = count;
+  pmi->store     = strmap_new();
+  pmi->puts      = strmap_new();
+  pmi->nodeattrs = strmap_new();
+
+  /* our children follow those of lower launchers */
+  uint64_t mine = (uint64_t) count;
+  uint64_t offset;
+  lwgrp_exscan(&mine, &offset, 1, LWGRP_TYPE_UINT64, LWGRP_OP_SUM, group);
+  uint64_t ranks = mine;
+  lwgrp_allreduce_uint64_sum(&ranks, 1, group);
+  uint64_t max = mine;
+  lwgrp_allreduce_uint64_max(&max, 1, group);
+  pmi->offset = (int64_t) offset;
+  pmi->ranks  = (int64_t) ranks;
+
+  /* aborts travel on channels of their own, so they never mix
+   * with the collectives of a round */
+  pmi->ctl = lwgrp_split(group, 0, lwgrp_rank(group));
+
+  /* describe blocks of children if every launcher has the same number */
+  uint64_t launchers = (uint64_t) lwgrp_size(group);
+  if (max * launchers == ranks) {
+    pmi->mapping = SPAWN_STRDUPF("(vector,(0,%llu,%llu))",
+      (unsigned long long) launchers, (unsigned long long) max
+    );
+  }
+
+  size_t int_bytes = count * sizeof(int);
+  pmi->fds       = (int*)   SPAWN_MALLOC(int_bytes);
+  pmi->child_fds = (int*)   SPAWN_MALLOC(int_bytes);
+  pmi->states    = (int*)   SPAWN_MALLOC(int_bytes);
+  pmi->held      = (strmap**) SPAWN_MALLOC(count * sizeof(strmap*));
+  pmi->pids      = (pid_t*) SPAWN_MALLOC(count * sizeof(pid_t));
+
+  int64_t i;
+  for (i = 0; i < count; i++) {
+    pmi->fds[i]       = -1;
+    pmi->child_fds[i] = -1;
+    pmi->states[i]    = SPAWN_PMI2_NEW;
+    pmi->held[i]      = NULL;
+    pmi->pids[i]      = -1;
+
+    /* neither end should leak into children through exec,
+     * each child clears the flag on its own end */
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+      SPAWN_ERR("Failed to create socket pair for child %lld (socketpair() errno=%d %s)",
+        (long long) i, errno, strerror(errno)
+      );
+      pmi->states[i] = SPAWN_PMI2_DONE;
+      continue;
+    }
+    fcntl(sv[0], F_SETFD, FD_CLOEXEC);
+    fcntl(sv[1], F_SETFD, FD_CLOEXEC);
+    pmi->fds[i]       = sv[0];
+    pmi->child_fds[i] = sv[1];
+  }
+
+  return pmi;
+}
+
+int spawn_pmi2_child(spawn_pmi2* pmi, int64_t index)
+{
+  if (index < 0 || index >= pmi->count || pmi->child_fds[index] < 0) {
+    SPAWN_ERR("Invalid child index %lld", (long long) index);
+    return SPAWN_FAILURE;
+  }
+
+  /* keep our end of the socket open across exec */
+  int fd = pmi->child_fds[index];
+  fcntl(fd, F_SETFD, 0);
+
+  /* tell launcher our pid, which stays the same across exec */
+  pid_t pid = getpid();
+  spawn_pmi2_write(fd, &pid, sizeof(pid));
+
+  char* fd_str   = SPAWN_STRDUPF("%d",   fd);
+  char* rank_str = SPAWN_STRDUPF("%lld", (long long) (pmi->offset + index));
+  char* size_str = SPAWN_STRDUPF("%lld", (long long) pmi->ranks);
+  setenv("PMI_FD",    fd_str,     1);
+  setenv("PMI_RANK",  rank_str,   1);
+  setenv("PMI_SIZE",  size_str,   1);
+  setenv("PMI_JOBID", pmi->jobid, 1);
+  spawn_free(&size_str);
+  spawn_free(&rank_str);
+  spawn_free(&fd_str);
+
+  return SPAWN_SUCCESS;
+}
+
+/* wait up to msecs for commands from children and process them,
+ * returns 1 if a child called abort and 0 otherwise */
+static int spawn_pmi2_poll(spawn_pmi2* pmi, struct pollfd* fds, int64_t* indices, int msecs)
+{
+  nfds_t nfds = 0;
+  int64_t i;
+  for (i = 0; i < pmi->count; i++) {
+    if (pmi->states[i] != SPAWN_PMI2_DONE) {
+      fds[nfds].fd      = pmi->fds[i];
+      fds[nfds].events  = POLLIN;
+      fds[nfds].revents = 0;
+      indices[nfds] = i;
+      nfds++;
+    }
+  }
+
+  int n = poll(fds, nfds, msecs);
+  if (n < 0) {
+    if (errno != EINTR) {
+      SPAWN_ERR("Failed to poll child sockets (poll() errno=%d %s)", errno, strerror(errno));
+    }
+    return 0;
+  }
+
+  int abort = 0;
+  nfds_t j;
+  for (j = 0; j < nfds; j++) {
+    if (fds[j].revents != 0) {
+      abort |= spawn_pmi2_handle(pmi, indices[j]);
+    }
+  }
+  return abort;
+}
+
+int spawn_pmi2_serve(spawn_pmi2* pmi)
+{
+  int rc = SPAWN_SUCCESS;
+
+  /* the children hold their own ends of the sockets now */
+  int64_t i;
+  for (i = 0; i < pmi->count; i++) {
+    if (pmi->child_fds[i] >= 0) {
+      close(pmi->child_fds[i]);
+      pmi->child_fds[i] = -1;
+    }
+  }
+
+  struct pollfd* fds = (struct pollfd*) SPAWN_MALLOC(pmi->count * sizeof(struct pollfd));
+  int64_t* indices = (int64_t*) SPAWN_MALLOC(pmi->count * sizeof(int64_t));
+
+  /* state of the round in progress, puts is NULL between rounds */
+  lwgrp_request* round_puts = NULL;
+  lwgrp_request* round_done = NULL;
+  strmap* puts = NULL;
+  uint64_t* done = NULL;
+
+  while (1) {
+    /* another launcher may have aborted the job */
+    if (spawn_pmi2_check_abort(pmi)) {
+      spawn_pmi2_kill(pmi);
+      rc = SPAWN_FAILURE;
+      break;
+    }
+
+    if (puts != NULL) {
+      /* wait for other launchers in the round */
+      int flag_puts, flag_done;
+      lwgrp_test(&round_puts, &flag_puts);
+      lwgrp_test(&round_done, &flag_done);
+      if (round_puts != NULL || round_done != NULL) {
+        if (spawn_pmi2_poll(pmi, fds, indices, SPAWN_PMI2_ROUND_MS)) {
+          spawn_pmi2_kill(pmi);
+          spawn_pmi2_send_abort(pmi, NULL);
+          rc = SPAWN_FAILURE;
+          break;
+        }
+        continue;
+      }
+
+      /* commit entries and release children from fence */
+      strmap_merge(pmi->store, puts);
+      strmap_delete(&puts);
+      uint64_t all_done = *done;
+      spawn_free(&done);
+      if (all_done == (uint64_t) lwgrp_size(pmi->group)) {
+        break;
+      }
+      spawn_pmi2_release(pmi);
+      continue;
+    }
+
+    /* count children still running and those in fence */
+    int64_t active = 0;
+    int64_t fencing = 0;
+    for (i = 0; i < pmi->count; i++) {
+      if (pmi->states[i] != SPAWN_PMI2_DONE) {
+        active++;
+      }
+      if (pmi->states[i] == SPAWN_PMI2_FENCE) {
+        fencing++;
+      }
+    }
+
+    /* join a round with other launchers once all of our children
+     * are in a fence, or all are done, in which case we have no
+     * entries to add but others may still be fencing */
+    if (fencing == active) {
+      puts = pmi->puts;
+      pmi->puts = strmap_new();
+      done = (uint64_t*) SPAWN_MALLOC(sizeof(uint64_t));
+      *done = (active == 0);
+      lwgrp_iallgather_strmap(puts, pmi->group, &round_puts);
+      lwgrp_iallreduce_uint64_sum(done, 1, pmi->group, &round_done);
+      continue;
+    }
+
+    /* wait for a command from any child */
+    if (spawn_pmi2_poll(pmi, fds, indices, SPAWN_PMI2_POLL_MS)) {
+      spawn_pmi2_kill(pmi);
+      spawn_pmi2_send_abort(pmi, NULL);
+      rc = SPAWN_FAILURE;
+      break;
+    }
+  }
+
+  /* launchers close the abort channels in spawn_pmi2_free, which
+   * others still watching them would take for an abort, so wait
+   * until all have left the loop, on abort, a round may still be in
+   * progress, and its requests refer to puts and done, so we leave
+   * them to the process exit */
+  if (rc == SPAWN_SUCCESS) {
+    lwgrp_barrier(pmi->group);
+  }
+
+  spawn_free(&indices);
+  spawn_free(&fds);
+
+  return rc;
+}
+
+int spawn_pmi2_free(spawn_pmi2** ppmi)
+{
+  if (ppmi == NULL) {
+    return SPAWN_FAILURE;
+  }
+
+  spawn_pmi2* pmi = *ppmi;
+  if (pmi == NULL) {
+    return SPAWN_SUCCESS;
+  }
+
+  int64_t i;
+  for (i = 0; i < pmi->count; i++) {
+    if (pmi->fds[i] >= 0) {
+      close(pmi->fds[i]);
+    }
+    if (pmi->child_fds[i] >= 0) {
+      close(pmi->child_fds[i]);
+    }
+    strmap_delete(&pmi->held[i]);
+  }
+
+  lwgrp_free(&pmi->ctl);
+  strmap_delete(&pmi->nodeattrs);
+  strmap_delete(&pmi->puts);
+  strmap_delete(&pmi->store);
+  spawn_free(&pmi->pids);
+  spawn_free(&pmi->held);
+  spawn_free(&pmi->states);
+  spawn_free(&pmi->child_fds);
+  spawn_free(&pmi->fds);
+  spawn_free(&pmi->mapping);
+  spawn_free(&pmi->jobid);
+  spawn_free(ppmi);
+
+  return SPAWN_SUCCESS;
+}
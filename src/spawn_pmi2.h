@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667277.
+ * All rights reserved.
+ * This file is part of the SpawnNet library.
+ * For details, see https://github.com/hpc/spawnnet
+ * Please also read the LICENSE file.
+*/
+
+#ifndef SPAWN_PMI2_H
+#define SPAWN_PMI2_H
+
+#include <stdint.h>
+#include "lwgrp.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The PMI2 server lets launchers serve the PMI2 wire protocol to the
+ * procs they fork, so existing MPI binaries can start under spawnnet
+ * unchanged.  Each launcher answers its own children over the socket
+ * named in $PMI_FD.  Puts are kept local until a fence, at which point
+ * the launchers allgather just the new entries over their group, and
+ * gets are answered from the local copy of all fenced entries.  Node
+ * attributes are shared among the children of one launcher, and every
+ * launcher must have at least one child. */
+
+/* handle to a PMI2 server */
+typedef struct spawn_pmi2_t spawn_pmi2;
+
+/* create PMI2 server for count children, children of launchers with
+ * lower rank in group come first in the job, collective over group */
+spawn_pmi2* spawn_pmi2_create(
+  const lwgrp* group, /* group of launchers */
+  int64_t count,      /* number of children of this launcher */
+  const char* jobid   /* name of job given to children */
+);
+
+/* to be called in child index after fork and before exec,
+ * hands socket and PMI environment variables to the child */
+int spawn_pmi2_child(spawn_pmi2* pmi, int64_t index);
+
+/* to be called in launcher after forking its children, serves PMI2
+ * requests until the children of all launchers have finalized or
+ * exited, collective over group, if any child calls abort, kills the
+ * children of every launcher and returns SPAWN_FAILURE */
+int spawn_pmi2_serve(spawn_pmi2* pmi);
+
+/* free PMI2 server */
+int spawn_pmi2_free(spawn_pmi2** ppmi);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* SPAWN_PMI2_H */
@@ -0,0 +1,444 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667277.
+ * All rights reserved.
+ * This file is part of the SpawnNet library.
+ * For details, see https://github.com/hpc/spawnnet
+ * Please also read the LICENSE file.
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <malloc.h>
+#include <time.h>
+
+#include "spawn_internal.h"
+#include "spawn_stats.h"
+#include "lwgrp.h"
+
+/* Metrics are collected into a strmap so that lwgrp_reduce_strmap can
+ * combine them across a group.  Each value is a kind letter, 'c' for a
+ * counter or 'g' for a gauge, then the value, and once combined the
+ * value is followed by the max over procs.  The writers group keys by
+ * metric name, since the labels in a key do not sort with its name. */
+
+static pthread_once_t spawn_stats_once = PTHREAD_ONCE_INIT;
+static uint64_t spawn_stats_start = 0;  /* time of init in ns */
+static char* spawn_stats_prefix   = NULL;
+static spawn_stats_format spawn_stats_fmt = SPAWN_STATS_FORMAT_JSON;
+static int spawn_stats_pipe[2] = {-1, -1};
+
+/* names of transports for labels, indexed by spawn_net_type */
+static const char* spawn_stats_types[] = {
+  NULL, "tcp", "fifo", "ibud", "inproc", "sim"
+};
+
+/* add value to key in map, keys may repeat, e.g., several __FILE__
+ * strings of a header included in different files */
+static void spawn_stats_add(strmap* map, const char* key, char kind, uint64_t value)
+{
+  const char* old = strmap_get(map, key);
+  if (old != NULL) {
+    unsigned long long old_value = 0;
+    sscanf(old + 1, "%llu", &old_value);
+    value += (uint64_t) old_value;
+  }
+
+  char str[64];
+  snprintf(str, sizeof(str), "%c %llu", kind, (unsigned long long) value);
+  strmap_set(map, key, str);
+}
+
+/* add counters and gauges of transport type to map */
+static void spawn_stats_net(strmap* map, int type)
+{
+  spawn_net_stats total;
+  uint64_t endpoints, channels;
+  spawn_net_stats_type(type, &total, &endpoints, &channels);
+
+  const char* name = spawn_stats_types[type];
+  char key[128];
+
+#define SPAWN_STATS_NET(metric, kind, value) \
+  do { \
+    snprintf(key, sizeof(key), "%s{type=\"%s\"}", metric, name); \
+    spawn_stats_add(map, key, kind, value); \
+  } while (0)
+
+  SPAWN_STATS_NET("spawn_net_endpoints", 'g', endpoints);
+  SPAWN_STATS_NET("spawn_net_channels", 'g', channels);
+  SPAWN_STATS_NET("spawn_net_sent_bytes_total", 'c', total.bytes_sent);
+  SPAWN_STATS_NET("spawn_net_received_bytes_total", 'c', total.bytes_recv);
+  SPAWN_STATS_NET("spawn_net_sent_messages_total", 'c', total.msgs_sent);
+  SPAWN_STATS_NET("spawn_net_received_messages_total", 'c', total.msgs_recv);
+  SPAWN_STATS_NET("spawn_net_syscalls_total", 'c', total.syscalls);
+  SPAWN_STATS_NET("spawn_net_wait_nanoseconds_total", 'c', total.wait_ns);
+  SPAWN_STATS_NET("spawn_net_retries_total", 'c', total.retries);
+  SPAWN_STATS_NET("spawn_net_resends_total", 'c', total.resends);
+
+#undef SPAWN_STATS_NET
+}
+
+strmap* spawn_stats_collect(void)
+{
+  spawn_stats_init();
+
+  strmap* map = strmap_new();
+  char key[256];
+
+  uint64_t now = spawn_net_stats_now();
+  spawn_stats_add(map, "spawn_uptime_seconds", 'g', (now - spawn_stats_start) / 1000000000);
+
+  /* allocations by the file that made them, labeled by base name */
+  int i = 0;
+  const char* file;
+  uint64_t calls, bytes;
+  while (spawn_alloc_stats(i, &file, &calls, &bytes) == SPAWN_SUCCESS) {
+    if (file != NULL) {
+      const char* base = strrchr(file, '/');
+      base = (base != NULL) ? base + 1 : file;
+      snprintf(key, sizeof(key), "spawn_alloc_calls_total{file=\"%s\"}", base);
+      spawn_stats_add(map, key, 'c', calls);
+      snprintf(key, sizeof(key), "spawn_alloc_bytes_total{file=\"%s\"}", base);
+      spawn_stats_add(map, key, 'c', bytes);
+    }
+    i++;
+  }
+  spawn_free_stats(&calls, &bytes);
+  spawn_stats_add(map, "spawn_free_calls_total", 'c', calls);
+  spawn_stats_add(map, "spawn_free_bytes_total", 'c', bytes);
+
+  /* bytes the allocator has handed out and not had back */
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+  struct mallinfo2 info = mallinfo2();
+  spawn_stats_add(map, "spawn_heap_bytes", 'g', (uint64_t) (info.uordblks + info.hblkhd));
+#endif
+
+  /* resident set size */
+  FILE* fp = fopen("/proc/self/statm", "r");
+  if (fp != NULL) {
+    unsigned long long size, resident;
+    if (fscanf(fp, "%llu %llu", &size, &resident) == 2) {
+      uint64_t page = (uint64_t) sysconf(_SC_PAGESIZE);
+      spawn_stats_add(map, "spawn_rss_bytes", 'g', (uint64_t) resident * page);
+    }
+    fclose(fp);
+  }
+
+  /* endpoints, channels, and their counters by transport */
+  spawn_stats_net(map, SPAWN_NET_TYPE_TCP);
+  spawn_stats_net(map, SPAWN_NET_TYPE_FIFO);
+  spawn_stats_net(map, SPAWN_NET_TYPE_INPROC);
+  spawn_stats_net(map, SPAWN_NET_TYPE_SIM);
+#ifdef HAVE_SPAWN_NET_IBUD
+  spawn_stats_net(map, SPAWN_NET_TYPE_IBUD);
+#endif
+
+  /* transport queues */
+  uint64_t packets;
+  spawn_net_queue_fifo(&packets, &bytes);
+  spawn_stats_add(map, "spawn_fifo_queue_packets", 'g', packets);
+  spawn_stats_add(map, "spawn_fifo_queue_bytes", 'g', bytes);
+#ifdef HAVE_SPAWN_NET_IBUD
+  uint64_t vbufs, vbufs_free, unacked, queued;
+  spawn_net_queue_ib(&vbufs, &vbufs_free, &bytes, &unacked, &queued);
+  spawn_stats_add(map, "spawn_ibud_vbufs", 'g', vbufs);
+  spawn_stats_add(map, "spawn_ibud_vbufs_free", 'g', vbufs_free);
+  spawn_stats_add(map, "spawn_ibud_vbuf_bytes", 'g', bytes);
+  spawn_stats_add(map, "spawn_ibud_unacked_packets", 'g', unacked);
+  spawn_stats_add(map, "spawn_ibud_queued_packets", 'g', queued);
+#endif
+
+  /* live data structures, minus the map we are filling in */
+  spawn_stats_add(map, "spawn_strmaps", 'g', strmap_count_live() - 1);
+  uint64_t groups, channels;
+  lwgrp_counts(&groups, &channels);
+  spawn_stats_add(map, "lwgrp_groups", 'g', groups);
+  spawn_stats_add(map, "lwgrp_channels", 'g', channels);
+
+  return map;
+}
+
+/* parse value into kind, sum, and max, returns 1 if it has a max */
+static int spawn_stats_parse(const char* value, char* kind, uint64_t* sum, uint64_t* max)
+{
+  unsigned long long s = 0, m = 0;
+  int n = sscanf(value, "%c %llu %llu", kind, &s, &m);
+  *sum = (uint64_t) s;
+  *max = (n == 3) ? (uint64_t) m : (uint64_t) s;
+  return (n == 3);
+}
+
+char* spawn_stats_combine(const char* dst_value, const char* src_value)
+{
+  char kind, src_kind;
+  uint64_t sum, max, src_sum, src_max;
+  spawn_stats_parse(dst_value, &kind, &sum, &max);
+  spawn_stats_parse(src_value, &src_kind, &src_sum, &src_max);
+
+  sum += src_sum;
+  if (src_max > max) {
+    max = src_max;
+  }
+
+  char* str = SPAWN_STRDUPF("%c %llu %llu", kind, (unsigned long long) sum, (unsigned long long) max);
+  return str;
+}
+
+/* returns length of metric name at start of key */
+static size_t spawn_stats_name_len(const char* key)
+{
+  const char* brace = strchr(key, '{');
+  return (brace != NULL) ? (size_t) (brace - key) : strlen(key);
+}
+
+/* write labels from key as members of a JSON object */
+static void spawn_stats_json_labels(FILE* fp, const char* key)
+{
+  const char* labels = strchr(key, '{');
+  fprintf(fp, "{");
+  if (labels != NULL) {
+    /* name="value",name="value" becomes "name":"value","name":"value" */
+    const char* p;
+    fputc('"', fp);
+    for (p = labels + 1; *p != '\0' && *p != '}'; p++) {
+      if (*p == '=') {
+        fputs("\":", fp);
+      } else if (*p == ',') {
+        fputs(",\"", fp);
+      } else {
+        fputc(*p, fp);
+      }
+    }
+  }
+  fprintf(fp, "}");
+}
+
+/* write entries of map for metric name in given format, if max_only
+ * is set write max values as a name_max gauge rather than sums */
+static int spawn_stats_write_family(
+  FILE* fp,
+  const strmap* map,
+  const char* name,
+  spawn_stats_format format,
+  int max_only,
+  int* first)
+{
+  size_t len = strlen(name);
+  int typed = 0;
+  strmap_node* node = strmap_node_first(map);
+  while (node != NULL) {
+    const char* key = strmap_node_key(node);
+    if (spawn_stats_name_len(key) == len && strncmp(key, name, len) == 0) {
+      char kind;
+      uint64_t sum, max;
+      int job = spawn_stats_parse(strmap_node_value(node), &kind, &sum, &max);
+      const char* type = (kind == 'c') ? "counter" : "gauge";
+
+      if (format == SPAWN_STATS_FORMAT_PROM) {
+        const char* labels = key + len;
+        if (max_only) {
+          if (! typed) {
+            fprintf(fp, "# TYPE %s_max gauge\n", name);
+            typed = 1;
+          }
+          fprintf(fp, "%s_max%s %llu\n", name, labels, (unsigned long long) max);
+        } else {
+          if (! typed) {
+            fprintf(fp, "# TYPE %s %s\n", name, type);
+            typed = 1;
+          }
+          fprintf(fp, "%s%s %llu\n", name, labels, (unsigned long long) sum);
+        }
+      } else {
+        fprintf(fp, "%s\n{\"name\":\"%s\",\"type\":\"%s\",\"labels\":", (*first) ? "" : ",", name, type);
+        spawn_stats_json_labels(fp, key);
+        fprintf(fp, ",\"value\":%llu", (unsigned long long) sum);
+        if (job) {
+          fprintf(fp, ",\"max\":%llu", (unsigned long long) max);
+        }
+        fprintf(fp, "}");
+        *first = 0;
+      }
+    }
+    node = strmap_node_next(node);
+  }
+  return SPAWN_SUCCESS;
+}
+
+int spawn_stats_write(const char* path, const strmap* map, spawn_stats_format format)
+{
+  FILE* fp = fopen(path, "w");
+  if (fp == NULL) {
+    SPAWN_ERR("Failed to open %s (fopen() errno=%d %s)", path, errno, strerror(errno));
+    return SPAWN_FAILURE;
+  }
+
+  /* get distinct metric names, and note whether values carry a max */
+  int job = 0;
+  strmap* names = strmap_new();
+  strmap_node* node = strmap_node_first(map);
+  while (node != NULL) {
+    const char* key = strmap_node_key(node);
+    char* name = SPAWN_STRDUP(key);
+    name[spawn_stats_name_len(key)] = '\0';
+    strmap_set(names, name, "");
+    spawn_free(&name);
+
+    char kind;
+    uint64_t sum, max;
+    job |= spawn_stats_parse(strmap_node_value(node), &kind, &sum, &max);
+
+    node = strmap_node_next(node);
+  }
+
+  if (format == SPAWN_STATS_FORMAT_JSON) {
+    fprintf(fp, "{\"metrics\":[");
+  }
+
+  /* in Prometheus format, max values of a job go in their own
+   * families after all sums */
+  int first = 1;
+  int pass;
+  int passes = (job && format == SPAWN_STATS_FORMAT_PROM) ? 2 : 1;
+  for (pass = 0; pass < passes; pass++) {
+    node = strmap_node_first(names);
+    while (node != NULL) {
+      spawn_stats_write_family(fp, map, strmap_node_key(node), format, pass, &first);
+      node = strmap_node_next(node);
+    }
+  }
+
+  if (format == SPAWN_STATS_FORMAT_JSON) {
+    fprintf(fp, "\n]}\n");
+  }
+
+  strmap_delete(&names);
+
+  if (fclose(fp) != 0) {
+    SPAWN_ERR("Failed to write %s (fclose() errno=%d %s)", path, errno, strerror(errno));
+    return SPAWN_FAILURE;
+  }
+
+  return SPAWN_SUCCESS;
+}
+
+int spawn_stats_dump(const char* path, spawn_stats_format format)
+{
+  strmap* map = spawn_stats_collect();
+  int rc = spawn_stats_write(path, map, format);
+  strmap_delete(&map);
+  return rc;
+}
+
+/* write snapshot to $SPAWN_STATS.<host>.<pid>.<ext> */
+static void spawn_stats_dump_env(void)
+{
+  char host[HOST_NAME_MAX + 1];
+  if (gethostname(host, sizeof(host)) < 0) {
+    strcpy(host, "unknown");
+  }
+  host[HOST_NAME_MAX] = '\0';
+
+  const char* ext = (spawn_stats_fmt == SPAWN_STATS_FORMAT_PROM) ? "prom" : "json";
+  char* path = SPAWN_STRDUPF("%s.%s.%d.%s", spawn_stats_prefix, host, (int) getpid(), ext);
+  spawn_stats_dump(path, spawn_stats_fmt);
+  spawn_free(&path);
+}
+
+/* only async-signal-safe calls here, the thread below does the work */
+static void spawn_stats_signal(int sig)
+{
+  (void) sig;
+  int saved = errno;
+  char c = 'S';
+  ssize_t rc = write(spawn_stats_pipe[1], &c, 1);
+  (void) rc;
+  errno = saved;
+}
+
+/* write a snapshot each time the signal handler pokes the pipe */
+static void* spawn_stats_thread(void* arg)
+{
+  (void) arg;
+  while (1) {
+    char c;
+    ssize_t rc = read(spawn_stats_pipe[0], &c, 1);
+    if (rc == 1) {
+      spawn_stats_dump_env();
+    } else if (rc < 0 && errno != EINTR) {
+      break;
+    }
+  }
+  return NULL;
+}
+
+static void spawn_stats_setup(void)
+{
+  spawn_stats_start = spawn_net_stats_now();
+
+  const char* value = getenv("SPAWN_STATS_FORMAT");
+  if (value != NULL && strcmp(value, "prom") == 0) {
+    spawn_stats_fmt = SPAWN_STATS_FORMAT_PROM;
+  }
+
+  value = getenv("SPAWN_STATS");
+  if (value == NULL || strcmp(value, "") == 0) {
+    return;
+  }
+  spawn_stats_prefix = SPAWN_STRDUP(value);
+  atexit(spawn_stats_dump_env);
+
+  value = getenv("SPAWN_STATS_SIGNAL");
+  if (value == NULL) {
+    return;
+  }
+  int sig = atoi(value);
+  if (sig <= 0 || sig >= NSIG) {
+    SPAWN_ERR("Invalid signal number in $SPAWN_STATS_SIGNAL: %s", value);
+    return;
+  }
+
+  /* procs we fork and exec should not inherit the pipe */
+  if (pipe2(spawn_stats_pipe, O_CLOEXEC) != 0) {
+    SPAWN_ERR("Failed to create pipe (pipe2() errno=%d %s)", errno, strerror(errno));
+    return;
+  }
+
+  pthread_t thread;
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  int rc = pthread_create(&thread, &attr, spawn_stats_thread, NULL);
+  pthread_attr_destroy(&attr);
+  if (rc != 0) {
+    SPAWN_ERR("Failed to start stats thread (pthread_create() rc=%d %s)", rc, strerror(rc));
+    return;
+  }
+
+  struct sigaction act;
+  memset(&act, 0, sizeof(act));
+  act.sa_handler = spawn_stats_signal;
+  sigemptyset(&act.sa_mask);
+  act.sa_flags = SA_RESTART;
+  if (sigaction(sig, &act, NULL) != 0) {
+    SPAWN_ERR("Failed to install handler for signal %d (sigaction() errno=%d %s)", sig, errno, strerror(errno));
+  }
+}
+
+void spawn_stats_init(void)
+{
+  pthread_once(&spawn_stats_once, spawn_stats_setup);
+}
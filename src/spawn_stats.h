@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667277.
+ * All rights reserved.
+ * This file is part of the SpawnNet library.
+ * For details, see https://github.com/hpc/spawnnet
+ * Please also read the LICENSE file.
+*/
+
+#ifndef SPAWN_STATS_H
+#define SPAWN_STATS_H
+
+#include "strmap.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A metrics snapshot covers allocations by source file, heap size,
+ * open endpoints and channels with their counters summed by transport,
+ * transport queue depths, and live strmaps and groups.  If $SPAWN_STATS
+ * is set, each process writes a snapshot to
+ * $SPAWN_STATS.<host>.<pid>.<json|prom> when it exits, and if
+ * $SPAWN_STATS_SIGNAL names a signal number, also each time it gets
+ * that signal.  $SPAWN_STATS_FORMAT picks json (default) or prom. */
+
+typedef enum spawn_stats_format_enum {
+  SPAWN_STATS_FORMAT_JSON = 0, /* array of metric objects */
+  SPAWN_STATS_FORMAT_PROM = 1, /* Prometheus text exposition format */
+} spawn_stats_format;
+
+/* returns a new map of current metrics, keys are metric names with
+ * optional Prometheus labels as in name{type="tcp"}, values are "c"
+ * for counters or "g" for gauges followed by the value, caller frees
+ * the map with strmap_delete */
+strmap* spawn_stats_collect(void);
+
+/* combine values of two maps from spawn_stats_collect into "c|g sum max",
+ * for use with lwgrp_reduce_strmap */
+char* spawn_stats_combine(const char* dst_value, const char* src_value);
+
+/* write map from spawn_stats_collect or spawn_stats_combine to path */
+int spawn_stats_write(const char* path, const strmap* map, spawn_stats_format format);
+
+/* collect metrics of this process and write them to path */
+int spawn_stats_dump(const char* path, spawn_stats_format format);
+
+/* read $SPAWN_STATS settings once, called when spawn_net opens
+ * its first endpoint */
+void spawn_stats_init(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* SPAWN_STATS_H */
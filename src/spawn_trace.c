@@ -0,0 +1,277 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667277.
+ * All rights reserved.
+ * This file is part of the SpawnNet library.
+ * For details, see https://github.com/hpc/spawnnet
+ * Please also read the LICENSE file.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "spawn_internal.h"
+#include "spawn_clock.h"
+#include "spawn_trace.h"
+
+/* Each thread records into its own ring of fixed-size events, so
+ * recording takes no locks.  A thread allocates its ring on its first
+ * event and pushes it onto a global list with compare-and-swap.  The
+ * writer publishes each event by bumping the ring count, and dump
+ * reads the last events up to that count.  Events are stamped with
+ * get_cycles, which dump converts to nanoseconds since the epoch
+ * using the time of day and cycle count taken when tracing started,
+ * and then shifts onto the clock of the root of the last clock sync.
+ * Times are kept as integer nanoseconds, since a double holding
+ * microseconds since the epoch only resolves a quarter microsecond. */
+
+/* events each thread keeps unless $SPAWN_TRACE_EVENTS says otherwise */
+#define SPAWN_TRACE_EVENTS (64 * 1024)
+
+typedef struct spawn_trace_rec_t {
+  uint64_t cycles;  /* time stamp */
+  const char* name; /* event name, a string constant */
+  int64_t arg;      /* event argument */
+  int64_t type;     /* spawn_trace_type */
+} spawn_trace_rec;
+
+typedef struct spawn_trace_buf_t {
+  spawn_trace_rec* recs; /* ring of spawn_trace_size events */
+  uint64_t count;        /* number of events ever recorded */
+  int64_t tid;           /* id of thread that owns ring */
+  struct spawn_trace_buf_t* next; /* link in list of all rings */
+} spawn_trace_buf;
+
+int spawn_trace_enabled = -1;
+
+static pthread_once_t spawn_trace_once = PTHREAD_ONCE_INIT;
+static __thread spawn_trace_buf* spawn_trace_mine = NULL;
+static spawn_trace_buf* spawn_trace_bufs = NULL;
+static uint64_t spawn_trace_size     = SPAWN_TRACE_EVENTS;
+static int64_t spawn_trace_next_tid  = 0;
+static int64_t spawn_trace_pid       = -1;
+static char* spawn_trace_prefix      = NULL;
+static uint64_t spawn_trace_cycles0  = 0;
+static int64_t spawn_trace_ns0      = 0;
+
+/* clock rate, measured once when first needed */
+static pthread_once_t spawn_trace_mhz_once = PTHREAD_ONCE_INIT;
+static double spawn_trace_mhz = 1.0;
+
+/* maps local event times to times on the clock of a root process */
+static int64_t spawn_trace_offset = 0;
+static double spawn_trace_drift   = 0.0;
+static int64_t spawn_trace_base   = 0;
+
+static void spawn_trace_exit(void)
+{
+  char host[HOST_NAME_MAX + 1];
+  if (gethostname(host, sizeof(host)) < 0) {
+    strcpy(host, "unknown");
+  }
+  host[HOST_NAME_MAX] = '\0';
+
+  char* path = SPAWN_STRDUPF("%s.%s.%d.json", spawn_trace_prefix, host, (int) getpid());
+  spawn_trace_dump(path);
+  spawn_free(&path);
+}
+
+static void spawn_trace_init(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  spawn_trace_cycles0 = (uint64_t) get_cycles();
+  spawn_trace_ns0 = (int64_t) tv.tv_sec * 1000000000 + (int64_t) tv.tv_usec * 1000;
+
+  /* round ring size up to a power of two */
+  const char* value = getenv("SPAWN_TRACE_EVENTS");
+  if (value != NULL) {
+    uint64_t events = (uint64_t) strtoull(value, NULL, 10);
+    spawn_trace_size = 1;
+    while (spawn_trace_size < events) {
+      spawn_trace_size <<= 1;
+    }
+  }
+
+  int enabled = 0;
+  value = getenv("SPAWN_TRACE");
+  if (value != NULL && strcmp(value, "") != 0) {
+    spawn_trace_prefix = SPAWN_STRDUP(value);
+    atexit(spawn_trace_exit);
+    enabled = 1;
+  }
+
+  /* spawn_trace_start may have turned tracing on already */
+  if (spawn_trace_enabled < 0) {
+    spawn_trace_enabled = enabled;
+  }
+}
+
+static void spawn_trace_mhz_init(void)
+{
+  spawn_trace_mhz = spawn_clock_cpu_mhz();
+  if (spawn_trace_mhz <= 0.0) {
+    SPAWN_ERR("Failed to measure clock rate for trace time stamps");
+    spawn_trace_mhz = 1.0;
+  }
+}
+
+/* convert cycle count to local time in nanoseconds */
+static int64_t spawn_trace_cycles_ns(uint64_t cycles)
+{
+  pthread_once(&spawn_trace_mhz_once, spawn_trace_mhz_init);
+  double ns = (double) (int64_t) (cycles - spawn_trace_cycles0) * 1000.0 / spawn_trace_mhz;
+  return spawn_trace_ns0 + (int64_t) ns;
+}
+
+/* allocate ring for calling thread */
+static spawn_trace_buf* spawn_trace_buf_new(void)
+{
+  spawn_trace_buf* buf = (spawn_trace_buf*) SPAWN_MALLOC(sizeof(spawn_trace_buf));
+  buf->recs  = (spawn_trace_rec*) SPAWN_MALLOC(spawn_trace_size * sizeof(spawn_trace_rec));
+  buf->count = 0;
+  buf->tid   = __atomic_fetch_add(&spawn_trace_next_tid, 1, __ATOMIC_RELAXED);
+
+  buf->next = __atomic_load_n(&spawn_trace_bufs, __ATOMIC_ACQUIRE);
+  while (! __atomic_compare_exchange_n(&spawn_trace_bufs, &buf->next, buf,
+      0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+  {
+    /* buf->next now holds the new head, try again */
+  }
+
+  spawn_trace_mine = buf;
+  return buf;
+}
+
+void spawn_trace_event(spawn_trace_type type, const char* name, int64_t arg)
+{
+  if (spawn_trace_enabled < 0) {
+    pthread_once(&spawn_trace_once, spawn_trace_init);
+  }
+  if (spawn_trace_enabled <= 0) {
+    return;
+  }
+
+  spawn_trace_buf* buf = spawn_trace_mine;
+  if (buf == NULL) {
+    buf = spawn_trace_buf_new();
+  }
+
+  uint64_t count = buf->count;
+  spawn_trace_rec* rec = &buf->recs[count & (spawn_trace_size - 1)];
+  rec->cycles = (uint64_t) get_cycles();
+  rec->name   = name;
+  rec->arg    = arg;
+  rec->type   = (int64_t) type;
+  __atomic_store_n(&buf->count, count + 1, __ATOMIC_RELEASE);
+}
+
+int spawn_trace_start(void)
+{
+  spawn_trace_enabled = 1;
+  pthread_once(&spawn_trace_once, spawn_trace_init);
+  return SPAWN_SUCCESS;
+}
+
+int spawn_trace_stop(void)
+{
+  pthread_once(&spawn_trace_once, spawn_trace_init);
+  spawn_trace_enabled = 0;
+  return SPAWN_SUCCESS;
+}
+
+int spawn_trace_rank(int64_t rank)
+{
+  spawn_trace_pid = rank;
+  return SPAWN_SUCCESS;
+}
+
+int64_t spawn_trace_time_ns(void)
+{
+  pthread_once(&spawn_trace_once, spawn_trace_init);
+  return spawn_trace_cycles_ns((uint64_t) get_cycles());
+}
+
+int spawn_trace_set_clock(int64_t offset, double drift, int64_t base)
+{
+  spawn_trace_offset = offset;
+  spawn_trace_drift  = drift;
+  spawn_trace_base   = base;
+  return SPAWN_SUCCESS;
+}
+
+int spawn_trace_get_clock(int64_t* offset, double* drift, int64_t* base)
+{
+  *offset = spawn_trace_offset;
+  *drift  = spawn_trace_drift;
+  *base   = spawn_trace_base;
+  return SPAWN_SUCCESS;
+}
+
+int spawn_trace_dump(const char* path)
+{
+  pthread_once(&spawn_trace_once, spawn_trace_init);
+
+  FILE* fp = fopen(path, "w");
+  if (fp == NULL) {
+    SPAWN_ERR("Failed to open %s (fopen() errno=%d %s)", path, errno, strerror(errno));
+    return SPAWN_FAILURE;
+  }
+
+  spawn_trace_buf* buf = __atomic_load_n(&spawn_trace_bufs, __ATOMIC_ACQUIRE);
+
+  char host[HOST_NAME_MAX + 1];
+  if (gethostname(host, sizeof(host)) < 0) {
+    strcpy(host, "unknown");
+  }
+  host[HOST_NAME_MAX] = '\0';
+
+  long long pid = (spawn_trace_pid >= 0) ? (long long) spawn_trace_pid : (long long) getpid();
+  fprintf(fp, "{\"traceEvents\":[\n");
+  fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%lld,\"tid\":0,"
+    "\"args\":{\"name\":\"%s:%d\"}}", pid, host, (int) getpid()
+  );
+
+  while (buf != NULL) {
+    /* take the newest events, up to the size of the ring */
+    uint64_t count = __atomic_load_n(&buf->count, __ATOMIC_ACQUIRE);
+    uint64_t first = (count > spawn_trace_size) ? count - spawn_trace_size : 0;
+    uint64_t i;
+    for (i = first; i < count; i++) {
+      const spawn_trace_rec* rec = &buf->recs[i & (spawn_trace_size - 1)];
+      int64_t t  = spawn_trace_cycles_ns(rec->cycles);
+      int64_t ts = t + spawn_trace_offset + (int64_t) (spawn_trace_drift * (double) (t - spawn_trace_base));
+      const char* ph = "i";
+      if (rec->type == SPAWN_TRACE_TYPE_BEGIN) {
+        ph = "B";
+      } else if (rec->type == SPAWN_TRACE_TYPE_END) {
+        ph = "E";
+      }
+      fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"%s\",%s\"pid\":%lld,\"tid\":%lld,\"ts\":%lld.%03lld,"
+        "\"args\":{\"arg\":%lld}}",
+        rec->name, ph, (rec->type == SPAWN_TRACE_TYPE_INSTANT) ? "\"s\":\"t\"," : "",
+        pid, (long long) buf->tid, (long long) (ts / 1000), (long long) (ts % 1000),
+        (long long) rec->arg
+      );
+    }
+    buf = buf->next;
+  }
+
+  fprintf(fp, "\n],\"displayTimeUnit\":\"ns\"}\n");
+
+  if (fclose(fp) != 0) {
+    SPAWN_ERR("Failed to write %s (fclose() errno=%d %s)", path, errno, strerror(errno));
+    return SPAWN_FAILURE;
+  }
+
+  return SPAWN_SUCCESS;
+}
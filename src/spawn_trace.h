@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667277.
+ * All rights reserved.
+ * This file is part of the SpawnNet library.
+ * For details, see https://github.com/hpc/spawnnet
+ * Please also read the LICENSE file.
+*/
+
+#ifndef SPAWN_TRACE_H
+#define SPAWN_TRACE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Tracing records begin, end, and instant events into a ring buffer
+ * per thread, and writes them out in Chrome trace JSON format, which
+ * chrome://tracing and ui.perfetto.dev can open.  It is off unless
+ * $SPAWN_TRACE is set, in which case each process writes its events
+ * to $SPAWN_TRACE.<host>.<pid>.json when it exits.  Files from all
+ * procs of a job can be merged with
+ *
+ *   jq -s '{traceEvents: map(.traceEvents) | add}' prefix.*.json
+ *
+ * $SPAWN_TRACE_EVENTS sets the number of events each thread keeps,
+ * once full a thread overwrites its oldest events.  When tracing is
+ * off, each trace point costs one load and branch. */
+
+typedef enum spawn_trace_type_enum {
+  SPAWN_TRACE_TYPE_BEGIN   = 0, /* start of a span */
+  SPAWN_TRACE_TYPE_END     = 1, /* end of span started by most recent begin */
+  SPAWN_TRACE_TYPE_INSTANT = 2, /* point in time */
+} spawn_trace_type;
+
+/* positive when tracing, zero when not, negative until first checked */
+extern int spawn_trace_enabled;
+
+/* record an event, name must be a string constant */
+void spawn_trace_event(spawn_trace_type type, const char* name, int64_t arg);
+
+#define SPAWN_TRACE_BEGIN(name, arg) \
+    do { if (spawn_trace_enabled) { spawn_trace_event(SPAWN_TRACE_TYPE_BEGIN, name, arg); } } while (0)
+#define SPAWN_TRACE_END(name, arg) \
+    do { if (spawn_trace_enabled) { spawn_trace_event(SPAWN_TRACE_TYPE_END, name, arg); } } while (0)
+#define SPAWN_TRACE_INSTANT(name, arg) \
+    do { if (spawn_trace_enabled) { spawn_trace_event(SPAWN_TRACE_TYPE_INSTANT, name, arg); } } while (0)
+
+/* start recording events even if $SPAWN_TRACE is not set */
+int spawn_trace_start(void);
+
+/* stop recording events, those already recorded are kept */
+int spawn_trace_stop(void);
+
+/* label events from this process with rank rather than its pid,
+ * so merged traces show one row per rank */
+int spawn_trace_rank(int64_t rank);
+
+/* returns nanoseconds since the epoch on the clock that stamps events */
+int64_t spawn_trace_time_ns(void);
+
+/* write each event time t as t + offset + drift * (t - base), times
+ * in nanoseconds, lwgrp_clock_sync sets this to align events with the
+ * clock of a root process */
+int spawn_trace_set_clock(int64_t offset, double drift, int64_t base);
+
+/* returns values last given to spawn_trace_set_clock, all zero if none */
+int spawn_trace_get_clock(int64_t* offset, double* drift, int64_t* base);
+
+/* write events recorded so far to path as Chrome trace JSON,
+ * best called while other threads are not recording */
+int spawn_trace_dump(const char* path);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* SPAWN_TRACE_H */
@@ -0,0 +1,441 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667277.
+ * All rights reserved.
+ * This file is part of the SpawnNet library.
+ * For details, see https://github.com/hpc/spawnnet
+ * Please also read the LICENSE file.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "spawn_internal.h"
+#include "spawn_tree.h"
+
+/* The children of rank r are ranks r*k+1 through r*k+k.  The root
+ * records everything agents need in a spec map:
+ *   SIZE, DEGREE - shape of tree
+ *   EXE, RSH     - program to start and remote shell command
+ *   HOST<rank>   - host of each agent, if not forked locally
+ *   ARGC, ARG<i> - arguments given to agents
+ *   ENV:<name>   - environment variables set in agents
+ * Each proc forwards the spec to its children unchanged.  Agents
+ * open the same type of endpoint as their parent, which they need
+ * before they connect, since a FIFO connection names both ends.
+ *
+ * Once its subtree is ready, each agent sends its parent a status
+ * word, 1 if every agent below it started and 0 otherwise, followed
+ * by the endpoint names of its subtree.  Each level ANDs the status
+ * of its children with its own, so the launcher learns whether the
+ * whole tree started.  A parent only waits on children whose exec
+ * succeeded, which it learns from a close-on-exec pipe that the
+ * child writes errno to if exec fails. */
+
+/* names of environment variables that tell an agent where to connect */
+#define SPAWN_TREE_ENV_PARENT "SPAWN_TREE_PARENT"
+#define SPAWN_TREE_ENV_RANK   "SPAWN_TREE_RANK"
+
+/* prefix of spec keys holding environment variables */
+#define SPAWN_TREE_ENV_PREFIX "ENV:"
+
+struct spawn_tree_t {
+  int64_t rank;                 /* our rank in tree */
+  int64_t size;                 /* number of procs in tree */
+  int64_t degree;               /* max number of children per proc */
+  spawn_net_endpoint* ep;       /* our endpoint */
+  spawn_net_channel* parent;    /* channel to our parent, NULL on root */
+  int64_t nchildren;            /* number of children we started */
+  spawn_net_channel** children; /* channel to each child */
+  pid_t* pids;                  /* pid of each child */
+  strmap* spec;                 /* program, arguments, and environment */
+  strmap* names;                /* endpoint names of all agents, root only */
+  int argc;                     /* number of arguments for agents */
+  const char** argv;            /* arguments for agents, points into spec */
+};
+
+/* allocate tree and read fields from spec */
+static spawn_tree* spawn_tree_new(int64_t rank, strmap* spec)
+{
+  spawn_tree* tree = (spawn_tree*) SPAWN_MALLOC(sizeof(spawn_tree));
+  tree->rank      = rank;
+  tree->size      = (int64_t) strtoll(strmap_get(spec, "SIZE"),   NULL, 10);
+  tree->degree    = (int64_t) strtoll(strmap_get(spec, "DEGREE"), NULL, 10);
+  tree->ep        = SPAWN_NET_ENDPOINT_NULL;
+  tree->parent    = SPAWN_NET_CHANNEL_NULL;
+  tree->nchildren = 0;
+  tree->children  = NULL;
+  tree->pids      = NULL;
+  tree->spec      = spec;
+  tree->names     = NULL;
+
+  /* point argv at values in spec */
+  tree->argc = atoi(strmap_get(spec, "ARGC"));
+  tree->argv = (const char**) SPAWN_MALLOC((tree->argc + 1) * sizeof(char*));
+  int i;
+  for (i = 0; i < tree->argc; i++) {
+    tree->argv[i] = strmap_getf(spec, "ARG%d", i);
+  }
+  tree->argv[tree->argc] = NULL;
+
+  /* count our children */
+  int64_t first = rank * tree->degree + 1;
+  int64_t count = tree->size - first;
+  if (count > tree->degree) {
+    count = tree->degree;
+  }
+  if (count > 0) {
+    tree->nchildren = count;
+    tree->children  = (spawn_net_channel**) SPAWN_MALLOC(count * sizeof(spawn_net_channel*));
+    tree->pids      = (pid_t*) SPAWN_MALLOC(count * sizeof(pid_t));
+    for (i = 0; i < count; i++) {
+      tree->children[i] = SPAWN_NET_CHANNEL_NULL;
+      tree->pids[i]     = -1;
+    }
+  }
+
+  return tree;
+}
+
+/* fork and exec child with given rank, directly or through the
+ * remote shell, returns pid of child or -1 if it failed to start */
+static pid_t spawn_tree_exec(const spawn_tree* tree, int64_t child)
+{
+  const char* exe  = strmap_get(tree->spec, "EXE");
+  const char* rsh  = strmap_get(tree->spec, "RSH");
+  const char* host = strmap_getf(tree->spec, "HOST%lld", (long long) child);
+
+  char* parent_str = SPAWN_STRDUPF("%s=%s",   SPAWN_TREE_ENV_PARENT, spawn_net_name(tree->ep));
+  char* rank_str   = SPAWN_STRDUPF("%s=%lld", SPAWN_TREE_ENV_RANK, (long long) child);
+
+  /* the child writes errno to this pipe if exec fails,
+   * otherwise exec closes it */
+  int fds[2];
+  if (pipe2(fds, O_CLOEXEC) < 0) {
+    SPAWN_ERR("Failed to create pipe (pipe2() errno=%d %s)", errno, strerror(errno));
+    spawn_free(&rank_str);
+    spawn_free(&parent_str);
+    return -1;
+  }
+
+  /* the transports mark their descriptors close-on-exec,
+   * so the agent inherits none of our channels */
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(fds[0]);
+    if (host == NULL || rsh == NULL) {
+      /* start agent locally */
+      putenv(parent_str);
+      putenv(rank_str);
+      execl(exe, exe, (char*) NULL);
+    } else {
+      /* start agent on its host, passing our variables through env */
+      execlp(rsh, rsh, host, "env", parent_str, rank_str, exe, (char*) NULL);
+    }
+    int err = errno;
+    SPAWN_ERR("Failed to start agent %lld `%s' (exec() errno=%d %s)",
+      (long long) child, exe, err, strerror(err)
+    );
+    ssize_t n = write(fds[1], &err, sizeof(err));
+    (void) n;
+    _exit(1);
+  } else if (pid < 0) {
+    SPAWN_ERR("Failed to fork agent %lld (fork() errno=%d %s)",
+      (long long) child, errno, strerror(errno)
+    );
+  }
+  close(fds[1]);
+
+  /* wait for exec to close the pipe, if we read an errno instead,
+   * the child never became an agent, so reap it now */
+  if (pid > 0) {
+    int err;
+    ssize_t n;
+    do {
+      n = read(fds[0], &err, sizeof(err));
+    } while (n < 0 && errno == EINTR);
+    if (n > 0) {
+      waitpid(pid, NULL, 0);
+      pid = -1;
+    }
+  }
+  close(fds[0]);
+
+  spawn_free(&rank_str);
+  spawn_free(&parent_str);
+
+  return pid;
+}
+
+/* write status of our subtree to parent */
+static void spawn_tree_write_status(const spawn_net_channel* ch, int status)
+{
+  uint64_t status_net;
+  spawn_pack_uint64(&status_net, (uint64_t) status);
+  spawn_net_write(ch, &status_net, sizeof(status_net));
+}
+
+/* read status of subtree from child, returns 0 if child failed
+ * or if we lost the connection */
+static int spawn_tree_read_status(const spawn_net_channel* ch)
+{
+  uint64_t status_net;
+  if (spawn_net_read(ch, &status_net, sizeof(status_net)) != SPAWN_SUCCESS) {
+    return 0;
+  }
+  uint64_t status;
+  spawn_unpack_uint64(&status_net, &status);
+  return (status != 0);
+}
+
+/* start our children, send them the spec, and wait for the names of
+ * their subtrees, adds names of our subtree including ourself,
+ * returns SPAWN_FAILURE if any agent in our subtree failed to start */
+static int spawn_tree_start(spawn_tree* tree, strmap* names)
+{
+  int rc = SPAWN_SUCCESS;
+
+  /* start all children before waiting on any of them */
+  int64_t first = tree->rank * tree->degree + 1;
+  int64_t started = 0;
+  int64_t i;
+  for (i = 0; i < tree->nchildren; i++) {
+    tree->pids[i] = spawn_tree_exec(tree, first + i);
+    if (tree->pids[i] < 0) {
+      rc = SPAWN_FAILURE;
+    } else {
+      started++;
+    }
+  }
+
+  /* children that started connect in any order and tell us their
+   * rank, we still serve them if a sibling failed so that they
+   * don't hang waiting on us */
+  for (i = 0; i < started; i++) {
+    spawn_net_channel* ch = spawn_net_accept(tree->ep);
+    if (ch == SPAWN_NET_CHANNEL_NULL) {
+      SPAWN_ERR("Failed to accept connection from agent");
+      return SPAWN_FAILURE;
+    }
+    char* rank_str = spawn_net_read_str(ch);
+    int64_t index = -1;
+    if (rank_str != NULL) {
+      index = (int64_t) strtoll(rank_str, NULL, 10) - first;
+    }
+    spawn_free(&rank_str);
+    if (index < 0 || index >= tree->nchildren || tree->children[index] != NULL) {
+      SPAWN_ERR("Unexpected connection from agent");
+      spawn_net_disconnect(&ch);
+      return SPAWN_FAILURE;
+    }
+    tree->children[index] = ch;
+
+    /* get the child going on its own subtree right away */
+    spawn_net_write_strmap(ch, tree->spec);
+  }
+
+  /* each child reports once its subtree is ready */
+  for (i = 0; i < tree->nchildren; i++) {
+    spawn_net_channel* ch = tree->children[i];
+    if (ch == SPAWN_NET_CHANNEL_NULL) {
+      continue;
+    }
+    if (! spawn_tree_read_status(ch)) {
+      rc = SPAWN_FAILURE;
+    }
+    spawn_net_read_strmap(ch, names);
+  }
+  strmap_setf(names, "%lld=%s", (long long) tree->rank, spawn_net_name(tree->ep));
+
+  return rc;
+}
+
+spawn_tree* spawn_tree_launch(
+  int64_t count,
+  int64_t degree,
+  const char** hosts,
+  const char* rsh,
+  const char* exe,
+  int argc,
+  const char** argv,
+  const strmap* env,
+  spawn_net_type type)
+{
+  /* a degree less than 1 makes no sense */
+  if (degree < 1) {
+    degree = 1;
+  }
+
+  /* record everything agents need */
+  strmap* spec = strmap_new();
+  strmap_setf(spec, "SIZE=%lld",   (long long) (count + 1));
+  strmap_setf(spec, "DEGREE=%lld", (long long) degree);
+  strmap_set(spec, "EXE", exe);
+  if (rsh != NULL) {
+    strmap_set(spec, "RSH", rsh);
+  }
+  int64_t i;
+  if (hosts != NULL) {
+    for (i = 0; i < count; i++) {
+      strmap_setf(spec, "HOST%lld=%s", (long long) (i + 1), hosts[i]);
+    }
+  }
+  strmap_setf(spec, "ARGC=%d", argc);
+  for (i = 0; i < argc; i++) {
+    strmap_setf(spec, "ARG%d=%s", (int) i, argv[i]);
+  }
+  if (env != NULL) {
+    strmap_node* node;
+    for (node = strmap_node_first(env); node != NULL; node = strmap_node_next(node)) {
+      strmap_setf(spec, "%s%s=%s", SPAWN_TREE_ENV_PREFIX,
+        strmap_node_key(node), strmap_node_value(node)
+      );
+    }
+  }
+
+  spawn_tree* tree = spawn_tree_new(0, spec);
+  tree->ep = spawn_net_open(type);
+  tree->names = strmap_new();
+  if (spawn_tree_start(tree, tree->names) != SPAWN_SUCCESS) {
+    SPAWN_ERR("Failed to launch agents");
+    spawn_tree_free(&tree);
+    return NULL;
+  }
+
+  return tree;
+}
+
+spawn_tree* spawn_tree_join(void)
+{
+  const char* parent = getenv(SPAWN_TREE_ENV_PARENT);
+  const char* rank_str = getenv(SPAWN_TREE_ENV_RANK);
+  if (parent == NULL || rank_str == NULL) {
+    return NULL;
+  }
+
+  /* tell our parent who we are and get the spec */
+  spawn_net_endpoint* ep = spawn_net_open(spawn_net_infer_type(parent));
+  spawn_net_channel* ch = spawn_net_connect(parent);
+  if (ch == SPAWN_NET_CHANNEL_NULL) {
+    SPAWN_ERR("Failed to connect to parent agent at %s", parent);
+    spawn_net_close(&ep);
+    return NULL;
+  }
+  spawn_net_write_str(ch, rank_str);
+  strmap* spec = strmap_new();
+  spawn_net_read_strmap(ch, spec);
+  if (strmap_get(spec, "SIZE") == NULL) {
+    SPAWN_ERR("Failed to read spec from parent agent at %s", parent);
+    strmap_delete(&spec);
+    spawn_net_disconnect(&ch);
+    spawn_net_close(&ep);
+    return NULL;
+  }
+
+  spawn_tree* tree = spawn_tree_new((int64_t) strtoll(rank_str, NULL, 10), spec);
+  tree->ep     = ep;
+  tree->parent = ch;
+
+  /* procs we start later should not think they are agents */
+  unsetenv(SPAWN_TREE_ENV_PARENT);
+  unsetenv(SPAWN_TREE_ENV_RANK);
+
+  /* set environment given by the launcher */
+  size_t prefix_len = strlen(SPAWN_TREE_ENV_PREFIX);
+  strmap_node* node;
+  for (node = strmap_node_first(spec); node != NULL; node = strmap_node_next(node)) {
+    const char* key = strmap_node_key(node);
+    if (strncmp(key, SPAWN_TREE_ENV_PREFIX, prefix_len) == 0) {
+      setenv(key + prefix_len, strmap_node_value(node), 1);
+    }
+  }
+
+  /* start our subtree and report to our parent once it is ready */
+  strmap* names = strmap_new();
+  int status = 1;
+  if (spawn_tree_start(tree, names) != SPAWN_SUCCESS) {
+    SPAWN_ERR("Failed to launch agents under rank %lld", (long long) tree->rank);
+    status = 0;
+  }
+  spawn_tree_write_status(ch, status);
+  spawn_net_write_strmap(ch, names);
+  strmap_delete(&names);
+
+  return tree;
+}
+
+int spawn_tree_free(spawn_tree** ptree)
+{
+  if (ptree == NULL) {
+    return SPAWN_FAILURE;
+  }
+
+  spawn_tree* tree = *ptree;
+  if (tree == NULL) {
+    return SPAWN_SUCCESS;
+  }
+
+  /* each child waits on its own children before it exits */
+  int rc = SPAWN_SUCCESS;
+  int64_t i;
+  for (i = 0; i < tree->nchildren; i++) {
+    spawn_net_disconnect(&tree->children[i]);
+  }
+  for (i = 0; i < tree->nchildren; i++) {
+    if (tree->pids[i] > 0) {
+      int status;
+      waitpid(tree->pids[i], &status, 0);
+      if (! WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        rc = SPAWN_FAILURE;
+      }
+    }
+  }
+  spawn_net_disconnect(&tree->parent);
+  spawn_net_close(&tree->ep);
+
+  strmap_delete(&tree->names);
+  strmap_delete(&tree->spec);
+  spawn_free(&tree->argv);
+  spawn_free(&tree->pids);
+  spawn_free(&tree->children);
+  spawn_free(ptree);
+
+  return rc;
+}
+
+int64_t spawn_tree_rank(const spawn_tree* tree)
+{
+  return tree->rank;
+}
+
+int64_t spawn_tree_size(const spawn_tree* tree)
+{
+  return tree->size;
+}
+
+spawn_net_endpoint* spawn_tree_ep(const spawn_tree* tree)
+{
+  return tree->ep;
+}
+
+int spawn_tree_args(const spawn_tree* tree, int* argc, const char*** argv)
+{
+  *argc = tree->argc;
+  *argv = tree->argv;
+  return SPAWN_SUCCESS;
+}
+
+const strmap* spawn_tree_names(const spawn_tree* tree)
+{
+  return tree->names;
+}
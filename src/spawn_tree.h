@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2015, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-667277.
+ * All rights reserved.
+ * This file is part of the SpawnNet library.
+ * For details, see https://github.com/hpc/spawnnet
+ * Please also read the LICENSE file.
+*/
+
+#ifndef SPAWN_TREE_H
+#define SPAWN_TREE_H
+
+#include <stdint.h>
+#include "strmap.h"
+#include "spawn_net.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The launch tree starts agents in a tree of degree k rooted at the
+ * launcher, which is rank 0.  Each proc starts its own children with
+ * fork and exec, or through a remote shell command such as ssh when
+ * the agent has a host, and passes its endpoint name so they connect
+ * back to it.  The program, arguments, and environment travel down
+ * the tree as packed strmaps, and endpoint names of all agents travel
+ * back up once the subtree of each agent is ready, so starting N agents
+ * takes O(log_k N) steps.  An agent learns it was started by the
+ * tree through $SPAWN_TREE_PARENT and $SPAWN_TREE_RANK. */
+
+/* handle to our place in a launch tree */
+typedef struct spawn_tree_t spawn_tree;
+
+/* launch count agents running exe with args and extra environment
+ * variables from env, returns once all agents are ready, or NULL
+ * if any agent failed to start */
+spawn_tree* spawn_tree_launch(
+  int64_t count,      /* number of agents to start */
+  int64_t degree,     /* number of children per proc in tree */
+  const char** hosts, /* host of each agent, NULL to fork all locally */
+  const char* rsh,    /* remote shell command to reach hosts, e.g., "ssh" */
+  const char* exe,    /* path to agent executable */
+  int argc,           /* number of arguments in argv */
+  const char** argv,  /* arguments given to agents */
+  const strmap* env,  /* extra environment variables given to agents */
+  spawn_net_type type /* type of endpoint agents open */
+);
+
+/* join the launch tree that started us, to be called early by each
+ * agent, returns NULL if we were not started by a launch tree */
+spawn_tree* spawn_tree_join(void);
+
+/* disconnect from tree and wait for our children to exit */
+int spawn_tree_free(spawn_tree** ptree);
+
+/* returns our rank in tree, the launcher is rank 0 */
+int64_t spawn_tree_rank(const spawn_tree* tree);
+
+/* returns number of procs in tree including the launcher */
+int64_t spawn_tree_size(const spawn_tree* tree);
+
+/* returns our endpoint, which agents may use for other traffic */
+spawn_net_endpoint* spawn_tree_ep(const spawn_tree* tree);
+
+/* returns number of arguments given to agents and a NULL-terminated
+ * list of them, valid until the tree is freed */
+int spawn_tree_args(const spawn_tree* tree, int* argc, const char*** argv);
+
+/* returns map from rank to endpoint name of each agent, only valid
+ * on the launcher, NULL elsewhere */
+const strmap* spawn_tree_names(const spawn_tree* tree);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* SPAWN_TREE_H */
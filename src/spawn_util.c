@@ -14,6 +14,7 @@
 #include <unistd.h>
 #include <time.h>
 #include <errno.h>
+#include <malloc.h>
 
 #include "spawn_internal.h"
 
@@ -142,6 +143,75 @@ void spawn_exit(int code)
   exit(code);
 }
 
+/* Allocations are tallied by the source file that made them.  Each
+ * file gets a slot in a fixed table, found by hashing the pointer to
+ * its __FILE__ string and claimed with compare-and-swap, and the last
+ * slot takes whatever does not fit.  Without a header on each block,
+ * frees cannot be charged back to a file, so they are only totaled. */
+#define SPAWN_ALLOC_TAGS (128)
+
+typedef struct spawn_alloc_tag_t {
+  const char* file; /* __FILE__ of caller, NULL if slot is unused */
+  uint64_t calls;   /* number of allocations */
+  uint64_t bytes;   /* usable bytes allocated */
+} spawn_alloc_tag;
+
+static spawn_alloc_tag spawn_alloc_tags[SPAWN_ALLOC_TAGS];
+static uint64_t spawn_free_calls = 0;
+static uint64_t spawn_free_bytes = 0;
+
+static void spawn_alloc_count(const char* file, void* ptr)
+{
+  uint64_t bytes = (uint64_t) malloc_usable_size(ptr);
+
+  uint64_t hash = (uint64_t) (uintptr_t) file;
+  hash = (hash ^ (hash >> 17)) * 0x9e3779b97f4a7c15ULL;
+
+  spawn_alloc_tag* tag = &spawn_alloc_tags[SPAWN_ALLOC_TAGS - 1];
+  int i;
+  for (i = 0; i < SPAWN_ALLOC_TAGS - 1; i++) {
+    spawn_alloc_tag* slot = &spawn_alloc_tags[(hash + i) % (SPAWN_ALLOC_TAGS - 1)];
+    const char* slot_file = __atomic_load_n(&slot->file, __ATOMIC_ACQUIRE);
+    if (slot_file == NULL) {
+      /* try to claim empty slot, we may lose to a racing thread */
+      __atomic_compare_exchange_n(&slot->file, &slot_file, file,
+        0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE
+      );
+      slot_file = __atomic_load_n(&slot->file, __ATOMIC_ACQUIRE);
+    }
+    if (slot_file == file) {
+      tag = slot;
+      break;
+    }
+  }
+
+  __atomic_fetch_add(&tag->calls, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&tag->bytes, bytes, __ATOMIC_RELAXED);
+}
+
+int spawn_alloc_stats(int index, const char** file, uint64_t* calls, uint64_t* bytes)
+{
+  if (index < 0 || index >= SPAWN_ALLOC_TAGS) {
+    return SPAWN_FAILURE;
+  }
+
+  spawn_alloc_tag* tag = &spawn_alloc_tags[index];
+  *calls = __atomic_load_n(&tag->calls, __ATOMIC_RELAXED);
+  *bytes = __atomic_load_n(&tag->bytes, __ATOMIC_RELAXED);
+  *file  = __atomic_load_n(&tag->file, __ATOMIC_ACQUIRE);
+  if (index == SPAWN_ALLOC_TAGS - 1 && *calls > 0) {
+    *file = "other";
+  }
+  return SPAWN_SUCCESS;
+}
+
+int spawn_free_stats(uint64_t* calls, uint64_t* bytes)
+{
+  *calls = __atomic_load_n(&spawn_free_calls, __ATOMIC_RELAXED);
+  *bytes = __atomic_load_n(&spawn_free_bytes, __ATOMIC_RELAXED);
+  return SPAWN_SUCCESS;
+}
+
 /* allocate size bytes, returns NULL if size == 0,
  * fatal error if allocation fails */
 void* spawn_malloc(size_t size, const char* file, int line)
@@ -154,6 +224,7 @@ void* spawn_malloc(size_t size, const char* file, int line)
       spawn_err(file, line, "Failed to allocate %llu bytes", (unsigned long long) size);
       spawn_exit(1);
     }
+    spawn_alloc_count(file, ptr);
   }
   return ptr;
 }
@@ -168,6 +239,7 @@ char* spawn_strdup(const char* file, int line, const char* origstr)
       spawn_err(file, line, "Failed to allocate string (strdup() errno=%d %s)", errno, strerror(errno));
       spawn_exit(1);
     }
+    spawn_alloc_count(file, str);
   }
   return str;
 }
@@ -207,6 +279,8 @@ void spawn_free(void* arg_pptr)
     /* get pointer to memory and call free if it's not NULL*/
     void* ptr = *pptr;
     if (ptr != NULL) {
+      __atomic_fetch_add(&spawn_free_calls, 1, __ATOMIC_RELAXED);
+      __atomic_fetch_add(&spawn_free_bytes, (uint64_t) malloc_usable_size(ptr), __ATOMIC_RELAXED);
       free(ptr);
     }
 
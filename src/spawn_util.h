@@ -80,6 +80,14 @@ char* spawn_strdupf(const char* file, int line, const char* format, ...);
  * it's ok to call with pptr == NULL or *pptr == NULL */
 void spawn_free(void* pptr);
 
+/* get allocation totals of tag at index, tags are the source files
+ * that called spawn_malloc or spawn_strdup, sets file to NULL if the
+ * slot is unused, returns SPAWN_FAILURE once index is past the end */
+int spawn_alloc_stats(int index, const char** file, uint64_t* calls, uint64_t* bytes);
+
+/* get number of calls to spawn_free and bytes they released */
+int spawn_free_stats(uint64_t* calls, uint64_t* bytes);
+
 #ifdef __cplusplus
 }
 #endif
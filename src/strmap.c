@@ -47,11 +47,11 @@ static strmap_node* strmap_node_new(const char* key, const char* value)
     node->right     = NULL;
 
     if (key != NULL) {
-      node->key = strdup(key);
+      node->key = SPAWN_STRDUP(key);
       node->key_len = strlen(key) + 1;
     }
     if (value != NULL) {
-      node->value = strdup(value);
+      node->value = SPAWN_STRDUP(value);
       node->value_len = strlen(value) + 1;
     }
     if (node->key == NULL || node->value == NULL) {
@@ -89,15 +89,24 @@ static int strmap_node_delete(strmap_node* node)
   return STRMAP_SUCCESS;
 }
 
+/* number of maps allocated and not yet deleted */
+static uint64_t strmap_live = 0;
+
 /* allocates a new tree and initializes it as a single element */
 strmap* strmap_new()
 {
   strmap* tree = (strmap*) SPAWN_MALLOC(sizeof(strmap));
   tree->root = NULL;
   tree->len = 0;
+  __atomic_fetch_add(&strmap_live, 1, __ATOMIC_RELAXED);
   return tree;
 }
 
+uint64_t strmap_count_live()
+{
+  return __atomic_load_n(&strmap_live, __ATOMIC_RELAXED);
+}
+
 /* frees a tree */
 void strmap_delete(strmap** ptree)
 {
@@ -106,6 +115,7 @@ void strmap_delete(strmap** ptree)
     if (tree != NULL) {
       strmap_node_delete(tree->root);
       tree->root = NULL;
+      __atomic_fetch_sub(&strmap_live, 1, __ATOMIC_RELAXED);
     }
     spawn_free(&tree);
     *ptree = NULL;
@@ -128,6 +138,49 @@ void strmap_merge(strmap* dst, const strmap* src)
   return;
 }
 
+/* copies entries from src into dst, combining values of keys in both */
+void strmap_merge_combine(strmap* dst, const strmap* src, strmap_combine_fn fn)
+{
+  strmap_node* node;
+  for (node = strmap_node_first(src);
+       node != NULL;
+       node = strmap_node_next(node))
+  {
+    const char* key = strmap_node_key(node);
+    const char* val = strmap_node_value(node);
+    const char* current = strmap_get(dst, key);
+    if (current != NULL) {
+      char* combined = (*fn)(current, val);
+      strmap_set(dst, key, combined);
+      spawn_free(&combined);
+    } else {
+      strmap_set(dst, key, val);
+    }
+  }
+  return;
+}
+
+char* strmap_combine_sum(const char* dst_value, const char* src_value)
+{
+  long long a = strtoll(dst_value, NULL, 10);
+  long long b = strtoll(src_value, NULL, 10);
+  return SPAWN_STRDUPF("%lld", a + b);
+}
+
+char* strmap_combine_min(const char* dst_value, const char* src_value)
+{
+  long long a = strtoll(dst_value, NULL, 10);
+  long long b = strtoll(src_value, NULL, 10);
+  return SPAWN_STRDUPF("%lld", (b < a) ? b : a);
+}
+
+char* strmap_combine_max(const char* dst_value, const char* src_value)
+{
+  long long a = strtoll(dst_value, NULL, 10);
+  long long b = strtoll(src_value, NULL, 10);
+  return SPAWN_STRDUPF("%lld", (b > a) ? b : a);
+}
+
 /*
 =========================================
 set, get, unset functions
@@ -602,7 +655,7 @@ int strmap_set(strmap* tree, const char* key, const char* value)
 
       /* copy in the new value */
       if (value != NULL) {
-        node->value = strdup(value);
+        node->value = SPAWN_STRDUP(value);
         node->value_len = strlen(value) + 1;
       }
       tree->len += node->value_len;
@@ -16,6 +16,7 @@
  * stored as strings. */
 
 #include <stdarg.h>
+#include <stdint.h>
 #include <sys/types.h>
 #include <string.h>
 
@@ -65,9 +66,25 @@ strmap* strmap_new();
 /* frees a map */
 void strmap_delete(strmap** map);
 
+/* returns number of maps allocated and not yet deleted */
+uint64_t strmap_count_live();
+
 /* copies entries from src to dst strmap */
 void strmap_merge(strmap* dst, const strmap* src);
 
+/* combines two values for the same key, returns a newly allocated
+ * string that the caller frees with spawn_free */
+typedef char* (*strmap_combine_fn)(const char* dst_value, const char* src_value);
+
+/* copies entries from src to dst strmap, for keys in both maps
+ * the value is set to fn(dst value, src value) */
+void strmap_merge_combine(strmap* dst, const strmap* src, strmap_combine_fn fn);
+
+/* built-in combiners that treat values as signed 64-bit integers */
+char* strmap_combine_sum(const char* dst_value, const char* src_value);
+char* strmap_combine_min(const char* dst_value, const char* src_value);
+char* strmap_combine_max(const char* dst_value, const char* src_value);
+
 /*
 =========================================
 iterate over key/value pairs
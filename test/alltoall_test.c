@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mpi.h"
+
+#include "spawn_internal.h"
+#include "lwgrp.h"
+
+/* fill in value for byte i of the block rank src sends to rank dst */
+static char fill(int src, int dst, uint64_t i)
+{
+  return (char) ((src * 31 + dst * 17 + i) & 0xFF);
+}
+
+int main(int argc, char* argv[])
+{
+  MPI_Init(&argc, &argv);
+
+  int rank, ranks;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+
+  spawn_net_endpoint* ep = spawn_net_open(SPAWN_NET_TYPE_TCP);
+  const char* ep_name = spawn_net_name(ep);
+
+  /* gather endpoint names from all tasks */
+  char name[256];
+  strncpy(name, ep_name, sizeof(name));
+  name[sizeof(name) - 1] = '\0';
+  char* names = (char*) malloc(sizeof(name) * ranks);
+  MPI_Allgather(name, sizeof(name), MPI_CHAR, names, sizeof(name), MPI_CHAR, MPI_COMM_WORLD);
+
+  /* create group from left and right neighbors */
+  const char* left  = (rank > 0)         ? names + (rank - 1) * sizeof(name) : NULL;
+  const char* right = (rank < ranks - 1) ? names + (rank + 1) * sizeof(name) : NULL;
+  lwgrp* group = lwgrp_create(ranks, rank, ep_name, left, right, ep);
+
+  int errors = 0;
+
+  /* test alltoall with small and large blocks */
+  size_t sizes[2] = {16, 256 * 1024};
+  int s;
+  for (s = 0; s < 2; s++) {
+    size_t size = sizes[s];
+    char* sendbuf = (char*) malloc(size * ranks);
+    char* recvbuf = (char*) malloc(size * ranks);
+
+    int i;
+    uint64_t j;
+    for (i = 0; i < ranks; i++) {
+      for (j = 0; j < size; j++) {
+        sendbuf[i * size + j] = fill(rank, i, j);
+      }
+    }
+
+    lwgrp_alltoall(sendbuf, recvbuf, size, group);
+
+    for (i = 0; i < ranks; i++) {
+      for (j = 0; j < size; j++) {
+        if (recvbuf[i * size + j] != fill(i, rank, j)) {
+          errors++;
+        }
+      }
+    }
+
+    free(recvbuf);
+    free(sendbuf);
+  }
+
+  /* test alltoallv, rank i sends (i + dst) % 4 * 100 bytes to dst */
+  uint64_t* sendcounts = (uint64_t*) malloc(sizeof(uint64_t) * ranks);
+  uint64_t* senddispls = (uint64_t*) malloc(sizeof(uint64_t) * ranks);
+  uint64_t* recvcounts = (uint64_t*) malloc(sizeof(uint64_t) * ranks);
+  uint64_t* recvdispls = (uint64_t*) malloc(sizeof(uint64_t) * ranks);
+  uint64_t sendtotal = 0;
+  uint64_t recvtotal = 0;
+  int i;
+  for (i = 0; i < ranks; i++) {
+    sendcounts[i] = ((rank + i) % 4) * 100;
+    senddispls[i] = sendtotal;
+    sendtotal += sendcounts[i];
+    recvcounts[i] = ((i + rank) % 4) * 100;
+    recvdispls[i] = recvtotal;
+    recvtotal += recvcounts[i];
+  }
+
+  char* sendbuf = (char*) malloc(sendtotal + 1);
+  char* recvbuf = (char*) malloc(recvtotal + 1);
+  uint64_t j;
+  for (i = 0; i < ranks; i++) {
+    for (j = 0; j < sendcounts[i]; j++) {
+      sendbuf[senddispls[i] + j] = fill(rank, i, j);
+    }
+  }
+
+  lwgrp_alltoallv(sendbuf, sendcounts, senddispls, recvbuf, recvcounts, recvdispls, group);
+
+  for (i = 0; i < ranks; i++) {
+    for (j = 0; j < recvcounts[i]; j++) {
+      if (recvbuf[recvdispls[i] + j] != fill(i, rank, j)) {
+        errors++;
+      }
+    }
+  }
+
+  free(recvbuf);
+  free(sendbuf);
+  free(recvdispls);
+  free(recvcounts);
+  free(senddispls);
+  free(sendcounts);
+
+  if (errors > 0) {
+    printf("%d: %d errors\n", rank, errors);
+  }
+
+  int all_errors;
+  MPI_Allreduce(&errors, &all_errors, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+  if (rank == 0) {
+    printf("%s\n", (all_errors == 0) ? "PASSED" : "FAILED");
+  }
+
+  lwgrp_free(&group);
+  free(names);
+  spawn_net_close(&ep);
+
+  MPI_Finalize();
+  return 0;
+}
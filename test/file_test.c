@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mpi.h"
+
+#include "spawn_internal.h"
+#include "lwgrp.h"
+
+/* larger than the chunks sent down the tree,
+ * and not a multiple of them */
+#define FILE_SIZE (5 * 1024 * 1024 / 2 + 7)
+
+/* value of byte i of the test file */
+static char fill(size_t i)
+{
+  return (char) ('a' + (i * 7 + i / 4096) % 26);
+}
+
+/* write size bytes of test data to path */
+static void create(const char* path, size_t size)
+{
+  FILE* fp = fopen(path, "w");
+  size_t i;
+  for (i = 0; i < size; i++) {
+    fputc(fill(i), fp);
+  }
+  fclose(fp);
+}
+
+/* returns number of errors in file at path,
+ * which should hold size bytes of test data */
+static int check(int rank, const char* path, size_t size)
+{
+  FILE* fp = fopen(path, "r");
+  if (fp == NULL) {
+    printf("%d: missing %s\n", rank, path);
+    return 1;
+  }
+
+  int errors = 0;
+  size_t i = 0;
+  int c;
+  while ((c = fgetc(fp)) != EOF) {
+    if (i >= size || (char) c != fill(i)) {
+      printf("%d: wrong data in %s at %llu\n", rank, path, (unsigned long long) i);
+      errors++;
+      break;
+    }
+    i++;
+  }
+  if (errors == 0 && i != size) {
+    printf("%d: %s has %llu bytes, expected %llu\n",
+      rank, path, (unsigned long long) i, (unsigned long long) size
+    );
+    errors++;
+  }
+  fclose(fp);
+
+  return errors;
+}
+
+/* broadcast file of size bytes from rank 0 to dest on every node,
+ * returns number of errors */
+static int test_bcast(int rank, const char* src, const char* dest, size_t size, const lwgrp* group)
+{
+  int errors = 0;
+
+  if (rank == 0) {
+    create(src, size);
+  }
+
+  if (lwgrp_bcast_file(src, dest, 0, group) != LWGRP_SUCCESS) {
+    errors++;
+  }
+  errors += check(rank, dest, size);
+
+  /* procs on a node share dest, so wait for all to check it */
+  MPI_Barrier(MPI_COMM_WORLD);
+  unlink(dest);
+
+  return errors;
+}
+
+int main(int argc, char* argv[])
+{
+  MPI_Init(&argc, &argv);
+
+  int rank, ranks;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+
+  spawn_net_endpoint* ep = spawn_net_open(SPAWN_NET_TYPE_TCP);
+  const char* ep_name = spawn_net_name(ep);
+
+  /* gather endpoint names from all tasks */
+  char name[256];
+  strncpy(name, ep_name, sizeof(name));
+  name[sizeof(name) - 1] = '\0';
+  char* names = (char*) malloc(sizeof(name) * ranks);
+  MPI_Allgather(name, sizeof(name), MPI_CHAR, names, sizeof(name), MPI_CHAR, MPI_COMM_WORLD);
+
+  /* create group from left and right neighbors */
+  const char* left  = (rank > 0)         ? names + (rank - 1) * sizeof(name) : NULL;
+  const char* right = (rank < ranks - 1) ? names + (rank + 1) * sizeof(name) : NULL;
+  lwgrp* group = lwgrp_create(ranks, rank, ep_name, left, right, ep);
+
+  /* name files after pid of rank 0, so runs don't collide */
+  int id = (int) getpid();
+  MPI_Bcast(&id, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  char src[256], dest[256];
+  snprintf(src,  sizeof(src),  "/tmp/file_test.%d.src",  id);
+  snprintf(dest, sizeof(dest), "/tmp/file_test.%d.dest", id);
+
+  int errors = 0;
+
+  /* one copy per host */
+  errors += test_bcast(rank, src, dest, FILE_SIZE, group);
+  errors += test_bcast(rank, src, dest, 0, group);
+
+  /* treat each proc as its own node, so every proc writes a copy
+   * and the file passes down the full tree */
+  char node[64];
+  snprintf(node, sizeof(node), "node.%d", rank);
+  setenv("LWGRP_FILE_NODE", node, 1);
+  snprintf(dest, sizeof(dest), "/tmp/file_test.%d.dest.%d", id, rank);
+  errors += test_bcast(rank, src, dest, FILE_SIZE, group);
+  errors += test_bcast(rank, src, dest, 0, group);
+  unsetenv("LWGRP_FILE_NODE");
+
+  if (rank == 0) {
+    unlink(src);
+  }
+
+  int all_errors;
+  MPI_Allreduce(&errors, &all_errors, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+  if (rank == 0) {
+    if (all_errors == 0) {
+      printf("file test: PASS\n");
+    } else {
+      printf("file test: FAIL with %d errors\n", all_errors);
+    }
+  }
+
+  lwgrp_free(&group);
+  spawn_net_close(&ep);
+  free(names);
+
+  MPI_Finalize();
+
+  return (all_errors == 0) ? 0 : 1;
+}
@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "spawn_internal.h"
+#include "lwgrp.h"
+
+/* runs each rank as a thread, optionally pass number of threads */
+
+static int ranks;
+static char** names;
+static pthread_barrier_t names_ready;
+
+static void* run(void* arg)
+{
+  int rank = (int) (intptr_t) arg;
+  int errors = 0;
+
+  spawn_net_endpoint* ep = spawn_net_open(SPAWN_NET_TYPE_INPROC);
+  names[rank] = (char*) spawn_net_name(ep);
+  pthread_barrier_wait(&names_ready);
+
+  const char* left  = (rank > 0)         ? names[rank - 1] : NULL;
+  const char* right = (rank < ranks - 1) ? names[rank + 1] : NULL;
+  lwgrp* group = lwgrp_create(ranks, rank, names[rank], left, right, ep);
+
+  lwgrp_barrier(group);
+
+  uint64_t sum = (uint64_t) rank;
+  lwgrp_allreduce_uint64_sum(&sum, 1, group);
+  if (sum != (uint64_t) ranks * (ranks - 1) / 2) {
+    errors++;
+  }
+
+  /* large enough to be handed off rather than copied through ring */
+  size_t size = 1024 * 1024 + 3;
+  char* buf = (char*) malloc(size);
+  size_t i;
+  for (i = 0; i < size; i++) {
+    buf[i] = (rank == 0) ? (char) (i * 7) : 0;
+  }
+  lwgrp_bcast(buf, size, 0, group);
+  for (i = 0; i < size; i++) {
+    if (buf[i] != (char) (i * 7)) {
+      errors++;
+      break;
+    }
+  }
+  free(buf);
+
+  /* every rank writes a full chunk of the exchange engine to its
+   * partner before reading, which must not wait on the reader */
+  size = 16 * 1024;
+  char* send = (char*) malloc(size * ranks);
+  char* recv = (char*) malloc(size * ranks);
+  for (i = 0; i < size * ranks; i++) {
+    send[i] = (char) (rank * 31 + i);
+  }
+  lwgrp_allgather(send, recv, size, group);
+  int r;
+  for (r = 0; r < ranks; r++) {
+    for (i = 0; i < size; i++) {
+      if (recv[r * size + i] != (char) (r * 31 + i)) {
+        errors++;
+        break;
+      }
+    }
+  }
+
+  /* block r from rank s holds s * 31 + r * size + i */
+  lwgrp_alltoall(send, recv, size, group);
+  for (r = 0; r < ranks; r++) {
+    for (i = 0; i < size; i++) {
+      if (recv[r * size + i] != (char) (r * 31 + rank * size + i)) {
+        errors++;
+        break;
+      }
+    }
+  }
+  free(recv);
+  free(send);
+
+  lwgrp_free(&group);
+  spawn_net_close(&ep);
+
+  return (void*) (intptr_t) errors;
+}
+
+int main(int argc, char* argv[])
+{
+  ranks = (argc > 1) ? atoi(argv[1]) : 8;
+
+  names = (char**) malloc(ranks * sizeof(char*));
+  pthread_barrier_init(&names_ready, NULL, (unsigned) ranks);
+
+  pthread_t* threads = (pthread_t*) malloc(ranks * sizeof(pthread_t));
+  int i;
+  for (i = 0; i < ranks; i++) {
+    pthread_create(&threads[i], NULL, run, (void*) (intptr_t) i);
+  }
+
+  int errors = 0;
+  for (i = 0; i < ranks; i++) {
+    void* rc;
+    pthread_join(threads[i], &rc);
+    errors += (int) (intptr_t) rc;
+  }
+
+  pthread_barrier_destroy(&names_ready);
+  free(threads);
+  free(names);
+
+  printf("inproc test: %s\n", (errors == 0) ? "PASS" : "FAIL");
+
+  return errors;
+}
@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mpi.h"
+
+#include "spawn_internal.h"
+#include "lwgrp.h"
+
+/* size of large values, far more than the transports buffer */
+#define KVS_BIG (16 * 1024 * 1024)
+
+/* fill in value for key number i put by rank in epoch */
+static void fill(char* buf, size_t len, int epoch, int rank, int i)
+{
+  size_t j;
+  for (j = 0; j < len; j++) {
+    buf[j] = (char) ('a' + (epoch * 7 + rank * 3 + i + j) % 26);
+  }
+  buf[len] = '\0';
+}
+
+/* each rank puts count values of len bytes, fences, then gets every
+ * value from every rank, returns number of errors */
+static int epoch(int e, int rank, int ranks, int count, size_t len, lwgrp_kvs* kvs)
+{
+  int errors = 0;
+
+  char key[64];
+  char* val = (char*) malloc(len + 1);
+
+  int i;
+  for (i = 0; i < count; i++) {
+    snprintf(key, sizeof(key), "key.%d.%d.%d", e, rank, i);
+    fill(val, len, e, rank, i);
+    lwgrp_kvs_put(kvs, key, val);
+  }
+
+  lwgrp_kvs_fence(kvs);
+
+  /* start with our right neighbor, so procs fetch from each other */
+  int r;
+  for (r = 1; r <= ranks; r++) {
+    int src = (rank + r) % ranks;
+    for (i = 0; i < count; i++) {
+      snprintf(key, sizeof(key), "key.%d.%d.%d", e, src, i);
+      fill(val, len, e, src, i);
+
+      /* line procs up so that their gets overlap */
+      MPI_Barrier(MPI_COMM_WORLD);
+      const char* got = lwgrp_kvs_get(kvs, key);
+      if (got == NULL || strcmp(got, val) != 0) {
+        printf("%d: wrong value for %s\n", rank, key);
+        errors++;
+      }
+    }
+  }
+
+  /* missing keys return NULL */
+  snprintf(key, sizeof(key), "missing.%d", rank);
+  if (lwgrp_kvs_get(kvs, key) != NULL) {
+    errors++;
+  }
+
+  free(val);
+  return errors;
+}
+
+int main(int argc, char* argv[])
+{
+  MPI_Init(&argc, &argv);
+
+  int rank, ranks;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+
+  spawn_net_endpoint* ep = spawn_net_open(SPAWN_NET_TYPE_TCP);
+  const char* ep_name = spawn_net_name(ep);
+
+  /* gather endpoint names from all tasks */
+  char name[256];
+  strncpy(name, ep_name, sizeof(name));
+  name[sizeof(name) - 1] = '\0';
+  char* names = (char*) malloc(sizeof(name) * ranks);
+  MPI_Allgather(name, sizeof(name), MPI_CHAR, names, sizeof(name), MPI_CHAR, MPI_COMM_WORLD);
+
+  /* create group from left and right neighbors */
+  const char* left  = (rank > 0)         ? names + (rank - 1) * sizeof(name) : NULL;
+  const char* right = (rank < ranks - 1) ? names + (rank + 1) * sizeof(name) : NULL;
+  lwgrp* group = lwgrp_create(ranks, rank, ep_name, left, right, ep);
+
+  int errors = 0;
+
+  lwgrp_kvs* kvs = lwgrp_kvs_create(group);
+
+  /* many small values, then large values whose replies cross
+   * each other on the service channels */
+  errors += epoch(0, rank, ranks, 20, 16, kvs);
+  errors += epoch(1, rank, ranks, 4, KVS_BIG, kvs);
+
+  lwgrp_kvs_free(&kvs);
+
+  int all_errors;
+  MPI_Allreduce(&errors, &all_errors, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+  if (rank == 0) {
+    if (all_errors == 0) {
+      printf("kvs test: PASS\n");
+    } else {
+      printf("kvs test: FAIL with %d errors\n", all_errors);
+    }
+  }
+
+  lwgrp_free(&group);
+  spawn_net_close(&ep);
+  free(names);
+
+  MPI_Finalize();
+
+  return (all_errors == 0) ? 0 : 1;
+}
@@ -0,0 +1,274 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <pthread.h>
+
+#include "mpi.h"
+
+#include "spawn_internal.h"
+#include "lwgrp.h"
+
+/* number of values in large reductions, far more than the
+ * transports buffer between two procs */
+#define NB_COUNT (1024 * 1024)
+
+/* checks a sum and max over NB_COUNT values with both started before
+ * either is waited on, returns number of errors */
+static int test_allreduce(int rank, int ranks, const lwgrp* group)
+{
+  int errors = 0;
+
+  uint64_t* sum = (uint64_t*) malloc(NB_COUNT * sizeof(uint64_t));
+  uint64_t* max = (uint64_t*) malloc(NB_COUNT * sizeof(uint64_t));
+  uint64_t i;
+  for (i = 0; i < NB_COUNT; i++) {
+    sum[i] = (uint64_t) rank + i;
+    max[i] = (uint64_t) (rank + i) % ranks;
+  }
+
+  lwgrp_request* sum_req;
+  lwgrp_request* max_req;
+  lwgrp_iallreduce_uint64_sum(sum, NB_COUNT, group, &sum_req);
+  lwgrp_iallreduce_uint64_max(max, NB_COUNT, group, &max_req);
+  lwgrp_wait(&max_req);
+  lwgrp_wait(&sum_req);
+
+  uint64_t base = (uint64_t) ranks * (ranks - 1) / 2;
+  for (i = 0; i < NB_COUNT; i++) {
+    if (sum[i] != base + i * ranks || max[i] != (uint64_t) ranks - 1) {
+      printf("%d: allreduce mismatch at %llu\n", rank, (unsigned long long) i);
+      errors++;
+      break;
+    }
+  }
+
+  free(max);
+  free(sum);
+  return errors;
+}
+
+/* checks a large prefix sum driven by lwgrp_test, returns number of errors */
+static int test_scan(int rank, int ranks, const lwgrp* group)
+{
+  int errors = 0;
+
+  uint64_t* buf = (uint64_t*) malloc(NB_COUNT * sizeof(uint64_t));
+  uint64_t i;
+  for (i = 0; i < NB_COUNT; i++) {
+    buf[i] = i + 1;
+  }
+
+  lwgrp_request* req;
+  lwgrp_iscan_uint64_sum(buf, NB_COUNT, group, &req);
+  int flag = 0;
+  while (! flag) {
+    lwgrp_test(&req, &flag);
+  }
+
+  for (i = 0; i < NB_COUNT; i++) {
+    if (buf[i] != (i + 1) * (rank + 1)) {
+      printf("%d: scan mismatch at %llu\n", rank, (unsigned long long) i);
+      errors++;
+      break;
+    }
+  }
+
+  free(buf);
+  return errors;
+}
+
+/* checks persistent sum and scan requests over NB_COUNT values
+ * started several times, returns number of errors */
+static int test_persistent(int rank, int ranks, const lwgrp* group)
+{
+  int errors = 0;
+
+  uint64_t* sum  = (uint64_t*) malloc(NB_COUNT * sizeof(uint64_t));
+  uint64_t* scan = (uint64_t*) malloc(NB_COUNT * sizeof(uint64_t));
+
+  lwgrp_request* sum_req;
+  lwgrp_request* scan_req;
+  lwgrp_request* barrier_req;
+  lwgrp_allreduce_uint64_sum_init(sum, NB_COUNT, group, &sum_req);
+  lwgrp_scan_uint64_sum_init(scan, NB_COUNT, group, &scan_req);
+  lwgrp_barrier_init(group, &barrier_req);
+
+  uint64_t iter;
+  for (iter = 0; iter < 3; iter++) {
+    uint64_t i;
+    for (i = 0; i < NB_COUNT; i++) {
+      sum[i]  = (uint64_t) rank + i + iter;
+      scan[i] = iter + 1;
+    }
+
+    lwgrp_start(sum_req);
+    lwgrp_start(scan_req);
+    lwgrp_start(barrier_req);
+    lwgrp_wait(&sum_req);
+    lwgrp_wait(&scan_req);
+    lwgrp_wait(&barrier_req);
+
+    uint64_t base = (uint64_t) ranks * (ranks - 1) / 2;
+    for (i = 0; i < NB_COUNT; i++) {
+      if (sum[i] != base + (i + iter) * ranks ||
+          scan[i] != (iter + 1) * (rank + 1))
+      {
+        printf("%d: persistent mismatch at %llu in iteration %llu\n",
+          rank, (unsigned long long) i, (unsigned long long) iter
+        );
+        errors++;
+        break;
+      }
+    }
+  }
+
+  lwgrp_request_free(&barrier_req);
+  lwgrp_request_free(&scan_req);
+  lwgrp_request_free(&sum_req);
+
+  free(scan);
+  free(sum);
+  return errors;
+}
+
+/* checks an allgather of maps with large values and a barrier,
+ * returns number of errors */
+static int test_allgather(int rank, int ranks, const lwgrp* group)
+{
+  int errors = 0;
+
+  size_t len = 64 * 1024;
+  char* value = (char*) malloc(len + 1);
+  memset(value, 'a' + rank % 26, len);
+  value[len] = '\0';
+
+  strmap* map = strmap_new();
+  strmap_setf(map, "%d", rank);
+  strmap_set(map, value, value);
+
+  lwgrp_request* req;
+  lwgrp_iallgather_strmap(map, group, &req);
+  lwgrp_wait(&req);
+
+  int i;
+  for (i = 0; i < ranks; i++) {
+    memset(value, 'a' + i % 26, len);
+    const char* got = strmap_get(map, value);
+    if (got == NULL || strcmp(got, value) != 0) {
+      printf("%d: allgather missing value from %d\n", rank, i);
+      errors++;
+    }
+  }
+
+  lwgrp_ibarrier(group, &req);
+  lwgrp_wait(&req);
+
+  strmap_delete(&map);
+  free(value);
+  return errors;
+}
+
+/* returns number of threads in this process */
+static int count_threads(void)
+{
+  int count = 0;
+  DIR* dir = opendir("/proc/self/task");
+  if (dir == NULL) {
+    return 0;
+  }
+  struct dirent* entry;
+  while ((entry = readdir(dir)) != NULL) {
+    if (entry->d_name[0] != '.') {
+      count++;
+    }
+  }
+  closedir(dir);
+  return count;
+}
+
+static void* start_progress(void* arg)
+{
+  (void) arg;
+  lwgrp_progress_start();
+  return NULL;
+}
+
+/* starts the progress thread from several threads at once,
+ * returns number of errors */
+static int test_progress_start(int rank)
+{
+  int before = count_threads();
+
+  pthread_t threads[4];
+  int i;
+  for (i = 0; i < 4; i++) {
+    pthread_create(&threads[i], NULL, start_progress, NULL);
+  }
+  for (i = 0; i < 4; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  int errors = 0;
+  int after = count_threads();
+  if (after != before + 1) {
+    printf("%d: expected one progress thread, found %d\n", rank, after - before);
+    errors++;
+  }
+  return errors;
+}
+
+int main(int argc, char* argv[])
+{
+  MPI_Init(&argc, &argv);
+
+  int rank, ranks;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+
+  spawn_net_endpoint* ep = spawn_net_open(SPAWN_NET_TYPE_TCP);
+  const char* ep_name = spawn_net_name(ep);
+
+  /* gather endpoint names from all tasks */
+  char name[256];
+  strncpy(name, ep_name, sizeof(name));
+  name[sizeof(name) - 1] = '\0';
+  char* names = (char*) malloc(sizeof(name) * ranks);
+  MPI_Allgather(name, sizeof(name), MPI_CHAR, names, sizeof(name), MPI_CHAR, MPI_COMM_WORLD);
+
+  /* create group from left and right neighbors */
+  const char* left  = (rank > 0)         ? names + (rank - 1) * sizeof(name) : NULL;
+  const char* right = (rank < ranks - 1) ? names + (rank + 1) * sizeof(name) : NULL;
+  lwgrp* group = lwgrp_create(ranks, rank, ep_name, left, right, ep);
+
+  int errors = 0;
+
+  errors += test_allreduce(rank, ranks, group);
+  errors += test_scan(rank, ranks, group);
+  errors += test_allgather(rank, ranks, group);
+  errors += test_persistent(rank, ranks, group);
+
+  /* run again with the progress thread driving requests */
+  errors += test_progress_start(rank);
+  errors += test_allreduce(rank, ranks, group);
+  errors += test_persistent(rank, ranks, group);
+  lwgrp_progress_stop();
+
+  int all_errors;
+  MPI_Allreduce(&errors, &all_errors, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+  if (rank == 0) {
+    if (all_errors == 0) {
+      printf("nb test: PASS\n");
+    } else {
+      printf("nb test: FAIL with %d errors\n", all_errors);
+    }
+  }
+
+  lwgrp_free(&group);
+  spawn_net_close(&ep);
+  free(names);
+
+  MPI_Finalize();
+
+  return (all_errors == 0) ? 0 : 1;
+}
@@ -0,0 +1,238 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "mpi.h"
+
+#include "spawn_internal.h"
+#include "lwgrp.h"
+#include "spawn_pmi2.h"
+
+/* number of children each task launches */
+#define CHILDREN (3)
+
+/* write PMI2 command with its length field and read the response */
+static void command(int fd, const char* cmd, char* resp, size_t resp_size)
+{
+  char buf[1024];
+  size_t len = strlen(cmd);
+  snprintf(buf, sizeof(buf), "%-6d%s", (int) len, cmd);
+  write(fd, buf, 6 + len);
+
+  char len_str[7];
+  read(fd, len_str, 6);
+  len_str[6] = '\0';
+  len = (size_t) atoi(len_str);
+  size_t got = 0;
+  while (got < len) {
+    ssize_t n = read(fd, resp + got, len - got);
+    if (n <= 0) {
+      break;
+    }
+    got += (size_t) n;
+  }
+  resp[got] = '\0';
+}
+
+/* reads the one line response to init */
+static void init(int fd)
+{
+  const char* init = "cmd=init pmi_version=2 pmi_subversion=0\n";
+  write(fd, init, strlen(init));
+  char c = '\0';
+  while (c != '\n') {
+    read(fd, &c, 1);
+  }
+}
+
+/* minimal PMI2 client as an MPI library would run it,
+ * returns number of errors */
+static int child(void)
+{
+  int errors = 0;
+  int fd    = atoi(getenv("PMI_FD"));
+  int rank  = atoi(getenv("PMI_RANK"));
+  int ranks = atoi(getenv("PMI_SIZE"));
+
+  char resp[1024];
+  init(fd);
+
+  char cmd[256];
+  snprintf(cmd, sizeof(cmd), "cmd=fullinit;pmirank=%d;", rank);
+  command(fd, cmd, resp, sizeof(resp));
+  char expect[256];
+  snprintf(expect, sizeof(expect), "rank=%d;size=%d;", rank, ranks);
+  if (strstr(resp, expect) == NULL) {
+    errors++;
+  }
+
+  /* values with semicolons must survive escaping */
+  snprintf(cmd, sizeof(cmd), "cmd=kvs-put;key=rank%d;value=val;;%d;", rank, rank);
+  command(fd, cmd, resp, sizeof(resp));
+  command(fd, "cmd=kvs-fence;", resp, sizeof(resp));
+  if (strstr(resp, "cmd=kvs-fence-response;rc=0;") == NULL) {
+    errors++;
+  }
+
+  int i;
+  for (i = 0; i < ranks; i++) {
+    snprintf(cmd, sizeof(cmd), "cmd=kvs-get;jobid=test;srcid=-1;key=rank%d;", i);
+    command(fd, cmd, resp, sizeof(resp));
+    snprintf(expect, sizeof(expect), "found=TRUE;value=val;;%d;", i);
+    if (strstr(resp, expect) == NULL) {
+      errors++;
+    }
+  }
+
+  command(fd, "cmd=kvs-get;jobid=test;srcid=-1;key=missing;", resp, sizeof(resp));
+  if (strstr(resp, "found=FALSE;") == NULL) {
+    errors++;
+  }
+
+  /* last local child sets a node attribute the others wait on */
+  if (rank % CHILDREN == CHILDREN - 1) {
+    command(fd, "cmd=info-putnodeattr;key=shm;value=seg;", resp, sizeof(resp));
+  }
+  command(fd, "cmd=info-getnodeattr;key=shm;wait=TRUE;thrid=7;", resp, sizeof(resp));
+  if (strstr(resp, "value=seg;") == NULL || strstr(resp, "thrid=7;") == NULL) {
+    errors++;
+  }
+
+  /* children of the first launcher finalize while the others fence
+   * again, so that launcher must keep joining fences after its
+   * children are done */
+  if (rank >= CHILDREN) {
+    snprintf(cmd, sizeof(cmd), "cmd=kvs-put;key=again%d;value=%d;", rank, rank);
+    command(fd, cmd, resp, sizeof(resp));
+    command(fd, "cmd=kvs-fence;", resp, sizeof(resp));
+    for (i = CHILDREN; i < ranks; i++) {
+      snprintf(cmd, sizeof(cmd), "cmd=kvs-get;jobid=test;srcid=-1;key=again%d;", i);
+      command(fd, cmd, resp, sizeof(resp));
+      snprintf(expect, sizeof(expect), "found=TRUE;value=%d;", i);
+      if (strstr(resp, expect) == NULL) {
+        errors++;
+      }
+    }
+  }
+
+  command(fd, "cmd=finalize;", resp, sizeof(resp));
+  close(fd);
+
+  return errors;
+}
+
+/* rank 1 calls abort while the others wait in a fence,
+ * none of them should get past this */
+static void abort_child(void)
+{
+  int fd   = atoi(getenv("PMI_FD"));
+  int rank = atoi(getenv("PMI_RANK"));
+
+  char resp[1024];
+  init(fd);
+
+  char cmd[256];
+  snprintf(cmd, sizeof(cmd), "cmd=fullinit;pmirank=%d;", rank);
+  command(fd, cmd, resp, sizeof(resp));
+
+  if (rank == 1) {
+    const char* abort = "cmd=abort;isworld=TRUE;message=test abort;";
+    snprintf(cmd, sizeof(cmd), "%-6d%s", (int) strlen(abort), abort);
+    write(fd, cmd, strlen(cmd));
+  } else {
+    command(fd, "cmd=kvs-fence;", resp, sizeof(resp));
+  }
+
+  while (1) {
+    pause();
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  MPI_Init(&argc, &argv);
+
+  int rank, ranks;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+
+  spawn_net_endpoint* ep = spawn_net_open(SPAWN_NET_TYPE_TCP);
+  const char* ep_name = spawn_net_name(ep);
+
+  /* gather endpoint names from all tasks */
+  char name[256];
+  strncpy(name, ep_name, sizeof(name));
+  name[sizeof(name) - 1] = '\0';
+  char* names = (char*) malloc(sizeof(name) * ranks);
+  MPI_Allgather(name, sizeof(name), MPI_CHAR, names, sizeof(name), MPI_CHAR, MPI_COMM_WORLD);
+
+  /* create group from left and right neighbors */
+  const char* left  = (rank > 0)         ? names + (rank - 1) * sizeof(name) : NULL;
+  const char* right = (rank < ranks - 1) ? names + (rank + 1) * sizeof(name) : NULL;
+  lwgrp* group = lwgrp_create(ranks, rank, ep_name, left, right, ep);
+
+  /* each task acts as a launcher for its children */
+  spawn_pmi2* pmi = spawn_pmi2_create(group, CHILDREN, "test");
+  pid_t pids[CHILDREN];
+  int i;
+  for (i = 0; i < CHILDREN; i++) {
+    pids[i] = fork();
+    if (pids[i] == 0) {
+      spawn_pmi2_child(pmi, i);
+      _exit(child());
+    }
+  }
+  int errors = 0;
+  if (spawn_pmi2_serve(pmi) != SPAWN_SUCCESS) {
+    errors++;
+  }
+  spawn_pmi2_free(&pmi);
+
+  for (i = 0; i < CHILDREN; i++) {
+    int status;
+    waitpid(pids[i], &status, 0);
+    if (! WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      errors++;
+    }
+  }
+
+  /* an abort from one child must kill the children of every launcher */
+  pmi = spawn_pmi2_create(group, CHILDREN, "test");
+  for (i = 0; i < CHILDREN; i++) {
+    pids[i] = fork();
+    if (pids[i] == 0) {
+      spawn_pmi2_child(pmi, i);
+      abort_child();
+    }
+  }
+  if (spawn_pmi2_serve(pmi) != SPAWN_FAILURE) {
+    errors++;
+  }
+  spawn_pmi2_free(&pmi);
+
+  for (i = 0; i < CHILDREN; i++) {
+    int status;
+    waitpid(pids[i], &status, 0);
+    if (! WIFSIGNALED(status) || WTERMSIG(status) != SIGKILL) {
+      errors++;
+    }
+  }
+
+  int all_errors;
+  MPI_Allreduce(&errors, &all_errors, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+  if (rank == 0) {
+    printf("pmi2 test: %s\n", (all_errors == 0) ? "PASS" : "FAIL");
+  }
+
+  lwgrp_free(&group);
+  free(names);
+  spawn_net_close(&ep);
+
+  MPI_Finalize();
+
+  return 0;
+}
@@ -0,0 +1,218 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mpi.h"
+
+#include "spawn_internal.h"
+#include "lwgrp.h"
+
+/* fill in value for byte i of message number msg from src to dst */
+static char fill(int src, int dst, int msg, uint64_t i)
+{
+  return (char) ((src * 31 + dst * 17 + msg * 7 + i) & 0xFF);
+}
+
+/* each rank sends count messages of size bytes to each of its two
+ * neighbors on a ring and one to itself, returns number of errors */
+static int exchange(int rank, int ranks, uint64_t size, int count, const lwgrp* group)
+{
+  int dsts[3];
+  dsts[0] = (rank + 1) % ranks;
+  dsts[1] = (rank + ranks - 1) % ranks;
+  dsts[2] = rank;
+
+  int64_t sends = 3 * count;
+  int64_t* send_ranks  = (int64_t*)  malloc(sends * sizeof(int64_t));
+  const void** send_bufs = (const void**) malloc(sends * sizeof(void*));
+  uint64_t* send_sizes = (uint64_t*) malloc(sends * sizeof(uint64_t));
+
+  int d, m;
+  uint64_t i;
+  int64_t k = 0;
+  for (d = 0; d < 3; d++) {
+    for (m = 0; m < count; m++) {
+      char* buf = (char*) malloc(size + 1);
+      for (i = 0; i < size; i++) {
+        buf[i] = fill(rank, dsts[d], m, i);
+      }
+      send_ranks[k] = dsts[d];
+      send_bufs[k]  = buf;
+      send_sizes[k] = size;
+      k++;
+    }
+  }
+
+  int64_t recv_count;
+  int64_t* recv_ranks;
+  void** recv_bufs;
+  uint64_t* recv_sizes;
+  lwgrp_sparse_exchange(
+    sends, send_ranks, send_bufs, send_sizes,
+    &recv_count, &recv_ranks, &recv_bufs, &recv_sizes, group
+  );
+
+  /* expect messages from each source in the order they were sent */
+  int errors = 0;
+  if (recv_count != sends) {
+    printf("%d: Expected %lld messages, got %lld\n", rank, (long long) sends, (long long) recv_count);
+    errors++;
+  }
+
+  int64_t j;
+  int64_t prev = -1;
+  m = 0;
+  for (j = 0; j < recv_count; j++) {
+    int src = (int) recv_ranks[j];
+    m = (src == prev) ? m + 1 : 0;
+    prev = src;
+    if (recv_sizes[j] != size) {
+      errors++;
+      continue;
+    }
+
+    /* with fewer than three ranks, a source sends us more than one
+     * batch of messages, each numbered from 0 */
+    int msg = m % count;
+    const char* buf = (const char*) recv_bufs[j];
+    for (i = 0; i < size; i++) {
+      if (buf[i] != fill(src, rank, msg, i)) {
+        errors++;
+        break;
+      }
+    }
+    free(recv_bufs[j]);
+  }
+
+  free(recv_sizes);
+  free(recv_bufs);
+  free(recv_ranks);
+  for (k = 0; k < sends; k++) {
+    free((void*) send_bufs[k]);
+  }
+  free(send_sizes);
+  free(send_bufs);
+  free(send_ranks);
+
+  return errors;
+}
+
+/* rank 0 sends one message to a rank outside the group along with
+ * one to its right neighbor, expects the exchange to fail on rank 0
+ * and succeed elsewhere with the valid message still delivered,
+ * returns number of errors */
+static int bad_destination(int rank, int ranks, const lwgrp* group)
+{
+  int64_t send_ranks[2];
+  const void* send_bufs[2];
+  uint64_t send_sizes[2];
+  char buf[1] = { 'x' };
+
+  int64_t sends = 0;
+  if (rank == 0) {
+    send_ranks[0] = ranks;
+    send_ranks[1] = 1 % ranks;
+    send_bufs[0]  = buf;
+    send_bufs[1]  = buf;
+    send_sizes[0] = sizeof(buf);
+    send_sizes[1] = sizeof(buf);
+    sends = 2;
+  }
+
+  int64_t recv_count;
+  int64_t* recv_ranks;
+  void** recv_bufs;
+  uint64_t* recv_sizes;
+  int rc = lwgrp_sparse_exchange(
+    sends, send_ranks, send_bufs, send_sizes,
+    &recv_count, &recv_ranks, &recv_bufs, &recv_sizes, group
+  );
+
+  int errors = 0;
+  int expect = (rank == 0) ? LWGRP_FAILURE : LWGRP_SUCCESS;
+  if (rc != expect) {
+    printf("%d: Expected rc %d, got %d\n", rank, expect, rc);
+    errors++;
+  }
+
+  int64_t expect_count = (rank == 1 % ranks) ? 1 : 0;
+  if (recv_count != expect_count) {
+    printf("%d: Expected %lld messages, got %lld\n", rank, (long long) expect_count, (long long) recv_count);
+    errors++;
+  }
+
+  int64_t j;
+  for (j = 0; j < recv_count; j++) {
+    if (recv_ranks[j] != 0 || recv_sizes[j] != sizeof(buf) ||
+        ((char*) recv_bufs[j])[0] != 'x')
+    {
+      errors++;
+    }
+    free(recv_bufs[j]);
+  }
+  free(recv_sizes);
+  free(recv_bufs);
+  free(recv_ranks);
+
+  return errors;
+}
+
+int main(int argc, char* argv[])
+{
+  MPI_Init(&argc, &argv);
+
+  int rank, ranks;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+
+  spawn_net_endpoint* ep = spawn_net_open(SPAWN_NET_TYPE_TCP);
+  const char* ep_name = spawn_net_name(ep);
+
+  /* gather endpoint names from all tasks */
+  char name[256];
+  strncpy(name, ep_name, sizeof(name));
+  name[sizeof(name) - 1] = '\0';
+  char* names = (char*) malloc(sizeof(name) * ranks);
+  MPI_Allgather(name, sizeof(name), MPI_CHAR, names, sizeof(name), MPI_CHAR, MPI_COMM_WORLD);
+
+  /* create group from left and right neighbors */
+  const char* left  = (rank > 0)         ? names + (rank - 1) * sizeof(name) : NULL;
+  const char* right = (rank < ranks - 1) ? names + (rank + 1) * sizeof(name) : NULL;
+  lwgrp* group = lwgrp_create(ranks, rank, ep_name, left, right, ep);
+
+  int errors = 0;
+
+  /* many small messages, empty messages, and payloads far larger
+   * than the transport buffers flowing both ways at once */
+  errors += exchange(rank, ranks, 100, 50, group);
+  errors += exchange(rank, ranks, 0, 3, group);
+  errors += exchange(rank, ranks, 8 * 1024 * 1024, 1, group);
+
+  /* an invalid destination fails on the sender only */
+  errors += bad_destination(rank, ranks, group);
+
+  /* run a collective to check that nothing was left on the channels */
+  uint64_t sum = (uint64_t) rank;
+  lwgrp_allreduce_uint64_sum(&sum, 1, group);
+  if (sum != (uint64_t) ranks * (ranks - 1) / 2) {
+    errors++;
+  }
+
+  int all_errors;
+  MPI_Allreduce(&errors, &all_errors, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+  if (rank == 0) {
+    if (all_errors == 0) {
+      printf("sparse test: PASS\n");
+    } else {
+      printf("sparse test: FAIL with %d errors\n", all_errors);
+    }
+  }
+
+  lwgrp_free(&group);
+  spawn_net_close(&ep);
+  free(names);
+
+  MPI_Finalize();
+
+  return (all_errors == 0) ? 0 : 1;
+}
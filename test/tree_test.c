@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <libgen.h>
+
+#include "spawn_internal.h"
+#include "spawn_tree.h"
+
+/* returns number of open file descriptors */
+static int count_fds(void)
+{
+  int count = 0;
+  DIR* dir = opendir("/proc/self/fd");
+  if (dir == NULL) {
+    return 0;
+  }
+  struct dirent* entry;
+  while ((entry = readdir(dir)) != NULL) {
+    if (entry->d_name[0] != '.') {
+      count++;
+    }
+  }
+  closedir(dir);
+
+  /* don't count the descriptor of the directory itself */
+  return count - 1;
+}
+
+/* launches agents where the agent of fail_rank can't start its
+ * children, or the launcher itself can't if fail_rank is 0,
+ * returns number of errors */
+static int test_failure(int64_t count, int64_t degree, int64_t fail_rank, int fds)
+{
+  /* run agents by a path relative to our directory, which agents
+   * lose when they change to the root directory */
+  char path[1024];
+  ssize_t len = readlink("/proc/self/exe", path, sizeof(path) - 1);
+  if (len < 0) {
+    return 1;
+  }
+  path[len] = '\0';
+  char* exe = SPAWN_STRDUPF("./%s", basename(path));
+  char cwd[1024];
+  if (getcwd(cwd, sizeof(cwd)) == NULL || chdir(dirname(path)) != 0) {
+    spawn_free(&exe);
+    return 1;
+  }
+
+  char* fail_str = SPAWN_STRDUPF("%lld", (long long) fail_rank);
+  setenv("TREE_TEST_FAIL_RANK", fail_str, 1);
+  spawn_free(&fail_str);
+  if (fail_rank == 0) {
+    spawn_free(&exe);
+    exe = SPAWN_STRDUP("/nonexistent/agent");
+  }
+
+  const char* args[2] = {"hello", "a=b c"};
+  strmap* env = strmap_new();
+  strmap_set(env, "TREE_TEST_VAR", "x=1");
+  strmap_setf(env, "TREE_TEST_FDS=%d", fds);
+  spawn_tree* tree = spawn_tree_launch(count, degree, NULL, NULL, exe,
+    2, args, env, SPAWN_NET_TYPE_TCP
+  );
+  strmap_delete(&env);
+
+  /* launch should report the failure rather than hang */
+  int errors = 0;
+  if (tree != NULL) {
+    errors++;
+    spawn_tree_free(&tree);
+  }
+
+  unsetenv("TREE_TEST_FAIL_RANK");
+  if (chdir(cwd) != 0) {
+    errors++;
+  }
+  spawn_free(&exe);
+
+  return errors;
+}
+
+/* run with no arguments to launch agents of this same program
+ * under a tree, optionally followed by the number of agents and
+ * degree of tree */
+int main(int argc, char* argv[])
+{
+  /* count before we open any channels of our own */
+  int fds = count_fds();
+
+  /* an agent chosen to fail moves away from the directory holding
+   * our program, so exec of its children fails */
+  const char* fail_rank = getenv("TREE_TEST_FAIL_RANK");
+  const char* rank_str  = getenv("SPAWN_TREE_RANK");
+  if (fail_rank != NULL && rank_str != NULL && strcmp(fail_rank, rank_str) == 0) {
+    if (chdir("/") != 0) {
+      return 1;
+    }
+  }
+
+  spawn_tree* tree = spawn_tree_join();
+  if (tree != NULL) {
+    /* we are an agent, check what the launcher sent us */
+    int errors = 0;
+    int tree_argc;
+    const char** tree_argv;
+    spawn_tree_args(tree, &tree_argc, &tree_argv);
+    if (tree_argc != 2 ||
+        strcmp(tree_argv[0], "hello") != 0 ||
+        strcmp(tree_argv[1], "a=b c") != 0 ||
+        tree_argv[2] != NULL)
+    {
+      errors++;
+    }
+    const char* value = getenv("TREE_TEST_VAR");
+    if (value == NULL || strcmp(value, "x=1") != 0) {
+      errors++;
+    }
+
+    /* we should inherit no channels from our parent */
+    value = getenv("TREE_TEST_FDS");
+    if (value == NULL || fds > atoi(value)) {
+      errors++;
+    }
+    if (spawn_tree_rank(tree) < 1 || spawn_tree_rank(tree) >= spawn_tree_size(tree)) {
+      errors++;
+    }
+    if (spawn_tree_free(&tree) != SPAWN_SUCCESS) {
+      errors++;
+    }
+    return errors;
+  }
+
+  int64_t count  = (argc > 1) ? atoi(argv[1]) : 20;
+  int64_t degree = (argc > 2) ? atoi(argv[2]) : 3;
+
+  const char* args[2] = {"hello", "a=b c"};
+  strmap* env = strmap_new();
+  strmap_set(env, "TREE_TEST_VAR", "x=1");
+  strmap_setf(env, "TREE_TEST_FDS=%d", fds);
+
+  tree = spawn_tree_launch(count, degree, NULL, NULL, "/proc/self/exe",
+    2, args, env, SPAWN_NET_TYPE_TCP
+  );
+
+  /* every agent reports its endpoint name once ready */
+  int errors = 0;
+  const strmap* names = spawn_tree_names(tree);
+  int64_t i;
+  for (i = 0; i <= count; i++) {
+    if (strmap_getf(names, "%lld", (long long) i) == NULL) {
+      errors++;
+    }
+  }
+
+  /* agents exit with their error count */
+  if (spawn_tree_free(&tree) != SPAWN_SUCCESS) {
+    errors++;
+  }
+  strmap_delete(&env);
+
+  /* exec failures at the launcher and below the first level */
+  errors += test_failure(count, degree, 0, fds);
+  if (1 + degree < count) {
+    errors += test_failure(count, degree, 1, fds);
+  }
+
+  printf("tree test: %s\n", (errors == 0) ? "PASS" : "FAIL");
+
+  return errors;
+}